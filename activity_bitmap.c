@@ -0,0 +1,487 @@
+#include "activity_bitmap.h"
+#include <stdlib.h> // malloc, realloc, free
+#include <string.h> // memset, memcpy
+
+void activityBitmapInit(ActivityBitmap* bitmap, int64_t binUs, uint32_t tubeCount) {
+    memset(bitmap, 0, sizeof(*bitmap));
+    bitmap->binUs = binUs;
+    bitmap->tubeCount = tubeCount > SCAN_MAX_TUBES ? SCAN_MAX_TUBES : tubeCount;
+    bitmap->originIndex = -1;
+    InitializeCriticalSection(&bitmap->mutex);
+    bitmap->started = true;
+}
+
+void activityBitmapFree(ActivityBitmap* bitmap) {
+    uint32_t i;
+
+    if (!bitmap->started) {
+        return;
+    }
+    for (i = 0; i < bitmap->chunkCount; i++) {
+        free(bitmap->chunks[i].containers);
+    }
+    free(bitmap->chunks);
+    DeleteCriticalSection(&bitmap->mutex);
+    memset(bitmap, 0, sizeof(*bitmap));
+}
+
+// Bits set in words from bit lo to bit hi - 1
+static uint32_t countWords(const uint64_t words[], uint32_t lo, uint32_t hi) {
+    uint32_t total = 0;
+    uint32_t w;
+
+    for (w = lo / 64; w * 64 < hi; w++) {
+        uint64_t bits = words[w];
+
+        if (w == lo / 64) {
+            bits &= ~0ull << (lo % 64);
+        }
+        if (hi < w * 64 + 64) {
+            bits &= ~(~0ull << (hi - w * 64));
+        }
+        total += (uint32_t)__builtin_popcountll(bits);
+    }
+    return total;
+}
+
+// First bit at or after pos and below hi that equals value, hi if none
+static uint32_t findBit(const uint64_t words[], uint32_t pos, uint32_t hi, bool value) {
+    while (pos < hi) {
+        uint64_t bits = (value ? words[pos / 64] : ~words[pos / 64]) >> (pos % 64);
+
+        if (bits != 0) {
+            pos += (uint32_t)__builtin_ctzll(bits);
+            return pos < hi ? pos : hi;
+        }
+        pos = (pos / 64 + 1) * 64;
+    }
+    return hi;
+}
+
+// Last clear bit below hi; there must be one at lo or above
+static uint32_t lastClearBit(const uint64_t words[], uint32_t hi) {
+    uint32_t pos = hi;
+
+    for (;;) {
+        uint32_t w = (pos - 1) / 64;
+        uint64_t bits = ~words[w] & (~0ull >> (63 - (pos - 1) % 64));
+
+        if (bits != 0) {
+            return w * 64 + 63 - (uint32_t)__builtin_clzll(bits);
+        }
+        pos = w * 64;
+    }
+}
+
+// Sets bits first ... last
+static void setBits(uint64_t words[], uint32_t first, uint32_t last) {
+    uint32_t w;
+
+    for (w = first / 64; w <= last / 64; w++) {
+        uint64_t bits = ~0ull;
+
+        if (w == first / 64) {
+            bits &= ~0ull << (first % 64);
+        }
+        if (w == last / 64) {
+            bits &= ~0ull >> (63 - last % 64);
+        }
+        words[w] |= bits;
+    }
+}
+
+// First of the count sorted offsets that is not below value
+static uint32_t lowerBound(const uint16_t offsets[], uint32_t count, uint32_t value) {
+    uint32_t low = 0, high = count;
+
+    while (low < high) {
+        uint32_t middle = (low + high) / 2;
+
+        if (offsets[middle] < value) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+// Stores the open chunk as the next sealed one, each tube in its smallest container; caller holds mutex
+static int sealChunk(ActivityBitmap* bitmap) {
+    ActivityContainer containers[SCAN_MAX_TUBES];
+    size_t headerBytes = (sizeof(ActivityContainer) * bitmap->tubeCount + 7) & ~(size_t)7;
+    uint32_t units = 0;
+    uint32_t tube, w;
+    ActivityChunk chunk;
+    uint16_t* data;
+    int pass;
+
+    if (bitmap->chunkCount == bitmap->chunkSlots) {
+        uint32_t slots = bitmap->chunkSlots ? bitmap->chunkSlots * 2 : 64;
+        ActivityChunk* grown = realloc(bitmap->chunks, slots * sizeof(ActivityChunk));
+
+        if (grown == NULL) {
+            return -1;
+        }
+        bitmap->chunks = grown;
+        bitmap->chunkSlots = slots;
+    }
+
+    for (tube = 0; tube < bitmap->tubeCount; tube++) {
+        const uint64_t* words = bitmap->open[tube];
+        ActivityContainer* container = &containers[tube];
+        uint32_t active = 0, runs = 0;
+        uint64_t carry = 0;
+
+        for (w = 0; w < ACTIVITY_CHUNK_WORDS; w++) {
+            active += (uint32_t)__builtin_popcountll(words[w]);
+            runs += (uint32_t)__builtin_popcountll(words[w] & ~(words[w] << 1 | carry)); // First bins of runs
+            carry = words[w] >> 63;
+        }
+        memset(container, 0, sizeof(*container));
+        container->active = (uint16_t)active;
+        if (active <= 2 * runs && active < ACTIVITY_CHUNK_WORDS * 4) {
+            container->kind = ACTIVITY_ARRAY;
+            container->count = (uint16_t)active;
+        } else if (2 * runs < ACTIVITY_CHUNK_WORDS * 4) {
+            container->kind = ACTIVITY_RUNS;
+            container->count = (uint16_t)runs;
+        } else {
+            container->kind = ACTIVITY_BITMAP;
+        }
+    }
+    for (pass = 0; pass < 2; pass++) {
+        for (tube = 0; tube < bitmap->tubeCount; tube++) {
+            ActivityContainer* container = &containers[tube];
+
+            if ((container->kind == ACTIVITY_BITMAP) == (pass == 0)) {
+                container->data = units;
+                units += container->kind == ACTIVITY_BITMAP ? ACTIVITY_CHUNK_WORDS * 4 :
+                         container->kind == ACTIVITY_RUNS ? 2u * container->count : container->count;
+            }
+        }
+    }
+
+    chunk.containers = malloc(headerBytes + units * sizeof(uint16_t));
+    if (chunk.containers == NULL) {
+        return -1;
+    }
+    memcpy(chunk.containers, containers, sizeof(ActivityContainer) * bitmap->tubeCount);
+    data = (uint16_t*)((uint8_t*)chunk.containers + headerBytes);
+    chunk.data = data;
+    for (tube = 0; tube < bitmap->tubeCount; tube++) {
+        const uint64_t* words = bitmap->open[tube];
+        const ActivityContainer* container = &containers[tube];
+        uint16_t* entries = data + container->data;
+        uint32_t pos = 0, first;
+
+        if (container->kind == ACTIVITY_BITMAP) {
+            memcpy(entries, words, ACTIVITY_CHUNK_WORDS * sizeof(uint64_t));
+        } else if (container->kind == ACTIVITY_ARRAY) {
+            while ((first = findBit(words, pos, ACTIVITY_CHUNK_BINS, true)) < ACTIVITY_CHUNK_BINS) {
+                *entries++ = (uint16_t)first;
+                pos = first + 1;
+            }
+        } else {
+            while ((first = findBit(words, pos, ACTIVITY_CHUNK_BINS, true)) < ACTIVITY_CHUNK_BINS) {
+                pos = findBit(words, first, ACTIVITY_CHUNK_BINS, false);
+                *entries++ = (uint16_t)first;
+                *entries++ = (uint16_t)(pos - 1);
+            }
+        }
+        bitmap->kinds[container->kind]++;
+    }
+
+    bitmap->chunks[bitmap->chunkCount++] = chunk;
+    bitmap->bytes += headerBytes + units * sizeof(uint16_t);
+    memset(bitmap->open, 0, sizeof(bitmap->open));
+    return 0;
+}
+
+int activityBitmapAdd(ActivityBitmap* bitmap, int64_t startUs, uint64_t moved) {
+    int64_t index = startUs / bitmap->binUs;
+    uint32_t offset;
+    int result = 0;
+
+    EnterCriticalSection(&bitmap->mutex);
+    if (bitmap->originIndex < 0) {
+        bitmap->originIndex = index - index % ACTIVITY_CHUNK_BINS;
+        bitmap->endIndex = index;
+    }
+    if (index < bitmap->endIndex - 1) {
+        LeaveCriticalSection(&bitmap->mutex);
+        return -1;
+    }
+    while (index >= bitmap->originIndex + (int64_t)(bitmap->chunkCount + 1) * ACTIVITY_CHUNK_BINS) {
+        if (sealChunk(bitmap) != 0) {
+            result = -1;
+            break;
+        }
+    }
+    if (result == 0) {
+        offset = (uint32_t)((index - bitmap->originIndex) % ACTIVITY_CHUNK_BINS);
+        if (bitmap->tubeCount < 64) {
+            moved &= (1ull << bitmap->tubeCount) - 1;
+        }
+        while (moved != 0) {
+            bitmap->open[__builtin_ctzll(moved)][offset / 64] |= 1ull << (offset % 64);
+            moved &= moved - 1;
+        }
+        bitmap->endIndex = index + 1 > bitmap->endIndex ? index + 1 : bitmap->endIndex;
+    }
+    LeaveCriticalSection(&bitmap->mutex);
+    return result;
+}
+
+// Active bins of tube within [lo, hi) of chunk; caller holds mutex
+static uint32_t countBins(const ActivityBitmap* bitmap, uint32_t chunk, uint32_t tube, uint32_t lo, uint32_t hi) {
+    const ActivityContainer* container;
+    const uint16_t* entries;
+    uint32_t total = 0;
+    uint32_t i;
+
+    if (chunk == bitmap->chunkCount) {
+        return countWords(bitmap->open[tube], lo, hi);
+    }
+    container = &bitmap->chunks[chunk].containers[tube];
+    if (lo == 0 && hi == ACTIVITY_CHUNK_BINS) {
+        return container->active;
+    }
+    entries = bitmap->chunks[chunk].data + container->data;
+    if (container->kind == ACTIVITY_BITMAP) {
+        return countWords((const uint64_t*)entries, lo, hi);
+    }
+    if (container->kind == ACTIVITY_ARRAY) {
+        return lowerBound(entries, container->count, hi) - lowerBound(entries, container->count, lo);
+    }
+    for (i = 0; i < container->count; i++) {
+        uint32_t first = entries[2 * i] > lo ? entries[2 * i] : lo;
+        uint32_t last = entries[2 * i + 1] < hi - 1 ? entries[2 * i + 1] : hi - 1;
+
+        total += first <= last ? last - first + 1 : 0;
+    }
+    return total;
+}
+
+// Active bins of tube within [lo, hi) of chunk as a bitmap, the rest clear; caller holds mutex
+static void loadWords(const ActivityBitmap* bitmap, uint32_t chunk, uint32_t tube, uint32_t lo, uint32_t hi,
+                      uint64_t words[]) {
+    const ActivityContainer* container = NULL;
+    const uint16_t* entries = NULL;
+    uint32_t i;
+
+    if (chunk < bitmap->chunkCount) {
+        container = &bitmap->chunks[chunk].containers[tube];
+        entries = bitmap->chunks[chunk].data + container->data;
+    }
+    if (container == NULL) {
+        memcpy(words, bitmap->open[tube], ACTIVITY_CHUNK_WORDS * sizeof(uint64_t));
+    } else if (container->kind == ACTIVITY_BITMAP) {
+        memcpy(words, entries, ACTIVITY_CHUNK_WORDS * sizeof(uint64_t));
+    } else {
+        memset(words, 0, ACTIVITY_CHUNK_WORDS * sizeof(uint64_t));
+        for (i = 0; i < container->count; i++) {
+            if (container->kind == ACTIVITY_ARRAY) {
+                words[entries[i] / 64] |= 1ull << (entries[i] % 64);
+            } else {
+                setBits(words, entries[2 * i], entries[2 * i + 1]);
+            }
+        }
+    }
+    for (i = 0; i < ACTIVITY_CHUNK_WORDS; i++) {
+        uint64_t keep = ~0ull;
+
+        if (i * 64 + 64 <= lo || i * 64 >= hi) {
+            keep = 0;
+        } else {
+            keep &= i * 64 < lo ? ~0ull << (lo % 64) : ~0ull;
+            keep &= hi < i * 64 + 64 ? ~(~0ull << (hi % 64)) : ~0ull;
+        }
+        words[i] &= keep;
+    }
+}
+
+// True if words holds a run of at least n set bits. Each step ANDs the bitmap with
+// itself shifted, doubling the run length every bit stands for, so a run of n costs
+// log2(n) passes over the words whatever the number of runs.
+static bool hasRun(const uint64_t words[], uint32_t n) {
+    uint64_t runs[ACTIVITY_CHUNK_WORDS];
+    uint64_t any = 0;
+    uint32_t have = 1;     // runs has bit i set if bins i ... i + have - 1 are all set
+    uint32_t w;
+
+    memcpy(runs, words, sizeof(runs));
+    while (have < n) {
+        uint32_t step = have * 2 <= n ? have : n - have;
+        uint32_t q = step / 64, r = step % 64;
+
+        any = 0;
+        for (w = 0; w < ACTIVITY_CHUNK_WORDS; w++) {
+            uint64_t shifted = w + q < ACTIVITY_CHUNK_WORDS ? runs[w + q] >> r : 0;
+
+            if (r != 0 && w + q + 1 < ACTIVITY_CHUNK_WORDS) {
+                shifted |= runs[w + q + 1] << (64 - r);
+            }
+            runs[w] &= shifted;
+            any |= runs[w];
+        }
+        if (any == 0) {
+            return false;
+        }
+        have += step;
+    }
+    for (w = 0; w < ACTIVITY_CHUNK_WORDS; w++) {
+        any |= runs[w];
+    }
+    return any != 0;
+}
+
+// Clips the bins starting in [startUs, endUs) to those added, false if none are
+static bool clipRange(const ActivityBitmap* bitmap, int64_t startUs, int64_t endUs, int64_t* first, int64_t* end) {
+    *first = (startUs + bitmap->binUs - 1) / bitmap->binUs;
+    *end = (endUs + bitmap->binUs - 1) / bitmap->binUs;
+    if (bitmap->originIndex < 0) {
+        return false;
+    }
+    *first = *first > bitmap->originIndex ? *first : bitmap->originIndex;
+    *end = *end < bitmap->endIndex ? *end : bitmap->endIndex;
+    return *first < *end;
+}
+
+// The part of chunk holding index, up to end
+static uint32_t chunkPart(const ActivityBitmap* bitmap, int64_t index, int64_t end, uint32_t* lo, uint32_t* hi) {
+    uint32_t chunk = (uint32_t)((index - bitmap->originIndex) / ACTIVITY_CHUNK_BINS);
+    int64_t chunkStart = bitmap->originIndex + (int64_t)chunk * ACTIVITY_CHUNK_BINS;
+
+    *lo = (uint32_t)(index - chunkStart);
+    *hi = end - chunkStart < ACTIVITY_CHUNK_BINS ? (uint32_t)(end - chunkStart) : ACTIVITY_CHUNK_BINS;
+    return chunk;
+}
+
+uint64_t activityBitmapBin(ActivityBitmap* bitmap, int64_t startUs) {
+    int64_t index = startUs / bitmap->binUs;
+    uint64_t moved = 0;
+    uint32_t chunk, lo, hi, tube;
+
+    EnterCriticalSection(&bitmap->mutex);
+    if (bitmap->originIndex >= 0 && index >= bitmap->originIndex && index < bitmap->endIndex) {
+        chunk = chunkPart(bitmap, index, index + 1, &lo, &hi);
+        for (tube = 0; tube < bitmap->tubeCount; tube++) {
+            moved |= (uint64_t)(countBins(bitmap, chunk, tube, lo, hi) != 0) << tube;
+        }
+    }
+    LeaveCriticalSection(&bitmap->mutex);
+    return moved;
+}
+
+uint64_t activityBitmapAny(ActivityBitmap* bitmap, int64_t startUs, int64_t endUs) {
+    int64_t first, end, index;
+    uint64_t any = 0;
+    uint32_t chunk, lo, hi, tube;
+
+    EnterCriticalSection(&bitmap->mutex);
+    if (clipRange(bitmap, startUs, endUs, &first, &end)) {
+        for (tube = 0; tube < bitmap->tubeCount; tube++) {
+            for (index = first; index < end && !(any >> tube & 1); index += hi - lo) {
+                chunk = chunkPart(bitmap, index, end, &lo, &hi);
+                any |= (uint64_t)(countBins(bitmap, chunk, tube, lo, hi) != 0) << tube;
+            }
+        }
+    }
+    LeaveCriticalSection(&bitmap->mutex);
+    return any;
+}
+
+uint64_t activityBitmapAll(ActivityBitmap* bitmap, int64_t startUs, int64_t endUs) {
+    int64_t first, end, index;
+    uint64_t all = 0;
+    uint32_t chunk, lo, hi, tube;
+
+    EnterCriticalSection(&bitmap->mutex);
+    // Bins outside the record have no tube active
+    if (clipRange(bitmap, startUs, endUs, &first, &end) &&
+        first == (startUs + bitmap->binUs - 1) / bitmap->binUs && end == (endUs + bitmap->binUs - 1) / bitmap->binUs) {
+        for (tube = 0; tube < bitmap->tubeCount; tube++) {
+            bool every = true;
+
+            for (index = first; index < end && every; index += hi - lo) {
+                chunk = chunkPart(bitmap, index, end, &lo, &hi);
+                every = countBins(bitmap, chunk, tube, lo, hi) == hi - lo;
+            }
+            all |= (uint64_t)every << tube;
+        }
+    }
+    LeaveCriticalSection(&bitmap->mutex);
+    return all;
+}
+
+uint64_t activityBitmapCount(ActivityBitmap* bitmap, int64_t startUs, int64_t endUs, uint64_t mask,
+                             uint32_t counts[]) {
+    int64_t first, end, index;
+    uint64_t total = 0;
+    uint32_t chunk, lo, hi, tube;
+
+    if (counts != NULL) {
+        memset(counts, 0, SCAN_MAX_TUBES * sizeof(uint32_t));
+    }
+    EnterCriticalSection(&bitmap->mutex);
+    if (clipRange(bitmap, startUs, endUs, &first, &end)) {
+        for (tube = 0; tube < bitmap->tubeCount; tube++) {
+            uint32_t active = 0;
+
+            if (!(mask >> tube & 1)) {
+                continue;
+            }
+            for (index = first; index < end; index += hi - lo) {
+                chunk = chunkPart(bitmap, index, end, &lo, &hi);
+                active += countBins(bitmap, chunk, tube, lo, hi);
+            }
+            if (counts != NULL) {
+                counts[tube] = active;
+            }
+            total += active;
+        }
+    }
+    LeaveCriticalSection(&bitmap->mutex);
+    return total;
+}
+
+uint64_t activityBitmapStreak(ActivityBitmap* bitmap, int64_t startUs, int64_t endUs, uint32_t runBins) {
+    uint64_t words[ACTIVITY_CHUNK_WORDS];
+    int64_t first, end, index;
+    uint64_t found = 0;
+    uint32_t chunk, lo, hi, tube;
+
+    if (runBins <= 1) {
+        return activityBitmapAny(bitmap, startUs, endUs);
+    }
+    EnterCriticalSection(&bitmap->mutex);
+    if (clipRange(bitmap, startUs, endUs, &first, &end)) {
+        for (tube = 0; tube < bitmap->tubeCount; tube++) {
+            uint64_t carry = 0;  // Run reaching the start of the current part
+            bool streak = false;
+
+            // A chunk with no active bin or only active ones is settled by its count alone
+            for (index = first; index < end && !streak; index += hi - lo) {
+                uint32_t active;
+
+                chunk = chunkPart(bitmap, index, end, &lo, &hi);
+                active = countBins(bitmap, chunk, tube, lo, hi);
+                if (active == 0) {
+                    carry = 0;
+                } else if (active == hi - lo) {
+                    carry += active;
+                    streak = carry >= runBins;
+                } else {
+                    loadWords(bitmap, chunk, tube, lo, hi, words);
+                    streak = carry + findBit(words, lo, hi, false) - lo >= runBins ||
+                             (runBins <= hi - lo && hasRun(words, runBins));
+                    carry = hi - 1 - lastClearBit(words, hi);
+                }
+            }
+            found |= (uint64_t)streak << tube;
+        }
+    }
+    LeaveCriticalSection(&bitmap->mutex);
+    return found;
+}
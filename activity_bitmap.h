@@ -0,0 +1,74 @@
+#ifndef ACTIVITY_BITMAP_H
+#define ACTIVITY_BITMAP_H
+
+#include <stdint.h> // Fixed-width integer types
+#include <stdbool.h> // Standard boolean library
+#include <windows.h> // CRITICAL_SECTION
+#include "scan_kernel.h" // SCAN_MAX_TUBES
+
+// Constants
+#define ACTIVITY_CHUNK_BINS 1024     // Bins per chunk, about 17 hours of minutes
+#define ACTIVITY_CHUNK_WORDS (ACTIVITY_CHUNK_BINS / 64)
+#define ACTIVITY_ARRAY 0             // Container kinds: offsets of the active bins,
+#define ACTIVITY_BITMAP 1            // one bit per bin,
+#define ACTIVITY_RUNS 2              // or first and last bin of each run of active bins
+
+// The bins one tube was active in within one chunk, in whichever form is smallest,
+// as in roaring bitmaps: an array of up to 63 bin offsets, a bitmap of
+// ACTIVITY_CHUNK_WORDS words, or runs. A tube with no active bin takes no data at all.
+typedef struct {
+    uint8_t kind;            // ACTIVITY_*
+    uint16_t count;          // Offsets of an array, runs of a run container
+    uint16_t active;         // Active bins, so a whole chunk is counted without reading it
+    uint32_t data;           // Start of its entries in the chunk's data, in uint16 units
+} ActivityContainer;
+
+// One sealed chunk: a container per tube, then their entries, bitmaps first so
+// their words are aligned. One allocation.
+typedef struct {
+    ActivityContainer* containers;
+    const uint16_t* data;
+} ActivityChunk;
+
+// Which tubes of one monitor moved in each bin, from the first bin added on.
+// Chunks are aligned to ACTIVITY_CHUNK_BINS bins from the Unix epoch. The chunk
+// being filled is a bitmap per tube and is sealed once a later bin arrives. A bin
+// without scans has no tube active. Every call takes mutex, so one thread may add
+// bins while others query.
+typedef struct {
+    bool started;            // mutex initialised
+    CRITICAL_SECTION mutex;
+    int64_t binUs;
+    uint32_t tubeCount;
+    int64_t originIndex;     // First bin of chunk 0, -1 before the first bin
+    int64_t endIndex;        // One past the last bin added
+    ActivityChunk* chunks;   // Sealed chunks
+    uint32_t chunkCount;
+    uint32_t chunkSlots;
+    uint64_t bytes;          // Held by sealed chunks
+    uint64_t kinds[3];       // Sealed containers of each kind
+    uint64_t open[SCAN_MAX_TUBES][ACTIVITY_CHUNK_WORDS]; // Chunk chunkCount, being filled
+} ActivityBitmap;
+
+void activityBitmapInit(ActivityBitmap* bitmap, int64_t binUs, uint32_t tubeCount);
+void activityBitmapFree(ActivityBitmap* bitmap);
+
+// Sets the tubes that moved in the bin starting at startUs, bit i is tube i. Bins
+// come in time order; returns -1 for a bin before the last one added or if a chunk
+// cannot be allocated.
+int activityBitmapAdd(ActivityBitmap* bitmap, int64_t startUs, uint64_t moved);
+
+// Queries over the bins starting in [startUs, endUs), results one bit per tube;
+// bins before the first or after the last added have no tube active
+uint64_t activityBitmapBin(ActivityBitmap* bitmap, int64_t startUs);               // Moved in the bin at startUs
+uint64_t activityBitmapAny(ActivityBitmap* bitmap, int64_t startUs, int64_t endUs); // In at least one bin
+uint64_t activityBitmapAll(ActivityBitmap* bitmap, int64_t startUs, int64_t endUs); // In every bin
+
+// Active bins of the tubes in mask, summed; per tube in counts[SCAN_MAX_TUBES] if not NULL
+uint64_t activityBitmapCount(ActivityBitmap* bitmap, int64_t startUs, int64_t endUs, uint64_t mask,
+                             uint32_t counts[]);
+
+// Tubes active in at least runBins consecutive bins
+uint64_t activityBitmapStreak(ActivityBitmap* bitmap, int64_t startUs, int64_t endUs, uint32_t runBins);
+
+#endif
@@ -0,0 +1,819 @@
+#include "archive.h"
+#include <stdlib.h> // malloc, realloc, free
+#include <string.h> // memset, memcpy
+#include <process.h> // _beginthreadex
+#include <io.h> // _chsize_s, _get_osfhandle
+
+// CRC-32 four bits at a time, small enough to need no generated table
+static const uint32_t crcNibble[16] = {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+    0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+};
+
+uint32_t archiveCrc32(uint32_t crc, const void* data, size_t bytes) {
+    const uint8_t* in = data;
+
+    crc = ~crc;
+    while (bytes--) {
+        crc ^= *in++;
+        crc = (crc >> 4) ^ crcNibble[crc & 15];
+        crc = (crc >> 4) ^ crcNibble[crc & 15];
+    }
+    return ~crc;
+}
+
+// CRC a block header must carry for payload and the events after it
+static uint32_t blockCrc(const ArchiveBlockHeader* header, const uint8_t* payload) {
+    ArchiveBlockHeader copy = *header;
+
+    copy.crc = 0;
+    return archiveCrc32(archiveCrc32(0, &copy, sizeof(copy)), payload, (size_t)ARCHIVE_BLOCK_BYTES(header));
+}
+
+// Writes value as LEB128, returns bytes written
+static size_t putVarint(uint8_t* out, uint64_t value) {
+    size_t n = 0;
+    while (value >= 0x80) {
+        out[n++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    out[n++] = (uint8_t)value;
+    return n;
+}
+
+// Reads a LEB128 value, returns bytes consumed or 0 if it runs past end
+static size_t getVarint(const uint8_t* in, const uint8_t* end, uint64_t* value) {
+    uint64_t result = 0;
+    size_t n = 0;
+    int shift = 0;
+    while (in + n < end && shift < 64) {
+        uint8_t byte = in[n++];
+        result |= (uint64_t)(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            *value = result;
+            return n;
+        }
+        shift += 7;
+    }
+    return 0;
+}
+
+static uint64_t zigzag(int64_t value) {
+    return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static int64_t unzigzag(uint64_t value) {
+    return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+// Encodes a full block, returns payload size
+// Times: delta-of-delta, so a steady scan rate costs one byte per scan
+// States: per tube, a run count then (state, run length) pairs
+static size_t encodeBlock(const ArchiveBlockBuffer* block, uint32_t tubeCount, uint8_t* out) {
+    size_t n = 0;
+    int64_t previousDelta = 0;
+    uint32_t tube;
+    int i;
+
+    for (i = 1; i < block->scanCount; i++) {
+        int64_t delta = block->times[i] - block->times[i - 1];
+        n += putVarint(out + n, zigzag(delta - previousDelta));
+        previousDelta = delta;
+    }
+
+    for (tube = 0; tube < tubeCount; tube++) {
+        const uint8_t* column = block->states + tube;
+        uint64_t runCount = 1;
+        uint8_t value = column[0];
+        uint64_t runLength = 1;
+
+        for (i = 1; i < block->scanCount; i++) {
+            if (column[(size_t)i * tubeCount] != column[(size_t)(i - 1) * tubeCount]) {
+                runCount++;
+            }
+        }
+
+        n += putVarint(out + n, runCount);
+
+        for (i = 1; i < block->scanCount; i++) {
+            uint8_t next = column[(size_t)i * tubeCount];
+            if (next == value) {
+                runLength++;
+                continue;
+            }
+            out[n++] = value;
+            n += putVarint(out + n, runLength);
+            value = next;
+            runLength = 1;
+        }
+        out[n++] = value;
+        n += putVarint(out + n, runLength);
+    }
+
+    return n;
+}
+
+// Decodes the time column, returns a pointer to the first tube column or NULL
+static const uint8_t* decodeTimes(const ArchiveBlockHeader* header, const uint8_t* payload, int64_t times[]) {
+    const uint8_t* in = payload;
+    const uint8_t* end = payload + header->payloadBytes;
+    int64_t delta = 0;
+    uint64_t value;
+    uint32_t i;
+    size_t used;
+
+    if (header->codec != ARCHIVE_CODEC_RLE || header->scanCount == 0) {
+        return NULL;
+    }
+
+    times[0] = header->firstTimeUs;
+    for (i = 1; i < header->scanCount; i++) {
+        if ((used = getVarint(in, end, &value)) == 0) return NULL;
+        in += used;
+        delta += unzigzag(value);
+        times[i] = times[i - 1] + delta;
+    }
+
+    return in;
+}
+
+// Decodes (stride != 0) or skips (states == NULL) one tube column, returns the next column or NULL
+static const uint8_t* decodeColumn(const uint8_t* in, const uint8_t* end, uint32_t scanCount,
+                                   uint8_t* states, size_t stride) {
+    uint64_t runCount;
+    uint32_t row = 0;
+    size_t used;
+
+    if ((used = getVarint(in, end, &runCount)) == 0) return NULL;
+    in += used;
+
+    while (runCount--) {
+        uint64_t runLength;
+        uint8_t state;
+
+        if (in >= end) return NULL;
+        state = *in++;
+        if ((used = getVarint(in, end, &runLength)) == 0) return NULL;
+        in += used;
+        if (runLength > scanCount - row) return NULL;
+
+        if (states != NULL) {
+            while (runLength--) {
+                states[(size_t)row++ * stride] = state;
+            }
+        } else {
+            row += (uint32_t)runLength;
+        }
+    }
+
+    return row == scanCount ? in : NULL;
+}
+
+int archiveDecodeBlock(const ArchiveBlockHeader* header, const uint8_t* payload, uint32_t tubeCount,
+                       int64_t times[], uint8_t states[]) {
+    const uint8_t* end = payload + header->payloadBytes;
+    const uint8_t* in = decodeTimes(header, payload, times);
+    uint32_t tube;
+
+    for (tube = 0; tube < tubeCount && in != NULL; tube++) {
+        in = decodeColumn(in, end, header->scanCount, states + tube, tubeCount);
+    }
+
+    return in != NULL ? 0 : -1;
+}
+
+int archiveDecodeTube(const ArchiveBlockHeader* header, const uint8_t* payload, uint32_t tubeCount,
+                      uint32_t tube, int64_t times[], uint8_t states[]) {
+    const uint8_t* end = payload + header->payloadBytes;
+    const uint8_t* in = decodeTimes(header, payload, times);
+    uint32_t skipped;
+
+    if (tube >= tubeCount) {
+        return -1;
+    }
+    for (skipped = 0; skipped < tube && in != NULL; skipped++) {
+        in = decodeColumn(in, end, header->scanCount, NULL, 0);
+    }
+    if (in != NULL) {
+        in = decodeColumn(in, end, header->scanCount, states, 1);
+    }
+
+    return in != NULL ? 0 : -1;
+}
+
+// Counts moves and eating scans per tube for the block index
+static void summarizeBlock(ArchiveWriter* writer, const ArchiveBlockBuffer* block, ArchiveTubeSummary summary[]) {
+    uint32_t tubeCount = writer->tubeCount;
+    const uint8_t* previous = writer->havePrevious ? writer->previousStates : block->states;
+    uint32_t tube;
+    int i;
+
+    memset(summary, 0, tubeCount * sizeof(ArchiveTubeSummary));
+    for (i = 0; i < block->scanCount; i++) {
+        const uint8_t* row = block->states + (size_t)i * tubeCount;
+        for (tube = 0; tube < tubeCount; tube++) {
+            summary[tube].moves += (row[tube] & PACKED_DATA_MASK) != (previous[tube] & PACKED_DATA_MASK);
+            summary[tube].eatingScans += row[tube] >> 4;
+        }
+        previous = row;
+    }
+
+    memcpy(writer->previousStates, previous, tubeCount);
+    writer->havePrevious = true;
+}
+
+// Adds the index entry and summaries of a block written at offset, returns 0 on success
+static int indexBlock(ArchiveWriter* writer, const ArchiveBlockHeader* header, uint64_t offset,
+                      const ArchiveBlockBuffer* block) {
+    ArchiveIndexEntry* entry;
+
+    if (writer->indexCount == writer->indexCapacity) {
+        uint32_t capacity = writer->indexCapacity ? writer->indexCapacity * 2 : 256;
+        ArchiveIndexEntry* grown = realloc(writer->index, capacity * sizeof(ArchiveIndexEntry));
+        ArchiveTubeSummary* grownSummaries;
+        if (grown == NULL) {
+            return -1;
+        }
+        writer->index = grown;
+        grownSummaries = realloc(writer->summaries, (size_t)capacity * writer->tubeCount * sizeof(ArchiveTubeSummary));
+        if (grownSummaries == NULL) {
+            return -1;
+        }
+        writer->summaries = grownSummaries;
+        writer->indexCapacity = capacity;
+    }
+    summarizeBlock(writer, block, writer->summaries + (size_t)writer->indexCount * writer->tubeCount);
+    entry = &writer->index[writer->indexCount++];
+    entry->firstTimeUs = header->firstTimeUs;
+    entry->lastTimeUs = header->lastTimeUs;
+    entry->offset = offset;
+    entry->scanCount = header->scanCount;
+    entry->flags = header->flags;
+    return 0;
+}
+
+// Writes index, summaries and trailer at writer->offset, the file position
+static int writeFooter(ArchiveWriter* writer) {
+    ArchiveTrailer trailer;
+    size_t summaryBytes = (size_t)writer->indexCount * writer->tubeCount * sizeof(ArchiveTubeSummary);
+
+    memset(&trailer, 0, sizeof(trailer));
+    trailer.indexOffset = writer->offset;
+    trailer.summaryOffset = writer->offset + (uint64_t)writer->indexCount * sizeof(ArchiveIndexEntry);
+    trailer.blockCount = writer->indexCount;
+    trailer.crc = archiveCrc32(archiveCrc32(0, writer->index, writer->indexCount * sizeof(ArchiveIndexEntry)),
+                               writer->summaries, summaryBytes);
+    trailer.magic = ARCHIVE_TRAILER_MAGIC;
+    if (writer->indexCount > 0 &&
+        (fwrite(writer->index, sizeof(ArchiveIndexEntry), writer->indexCount, writer->file) != writer->indexCount ||
+         fwrite(writer->summaries, 1, summaryBytes, writer->file) != summaryBytes)) {
+        return -1;
+    }
+    return fwrite(&trailer, sizeof(trailer), 1, writer->file) == 1 ? 0 : -1;
+}
+
+static uint64_t ticksToNs(const ArchiveWriter* writer, int64_t ticks) {
+    return (uint64_t)ticks * 1000000000ULL / (uint64_t)writer->tickRate.QuadPart;
+}
+
+// Pushes everything written so far to the disk, called on the writer thread only
+static int syncFile(ArchiveWriter* writer) {
+    LARGE_INTEGER start, end;
+    int error = 0;
+
+    QueryPerformanceCounter(&start);
+    if (fflush(writer->file) != 0 || !FlushFileBuffers((HANDLE)_get_osfhandle(_fileno(writer->file)))) {
+        error = -1;
+    }
+    if (writer->options.pyramid && pyramidSync(&writer->pyramid) != 0) {
+        error = -1;
+    }
+    QueryPerformanceCounter(&end);
+
+    latencyRecord(&writer->syncLatency, ticksToNs(writer, end.QuadPart - start.QuadPart));
+    writer->lastSync = end;
+    writer->unsyncedBytes = 0;
+    EnterCriticalSection(&writer->mutex);
+    writer->stats.syncs++;
+    LeaveCriticalSection(&writer->mutex);
+    return error;
+}
+
+// Milliseconds until the next sync is due, 0 if it is
+static DWORD msUntilSync(const ArchiveWriter* writer) {
+    LARGE_INTEGER now;
+    int64_t elapsedMs;
+
+    QueryPerformanceCounter(&now);
+    elapsedMs = (now.QuadPart - writer->lastSync.QuadPart) * 1000 / writer->tickRate.QuadPart;
+    return elapsedMs >= writer->options.syncMs ? 0 : (DWORD)(writer->options.syncMs - elapsedMs);
+}
+
+static bool fileExists(const char* path) {
+    return GetFileAttributesA(path) != INVALID_FILE_ATTRIBUTES;
+}
+
+void archiveSegmentPath(const char* path, uint32_t segment, char* out, size_t outBytes) {
+    const char* extension = strrchr(path, '.');
+    const char* separator = strrchr(path, '\\');
+
+    if (separator == NULL || (strrchr(path, '/') != NULL && strrchr(path, '/') > separator)) {
+        separator = strrchr(path, '/');
+    }
+    if (segment == 0) {
+        snprintf(out, outBytes, "%s", path);
+    } else if (extension != NULL && (separator == NULL || extension > separator)) {
+        snprintf(out, outBytes, "%.*s.%u%s", (int)(extension - path), path, segment, extension);
+    } else {
+        snprintf(out, outBytes, "%s.%u", path, segment);
+    }
+}
+
+// Creates the first segment from writer->segment on that does not exist yet and writes its header
+static int openSegment(ArchiveWriter* writer) {
+    ArchiveFileHeader header;
+
+    for (;; writer->segment++) {
+        archiveSegmentPath(writer->path, writer->segment, writer->segmentPath, sizeof(writer->segmentPath));
+        if (!fileExists(writer->segmentPath)) {
+            break;
+        }
+    }
+    writer->file = fopen(writer->segmentPath, "wb");
+    if (writer->file == NULL) {
+        return -1;
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC));
+    header.version = ARCHIVE_VERSION;
+    header.monitorId = writer->monitorId;
+    header.tubeCount = writer->tubeCount;
+    header.blockScans = ARCHIVE_BLOCK_SCANS;
+    if (fwrite(&header, sizeof(header), 1, writer->file) != 1) {
+        fclose(writer->file);
+        writer->file = NULL;
+        return -1;
+    }
+    writer->offset = sizeof(header);
+    writer->indexCount = 0;
+    writer->havePrevious = false; // Summaries of a segment stand on their own
+    writer->pyramid.havePrevious = false;
+    return 0;
+}
+
+// Writes the footer, syncs and closes the current segment
+static int closeSegment(ArchiveWriter* writer) {
+    int error = 0;
+
+    // A failed block write may have left part of the block behind the last indexed one
+    if (writer->failed &&
+        (fflush(writer->file) != 0 || _chsize_s(_fileno(writer->file), (long long)writer->offset) != 0 ||
+         _fseeki64(writer->file, (int64_t)writer->offset, SEEK_SET) != 0)) {
+        error = -1;
+    }
+    if (writeFooter(writer) != 0) {
+        error = -1;
+    }
+
+    if (syncFile(writer) != 0) {
+        error = -1;
+    }
+    if (fclose(writer->file) != 0) {
+        error = -1;
+    }
+    writer->file = NULL;
+    EnterCriticalSection(&writer->mutex);
+    writer->stats.segmentsClosed++;
+    LeaveCriticalSection(&writer->mutex);
+    return error;
+}
+
+// Counts a block that never reached the file
+static void dropBlock(ArchiveWriter* writer, const ArchiveBlockBuffer* block) {
+    EnterCriticalSection(&writer->mutex);
+    writer->stats.scansDropped += (uint64_t)block->scanCount;
+    writer->stats.eventsDropped += (uint64_t)block->eventCount;
+    LeaveCriticalSection(&writer->mutex);
+}
+
+// Encodes and writes one block, called on the writer thread only
+static void writeBlock(ArchiveWriter* writer, ArchiveBlockBuffer* block) {
+    ArchiveBlockHeader header;
+    size_t payloadBytes;
+    size_t eventBytes = (size_t)block->eventCount * sizeof(EnvironmentEvent);
+
+    if (writer->file == NULL || writer->failed) {
+        dropBlock(writer, block);
+        return;
+    }
+
+    // The events go right after the payload, under the same CRC
+    payloadBytes = encodeBlock(block, writer->tubeCount, writer->encodeBuffer);
+    memcpy(writer->encodeBuffer + payloadBytes, block->events, eventBytes);
+    header.magic = ARCHIVE_BLOCK_MAGIC;
+    header.scanCount = (uint32_t)block->scanCount;
+    header.firstTimeUs = block->times[0];
+    header.lastTimeUs = block->times[block->scanCount - 1];
+    header.payloadBytes = (uint32_t)payloadBytes;
+    header.codec = ARCHIVE_CODEC_RLE;
+    header.flags = block->flags | (block->eventCount > 0 ? ARCHIVE_BLOCK_EVENTS : 0);
+    header.eventCount = (uint32_t)block->eventCount;
+    header.reserved = 0;
+    header.crc = blockCrc(&header, writer->encodeBuffer);
+
+    // Only a block that is fully on disk goes into the index, a failure stops the segment where it is
+    if (fwrite(&header, sizeof(header), 1, writer->file) != 1 ||
+        fwrite(writer->encodeBuffer, 1, payloadBytes + eventBytes, writer->file) != payloadBytes + eventBytes ||
+        indexBlock(writer, &header, writer->offset, block) != 0) {
+        writer->failed = true;
+        dropBlock(writer, block);
+        return;
+    }
+    writer->offset += sizeof(header) + payloadBytes + eventBytes;
+    writer->unsyncedBytes += sizeof(header) + payloadBytes + eventBytes;
+
+    EnterCriticalSection(&writer->mutex);
+    writer->stats.scansWritten += (uint64_t)block->scanCount;
+    writer->stats.blocksWritten++;
+    writer->stats.rawBytes += (uint64_t)block->scanCount * (sizeof(int64_t) + writer->tubeCount);
+    writer->stats.encodedBytes += sizeof(header) + payloadBytes + eventBytes;
+    writer->stats.eventsWritten += (uint64_t)block->eventCount;
+    LeaveCriticalSection(&writer->mutex);
+    if (writer->options.pyramid) {
+        pyramidAddScans(&writer->pyramid, block->times, block->states, block->scanCount,
+                        (block->flags & ARCHIVE_BLOCK_AFTER_GAP) != 0);
+    }
+
+    // The next segment is opened right away, a failure drops blocks until close
+    if (writer->options.segmentMiB > 0 && writer->offset >= (uint64_t)writer->options.segmentMiB << 20) {
+        closeSegment(writer);
+        writer->segment++;
+        openSegment(writer);
+    }
+}
+
+// Writer thread function - encodes, writes and syncs queued blocks
+static unsigned int __stdcall writerThread(void* arg) {
+    ArchiveWriter* writer = (ArchiveWriter*)arg;
+
+    EnterCriticalSection(&writer->mutex);
+    while (writer->running || writer->pendingCount > 0) {
+        ArchiveBlockBuffer* block;
+        bool syncDue = writer->options.syncMs > 0 && writer->unsyncedBytes > 0 && writer->file != NULL;
+        int i;
+
+        if (syncDue && msUntilSync(writer) == 0) {
+            // The acquisition side only ever waits for this mutex, never for the disk
+            LeaveCriticalSection(&writer->mutex);
+            syncFile(writer);
+            EnterCriticalSection(&writer->mutex);
+            continue;
+        }
+        if (writer->pendingCount == 0) {
+            SleepConditionVariableCS(&writer->pendingCond, &writer->mutex, syncDue ? msUntilSync(writer) : INFINITE);
+            continue;
+        }
+
+        block = writer->pending[0];
+        for (i = 1; i < writer->pendingCount; i++) {
+            writer->pending[i - 1] = writer->pending[i];
+        }
+        writer->pendingCount--;
+        LeaveCriticalSection(&writer->mutex);
+
+        writeBlock(writer, block);
+
+        EnterCriticalSection(&writer->mutex);
+        block->scanCount = 0;
+        block->eventCount = 0;
+        block->flags = 0;
+        writer->spare[writer->spareCount++] = block;
+    }
+    LeaveCriticalSection(&writer->mutex);
+
+    return 0;
+}
+
+int archiveOpen(ArchiveWriter* writer, const char* path, uint32_t monitorId, uint32_t tubeCount,
+                const ArchiveOptions* options) {
+    int i;
+
+    memset(writer, 0, sizeof(*writer));
+    writer->monitorId = monitorId;
+    writer->tubeCount = tubeCount;
+    writer->options = *options;
+    writer->syncUs = (int64_t)options->syncMs * 1000;
+    QueryPerformanceFrequency(&writer->tickRate);
+    if (tubeCount == 0 || tubeCount > SCAN_MAX_TUBES || strlen(path) + 12 >= sizeof(writer->path)) {
+        return -1;
+    }
+    memcpy(writer->path, path, strlen(path) + 1);
+
+    // Close what a crash left open, then continue after the last segment
+    for (writer->segment = 0; ; writer->segment++) {
+        ArchiveRecovery recovery;
+
+        archiveSegmentPath(path, writer->segment, writer->segmentPath, sizeof(writer->segmentPath));
+        if (!fileExists(writer->segmentPath)) {
+            break;
+        }
+        if (archiveRecover(writer->segmentPath, &recovery) == 0 && recovery.wasOpen) {
+            writer->segmentsRecovered++;
+            writer->recovery.wasOpen = true;
+            writer->recovery.blocksKept += recovery.blocksKept;
+            writer->recovery.scansKept += recovery.scansKept;
+            writer->recovery.bytesDropped += recovery.bytesDropped;
+        }
+    }
+
+    for (i = 0; i < ARCHIVE_BUFFER_COUNT; i++) {
+        writer->buffers[i].states = malloc((size_t)ARCHIVE_BLOCK_SCANS * tubeCount);
+        if (writer->buffers[i].states == NULL) {
+            goto Error;
+        }
+    }
+    writer->encodeCapacity = (size_t)ARCHIVE_BLOCK_SCANS * (10 + (size_t)tubeCount * 6) + 16 +
+                             ARCHIVE_BLOCK_MAX_EVENTS * sizeof(EnvironmentEvent);
+    writer->encodeBuffer = malloc(writer->encodeCapacity);
+    if (writer->encodeBuffer == NULL) {
+        goto Error;
+    }
+    if (openSegment(writer) != 0) {
+        goto Error;
+    }
+    if (options->pyramid && pyramidOpen(&writer->pyramid, path, tubeCount) != 0) {
+        goto Error;
+    }
+    QueryPerformanceCounter(&writer->lastSync);
+
+    writer->current = &writer->buffers[0];
+    if (writer->segment > 0) {
+        writer->current->flags = ARCHIVE_BLOCK_AFTER_GAP; // The time since the last run's segment was not recorded
+    }
+    for (i = 1; i < ARCHIVE_BUFFER_COUNT; i++) {
+        writer->spare[writer->spareCount++] = &writer->buffers[i];
+    }
+
+    InitializeCriticalSection(&writer->mutex);
+    InitializeConditionVariable(&writer->pendingCond);
+    writer->running = true;
+    writer->thread = (HANDLE)_beginthreadex(NULL, 0, writerThread, writer, 0, NULL);
+    if (writer->thread == 0) {
+        DeleteCriticalSection(&writer->mutex);
+        if (options->pyramid) {
+            pyramidClose(&writer->pyramid);
+        }
+        goto Error;
+    }
+
+    return 0;
+
+Error:
+    for (i = 0; i < ARCHIVE_BUFFER_COUNT; i++) {
+        free(writer->buffers[i].states);
+    }
+    free(writer->encodeBuffer);
+    if (writer->file != NULL) {
+        fclose(writer->file);
+        remove(writer->segmentPath);
+    }
+    writer->file = NULL;
+    return -1;
+}
+
+// Hands the current block to the writer thread and takes a spare one, caller holds no lock
+static void queueCurrentBlock(ArchiveWriter* writer) {
+    EnterCriticalSection(&writer->mutex);
+    if (writer->spareCount == 0) {
+        // Writer is behind, drop this block rather than stall acquisition
+        writer->stats.scansDropped += (uint64_t)writer->current->scanCount;
+        writer->stats.eventsDropped += (uint64_t)writer->current->eventCount;
+        writer->current->scanCount = 0;
+        writer->current->eventCount = 0;
+        writer->current->flags |= ARCHIVE_BLOCK_AFTER_GAP; // Readers see the hole like a device gap
+    } else {
+        writer->pending[writer->pendingCount++] = writer->current;
+        writer->current = writer->spare[--writer->spareCount];
+        WakeConditionVariable(&writer->pendingCond);
+    }
+    LeaveCriticalSection(&writer->mutex);
+}
+
+void archiveAppendScan(ArchiveWriter* writer, int64_t timeUs, const ScanState* state) {
+    ArchiveBlockBuffer* block = writer->current;
+    uint8_t* row = block->states + (size_t)block->scanCount * writer->tubeCount;
+    LARGE_INTEGER start, end;
+    uint32_t tube;
+
+    QueryPerformanceCounter(&start);
+    for (tube = 0; tube < writer->tubeCount; tube++) {
+        row[tube] = ARCHIVE_STATE(state->position[tube], state->eating[tube]);
+    }
+    block->times[block->scanCount++] = timeUs;
+
+    // A partial block goes out once it is syncMs old, so the sync has something to make durable
+    if (block->scanCount == ARCHIVE_BLOCK_SCANS ||
+        (writer->syncUs > 0 && timeUs - block->times[0] >= writer->syncUs)) {
+        queueCurrentBlock(writer);
+    }
+    QueryPerformanceCounter(&end);
+    latencyRecord(&writer->appendLatency, ticksToNs(writer, end.QuadPart - start.QuadPart));
+}
+
+void archiveAppendEvent(ArchiveWriter* writer, const EnvironmentEvent* event) {
+    ArchiveBlockBuffer* block = writer->current;
+
+    if (block->eventCount == ARCHIVE_BLOCK_MAX_EVENTS) {
+        EnterCriticalSection(&writer->mutex);
+        writer->stats.eventsDropped++;
+        LeaveCriticalSection(&writer->mutex);
+        return;
+    }
+    block->events[block->eventCount++] = *event;
+}
+
+void archiveMarkGap(ArchiveWriter* writer) {
+    if (writer->current->scanCount > 0) {
+        queueCurrentBlock(writer);
+    }
+    writer->current->flags |= ARCHIVE_BLOCK_AFTER_GAP;
+}
+
+int archiveClose(ArchiveWriter* writer) {
+    int error = 0;
+    int i;
+
+    if (writer->thread == NULL) {
+        return -1;
+    }
+
+    if (writer->current->scanCount > 0) {
+        queueCurrentBlock(writer);
+    }
+
+    EnterCriticalSection(&writer->mutex);
+    writer->stats.eventsDropped += (uint64_t)writer->current->eventCount; // No scan left to carry them
+    writer->current->eventCount = 0;
+    writer->running = false;
+    WakeConditionVariable(&writer->pendingCond);
+    LeaveCriticalSection(&writer->mutex);
+    WaitForSingleObject(writer->thread, INFINITE);
+    CloseHandle(writer->thread);
+    writer->thread = NULL;
+
+    if (writer->file == NULL || closeSegment(writer) != 0 || writer->failed) {
+        error = -1;
+    }
+    if (writer->options.pyramid && pyramidClose(&writer->pyramid) != 0) {
+        error = -1;
+    }
+    DeleteCriticalSection(&writer->mutex);
+
+    for (i = 0; i < ARCHIVE_BUFFER_COUNT; i++) {
+        free(writer->buffers[i].states);
+    }
+    free(writer->encodeBuffer);
+    free(writer->index);
+    free(writer->summaries);
+
+    return error;
+}
+
+// True if the file ends in a trailer whose offsets and CRC match the file
+static bool hasValidTrailer(FILE* file, uint64_t fileBytes, uint32_t tubeCount) {
+    ArchiveTrailer trailer;
+    uint64_t footerBytes;
+    uint8_t chunk[4096];
+    uint32_t crc = 0;
+
+    if (fileBytes < sizeof(ArchiveFileHeader) + sizeof(trailer) ||
+        _fseeki64(file, (int64_t)(fileBytes - sizeof(trailer)), SEEK_SET) != 0 ||
+        fread(&trailer, sizeof(trailer), 1, file) != 1 || trailer.magic != ARCHIVE_TRAILER_MAGIC) {
+        return false;
+    }
+    footerBytes = (uint64_t)trailer.blockCount * (sizeof(ArchiveIndexEntry) + tubeCount * sizeof(ArchiveTubeSummary));
+    if (trailer.indexOffset + (uint64_t)trailer.blockCount * sizeof(ArchiveIndexEntry) != trailer.summaryOffset ||
+        trailer.indexOffset + footerBytes + sizeof(trailer) != fileBytes ||
+        _fseeki64(file, (int64_t)trailer.indexOffset, SEEK_SET) != 0) {
+        return false;
+    }
+    while (footerBytes > 0) {
+        size_t bytes = footerBytes < sizeof(chunk) ? (size_t)footerBytes : sizeof(chunk);
+
+        if (fread(chunk, 1, bytes, file) != bytes) {
+            return false;
+        }
+        crc = archiveCrc32(crc, chunk, bytes);
+        footerBytes -= bytes;
+    }
+    return crc == trailer.crc;
+}
+
+int archiveRecover(const char* path, ArchiveRecovery* recovery) {
+    ArchiveWriter* writer; // Rebuilds the index the way the writer thread would have
+    ArchiveBlockBuffer* block;
+    ArchiveFileHeader header;
+    uint64_t fileBytes;
+    int error = -1;
+
+    memset(recovery, 0, sizeof(*recovery));
+    writer = calloc(1, sizeof(ArchiveWriter));
+    if (writer == NULL) {
+        return -1;
+    }
+    block = &writer->buffers[0];
+    writer->file = fopen(path, "r+b");
+    if (writer->file == NULL || fread(&header, sizeof(header), 1, writer->file) != 1 ||
+        memcmp(header.magic, ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC)) != 0 || header.version != ARCHIVE_VERSION ||
+        header.tubeCount == 0 || header.tubeCount > SCAN_MAX_TUBES ||
+        _fseeki64(writer->file, 0, SEEK_END) != 0) {
+        goto Done;
+    }
+    writer->tubeCount = header.tubeCount;
+    fileBytes = (uint64_t)_ftelli64(writer->file);
+    if (hasValidTrailer(writer->file, fileBytes, writer->tubeCount)) {
+        error = 0;
+        goto Done;
+    }
+    recovery->wasOpen = true;
+
+    block->states = malloc((size_t)ARCHIVE_BLOCK_SCANS * writer->tubeCount);
+    writer->encodeCapacity = (size_t)ARCHIVE_BLOCK_SCANS * (10 + (size_t)writer->tubeCount * 6) + 16 +
+                             ARCHIVE_BLOCK_MAX_EVENTS * sizeof(EnvironmentEvent);
+    writer->encodeBuffer = malloc(writer->encodeCapacity);
+    if (block->states == NULL || writer->encodeBuffer == NULL) {
+        goto Done;
+    }
+
+    // Keep blocks up to the first one that is cut short, fails its CRC or does not decode
+    writer->offset = sizeof(header);
+    for (;;) {
+        ArchiveBlockHeader blockHeader;
+
+        if (_fseeki64(writer->file, (int64_t)writer->offset, SEEK_SET) != 0 ||
+            fread(&blockHeader, sizeof(blockHeader), 1, writer->file) != 1 ||
+            blockHeader.magic != ARCHIVE_BLOCK_MAGIC || blockHeader.codec != ARCHIVE_CODEC_RLE ||
+            blockHeader.scanCount == 0 || blockHeader.scanCount > ARCHIVE_BLOCK_SCANS ||
+            blockHeader.eventCount > ARCHIVE_BLOCK_MAX_EVENTS ||
+            ARCHIVE_BLOCK_BYTES(&blockHeader) > writer->encodeCapacity ||
+            fread(writer->encodeBuffer, 1, (size_t)ARCHIVE_BLOCK_BYTES(&blockHeader), writer->file) !=
+                (size_t)ARCHIVE_BLOCK_BYTES(&blockHeader) ||
+            blockCrc(&blockHeader, writer->encodeBuffer) != blockHeader.crc ||
+            archiveDecodeBlock(&blockHeader, writer->encodeBuffer, writer->tubeCount, block->times, block->states) != 0) {
+            break;
+        }
+        block->scanCount = (int)blockHeader.scanCount;
+        if (indexBlock(writer, &blockHeader, writer->offset, block) != 0) {
+            goto Done;
+        }
+        writer->offset += sizeof(blockHeader) + ARCHIVE_BLOCK_BYTES(&blockHeader);
+        recovery->blocksKept++;
+        recovery->scansKept += blockHeader.scanCount;
+    }
+    recovery->bytesDropped = fileBytes - writer->offset;
+
+    fflush(writer->file);
+    if (_chsize_s(_fileno(writer->file), (long long)writer->offset) != 0 ||
+        _fseeki64(writer->file, (int64_t)writer->offset, SEEK_SET) != 0 ||
+        writeFooter(writer) != 0 || fflush(writer->file) != 0 ||
+        !FlushFileBuffers((HANDLE)_get_osfhandle(_fileno(writer->file)))) {
+        goto Done;
+    }
+    error = 0;
+
+Done:
+    if (writer->file != NULL) {
+        fclose(writer->file);
+    }
+    free(block->states);
+    free(writer->encodeBuffer);
+    free(writer->index);
+    free(writer->summaries);
+    free(writer);
+    return error;
+}
+
+ArchiveStats archiveGetStats(ArchiveWriter* writer) {
+    ArchiveStats stats;
+    EnterCriticalSection(&writer->mutex);
+    stats = writer->stats;
+    LeaveCriticalSection(&writer->mutex);
+    return stats;
+}
+
+uint32_t archiveFindBlock(const ArchiveIndexEntry index[], uint32_t blockCount, int64_t timeUs) {
+    uint32_t low = 0;
+    uint32_t high = blockCount;
+
+    while (low < high) {
+        uint32_t mid = low + (high - low) / 2;
+        if (index[mid].lastTimeUs < timeUs) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    return low;
+}
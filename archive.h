@@ -0,0 +1,214 @@
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include <stdio.h> // FILE
+#include <stdint.h> // Fixed-width integer types
+#include <stdbool.h> // Standard boolean library
+#include <windows.h> // Threads, critical sections and condition variables
+#include "scan_kernel.h" // ScanState
+#include "latency.h" // Append and sync latency histograms
+#include "pyramid.h" // Multi-resolution summaries written next to the archive
+#include "environment.h" // EnvironmentEvent, stored inline with the scans
+
+// Constants
+#define ARCHIVE_MAGIC "MADARCH"     // First 8 bytes of every archive file (with terminator)
+#define ARCHIVE_VERSION 4           // Bumped whenever the on-disk layout changes
+#define ARCHIVE_BLOCK_MAGIC 0x4B4C4244u // "DBLK"
+#define ARCHIVE_TRAILER_MAGIC 0x58444E49u // "INDX"
+#define ARCHIVE_BLOCK_SCANS 4096    // Scans per block, the unit of compression and seeking
+#define ARCHIVE_BUFFER_COUNT 4      // Blocks that can be queued for the writer thread
+#define ARCHIVE_CODEC_RLE 0         // Delta-of-delta times, per-tube run-length states
+#define ARCHIVE_BLOCK_AFTER_GAP 1u  // Index flag: acquisition was interrupted, or scans were dropped, before this block's first scan
+#define ARCHIVE_BLOCK_EVENTS 2u     // Index flag: the block carries environment events
+#define ARCHIVE_BLOCK_MAX_EVENTS 64 // Environment events one block can carry
+#define ARCHIVE_SYNC_MS 10000       // Default ArchiveOptions.syncMs
+#define ARCHIVE_SEGMENT_MIB 64      // Default ArchiveOptions.segmentMiB
+
+// File layout: ArchiveFileHeader, blocks (ArchiveBlockHeader + payload + events),
+// index (ArchiveIndexEntry per block), summaries (ArchiveTubeSummary per block per tube),
+// ArchiveTrailer at the very end. Every block carries its own CRC, so a file whose
+// writer died before the index was written can be cut back to its last whole block
+// and closed (archiveRecover).
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t monitorId;
+    uint32_t tubeCount;
+    uint32_t blockScans;
+} ArchiveFileHeader;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t scanCount;
+    int64_t firstTimeUs;  // Time of the first scan in the block
+    int64_t lastTimeUs;   // Time of the last scan in the block
+    uint32_t payloadBytes;
+    uint32_t codec;
+    uint32_t flags;       // ARCHIVE_BLOCK_* bits, also here so recovery can rebuild the index
+    uint32_t crc;         // CRC-32 of this header with crc = 0, then the payload and events
+    uint32_t eventCount;  // EnvironmentEvents right after the payload, unaligned; each applies
+                          // from its time on, which may be before the block's first scan
+    uint32_t reserved;
+} ArchiveBlockHeader;
+
+// Payload and events of a block, the bytes after its header
+#define ARCHIVE_BLOCK_BYTES(header) \
+    ((uint64_t)(header)->payloadBytes + (uint64_t)(header)->eventCount * sizeof(EnvironmentEvent))
+
+typedef struct {
+    int64_t firstTimeUs;
+    int64_t lastTimeUs;
+    uint64_t offset;      // File offset of the block header
+    uint32_t scanCount;
+    uint32_t flags;       // ARCHIVE_BLOCK_* bits
+} ArchiveIndexEntry;
+
+// Activity of one tube within one block, enough to answer counts without decoding
+typedef struct {
+    uint16_t moves;       // Position changes, including the one at the block's first scan
+    uint16_t eatingScans; // Scans with the eating flag set
+} ArchiveTubeSummary;
+
+typedef struct {
+    uint64_t indexOffset;
+    uint64_t summaryOffset;
+    uint32_t blockCount;
+    uint32_t crc;         // CRC-32 of the index and summaries
+    uint32_t reserved;
+    uint32_t magic;       // Written last, a torn trailer never ends in it
+} ArchiveTrailer;
+
+// Tube state as stored in the archive: position in bits 0-3, eating in bit 4
+#define ARCHIVE_STATE(position, eating) ((uint8_t)((position) | ((eating) << 4)))
+
+// Raw scans collected for one block
+typedef struct {
+    int64_t times[ARCHIVE_BLOCK_SCANS];
+    uint8_t* states;      // ARCHIVE_BLOCK_SCANS rows of tubeCount bytes
+    int scanCount;
+    uint32_t flags;       // Copied to the block's index entry
+    EnvironmentEvent events[ARCHIVE_BLOCK_MAX_EVENTS];
+    int eventCount;
+} ArchiveBlockBuffer;
+
+typedef struct {
+    uint64_t scansWritten;
+    uint64_t scansDropped; // Scans lost because every block buffer was queued, a segment failed to open
+                           // or a block write failed
+    uint64_t blocksWritten;
+    uint64_t rawBytes;     // Size the written scans would take as plain time + state rows
+    uint64_t encodedBytes; // Bytes actually written for blocks
+    uint64_t syncs;
+    uint32_t segmentsClosed;
+    uint64_t eventsWritten;
+    uint64_t eventsDropped; // A block full of events, or events after the last scan
+} ArchiveStats;
+
+// Durability of an archive
+typedef struct {
+    uint32_t syncMs;      // A partial block is handed to the writer after this long and the file
+                          // synced as often, so a crash loses at most about twice this; 0 = never
+    uint32_t segmentMiB;  // The segment is closed and the next one started past this size, 0 = never
+    bool pyramid;         // Keep the summary pyramid of every scan written, synced with the archive
+} ArchiveOptions;
+
+// What archiveRecover found
+typedef struct {
+    bool wasOpen;          // No valid trailer, the writer never closed the file
+    uint32_t blocksKept;
+    uint64_t scansKept;
+    uint64_t bytesDropped; // Torn or corrupt data after the last whole block
+} ArchiveRecovery;
+
+// Archive writer for one monitor, encoding, disk I/O and syncing run on a background
+// thread. The archive is a series of segments: path, then path with .1, .2 ... before
+// its extension, each a complete archive once closed.
+typedef struct {
+    FILE* file;                      // Current segment, NULL after a segment failed to open
+    char path[MAX_PATH];             // Segment 0
+    char segmentPath[MAX_PATH];      // Current segment
+    uint32_t segment;
+    uint32_t monitorId;
+    uint32_t tubeCount;
+    ArchiveOptions options;
+    uint64_t offset;                 // Current end of file
+    int64_t syncUs;                  // options.syncMs in scan time
+
+    ArchiveBlockBuffer buffers[ARCHIVE_BUFFER_COUNT];
+    ArchiveBlockBuffer* current;     // Block being filled by the acquisition thread
+    ArchiveBlockBuffer* pending[ARCHIVE_BUFFER_COUNT]; // Full blocks, oldest first
+    int pendingCount;
+    ArchiveBlockBuffer* spare[ARCHIVE_BUFFER_COUNT];   // Empty blocks ready for reuse
+    int spareCount;
+
+    CRITICAL_SECTION mutex;
+    CONDITION_VARIABLE pendingCond;
+    HANDLE thread;
+    volatile bool running;
+
+    ArchiveIndexEntry* index;        // Owned by the writer thread until close
+    ArchiveTubeSummary* summaries;   // indexCapacity rows of tubeCount summaries
+    uint32_t indexCount;
+    uint32_t indexCapacity;
+    uint8_t previousStates[SCAN_MAX_TUBES]; // Last row of the previous block
+    bool havePrevious;
+    uint8_t* encodeBuffer;
+    size_t encodeCapacity;
+    uint64_t unsyncedBytes;          // Written since the last sync, writer thread only
+    bool failed;                     // A block write or index growth failed, later blocks are dropped
+    LARGE_INTEGER lastSync;
+    PyramidWriter pyramid;           // options.pyramid only, one for all segments, writer thread only
+
+    LARGE_INTEGER tickRate;          // QueryPerformanceFrequency
+    LatencyHistogram appendLatency;  // archiveAppendScan, recorded by the acquisition side
+    LatencyHistogram syncLatency;    // fflush + FlushFileBuffers, recorded by the writer thread
+    ArchiveRecovery recovery;        // Segments of path left open by a crash, summed
+    uint32_t segmentsRecovered;
+
+    ArchiveStats stats;
+} ArchiveWriter;
+
+// Recovers any segment of path a crash left open, starts the next free segment and the
+// writer thread. Existing segments are never overwritten. Returns 0 on success.
+int archiveOpen(ArchiveWriter* writer, const char* path, uint32_t monitorId, uint32_t tubeCount,
+                const ArchiveOptions* options);
+
+// Copies one decoded scan into the current block, never blocks on disk or on a sync
+void archiveAppendScan(ArchiveWriter* writer, int64_t timeUs, const ScanState* state);
+
+// Copies one environment event into the current block, to be written before the next
+// scan; never blocks. Events come in time order.
+void archiveAppendEvent(ArchiveWriter* writer, const EnvironmentEvent* event);
+
+// Ends the current block so the next scan starts a new one flagged ARCHIVE_BLOCK_AFTER_GAP
+void archiveMarkGap(ArchiveWriter* writer);
+
+// Flushes the partial block, writes the block index, syncs and closes the file
+int archiveClose(ArchiveWriter* writer);
+
+// Closes a segment whose writer died: keeps the blocks up to the first torn or corrupt
+// one, cuts the rest and writes the index and trailer. A closed segment is left alone.
+// Returns 0 on success, -1 if path is missing or not an archive of this version.
+int archiveRecover(const char* path, ArchiveRecovery* recovery);
+
+// Name of segment number segment of the archive at path
+void archiveSegmentPath(const char* path, uint32_t segment, char* out, size_t outBytes);
+
+// CRC-32 (IEEE 802.3) of bytes, continuing from crc (0 to start)
+uint32_t archiveCrc32(uint32_t crc, const void* data, size_t bytes);
+
+// Snapshot of the writer counters while open, read writer->stats directly after archiveClose
+ArchiveStats archiveGetStats(ArchiveWriter* writer);
+
+// Index of the first block whose time range ends at or after timeUs (blockCount if none)
+uint32_t archiveFindBlock(const ArchiveIndexEntry index[], uint32_t blockCount, int64_t timeUs);
+
+// Decodes a block payload into scanCount times and scanCount rows of tubeCount states, returns 0 on success
+int archiveDecodeBlock(const ArchiveBlockHeader* header, const uint8_t* payload, uint32_t tubeCount,
+                       int64_t times[], uint8_t states[]);
+
+// Same as archiveDecodeBlock for a single tube, states gets scanCount bytes
+int archiveDecodeTube(const ArchiveBlockHeader* header, const uint8_t* payload, uint32_t tubeCount,
+                      uint32_t tube, int64_t times[], uint8_t states[]);
+
+#endif
@@ -0,0 +1,230 @@
+#include "archive_query.h"
+#include <string.h> // memset, memcmp, memcpy
+
+int archiveReaderOpen(ArchiveReader* reader, const char* path) {
+    LARGE_INTEGER fileSize;
+    const ArchiveTrailer* trailer;
+    uint64_t indexBytes;
+    uint64_t summaryBytes;
+
+    memset(reader, 0, sizeof(*reader));
+
+    reader->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                               FILE_ATTRIBUTE_NORMAL, NULL);
+    if (reader->file == INVALID_HANDLE_VALUE) {
+        reader->file = NULL;
+        return -1;
+    }
+    if (!GetFileSizeEx(reader->file, &fileSize) ||
+        (uint64_t)fileSize.QuadPart < sizeof(ArchiveFileHeader) + sizeof(ArchiveTrailer)) {
+        goto Error;
+    }
+    reader->size = (uint64_t)fileSize.QuadPart;
+
+    reader->mapping = CreateFileMappingA(reader->file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (reader->mapping == NULL) {
+        goto Error;
+    }
+    reader->base = MapViewOfFile(reader->mapping, FILE_MAP_READ, 0, 0, 0);
+    if (reader->base == NULL) {
+        goto Error;
+    }
+
+    reader->header = (const ArchiveFileHeader*)reader->base;
+    if (memcmp(reader->header->magic, ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC)) != 0 ||
+        reader->header->version != ARCHIVE_VERSION ||
+        reader->header->tubeCount == 0 || reader->header->tubeCount > SCAN_MAX_TUBES) {
+        goto Error;
+    }
+    reader->tubeCount = reader->header->tubeCount;
+
+    // A missing trailer means the writer never closed the file, archiveRecover closes it
+    trailer = (const ArchiveTrailer*)(reader->base + reader->size - sizeof(ArchiveTrailer));
+    if (trailer->magic != ARCHIVE_TRAILER_MAGIC) {
+        goto Error;
+    }
+    indexBytes = (uint64_t)trailer->blockCount * sizeof(ArchiveIndexEntry);
+    summaryBytes = (uint64_t)trailer->blockCount * reader->tubeCount * sizeof(ArchiveTubeSummary);
+    if (trailer->indexOffset + indexBytes != trailer->summaryOffset ||
+        trailer->summaryOffset + summaryBytes + sizeof(ArchiveTrailer) != reader->size ||
+        archiveCrc32(0, reader->base + trailer->indexOffset, (size_t)(indexBytes + summaryBytes)) != trailer->crc) {
+        goto Error;
+    }
+
+    reader->index = (const ArchiveIndexEntry*)(reader->base + trailer->indexOffset);
+    reader->summaries = (const ArchiveTubeSummary*)(reader->base + trailer->summaryOffset);
+    reader->blockCount = trailer->blockCount;
+
+    return 0;
+
+Error:
+    archiveReaderClose(reader);
+    return -1;
+}
+
+void archiveReaderClose(ArchiveReader* reader) {
+    if (reader->base != NULL) {
+        UnmapViewOfFile(reader->base);
+    }
+    if (reader->mapping != NULL) {
+        CloseHandle(reader->mapping);
+    }
+    if (reader->file != NULL) {
+        CloseHandle(reader->file);
+    }
+    reader->base = NULL;
+    reader->mapping = NULL;
+    reader->file = NULL;
+}
+
+int archiveReaderOpenSegment(ArchiveReader* reader, const char* path, uint32_t segment) {
+    char segmentPath[MAX_PATH];
+
+    archiveSegmentPath(path, segment, segmentPath, sizeof(segmentPath));
+    if (GetFileAttributesA(segmentPath) == INVALID_FILE_ATTRIBUTES) {
+        memset(reader, 0, sizeof(*reader));
+        return 1;
+    }
+    return archiveReaderOpen(reader, segmentPath);
+}
+
+// Header of block after bounds checks, or NULL
+static const ArchiveBlockHeader* blockHeader(ArchiveReader* reader, uint32_t block) {
+    const ArchiveIndexEntry* entry = &reader->index[block];
+    const ArchiveBlockHeader* header;
+
+    if (entry->offset + sizeof(ArchiveBlockHeader) > reader->size) {
+        return NULL;
+    }
+    header = (const ArchiveBlockHeader*)(reader->base + entry->offset);
+    if (header->magic != ARCHIVE_BLOCK_MAGIC || header->scanCount > ARCHIVE_BLOCK_SCANS ||
+        header->eventCount > ARCHIVE_BLOCK_MAX_EVENTS ||
+        entry->offset + sizeof(ArchiveBlockHeader) + ARCHIVE_BLOCK_BYTES(header) > reader->size) {
+        return NULL;
+    }
+
+    return header;
+}
+
+// Decodes tube's column of block into reader->times/states, returns the block header or NULL
+static const ArchiveBlockHeader* loadTube(ArchiveReader* reader, uint32_t block, uint32_t tube) {
+    const ArchiveBlockHeader* header = blockHeader(reader, block);
+
+    if (header == NULL ||
+        archiveDecodeTube(header, (const uint8_t*)(header + 1), reader->tubeCount, tube,
+                          reader->times, reader->states) != 0) {
+        return NULL;
+    }
+
+    return header;
+}
+
+int archiveReaderDecodeBlock(ArchiveReader* reader, uint32_t block, int64_t times[], uint8_t states[]) {
+    const ArchiveBlockHeader* header = blockHeader(reader, block);
+
+    if (header == NULL ||
+        archiveDecodeBlock(header, (const uint8_t*)(header + 1), reader->tubeCount, times, states) != 0) {
+        return -1;
+    }
+
+    return (int)header->scanCount;
+}
+
+int archiveReaderBlockEvents(ArchiveReader* reader, uint32_t block, EnvironmentEvent events[]) {
+    const ArchiveBlockHeader* header;
+
+    if ((reader->index[block].flags & ARCHIVE_BLOCK_EVENTS) == 0) {
+        return 0;  // Most blocks, answered from the index alone
+    }
+    header = blockHeader(reader, block);
+    if (header == NULL) {
+        return -1;
+    }
+    memcpy(events, (const uint8_t*)(header + 1) + header->payloadBytes,
+           header->eventCount * sizeof(EnvironmentEvent));
+    return (int)header->eventCount;
+}
+
+int queryTubeChanges(ArchiveReader* reader, uint32_t tube, int64_t startUs, int64_t endUs,
+                     TubeChangeCallback callback, void* context) {
+    uint32_t block = archiveFindBlock(reader->index, reader->blockCount, startUs);
+    bool first = true;
+    uint8_t previous = 0;
+
+    if (tube >= reader->tubeCount) {
+        return -1;
+    }
+
+    for (; block < reader->blockCount && reader->index[block].firstTimeUs <= endUs; block++) {
+        const ArchiveBlockHeader* header = loadTube(reader, block, tube);
+        uint32_t i;
+
+        if (header == NULL) {
+            return -1;
+        }
+        for (i = 0; i < header->scanCount; i++) {
+            if (reader->times[i] < startUs || reader->times[i] > endUs) {
+                continue;
+            }
+            if (first || reader->states[i] != previous) {
+                callback(reader->times[i], reader->states[i] & PACKED_DATA_MASK,
+                         (reader->states[i] >> 4) != 0, context);
+                previous = reader->states[i];
+                first = false;
+            }
+        }
+    }
+
+    return 0;
+}
+
+int queryTubeActivity(ArchiveReader* reader, uint32_t tube, int64_t startUs, int64_t endUs,
+                      TubeActivity* activity) {
+    uint32_t block = archiveFindBlock(reader->index, reader->blockCount, startUs);
+
+    memset(activity, 0, sizeof(*activity));
+    if (tube >= reader->tubeCount) {
+        return -1;
+    }
+
+    for (; block < reader->blockCount && reader->index[block].firstTimeUs <= endUs; block++) {
+        const ArchiveIndexEntry* entry = &reader->index[block];
+        const ArchiveTubeSummary* summary = &reader->summaries[(size_t)block * reader->tubeCount + tube];
+        const ArchiveBlockHeader* header;
+        uint32_t internalMoves = 0;
+        uint32_t i;
+
+        // Whole block in range, the index already has the answer
+        if (entry->firstTimeUs >= startUs && entry->lastTimeUs <= endUs) {
+            activity->scans += entry->scanCount;
+            activity->moves += summary->moves;
+            activity->eatingScans += summary->eatingScans;
+            activity->blocksSummarized++;
+            continue;
+        }
+
+        header = loadTube(reader, block, tube);
+        if (header == NULL) {
+            return -1;
+        }
+        for (i = 1; i < header->scanCount; i++) {
+            internalMoves += (reader->states[i] & PACKED_DATA_MASK) != (reader->states[i - 1] & PACKED_DATA_MASK);
+        }
+        for (i = 0; i < header->scanCount; i++) {
+            if (reader->times[i] < startUs || reader->times[i] > endUs) {
+                continue;
+            }
+            activity->scans++;
+            activity->eatingScans += reader->states[i] >> 4;
+            if (i > 0) {
+                activity->moves += (reader->states[i] & PACKED_DATA_MASK) != (reader->states[i - 1] & PACKED_DATA_MASK);
+            } else {
+                // The summary counts the move into the first scan, the decoded block does not
+                activity->moves += summary->moves - internalMoves;
+            }
+        }
+        activity->blocksDecoded++;
+    }
+
+    return 0;
+}
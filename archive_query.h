@@ -0,0 +1,62 @@
+#ifndef ARCHIVE_QUERY_H
+#define ARCHIVE_QUERY_H
+
+#include <stdint.h> // Fixed-width integer types
+#include <stdbool.h> // Standard boolean library
+#include <windows.h> // File mapping
+#include "archive.h" // On-disk archive layout
+
+// Read-only view of a closed archive, the whole file is memory mapped
+typedef struct {
+    HANDLE file;
+    HANDLE mapping;
+    const uint8_t* base;
+    uint64_t size;
+
+    const ArchiveFileHeader* header;
+    const ArchiveIndexEntry* index;
+    const ArchiveTubeSummary* summaries; // blockCount rows of tubeCount summaries
+    uint32_t blockCount;
+    uint32_t tubeCount;
+
+    int64_t times[ARCHIVE_BLOCK_SCANS];  // Decode scratch for one block
+    uint8_t states[ARCHIVE_BLOCK_SCANS];
+} ArchiveReader;
+
+// Aggregated activity of one tube over a time range
+typedef struct {
+    uint64_t scans;
+    uint64_t moves;           // Scans where the position differs from the previous scan
+    uint64_t eatingScans;
+    uint32_t blocksDecoded;   // Blocks only partly in range, decoded for the tube
+    uint32_t blocksSummarized; // Blocks fully in range, answered from the index
+} TubeActivity;
+
+// Called for the first scan in range and then for every change of position or eating flag
+typedef void (*TubeChangeCallback)(int64_t timeUs, uint8_t position, bool eating, void* context);
+
+// Maps the archive and validates its header, index and trailer, returns 0 on success
+int archiveReaderOpen(ArchiveReader* reader, const char* path);
+
+void archiveReaderClose(ArchiveReader* reader);
+
+// Opens segment number segment of the recording whose first segment is path (see
+// archiveSegmentPath). Returns 0 on success, 1 if there is no such segment, or -1 if
+// it exists but is unfinished, corrupt or of another version.
+int archiveReaderOpenSegment(ArchiveReader* reader, const char* path, uint32_t segment);
+
+// Decodes every tube of one block, states gets scanCount rows of tubeCount bytes, returns the scan count or -1
+int archiveReaderDecodeBlock(ArchiveReader* reader, uint32_t block, int64_t times[], uint8_t states[]);
+
+// Copies the environment events of one block (ARCHIVE_BLOCK_MAX_EVENTS at most), returns their count or -1
+int archiveReaderBlockEvents(ArchiveReader* reader, uint32_t block, EnvironmentEvent events[]);
+
+// Reports what tube did between startUs and endUs (inclusive), returns 0 on success
+int queryTubeChanges(ArchiveReader* reader, uint32_t tube, int64_t startUs, int64_t endUs,
+                     TubeChangeCallback callback, void* context);
+
+// Counts scans, moves and eating scans of tube between startUs and endUs (inclusive)
+int queryTubeActivity(ArchiveReader* reader, uint32_t tube, int64_t startUs, int64_t endUs,
+                      TubeActivity* activity);
+
+#endif
@@ -0,0 +1,40 @@
+# Decode throughput against the number of monitors, using simulated devices
+#   .\bench-scaling.ps1 [-Seconds 10] [-Counts 1,2,4,8,16,32,64]
+param(
+    [int]$Seconds = 10,
+    [int[]]$Counts = @(1, 2, 4, 8, 16, 32, 64)
+)
+
+$program = Join-Path $PSScriptRoot "program.exe"
+$config = Join-Path $env:TEMP "mad-bench.ini"
+$baseline = 0.0
+
+Write-Host ("{0,8} | {1,12} | {2,7} | {3}" -f "Monitors", "Scans/s", "Speedup", "Workers")
+Write-Host ("{0,8}-|-{1,12}-|-{2,7}-|--------" -f "--------", "------------", "-------")
+
+foreach ($count in $Counts) {
+    # Fixed timebase so no tuning runs, no pause between scans, no outputs
+    $lines = @("[acquisition]", "interval = 0")
+    for ($i = 1; $i -le $count; $i++) {
+        $lines += "[monitor $i]", "device = sim", "timebase = 0.2"
+    }
+    Set-Content -Path $config -Value $lines -Encoding ASCII
+
+    $output = & $program -c $config -r $Seconds
+    $decoded = $output | Select-String -Pattern "Decoded .* ([0-9]+) scans/s"
+    $workers = $output | Select-String -Pattern "^([0-9]+) decode worker"
+    if (-not $decoded) {
+        Write-Host "program.exe failed with $count monitor(s):" -ForegroundColor Red
+        $output | Select-Object -Last 5 | ForEach-Object { Write-Host $_ }
+        exit 1
+    }
+
+    $rate = [double]$decoded.Matches[0].Groups[1].Value
+    if ($baseline -eq 0.0) {
+        $baseline = $rate
+    }
+    Write-Host ("{0,8} | {1,12:N0} | {2,6:N2}x | {3}" -f $count, $rate, ($rate / $baseline),
+                $workers.Matches[0].Groups[1].Value)
+}
+
+Remove-Item $config
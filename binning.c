@@ -0,0 +1,78 @@
+#include "binning.h"
+#include <string.h> // memset
+
+// Clears the counters of the current bin and moves it to startUs, the conditions carry on
+static void resetBin(ActivityBinner* binner, int64_t startUs) {
+    EnvironmentState environment = binner->current.environment;
+
+    memset(&binner->current, 0, sizeof(binner->current));
+    binner->current.environment = environment;
+    binner->current.startUs = startUs;
+    binner->current.endUs = startUs + binner->binUs;
+}
+
+static int64_t binStart(const ActivityBinner* binner, int64_t timeUs) {
+    int64_t offset = timeUs % binner->binUs;
+    return timeUs - (offset < 0 ? offset + binner->binUs : offset);
+}
+
+void binnerInit(ActivityBinner* binner, int64_t binUs, uint32_t tubeCount,
+                BinClosedCallback callback, void* context) {
+    memset(binner, 0, sizeof(*binner));
+    binner->binUs = binUs;
+    binner->tubeCount = tubeCount > SCAN_MAX_TUBES ? SCAN_MAX_TUBES : tubeCount;
+    binner->callback = callback;
+    binner->context = context;
+}
+
+// Closes the current bin and any empty ones in a gap before timeUs
+static void closeBins(ActivityBinner* binner, int64_t timeUs) {
+    ActivityBin* bin = &binner->current;
+
+    if (!binner->started) {
+        resetBin(binner, binStart(binner, timeUs));
+        binner->started = true;
+    }
+    while (timeUs >= bin->endUs) {
+        binner->callback(bin, binner->tubeCount, binner->context);
+        resetBin(binner, bin->endUs);
+    }
+}
+
+void binnerAddScan(ActivityBinner* binner, int64_t timeUs, const ScanState* state, ScanDelta delta) {
+    ActivityBin* bin = &binner->current;
+    uint64_t bits;
+    uint32_t tube;
+
+    closeBins(binner, timeUs);
+    bin->scans++;
+    bin->lightScans += environmentLightOn(&bin->environment);
+    for (tube = 0; tube < binner->tubeCount; tube++) {
+        bin->occupancy[tube][state->position[tube] & PACKED_DATA_MASK]++;
+        bin->feedingScans[tube] += state->eating[tube];
+    }
+
+    // Only tubes that changed need their counters touched
+    for (bits = delta.moved; bits; bits &= bits - 1) {
+        bin->moves[__builtin_ctzll(bits)]++;
+    }
+    for (bits = delta.eatingChanged; bits; bits &= bits - 1) {
+        tube = (uint32_t)__builtin_ctzll(bits);
+        bin->feedingStarts[tube] += state->eating[tube];
+    }
+}
+
+void binnerAddEvent(ActivityBinner* binner, const EnvironmentEvent* event) {
+    // Before the first scan the event only sets the conditions the first bin starts with
+    if (binner->started) {
+        closeBins(binner, event->timeUs);
+    }
+    environmentApply(&binner->current.environment, event);
+}
+
+void binnerFlush(ActivityBinner* binner) {
+    if (binner->started && binner->current.scans > 0) {
+        binner->callback(&binner->current, binner->tubeCount, binner->context);
+        resetBin(binner, binner->current.endUs);
+    }
+}
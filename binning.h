@@ -0,0 +1,51 @@
+#ifndef BINNING_H
+#define BINNING_H
+
+#include <stdint.h> // Fixed-width integer types
+#include <stdbool.h> // Standard boolean library
+#include "scan_kernel.h" // ScanState, ScanDelta
+#include "environment.h" // Conditions of each bin
+
+// Constants
+#define BIN_POSITIONS 16 // Positions a 4-bit reading can take (0 = no beam interrupted)
+
+// Per-tube totals over one time bin
+typedef struct {
+    int64_t startUs;                                    // Bin start, a multiple of the bin length
+    int64_t endUs;                                      // Start of the next bin
+    uint32_t scans;                                     // Scans that fell in the bin (0 = no data)
+    uint32_t moves[SCAN_MAX_TUBES];                     // Position changes
+    uint32_t feedingStarts[SCAN_MAX_TUBES];             // Eating flag going from clear to set
+    uint32_t feedingScans[SCAN_MAX_TUBES];              // Scans with the eating flag set
+    uint32_t occupancy[SCAN_MAX_TUBES][BIN_POSITIONS];  // Scans spent at each position
+    uint32_t lightScans;                                // Scans taken with the lights on
+    EnvironmentState environment;                       // Conditions at the end of the bin
+} ActivityBin;
+
+// Called once for every bin that closes, including empty bins across gaps
+typedef void (*BinClosedCallback)(const ActivityBin* bin, uint32_t tubeCount, void* context);
+
+// Bins decoded scans of one monitor into fixed-length time bins
+typedef struct {
+    int64_t binUs;
+    uint32_t tubeCount;
+    bool started;
+    ActivityBin current;
+    BinClosedCallback callback;
+    void* context;
+} ActivityBinner;
+
+void binnerInit(ActivityBinner* binner, int64_t binUs, uint32_t tubeCount,
+                BinClosedCallback callback, void* context);
+
+// Adds one decoded scan, closing the current bin first if timeUs is past its end
+void binnerAddScan(ActivityBinner* binner, int64_t timeUs, const ScanState* state, ScanDelta delta);
+
+// Applies one environment event, closing the current bin first if timeUs is past its
+// end; events and scans come in time order
+void binnerAddEvent(ActivityBinner* binner, const EnvironmentEvent* event);
+
+// Closes the current bin even if it is not finished
+void binnerFlush(ActivityBinner* binner);
+
+#endif
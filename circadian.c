@@ -0,0 +1,278 @@
+#include "circadian.h"
+#include <stdlib.h> // calloc, free
+#include <string.h> // memset
+#include <math.h> // cos, sin, atan2, sqrt, log, pow
+#include <windows.h> // MemoryBarrier, YieldProcessor
+
+#define BIN_MINUTES (CIRCADIAN_BIN_US / 60000000LL)
+#define FIRST_CHI_BINS (CIRCADIAN_MIN_PERIOD_MIN / BIN_MINUTES)
+#define Z_ALPHA 2.3263 // Upper 1% point of the standard normal, goes with CIRCADIAN_ALPHA
+#define TWO_PI 6.283185307179586
+
+int circadianOpen(CircadianEngine* engine, uint32_t tubeCount) {
+    memset(engine, 0, sizeof(*engine));
+    engine->tubeCount = tubeCount > SCAN_MAX_TUBES ? SCAN_MAX_TUBES : tubeCount;
+    engine->currentIndex = -1;
+    engine->phaseSums = calloc((size_t)CIRCADIAN_CHI_PHASES * engine->tubeCount, sizeof(uint32_t));
+    engine->waveSums = calloc((size_t)CIRCADIAN_LS_PERIODS * 2 * engine->tubeCount, sizeof(double));
+    if (engine->phaseSums == NULL || engine->waveSums == NULL) {
+        circadianClose(engine);
+        return -1;
+    }
+    return 0;
+}
+
+void circadianClose(CircadianEngine* engine) {
+    free(engine->phaseSums);
+    free(engine->waveSums);
+    engine->phaseSums = NULL;
+    engine->waveSums = NULL;
+}
+
+static double lsPeriodHours(int period) {
+    return (CIRCADIAN_MIN_PERIOD_MIN + period * CIRCADIAN_LS_STEP_MIN) / 60.0;
+}
+
+// Adds the finished 30-minute bin to every sum
+static void addFullBin(CircadianEngine* engine) {
+    uint32_t tubeCount = engine->tubeCount;
+    const uint32_t* counts = engine->current;
+    uint32_t* phaseSums = engine->phaseSums;
+    double* waveSums = engine->waveSums;
+    double hours;
+    uint32_t offset = 0;
+    uint32_t tube;
+    int period;
+
+    if (engine->bins == 0) {
+        engine->firstIndex = engine->currentIndex;
+    }
+    engine->bins++;
+    for (tube = 0; tube < tubeCount; tube++) {
+        engine->sum[tube] += counts[tube];
+        engine->sumSquares[tube] += (double)counts[tube] * counts[tube];
+    }
+    if (!engine->currentUnknown && engine->currentLightScans == engine->currentScans) {
+        engine->lightBins++;
+        for (tube = 0; tube < tubeCount; tube++) {
+            engine->lightSum[tube] += counts[tube];
+        }
+    } else if (!engine->currentUnknown && engine->currentLightScans == 0) {
+        engine->darkBins++;
+        for (tube = 0; tube < tubeCount; tube++) {
+            engine->darkSum[tube] += counts[tube];
+        }
+    }
+
+    // Chi-square: the bin lands in one column of each period, numbered from the UTC epoch
+    for (period = 0; period < CIRCADIAN_CHI_PERIODS; period++) {
+        uint32_t length = FIRST_CHI_BINS + (uint32_t)period;
+        uint32_t phase = offset + (uint32_t)(engine->currentIndex % length);
+        uint32_t* column = phaseSums + (size_t)phase * tubeCount;
+
+        engine->phaseBins[phase]++;
+        for (tube = 0; tube < tubeCount; tube++) {
+            column[tube] += counts[tube];
+        }
+        offset += length;
+    }
+
+    // Lomb-Scargle: times in hours from the first bin keep the angles small
+    hours = (engine->currentIndex - engine->firstIndex + 0.5) * BIN_MINUTES / 60.0;
+    for (period = 0; period < CIRCADIAN_LS_PERIODS; period++) {
+        double angle = TWO_PI * hours / lsPeriodHours(period);
+        double c = cos(angle);
+        double s = sin(angle);
+        double* cosSums = waveSums + (size_t)period * 2 * tubeCount;
+        double* sinSums = cosSums + tubeCount;
+
+        engine->trig[period][0] += c;
+        engine->trig[period][1] += s;
+        engine->trig[period][2] += c * c;
+        engine->trig[period][3] += s * s;
+        engine->trig[period][4] += s * c;
+        for (tube = 0; tube < tubeCount; tube++) {
+            cosSums[tube] += counts[tube] * c;
+            sinSums[tube] += counts[tube] * s;
+        }
+    }
+}
+
+bool circadianAddBin(CircadianEngine* engine, const ActivityBin* bin) {
+    int64_t index = bin->startUs / CIRCADIAN_BIN_US;
+    bool added = false;
+    uint32_t tube;
+
+    if (index != engine->currentIndex) {
+        // Only a bin with scans all the way through says anything about its phase
+        if (engine->currentIndex >= 0 && engine->coveredUs >= CIRCADIAN_BIN_US) {
+            addFullBin(engine);
+            added = true;
+        }
+        engine->currentIndex = index;
+        engine->coveredUs = 0;
+        engine->currentScans = 0;
+        engine->currentLightScans = 0;
+        engine->currentUnknown = false;
+        memset(engine->current, 0, sizeof(engine->current));
+    }
+    if (bin->scans > 0) {
+        engine->coveredUs += bin->endUs - bin->startUs;
+        engine->currentScans += bin->scans;
+        engine->currentLightScans += bin->lightScans;
+        engine->currentUnknown |= (bin->environment.known & 1u << ENVIRONMENT_LIGHT) == 0;
+        for (tube = 0; tube < engine->tubeCount; tube++) {
+            engine->current[tube] += bin->moves[tube];
+        }
+    }
+    return added;
+}
+
+void circadianFlush(CircadianEngine* engine) {
+    if (engine->currentIndex >= 0 && engine->coveredUs >= CIRCADIAN_BIN_US) {
+        addFullBin(engine);
+    }
+    engine->currentIndex = -1;
+    engine->coveredUs = 0;
+    engine->currentScans = 0;
+    engine->currentLightScans = 0;
+    engine->currentUnknown = false;
+    memset(engine->current, 0, sizeof(engine->current));
+}
+
+// Chi-square with df degrees of freedom exceeded with probability CIRCADIAN_ALPHA (Wilson-Hilferty)
+static double chiSquareThreshold(int df) {
+    double v = 2.0 / (9.0 * df);
+
+    return df * pow(1.0 - v + Z_ALPHA * sqrt(v), 3.0);
+}
+
+static void computeTube(const CircadianEngine* engine, uint32_t tube, CircadianResult* result) {
+    double n = engine->bins;
+    double mean = engine->sum[tube] / n;
+    double squares = engine->sumSquares[tube] - engine->sum[tube] * mean;
+    double bestMargin = 0.0;
+    double lsThreshold;
+    uint32_t offset = 0;
+    int tested = 0;
+    int period;
+
+    memset(result, 0, sizeof(*result));
+    result->darkShare = NAN;
+    if (engine->lightBins > 0 && engine->darkBins > 0 &&
+        engine->lightSum[tube] + engine->darkSum[tube] > 0.0) {
+        double dark = engine->darkSum[tube] / engine->darkBins;
+
+        result->darkShare = (float)(dark / (dark + engine->lightSum[tube] / engine->lightBins));
+    }
+    if (squares <= 0.0) {
+        return;  // No activity, or the same in every bin
+    }
+
+    // Qp = N * sum(n_h * (M_h - M)^2) / sum((X_i - M)^2)
+    for (period = 0; period < CIRCADIAN_CHI_PERIODS; period++) {
+        uint32_t length = FIRST_CHI_BINS + (uint32_t)period;
+        double between = -engine->sum[tube] * mean;
+        double qp, threshold;
+        int columns = 0;
+        uint32_t h;
+
+        if (engine->bins < CIRCADIAN_MIN_CYCLES * length) {
+            break;
+        }
+        for (h = 0; h < length; h++) {
+            uint32_t phase = offset + h;
+
+            if (engine->phaseBins[phase] > 0) {
+                double columnSum = engine->phaseSums[(size_t)phase * engine->tubeCount + tube];
+
+                between += columnSum * columnSum / engine->phaseBins[phase];
+                columns++;
+            }
+        }
+        offset += length;
+        if (columns < 2) {
+            continue;
+        }
+        qp = n * between / squares;
+        threshold = chiSquareThreshold(columns - 1);
+        if (result->chiPeriodH == 0.0f || qp - threshold > bestMargin) {
+            bestMargin = qp - threshold;
+            result->chiPeriodH = (float)(length * BIN_MINUTES / 60.0);
+            result->chiQp = (float)qp;
+            result->chiThreshold = (float)threshold;
+        }
+    }
+
+    // Normalised power with the time offset tau that makes the fit independent of phase
+    for (period = 0; period < CIRCADIAN_LS_PERIODS; period++) {
+        const double* trig = engine->trig[period];
+        const double* cosSums = engine->waveSums + (size_t)period * 2 * engine->tubeCount;
+        double omegaTau, ct, st, c, s, yc, ys, cc, ss, power;
+
+        if (engine->bins * (BIN_MINUTES / 60.0) < CIRCADIAN_MIN_CYCLES * lsPeriodHours(period)) {
+            break;
+        }
+        tested++;
+        c = cosSums[tube] - mean * trig[0];
+        s = cosSums[engine->tubeCount + tube] - mean * trig[1];
+        omegaTau = 0.5 * atan2(2.0 * trig[4], trig[2] - trig[3]);
+        ct = cos(omegaTau);
+        st = sin(omegaTau);
+        yc = c * ct + s * st;
+        ys = s * ct - c * st;
+        cc = trig[2] * ct * ct + 2.0 * trig[4] * ct * st + trig[3] * st * st;
+        ss = trig[3] * ct * ct - 2.0 * trig[4] * ct * st + trig[2] * st * st;
+        if (cc <= 0.0 || ss <= 0.0) {
+            continue;
+        }
+        power = (yc * yc / cc + ys * ys / ss) / (2.0 * squares / (n - 1.0));
+        if (power > result->lsPower) {
+            result->lsPower = (float)power;
+            result->lsPeriodH = (float)lsPeriodHours(period);
+        }
+    }
+    if (tested > 0) {
+        lsThreshold = -log(1.0 - pow(1.0 - CIRCADIAN_ALPHA, 1.0 / tested));
+        result->lsThreshold = (float)lsThreshold;
+    }
+}
+
+void circadianPublish(CircadianEngine* engine) {
+    CircadianResult results[SCAN_MAX_TUBES];
+    uint32_t tube;
+
+    if (engine->bins < 2) {
+        return;
+    }
+    for (tube = 0; tube < engine->tubeCount; tube++) {
+        computeTube(engine, tube, &results[tube]);
+    }
+    engine->sequence++;
+    MemoryBarrier();
+    memcpy(engine->results, results, sizeof(CircadianResult) * engine->tubeCount);
+    engine->resultBins = engine->bins;
+    MemoryBarrier();
+    engine->sequence++;
+}
+
+uint32_t circadianSnapshot(const CircadianEngine* engine, CircadianResult results[SCAN_MAX_TUBES]) {
+    uint32_t before;
+    uint32_t bins;
+
+    // Retry until the copy was not torn by the writer
+    for (;;) {
+        before = engine->sequence;
+        if (before & 1) {
+            YieldProcessor();
+            continue;
+        }
+        MemoryBarrier();
+        memcpy(results, (const void*)engine->results, sizeof(engine->results));
+        bins = engine->resultBins;
+        MemoryBarrier();
+        if (engine->sequence == before) {
+            return bins;
+        }
+    }
+}
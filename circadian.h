@@ -0,0 +1,80 @@
+#ifndef CIRCADIAN_H
+#define CIRCADIAN_H
+
+#include <stdint.h> // Fixed-width integer types
+#include <stdbool.h> // Standard boolean library
+#include "binning.h" // ActivityBin, SCAN_MAX_TUBES
+
+// Constants
+#define CIRCADIAN_BIN_US 1800000000LL  // Activity is summed into 30-minute bins, aligned to UTC
+#define CIRCADIAN_MIN_PERIOD_MIN 960   // Periods tested, 16 to 32 hours
+#define CIRCADIAN_MAX_PERIOD_MIN 1920
+#define CIRCADIAN_CHI_PERIODS 33       // Chi-square: every whole number of bins, 32 to 64
+#define CIRCADIAN_CHI_PHASES 1584      // Columns of all of them together, 32 + 33 + ... + 64
+#define CIRCADIAN_LS_STEP_MIN 6        // Lomb-Scargle: every 0.1 hour
+#define CIRCADIAN_LS_PERIODS 161
+#define CIRCADIAN_MIN_CYCLES 2         // A period is only tested once the data covers it twice
+#define CIRCADIAN_ALPHA 0.01           // Significance level of both thresholds
+
+// Periodogram peaks of one tube; periods are 0 until enough data is in
+typedef struct {
+    float chiPeriodH;        // Sokolove-Bushell chi-square: period of the peak furthest above the threshold
+    float chiQp;             // Qp at that period
+    float chiThreshold;      // Qp that is significant at CIRCADIAN_ALPHA there
+    float lsPeriodH;         // Lomb-Scargle: period of the highest normalised power
+    float lsPower;
+    float lsThreshold;       // Power with a false alarm probability of CIRCADIAN_ALPHA
+    float darkShare;         // Mean activity of dark bins over that of dark and light bins, NAN until both
+} CircadianResult;
+
+// Periodograms of one monitor, kept as running sums so each closing bin adds to
+// them instead of the whole record being folded again. The chi-square sums hold
+// the activity of every phase of every period; the Lomb-Scargle sums hold the
+// activity times the cosine and sine of every frequency. Arrays are tube-minor,
+// so each bin is a few vectorisable loops over the tubes, whatever the length of
+// the record. Bins that are not fully covered by scans are left out. Activity is
+// also summed apart for bins spent wholly in the light and wholly in the dark.
+typedef struct {
+    uint32_t tubeCount;
+    int64_t currentIndex;        // 30-minute bin being summed, -1 before the first
+    int64_t coveredUs;           // Time of it with scans
+    uint32_t current[SCAN_MAX_TUBES];
+    uint32_t currentScans;       // Of it, and of those the ones with the lights on
+    uint32_t currentLightScans;
+    bool currentUnknown;         // Some of it had no light event yet
+    int64_t firstIndex;          // First bin used, the origin of the Lomb-Scargle times
+    uint32_t bins;               // Bins used
+    double sum[SCAN_MAX_TUBES];
+    double sumSquares[SCAN_MAX_TUBES];
+    uint32_t phaseBins[CIRCADIAN_CHI_PHASES];    // Bins that fell in each phase
+    uint32_t* phaseSums;                          // [phase][tube] activity
+    double trig[CIRCADIAN_LS_PERIODS][5];         // Sums of cos, sin, cos^2, sin^2, sin cos
+    double* waveSums;                             // [period][cos, sin][tube] activity times cos and sin
+    uint32_t lightBins;          // Bins with the lights on all through, and off all through
+    uint32_t darkBins;
+    double lightSum[SCAN_MAX_TUBES];
+    double darkSum[SCAN_MAX_TUBES];
+
+    volatile uint32_t sequence;  // Odd while circadianPublish writes results
+    uint32_t resultBins;         // Bins behind the results
+    CircadianResult results[SCAN_MAX_TUBES];
+} CircadianEngine;
+
+// Returns 0, or -1 if the sums cannot be allocated
+int circadianOpen(CircadianEngine* engine, uint32_t tubeCount);
+void circadianClose(CircadianEngine* engine);
+
+// Adds one activity bin (moves per tube) of a length that divides 30 minutes, in
+// time order and including empty bins. Returns true if a 30-minute bin was added.
+bool circadianAddBin(CircadianEngine* engine, const ActivityBin* bin);
+
+// Adds the 30-minute bin in progress if scans covered all of it, at the end of a record
+void circadianFlush(CircadianEngine* engine);
+
+// Recomputes the peaks of every tube from the sums and publishes them
+void circadianPublish(CircadianEngine* engine);
+
+// Copies the published peaks, safe from any thread; returns the bins behind them
+uint32_t circadianSnapshot(const CircadianEngine* engine, CircadianResult results[SCAN_MAX_TUBES]);
+
+#endif
@@ -0,0 +1,393 @@
+#include "config.h"
+#include <stdio.h> // fopen, fgets, snprintf
+#include <stdlib.h> // strtol, strtoul, strtof
+#include <string.h> // strcmp, strchr, memset
+#include <ctype.h> // isspace
+#include "scan_kernel.h" // SCAN_MAX_TUBES, SCAN_MAX_SAMPLES
+
+// Longest line in a configuration file
+#define CONFIG_LINE_BYTES 512
+
+// Section the parser is in
+typedef enum {
+    SECTION_NONE,
+    SECTION_OUTPUTS,
+    SECTION_ACQUISITION,
+    SECTION_MONITOR
+} ConfigSection;
+
+void configDefaultMonitor(MonitorConfig* monitor, uint32_t number) {
+    memset(monitor, 0, sizeof(*monitor));
+    monitor->number = number;
+    snprintf(monitor->device, sizeof(monitor->device), "Dev1");
+    monitor->tubeCount = 16;
+    monitor->oversample = 1;
+    monitor->spacingMm = LOCOMOTION_SPACING_MM;
+    monitor->faults.seed = number;
+    monitor->faults.glitchBelowTimebase = 0.0001f; // Simulated lines glitch below 0.1 ms
+}
+
+void configInit(AppConfig* config) {
+    memset(config, 0, sizeof(*config));
+    config->cpu = -1;
+    config->scanIntervalMs = CONFIG_SCAN_INTERVAL_MS;
+    config->archiveSyncMs = ARCHIVE_SYNC_MS;
+    config->archiveSegmentMiB = ARCHIVE_SEGMENT_MIB;
+    config->archivePyramid = true;
+    config->feedingStartMs = FEEDING_START_MS;
+    config->feedingEndMs = FEEDING_END_MS;
+    config->smoothingMs = LOCOMOTION_SMOOTH_MS;
+    config->deadHours = TUBE_HEALTH_DEAD_HOURS;
+    config->emptyHours = TUBE_HEALTH_EMPTY_HOURS;
+    config->synchronyWindowBins = SYNCHRONY_WINDOW_BINS;
+}
+
+// Trims whitespace at both ends in place
+static char* trim(char* text) {
+    char* end;
+
+    while (isspace((unsigned char)*text)) {
+        text++;
+    }
+    end = text + strlen(text);
+    while (end > text && isspace((unsigned char)end[-1])) {
+        *--end = '\0';
+    }
+    return text;
+}
+
+static int parseBool(const char* value, bool* result) {
+    if (strcmp(value, "yes") == 0 || strcmp(value, "true") == 0 || strcmp(value, "1") == 0) {
+        *result = true;
+        return 0;
+    }
+    if (strcmp(value, "no") == 0 || strcmp(value, "false") == 0 || strcmp(value, "0") == 0) {
+        *result = false;
+        return 0;
+    }
+    return -1;
+}
+
+static int parseInt(const char* value, long* result) {
+    char* end;
+
+    *result = strtol(value, &end, 10);
+    return end == value || *end != '\0' ? -1 : 0;
+}
+
+static int copyValue(char* target, size_t targetBytes, const char* value) {
+    if (strlen(value) >= targetBytes) {
+        return -1;
+    }
+    memcpy(target, value, strlen(value) + 1);
+    return 0;
+}
+
+static const char* setOutputKey(AppConfig* config, const char* key, const char* value) {
+    long number;
+
+    if (strcmp(key, "sync") == 0) {
+        if (parseInt(value, &number) || number < 0 || number > 3600000) {
+            return "sync must be 0 (never) to 3600000 ms";
+        }
+        config->archiveSyncMs = (uint32_t)number;
+        return NULL;
+    }
+    if (strcmp(key, "segment") == 0) {
+        if (parseInt(value, &number) || number < 0 || number > 4096) {
+            return "segment must be 0 (one file) to 4096 MiB";
+        }
+        config->archiveSegmentMiB = (uint32_t)number;
+        return NULL;
+    }
+    if (strcmp(key, "pyramid") == 0) {
+        return parseBool(value, &config->archivePyramid) ? "expected yes or no" : NULL;
+    }
+    if (strcmp(key, "dam") == 0) {
+        return copyValue(config->damDirectory, sizeof(config->damDirectory), value) ? "path too long" : NULL;
+    }
+    if (strcmp(key, "socket") == 0) {
+        return copyValue(config->socketPath, sizeof(config->socketPath), value) ? "path too long" : NULL;
+    }
+    return "unknown key";
+}
+
+static const char* setAcquisitionKey(AppConfig* config, const char* key, const char* value) {
+    long number;
+
+    if (strcmp(key, "cpu") == 0) {
+        if (parseInt(value, &number) || number < -1 || number > 63) {
+            return "cpu must be -1 or 0 to 63";
+        }
+        config->cpu = (int)number;
+        return NULL;
+    }
+    if (strcmp(key, "retune") == 0) {
+        return parseBool(value, &config->retune) ? "expected yes or no" : NULL;
+    }
+    if (strcmp(key, "interval") == 0) {
+        if (parseInt(value, &number) || number < 0 || number > 60000) {
+            return "interval must be 0 to 60000 ms";
+        }
+        config->scanIntervalMs = (int)number;
+        return NULL;
+    }
+    if (strcmp(key, "workers") == 0) {
+        if (parseInt(value, &number) || number < 0 || number > 64) {
+            return "workers must be 0 (one per CPU) to 64";
+        }
+        config->workerCount = (int)number;
+        return NULL;
+    }
+    if (strcmp(key, "debounce") == 0) {
+        char* comma;
+        char* end;
+        long endMs;
+
+        number = strtol(value, &comma, 10);
+        endMs = *comma == ',' ? strtol(comma + 1, &end, 10) : -1;
+        if (comma == value || *comma != ',' || end == comma + 1 || *end != '\0' ||
+            number < 0 || number > 60000 || endMs < 0 || endMs > 60000) {
+            return "debounce must be <start ms>,<end ms>, each 0 to 60000";
+        }
+        config->feedingStartMs = (uint32_t)number;
+        config->feedingEndMs = (uint32_t)endMs;
+        return NULL;
+    }
+    if (strcmp(key, "smoothing") == 0) {
+        if (parseInt(value, &number) || number < 0 || number > 60000) {
+            return "smoothing must be 0 to 60000 ms";
+        }
+        config->smoothingMs = (uint32_t)number;
+        return NULL;
+    }
+    if (strcmp(key, "dead") == 0 || strcmp(key, "empty") == 0) {
+        if (parseInt(value, &number) || number < 1 || number > 240) {
+            return "dead and empty must be 1 to 240 hours";
+        }
+        *(key[0] == 'd' ? &config->deadHours : &config->emptyHours) = (uint32_t)number;
+        return NULL;
+    }
+    if (strcmp(key, "window") == 0) {
+        if (parseInt(value, &number) || number < SYNCHRONY_MIN_BINS || number > SYNCHRONY_MAX_WINDOW_BINS) {
+            return "window must be 8 to 1024 minutes";
+        }
+        config->synchronyWindowBins = (uint32_t)number;
+        return NULL;
+    }
+    if (strcmp(key, "environment") == 0) {
+        return copyValue(config->environmentSource, sizeof(config->environmentSource), value) ? "path too long" : NULL;
+    }
+    return "unknown key";
+}
+
+static const char* setMonitorKey(MonitorConfig* monitor, const char* key, const char* value) {
+    long number;
+
+    if (strcmp(key, "device") == 0) {
+        return copyValue(monitor->device, sizeof(monitor->device), value) ? "device name too long" : NULL;
+    }
+    if (strcmp(key, "input") == 0) {
+        return copyValue(monitor->inputLines, sizeof(monitor->inputLines), value) ? "channel string too long" : NULL;
+    }
+    if (strcmp(key, "output") == 0) {
+        return copyValue(monitor->outputLines, sizeof(monitor->outputLines), value) ? "channel string too long" : NULL;
+    }
+    if (strcmp(key, "archive") == 0) {
+        return copyValue(monitor->archivePath, sizeof(monitor->archivePath), value) ? "path too long" : NULL;
+    }
+    if (strcmp(key, "tubes") == 0) {
+        if (parseInt(value, &number)) {
+            return "expected a number";
+        }
+        monitor->tubeCount = (int)number;
+        return NULL;
+    }
+    if (strcmp(key, "oversample") == 0) {
+        if (parseInt(value, &number)) {
+            return "expected a number";
+        }
+        monitor->oversample = (int)number;
+        return NULL;
+    }
+    if (strcmp(key, "reject") == 0) {
+        return parseBool(value, &monitor->rejectUnstable) ? "expected yes or no" : NULL;
+    }
+    if (strcmp(key, "timebase") == 0) {
+        char* end;
+
+        if (strcmp(value, "auto") == 0) {
+            monitor->timebase = 0.0f;
+            return NULL;
+        }
+        monitor->timebase = strtof(value, &end) / 1000.0f; // Written in milliseconds like the old menu
+        return end == value || *end != '\0' || monitor->timebase <= 0.0f ? "expected milliseconds or auto" : NULL;
+    }
+    if (strcmp(key, "spacing") == 0) {
+        char* end;
+
+        monitor->spacingMm = strtof(value, &end);
+        return end == value || *end != '\0' || monitor->spacingMm <= 0.0f ? "expected mm between beams" : NULL;
+    }
+    if (strcmp(key, "faults") == 0) {
+        char* comma;
+        char* end = NULL;
+        unsigned long scans;
+        unsigned long outageMs;
+
+        scans = strtoul(value, &comma, 10);
+        outageMs = *comma == ',' ? strtoul(comma + 1, &end, 10) : 0;
+        if (comma == value || *comma != ',' || end == comma + 1 || *end != '\0' ||
+            scans > UINT32_MAX || outageMs > UINT32_MAX) {
+            return "expected scans,ms";
+        }
+        monitor->faults.failEveryScans = (uint32_t)scans;
+        monitor->faults.outageMs = (uint32_t)outageMs;
+        return NULL;
+    }
+    if (strcmp(key, "seed") == 0) {
+        if (parseInt(value, &number)) {
+            return "expected a number";
+        }
+        monitor->faults.seed = (uint32_t)number;
+        return NULL;
+    }
+    return "unknown key";
+}
+
+int configLoad(AppConfig* config, const char* path, char error[CONFIG_ERROR_BYTES]) {
+    FILE* file = fopen(path, "r");
+    char line[CONFIG_LINE_BYTES];
+    ConfigSection section = SECTION_NONE;
+    MonitorConfig* monitor = NULL;
+    const char* problem = NULL;
+    int lineNumber = 0;
+
+    configInit(config);
+    copyValue(config->path, sizeof(config->path), path);
+    if (file == NULL) {
+        snprintf(error, CONFIG_ERROR_BYTES, "%s: cannot open", path);
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), file) != NULL) {
+        char* text = trim(line);
+        char* equals;
+
+        lineNumber++;
+        if (*text == '\0' || *text == ';' || *text == '#') {
+            continue;
+        }
+
+        if (*text == '[') {
+            char* close = strchr(text, ']');
+            long number;
+
+            if (close == NULL || close[1] != '\0') {
+                problem = "expected [section]";
+                goto Error;
+            }
+            *close = '\0';
+            text = trim(text + 1);
+            if (strcmp(text, "outputs") == 0) {
+                section = SECTION_OUTPUTS;
+            } else if (strcmp(text, "acquisition") == 0) {
+                section = SECTION_ACQUISITION;
+            } else if (strncmp(text, "monitor", 7) == 0 && parseInt(trim(text + 7), &number) == 0) {
+                if (number < 1 || number > CONFIG_MAX_MONITOR_NUMBER) {
+                    problem = "monitor number out of range";
+                    goto Error;
+                }
+                if (config->monitorCount == CONFIG_MAX_MONITORS) {
+                    problem = "too many monitors";
+                    goto Error;
+                }
+                monitor = &config->monitors[config->monitorCount++];
+                configDefaultMonitor(monitor, (uint32_t)number);
+                monitor->line = lineNumber;
+                section = SECTION_MONITOR;
+            } else {
+                problem = "unknown section";
+                goto Error;
+            }
+            continue;
+        }
+
+        equals = strchr(text, '=');
+        if (equals == NULL) {
+            problem = "expected key = value";
+            goto Error;
+        }
+        *equals = '\0';
+        switch (section) {
+            case SECTION_OUTPUTS:     problem = setOutputKey(config, trim(text), trim(equals + 1)); break;
+            case SECTION_ACQUISITION: problem = setAcquisitionKey(config, trim(text), trim(equals + 1)); break;
+            case SECTION_MONITOR:     problem = setMonitorKey(monitor, trim(text), trim(equals + 1)); break;
+            default:                  problem = "key outside a section"; break;
+        }
+        if (problem != NULL) {
+            goto Error;
+        }
+    }
+    fclose(file);
+
+    return configFinish(config, error);
+
+Error:
+    snprintf(error, CONFIG_ERROR_BYTES, "%s:%d: %s", path, lineNumber, problem);
+    fclose(file);
+    return -1;
+}
+
+int configFinish(AppConfig* config, char error[CONFIG_ERROR_BYTES]) {
+    // Monitor numbers are at most CONFIG_MAX_MONITOR_NUMBER, one bit each
+    uint64_t seen[(CONFIG_MAX_MONITOR_NUMBER + 64) / 64] = {0};
+    int i;
+    int j;
+
+    if (config->monitorCount == 0) {
+        snprintf(error, CONFIG_ERROR_BYTES, "no [monitor N] sections");
+        return -1;
+    }
+    for (i = 0; i < config->monitorCount; i++) {
+        MonitorConfig* monitor = &config->monitors[i];
+        const char* problem = NULL;
+
+        if (monitor->inputLines[0] == '\0') {
+            snprintf(monitor->inputLines, sizeof(monitor->inputLines), "%s/port0/line0:4", monitor->device);
+        }
+        if (monitor->outputLines[0] == '\0') {
+            snprintf(monitor->outputLines, sizeof(monitor->outputLines), "%s/port1/line0:1", monitor->device);
+        }
+
+        if (seen[monitor->number / 64] & (1ULL << (monitor->number % 64))) {
+            problem = "defined twice";
+        } else if (monitor->tubeCount < 1 || monitor->tubeCount > SCAN_MAX_TUBES) {
+            problem = "tubes must be 1 to 64";
+        } else if (monitor->oversample < 1 || monitor->oversample > SCAN_MAX_SAMPLES || monitor->oversample % 2 == 0) {
+            problem = "oversample must be 1, 3, 5 or 7";
+        } else if (monitor->timebase < 0.0f) {
+            problem = "timebase must be positive";
+        }
+        seen[monitor->number / 64] |= 1ULL << (monitor->number % 64);
+
+        // Two monitors cannot share a device, it would be clocked by both
+        for (j = 0; problem == NULL && j < i; j++) {
+            if (strcmp(monitor->device, CONFIG_SIM_DEVICE) != 0 &&
+                strcmp(monitor->device, config->monitors[j].device) == 0) {
+                problem = "device already used by another monitor";
+            }
+        }
+        if (problem != NULL) {
+            if (monitor->line > 0) {
+                snprintf(error, CONFIG_ERROR_BYTES, "%s:%d: monitor %u: %s", config->path, monitor->line,
+                         monitor->number, problem);
+            } else {
+                snprintf(error, CONFIG_ERROR_BYTES, "monitor %u: %s", monitor->number, problem);
+            }
+            return -1;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,91 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <stdint.h> // Fixed-width integer types
+#include <stdbool.h> // Standard boolean library
+#include "daq_device.h" // SimFaults
+#include "archive.h" // ARCHIVE_SYNC_MS, ARCHIVE_SEGMENT_MIB
+#include "feeding_bouts.h" // FEEDING_START_MS, FEEDING_END_MS
+#include "locomotion.h" // LOCOMOTION_SPACING_MM, LOCOMOTION_SMOOTH_MS
+#include "tube_health.h" // TUBE_HEALTH_DEAD_HOURS, TUBE_HEALTH_EMPTY_HOURS
+#include "synchrony.h" // SYNCHRONY_WINDOW_BINS
+
+// Constants
+#define CONFIG_FILE "monitors.ini"   // Loaded by program2.exe when no -c is given and it exists
+#define CONFIG_MAX_MONITORS 128      // [monitor N] sections per file, also LIVE_MAX_MONITORS
+#define CONFIG_MAX_MONITOR_NUMBER 511 // N in [monitor N], also the DAM MonitorN.txt number
+#define CONFIG_PATH_BYTES 260        // MAX_PATH
+#define CONFIG_ERROR_BYTES 256       // Room for one "file:line: message" error
+#define CONFIG_SIM_DEVICE "sim"      // device = sim selects the simulated monitor
+#define CONFIG_SCAN_INTERVAL_MS 100  // Default pause between two scans of a monitor
+
+// One [monitor N] section, validated by configLoad
+typedef struct {
+    uint32_t number;                 // N, the DAM monitor number
+    char device[32];                 // DAQmx device name, or CONFIG_SIM_DEVICE
+    char inputLines[64];             // P0.0-P0.4, configFinish defaults it to "<device>/port0/line0:4"
+    char outputLines[64];            // P1.0-P1.1, configFinish defaults it to "<device>/port1/line0:1"
+    int tubeCount;                   // 1 to SCAN_MAX_TUBES
+    float timebase;                  // Seconds, 0 = auto (saved value, else tuned)
+    int oversample;                  // Reads per tube, odd
+    bool rejectUnstable;             // Hold tubes whose reads disagree
+    char archivePath[CONFIG_PATH_BYTES]; // Empty = not archived
+    float spacingMm;                 // Distance between neighbouring beams
+    SimFaults faults;                // device = sim only
+    int line;                        // Line of the [monitor N] header, 0 if not from a file
+} MonitorConfig;
+
+// Whole configuration, as read from an INI file:
+//
+//   [outputs]            dam = <directory>, socket = <path>, sync = <ms> of the archives,
+//                        segment = <MiB> and pyramid = no
+//   [acquisition]        cpu = <n> pins the I/O threads, retune = yes,
+//                        interval = <ms> between scans, workers = <n> decode threads,
+//                        debounce = <start ms>,<end ms> of feeding bouts,
+//                        smoothing = <ms> a new position must hold to count as a step,
+//                        dead = <hours> and empty = <hours> before a tube is flagged,
+//                        window = <minutes> of the tube-to-tube correlations,
+//                        environment = stdin, sim or <file> of light and temperature events
+//   [monitor N]          device, input, output, tubes, timebase (ms or auto),
+//                        oversample, reject, archive, spacing = <mm> between beams,
+//                        faults = scans,ms, seed
+//
+// Blank lines and lines starting with ';' or '#' are ignored.
+typedef struct {
+    char path[CONFIG_PATH_BYTES];           // File it was loaded from, empty if built from the command line
+    char damDirectory[CONFIG_PATH_BYTES];   // Empty = no DAM files
+    char socketPath[CONFIG_PATH_BYTES];     // Empty = no stream server
+    uint32_t archiveSyncMs;                 // ArchiveOptions of every archive
+    uint32_t archiveSegmentMiB;
+    bool archivePyramid;
+    int cpu;                                // -1 = no pinning
+    bool retune;
+    int scanIntervalMs;                     // Pause after each scan of a monitor, 0 = none
+    int workerCount;                        // Decode workers, 0 = one per CPU
+    uint32_t feedingStartMs;                // Feeding bout debounce, see FeedingDetector
+    uint32_t feedingEndMs;
+    uint32_t smoothingMs;                   // Locomotion smoothing, see LocomotionTracker
+    uint32_t deadHours;                     // Dead and empty tube alerts, see HealthTracker
+    uint32_t emptyHours;
+    uint32_t synchronyWindowBins;           // Minutes of the correlations, see SynchronyEngine
+    char environmentSource[CONFIG_PATH_BYTES]; // Empty = no environment events, see EnvironmentChannel
+    MonitorConfig monitors[CONFIG_MAX_MONITORS];
+    int monitorCount;
+} AppConfig;
+
+// Fills in the defaults of one monitor (device Dev1, 16 tubes, auto timebase, 3 mm spacing)
+void configDefaultMonitor(MonitorConfig* monitor, uint32_t number);
+
+// Empty configuration, no monitors, no outputs
+void configInit(AppConfig* config);
+
+// Parses path into config and checks it as a whole. Returns 0, or -1 with a
+// "path:line: message" description in error.
+int configLoad(AppConfig* config, const char* path, char error[CONFIG_ERROR_BYTES]);
+
+// Fills in default channel strings and checks values and cross-monitor rules (unique
+// numbers and devices). configLoad calls it; configurations built from the command
+// line call it directly. Returns 0 or -1 with error set.
+int configFinish(AppConfig* config, char error[CONFIG_ERROR_BYTES]);
+
+#endif
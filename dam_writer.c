@@ -0,0 +1,275 @@
+#include "dam_writer.h"
+#include <stdlib.h> // malloc, free
+#include <string.h> // memset, memcpy, strlen
+#include <time.h> // localtime
+#include <process.h> // _beginthreadex
+
+// Longest formatted row: 10 fixed columns plus 32 counts of up to 10 digits
+#define DAM_MAX_ROW_BYTES 512
+
+static const char* monthNames[12] = {
+    "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"
+};
+
+static char* appendUnsigned(char* out, uint64_t value) {
+    char digits[20];
+    int n = 0;
+    do {
+        digits[n++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value);
+    while (n) {
+        *out++ = digits[--n];
+    }
+    return out;
+}
+
+static char* appendTwoDigits(char* out, int value) {
+    *out++ = (char)('0' + value / 10);
+    *out++ = (char)('0' + value % 10);
+    return out;
+}
+
+// "16 Oct 26\t14:03:00", in local time like DAMSystem
+static void formatStamp(DamWriter* writer, int64_t endUs) {
+    time_t seconds = (time_t)(endUs / 1000000);
+    struct tm* local = localtime(&seconds);
+    char* out = writer->cachedStamp;
+
+    if (local == NULL) {
+        writer->cachedStampLength = 0;
+        return;
+    }
+    out = appendUnsigned(out, (uint64_t)local->tm_mday);
+    *out++ = ' ';
+    memcpy(out, monthNames[local->tm_mon], 3);
+    out += 3;
+    *out++ = ' ';
+    out = appendTwoDigits(out, local->tm_year % 100);
+    *out++ = '\t';
+    out = appendTwoDigits(out, local->tm_hour);
+    *out++ = ':';
+    out = appendTwoDigits(out, local->tm_min);
+    *out++ = ':';
+    out = appendTwoDigits(out, local->tm_sec);
+
+    writer->cachedEndUs = endUs;
+    writer->cachedStampLength = (size_t)(out - writer->cachedStamp);
+}
+
+// Opens MonitorN.txt for appending, continuing its line numbering
+static int openMonitorFile(DamWriter* writer, uint32_t monitor) {
+    DamMonitorFile* monitorFile = &writer->monitors[monitor];
+    char path[300];
+    FILE* existing;
+    int c;
+
+    snprintf(path, sizeof(path), "%s\\Monitor%u.txt", writer->directory, monitor);
+
+    existing = fopen(path, "rb");
+    if (existing != NULL) {
+        while ((c = fgetc(existing)) != EOF) {
+            monitorFile->index += c == '\n';
+        }
+        fclose(existing);
+    }
+
+    monitorFile->buffer = malloc(DAM_BUFFER_BYTES);
+    monitorFile->file = fopen(path, "ab");
+    if (monitorFile->buffer == NULL || monitorFile->file == NULL) {
+        free(monitorFile->buffer);
+        monitorFile->buffer = NULL;
+        if (monitorFile->file != NULL) {
+            fclose(monitorFile->file);
+            monitorFile->file = NULL;
+        }
+        return -1;
+    }
+    setvbuf(monitorFile->file, NULL, _IONBF, 0); // Rows are already batched in buffer
+
+    return 0;
+}
+
+static void flushMonitorFile(DamMonitorFile* monitorFile) {
+    if (monitorFile->used > 0) {
+        fwrite(monitorFile->buffer, 1, monitorFile->used, monitorFile->file);
+        monitorFile->used = 0;
+    }
+}
+
+// Formats one row into its monitor's buffer
+static void formatRow(DamWriter* writer, const DamRow* row) {
+    DamMonitorFile* monitorFile = &writer->monitors[row->monitor];
+    char* out;
+    int channel;
+
+    if (monitorFile->file == NULL && openMonitorFile(writer, row->monitor) != 0) {
+        return;
+    }
+    if (monitorFile->used + DAM_MAX_ROW_BYTES > DAM_BUFFER_BYTES) {
+        flushMonitorFile(monitorFile);
+    }
+    if (row->endUs != writer->cachedEndUs) {
+        formatStamp(writer, row->endUs);
+    }
+
+    // index, date, time, status, readings, monitor, 0, data type, 0, light, 32 counts
+    out = monitorFile->buffer + monitorFile->used;
+    out = appendUnsigned(out, ++monitorFile->index);
+    *out++ = '\t';
+    memcpy(out, writer->cachedStamp, writer->cachedStampLength);
+    out += writer->cachedStampLength;
+    *out++ = '\t';
+    *out++ = row->scans > 0 ? '1' : '0'; // 0 marks a bin without data
+    *out++ = '\t';
+    out = appendUnsigned(out, row->scans);
+    *out++ = '\t';
+    out = appendUnsigned(out, row->monitor);
+    memcpy(out, "\t0\tMT\t0\t", 8);
+    out += 8;
+    *out++ = row->light ? '1' : '0';
+    for (channel = 0; channel < DAM_CHANNELS; channel++) {
+        *out++ = '\t';
+        out = appendUnsigned(out, row->counts[channel]);
+    }
+    *out++ = '\r';
+    *out++ = '\n';
+
+    monitorFile->used = (size_t)(out - monitorFile->buffer);
+}
+
+// Writer thread function - formats and writes queued rows in batches
+static unsigned int __stdcall damWriterThread(void* arg) {
+    DamWriter* writer = (DamWriter*)arg;
+    bool running = true;
+
+    while (running) {
+        DamRow* batch;
+        uint32_t count;
+        uint32_t i;
+
+        EnterCriticalSection(&writer->mutex);
+        if (writer->running && writer->queueCount < DAM_QUEUE_ROWS / 2) {
+            SleepConditionVariableCS(&writer->queueCond, &writer->mutex, DAM_FLUSH_INTERVAL_MS);
+        }
+        batch = writer->queue;
+        count = writer->queueCount;
+        writer->queue = writer->batch;
+        writer->batch = batch;
+        writer->queueCount = 0;
+        running = writer->running;
+        LeaveCriticalSection(&writer->mutex);
+
+        for (i = 0; i < count; i++) {
+            formatRow(writer, &batch[i]);
+        }
+        for (i = 0; i < DAM_MAX_MONITORS; i++) {
+            if (writer->monitors[i].file != NULL) {
+                flushMonitorFile(&writer->monitors[i]);
+            }
+        }
+
+        EnterCriticalSection(&writer->mutex);
+        writer->rowsWritten += count;
+        LeaveCriticalSection(&writer->mutex);
+    }
+
+    return 0;
+}
+
+int damWriterOpen(DamWriter* writer, const char* directory) {
+    memset(writer, 0, sizeof(*writer));
+    if (strlen(directory) >= sizeof(writer->directory)) {
+        return -1;
+    }
+    strcpy(writer->directory, directory);
+    writer->cachedEndUs = -1;
+
+    writer->queue = malloc(DAM_QUEUE_ROWS * sizeof(DamRow));
+    writer->batch = malloc(DAM_QUEUE_ROWS * sizeof(DamRow));
+    if (writer->queue == NULL || writer->batch == NULL) {
+        goto Error;
+    }
+
+    InitializeCriticalSection(&writer->mutex);
+    InitializeConditionVariable(&writer->queueCond);
+    writer->running = true;
+    writer->thread = (HANDLE)_beginthreadex(NULL, 0, damWriterThread, writer, 0, NULL);
+    if (writer->thread == 0) {
+        DeleteCriticalSection(&writer->mutex);
+        goto Error;
+    }
+
+    return 0;
+
+Error:
+    free(writer->queue);
+    free(writer->batch);
+    writer->queue = NULL;
+    writer->batch = NULL;
+    return -1;
+}
+
+void damWriterSubmit(DamWriter* writer, uint32_t monitor, const ActivityBin* bin, uint32_t tubeCount) {
+    DamRow* row;
+    uint32_t tube;
+
+    if (monitor == 0 || monitor >= DAM_MAX_MONITORS) {
+        return;
+    }
+    if (tubeCount > DAM_CHANNELS) {
+        tubeCount = DAM_CHANNELS;
+    }
+
+    EnterCriticalSection(&writer->mutex);
+    if (writer->queueCount == DAM_QUEUE_ROWS) {
+        writer->rowsDropped++;
+        LeaveCriticalSection(&writer->mutex);
+        return;
+    }
+    row = &writer->queue[writer->queueCount++];
+    row->endUs = bin->endUs;
+    row->monitor = monitor;
+    row->scans = bin->scans;
+    row->light = environmentLightOn(&bin->environment);
+    for (tube = 0; tube < tubeCount; tube++) {
+        row->counts[tube] = bin->moves[tube];
+    }
+    for (; tube < DAM_CHANNELS; tube++) {
+        row->counts[tube] = 0;
+    }
+    if (writer->queueCount == DAM_QUEUE_ROWS / 2) {
+        WakeConditionVariable(&writer->queueCond);
+    }
+    LeaveCriticalSection(&writer->mutex);
+}
+
+void damWriterClose(DamWriter* writer) {
+    int i;
+
+    if (writer->thread == NULL) {
+        return;
+    }
+
+    EnterCriticalSection(&writer->mutex);
+    writer->running = false;
+    WakeConditionVariable(&writer->queueCond);
+    LeaveCriticalSection(&writer->mutex);
+    WaitForSingleObject(writer->thread, INFINITE);
+    CloseHandle(writer->thread);
+    writer->thread = NULL;
+    DeleteCriticalSection(&writer->mutex);
+
+    for (i = 0; i < DAM_MAX_MONITORS; i++) {
+        if (writer->monitors[i].file != NULL) {
+            fclose(writer->monitors[i].file);
+            free(writer->monitors[i].buffer);
+            writer->monitors[i].file = NULL;
+            writer->monitors[i].buffer = NULL;
+        }
+    }
+    free(writer->queue);
+    free(writer->batch);
+    writer->queue = NULL;
+    writer->batch = NULL;
+}
@@ -0,0 +1,69 @@
+#ifndef DAM_WRITER_H
+#define DAM_WRITER_H
+
+#include <stdio.h> // FILE
+#include <stdint.h> // Fixed-width integer types
+#include <stdbool.h> // Standard boolean library
+#include <windows.h> // Threads, critical sections and condition variables
+#include "binning.h" // ActivityBin
+
+// Constants
+#define DAM_CHANNELS 32          // Count columns in a DAMSystem monitor file
+#define DAM_MAX_MONITORS 512     // Monitor numbers 1..DAM_MAX_MONITORS-1
+#define DAM_QUEUE_ROWS 4096      // Rows that can wait for the writer thread
+#define DAM_FLUSH_INTERVAL_MS 1000 // Longest a queued row waits before it is written
+#define DAM_BUFFER_BYTES 65536   // Formatted text kept per monitor before a write
+
+// One closed bin of one monitor, as queued by the acquisition side
+typedef struct {
+    int64_t endUs;               // DAMSystem stamps a reading at the end of its bin
+    uint32_t monitor;
+    uint32_t scans;
+    uint32_t light;              // Column 10, 1 if the lights were on at the end of the bin
+    uint32_t counts[DAM_CHANNELS];
+} DamRow;
+
+// Output file of one monitor, only touched by the writer thread
+typedef struct {
+    FILE* file;
+    uint64_t index;              // Running line number (column 1)
+    char* buffer;
+    size_t used;
+} DamMonitorFile;
+
+// Writes DAMSystem3-style MonitorN.txt files from binned activity.
+// Producers only copy a row into a queue under a short lock; formatting and
+// file I/O for every monitor run on one background thread in batches.
+typedef struct {
+    char directory[260];
+
+    DamRow* queue;               // Filled by producers
+    DamRow* batch;               // Drained by the writer thread
+    uint32_t queueCount;
+    uint64_t rowsDropped;        // Rows lost because the queue was full
+    uint64_t rowsWritten;
+
+    CRITICAL_SECTION mutex;
+    CONDITION_VARIABLE queueCond;
+    HANDLE thread;
+    volatile bool running;
+
+    DamMonitorFile monitors[DAM_MAX_MONITORS];
+
+    // Date and time columns of the last row formatted, rows of one bin share them.
+    // Writer thread only, two writers run side by side while a reload swaps them.
+    int64_t cachedEndUs;
+    char cachedStamp[32];
+    size_t cachedStampLength;
+} DamWriter;
+
+// Starts the writer thread, files are created in directory on first use
+int damWriterOpen(DamWriter* writer, const char* directory);
+
+// Queues one closed bin of monitor, moves per tube go to channels 1..tubeCount
+void damWriterSubmit(DamWriter* writer, uint32_t monitor, const ActivityBin* bin, uint32_t tubeCount);
+
+// Writes everything still queued and closes all files
+void damWriterClose(DamWriter* writer);
+
+#endif
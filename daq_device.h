@@ -0,0 +1,65 @@
+#ifndef DAQ_DEVICE_H
+#define DAQ_DEVICE_H
+
+#include <stdint.h> // Fixed-width integer types
+#include <stdbool.h> // Standard boolean library
+#include "scan_kernel.h" // ScanVoteStats, SCAN_MAX_SAMPLES
+
+// Constants
+#define DAQ_ERROR_SIM_LOST (-200000) // Returned by the simulator while an injected outage lasts
+#define SIM_MOVE_INTERVAL_MS 50      // Simulated flies never move faster than this
+
+// Faults injected by the simulated backend
+typedef struct {
+    uint32_t failEveryScans; // Device drops out after this many good scans (0 = never)
+    uint32_t outageMs;       // Opens fail for this long after each drop-out
+    uint32_t seed;           // Random fly behaviour
+    float glitchBelowTimebase; // Reads get corrupted at timebases shorter than this (0 = never)
+} SimFaults;
+
+// State of the NI USB-6501 backend
+typedef struct {
+    char inputLines[64];     // "Dev1/port0/line0:4"
+    char outputLines[64];    // "Dev1/port1/line0:1"
+    void* inputTask;         // TaskHandle for P0.0-P0.4
+    void* outputTask;        // TaskHandle for P1.0-P1.1
+} NiDeviceState;
+
+// State of the simulated backend
+typedef struct {
+    SimFaults faults;
+    uint32_t random;
+    uint64_t scansSinceFault;
+    uint64_t outageEndMs;    // GetTickCount64 time the current outage ends
+    uint64_t lastMoveMs;     // Flies move at most once per SIM_MOVE_INTERVAL_MS
+    uint8_t position[64];
+    uint8_t eating[64];
+} SimDeviceState;
+
+// One acquisition backend. open/readScan return 0 or a negative DAQmx-style error;
+// after a failed readScan the caller closes the device and opens it again.
+// readScan sets edgeTicks to the scanClockTicks() time of the scan's first clock edge.
+// With oversample > 1 each tube is read that many times while its data is valid and
+// packedScan holds the voteSamples result.
+typedef struct DaqDevice {
+    const char* name;
+    int oversample;          // Reads per tube, odd, 1 to SCAN_MAX_SAMPLES (init sets 1)
+    bool rejectUnstable;     // Hold tubes whose reads disagree instead of taking the majority
+    ScanVoteStats voteStats; // Accumulated by readScan while oversampling
+    int (*open)(struct DaqDevice* device);
+    int (*readScan)(struct DaqDevice* device, float timebase, uint8_t packedScan[], int tubeCount,
+                    uint64_t* edgeTicks);
+    void (*close)(struct DaqDevice* device);
+    union {
+        NiDeviceState ni;
+        SimDeviceState sim;
+    } state;
+} DaqDevice;
+
+// NI USB-6501 clocked by writing outputLines (P1.0-P1.1) and reading inputLines (P0.0-P0.4) for every tube
+void daqNiInit(DaqDevice* device, const char* inputLines, const char* outputLines);
+
+// Simulated monitor with random fly movement and the given faults
+void daqSimInit(DaqDevice* device, const SimFaults* faults);
+
+#endif
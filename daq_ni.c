@@ -0,0 +1,132 @@
+#include "daq_device.h"
+#include "include/NIDAQmx.h" // NI DAQ driver library
+#include <stdio.h> // snprintf
+#include <string.h> // memset, memcpy
+#include <windows.h> // Sleep
+#include "scan_kernel.h" // packPortLines, voteSamples
+#include "scan_clock.h" // scanClockTicks
+
+// Error checking macro
+#define DAQmxErrChk(functionCall) if( DAQmxFailed(error=(functionCall)) ) goto Error; else
+
+// Constants
+#define PORT0_LINE_COUNT 5  // P0.0 to P0.4 for data input
+#define PORT1_LINE_COUNT 2  // P1.0 (reset) and P1.1 (clock)
+
+static void niClose(DaqDevice* device) {
+    NiDeviceState* ni = &device->state.ni;
+
+    if (ni->inputTask != 0) {
+        DAQmxStopTask(ni->inputTask);
+        DAQmxClearTask(ni->inputTask);
+        ni->inputTask = 0;
+    }
+    if (ni->outputTask != 0) {
+        DAQmxStopTask(ni->outputTask);
+        DAQmxClearTask(ni->outputTask);
+        ni->outputTask = 0;
+    }
+}
+
+static int niOpen(DaqDevice* device) {
+    NiDeviceState* ni = &device->state.ni;
+    TaskHandle task;
+    int error = 0; // Error code to track errors
+
+    // Configure digital input (P0.0-P0.4)
+    DAQmxErrChk(DAQmxCreateTask("", &task));
+    ni->inputTask = task;
+    DAQmxErrChk(DAQmxCreateDIChan(ni->inputTask, ni->inputLines, "", DAQmx_Val_ChanForAllLines));
+
+    // Configure digital output (P1.0-P1.1)
+    DAQmxErrChk(DAQmxCreateTask("", &task));
+    ni->outputTask = task;
+    DAQmxErrChk(DAQmxCreateDOChan(ni->outputTask, ni->outputLines, "", DAQmx_Val_ChanForAllLines));
+
+    return 0;
+
+Error:
+    niClose(device);
+    return error;
+}
+
+static int niReadScan(DaqDevice* device, float timebase, uint8_t packedScan[], int tubeCount,
+                      uint64_t* edgeTicks) {
+    NiDeviceState* ni = &device->state.ni;
+    int error = 0; // Error code to track errors
+    unsigned char inputData[PORT0_LINE_COUNT]; // Buffer to store input data
+    unsigned char outputData[PORT1_LINE_COUNT]; // Buffer to store output data
+    uint8_t samples[SCAN_MAX_SAMPLES * SCAN_MAX_TUBES]; // Oversampled reads, one row per sample
+    int sampleCount = device->oversample > 1 ? device->oversample : 1;
+    int tubeCounter; // Counter for the number of tubes
+    int sample;
+
+    if (tubeCount > SCAN_MAX_TUBES) {
+        tubeCount = SCAN_MAX_TUBES;
+    }
+
+    // Step 1: Send reset pulse (P1.0 HIGH for 3Tb)
+    outputData[0] = 1;  // Reset high
+    outputData[1] = 0;  // Clock low
+    DAQmxErrChk(DAQmxWriteDigitalLines(ni->outputTask, 1, 1, timebase*3.0,
+                                      DAQmx_Val_GroupByChannel, outputData, NULL, NULL));
+
+    outputData[0] = 0;
+    DAQmxErrChk(DAQmxWriteDigitalLines(ni->outputTask, 1, 1, timebase,
+                                      DAQmx_Val_GroupByChannel, outputData, NULL, NULL));
+
+    // Main acquisition loop for all tubes
+    for(tubeCounter = 0; tubeCounter < tubeCount; tubeCounter++) {
+        // Step 2: Send clock pulse (P1.1 HIGH)
+        uint64_t beforeEdge = scanClockTicks();
+        outputData[1] = 1;
+        DAQmxErrChk(DAQmxWriteDigitalLines(ni->outputTask, 1, 1, timebase*2.5,
+                                          DAQmx_Val_GroupByChannel, outputData, NULL, NULL));
+        if (tubeCounter == 0) {
+            // The line changed somewhere inside the write, take the middle of it
+            uint64_t afterEdge = scanClockTicks();
+            *edgeTicks = beforeEdge + (afterEdge - beforeEdge) / 2;
+        }
+
+        // Step 4-5: Wait 1Tb and read data during 2Tb interval, back to back when oversampling
+        Sleep((DWORD)(timebase * 1000));
+        for (sample = 0; sample < sampleCount; sample++) {
+            DAQmxErrChk(DAQmxReadDigitalLines(ni->inputTask, 1, timebase*2.0,
+                                             DAQmx_Val_GroupByChannel, inputData,
+                                             PORT0_LINE_COUNT, NULL, NULL, NULL));
+
+            // Keep the read data for the whole-scan decode
+            samples[sample * tubeCount + tubeCounter] = packPortLines(inputData);
+        }
+
+        // Step 7: Wait 2Tb
+        Sleep((DWORD)(timebase * 2000));
+
+        // Clock low
+        outputData[1] = 0;
+        DAQmxErrChk(DAQmxWriteDigitalLines(ni->outputTask, 1, 1, timebase*2.5,
+                                          DAQmx_Val_GroupByChannel, outputData, NULL, NULL));
+    }
+
+    if (sampleCount == 1) {
+        memcpy(packedScan, samples, (size_t)tubeCount);
+    } else {
+        voteSamples(samples, sampleCount, tubeCount, device->rejectUnstable, packedScan, &device->voteStats);
+    }
+
+    return 0;
+
+Error:
+    return error;
+}
+
+void daqNiInit(DaqDevice* device, const char* inputLines, const char* outputLines) {
+    memset(device, 0, sizeof(*device));
+    device->name = "NI USB-6501";
+    device->oversample = 1;
+    device->open = niOpen;
+    device->readScan = niReadScan;
+    device->close = niClose;
+    snprintf(device->state.ni.inputLines, sizeof(device->state.ni.inputLines), "%s", inputLines);
+    snprintf(device->state.ni.outputLines, sizeof(device->state.ni.outputLines), "%s", outputLines);
+}
@@ -0,0 +1,99 @@
+#include "daq_device.h"
+#include <string.h> // memset, memcpy
+#include <windows.h> // GetTickCount64
+#include "scan_kernel.h" // PACKED_DV_BIT, voteSamples
+#include "scan_clock.h" // scanClockTicks
+
+static uint32_t nextRandom(SimDeviceState* sim) {
+    // xorshift32, good enough for fly behaviour
+    sim->random ^= sim->random << 13;
+    sim->random ^= sim->random >> 17;
+    sim->random ^= sim->random << 5;
+    return sim->random;
+}
+
+static int simOpen(DaqDevice* device) {
+    SimDeviceState* sim = &device->state.sim;
+
+    if (GetTickCount64() < sim->outageEndMs) {
+        return DAQ_ERROR_SIM_LOST;
+    }
+    sim->scansSinceFault = 0;
+    return 0;
+}
+
+static void simClose(DaqDevice* device) {
+}
+
+// One packed byte per tube as the monitor would send it: DV low with the
+// position, or DV high with zero data lines while feeding at position 1
+static int simReadScan(DaqDevice* device, float timebase, uint8_t packedScan[], int tubeCount,
+                       uint64_t* edgeTicks) {
+    SimDeviceState* sim = &device->state.sim;
+    uint64_t nowMs = GetTickCount64();
+    bool move = nowMs - sim->lastMoveMs >= SIM_MOVE_INTERVAL_MS;
+    bool glitchy = timebase < sim->faults.glitchBelowTimebase;
+    uint8_t samples[SCAN_MAX_SAMPLES * 64]; // One row per read of every tube
+    int sampleCount = device->oversample > 1 ? device->oversample : 1;
+    int tube;
+    int sample;
+
+    if (sim->faults.failEveryScans != 0 && sim->scansSinceFault >= sim->faults.failEveryScans) {
+        sim->outageEndMs = nowMs + sim->faults.outageMs;
+        return DAQ_ERROR_SIM_LOST;
+    }
+    sim->scansSinceFault++;
+    *edgeTicks = scanClockTicks();
+
+    if (move) {
+        sim->lastMoveMs = nowMs;
+    }
+
+    if (tubeCount > 64) {
+        tubeCount = 64;
+    }
+    for (tube = 0; tube < tubeCount; tube++) {
+        if (move) {
+            uint32_t roll = nextRandom(sim) % 100;
+
+            if (sim->eating[tube]) {
+                sim->eating[tube] = roll >= 10; // Feeding bouts last a few moves
+            } else if (sim->position[tube] == 1 && roll < 5) {
+                sim->eating[tube] = 1;
+            } else if (roll < 8) {
+                int step = (int)(nextRandom(sim) % 3) - 1;
+                int position = sim->position[tube] + step;
+                sim->position[tube] = (uint8_t)(position < 0 ? 0 : position > 15 ? 15 : position);
+            }
+        }
+        for (sample = 0; sample < sampleCount; sample++) {
+            uint8_t* read = &samples[sample * tubeCount + tube];
+
+            *read = sim->eating[tube] ? PACKED_DV_BIT : sim->position[tube];
+
+            // Lines sampled before they settled, independently for every read
+            if (glitchy && nextRandom(sim) % 100 < 5) {
+                *read = (uint8_t)(nextRandom(sim) & (PACKED_DV_BIT | PACKED_DATA_MASK));
+            }
+        }
+    }
+
+    if (sampleCount == 1) {
+        memcpy(packedScan, samples, (size_t)tubeCount);
+    } else {
+        voteSamples(samples, sampleCount, tubeCount, device->rejectUnstable, packedScan, &device->voteStats);
+    }
+
+    return 0;
+}
+
+void daqSimInit(DaqDevice* device, const SimFaults* faults) {
+    memset(device, 0, sizeof(*device));
+    device->name = "simulator";
+    device->oversample = 1;
+    device->open = simOpen;
+    device->readScan = simReadScan;
+    device->close = simClose;
+    device->state.sim.faults = *faults;
+    device->state.sim.random = faults->seed ? faults->seed : 1;
+}
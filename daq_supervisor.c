@@ -0,0 +1,80 @@
+#include "daq_supervisor.h"
+#include <string.h> // memset
+#include <windows.h> // Sleep
+#include "scan_clock.h" // Scan time stamps
+
+int supervisorOpen(DaqSupervisor* supervisor, DaqDevice* device) {
+    int error;
+
+    memset(supervisor, 0, sizeof(*supervisor));
+    supervisor->device = device;
+
+    error = device->open(device);
+    supervisor->connected = error == 0;
+    return error;
+}
+
+// Tries to reopen the lost device once, waiting longer after every failure
+static void reconnect(DaqSupervisor* supervisor) {
+    DaqDevice* device = supervisor->device;
+
+    supervisor->stats.reconnectAttempts++;
+    if (device->open(device) == 0) {
+        supervisor->retryDelayMs = 0;
+        supervisor->connected = true;
+        return;
+    }
+    supervisor->retryDelayMs = supervisor->retryDelayMs == 0 ? DAQ_RETRY_FIRST_MS :
+                               supervisor->retryDelayMs * 2 > DAQ_RETRY_MAX_MS ? DAQ_RETRY_MAX_MS :
+                               supervisor->retryDelayMs * 2;
+    Sleep(supervisor->retryDelayMs);
+}
+
+int supervisorScan(DaqSupervisor* supervisor, float timebase, uint8_t packedScan[], int tubeCount,
+                   int64_t* scanTimeUs, DaqGap* gap) {
+    DaqDevice* device = supervisor->device;
+    DaqGapStats* stats = &supervisor->stats;
+    uint64_t edgeTicks = 0;
+    int error;
+
+    if (!supervisor->connected) {
+        reconnect(supervisor);
+        return DAQ_SCAN_NONE;
+    }
+
+    error = device->readScan(device, timebase, packedScan, tubeCount, &edgeTicks);
+    if (error != 0) {
+        // Drop the tasks so the next call starts from scratch
+        device->close(device);
+        supervisor->connected = false;
+        supervisor->inGap = true;
+        stats->lastError = error;
+        return DAQ_SCAN_NONE;
+    }
+    *scanTimeUs = scanClockToUtcUs(edgeTicks);
+
+    if (supervisor->inGap && supervisor->lastScanUs != 0) {
+        supervisor->inGap = false;
+        gap->startUs = supervisor->lastScanUs;
+        gap->endUs = *scanTimeUs;
+        stats->gaps++;
+        stats->lastGapUs = gap->endUs - gap->startUs;
+        stats->totalGapUs += stats->lastGapUs;
+        if (stats->lastGapUs > stats->longestGapUs) {
+            stats->longestGapUs = stats->lastGapUs;
+        }
+        supervisor->lastScanUs = *scanTimeUs;
+        return DAQ_SCAN_RESUMED;
+    }
+
+    supervisor->inGap = false; // A loss before the first scan is not a gap in the data
+    supervisor->lastScanUs = *scanTimeUs;
+    return DAQ_SCAN_OK;
+}
+
+void supervisorClose(DaqSupervisor* supervisor) {
+    if (supervisor->device != NULL && supervisor->connected) {
+        supervisor->device->close(supervisor->device);
+    }
+    supervisor->connected = false;
+}
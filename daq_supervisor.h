@@ -0,0 +1,53 @@
+#ifndef DAQ_SUPERVISOR_H
+#define DAQ_SUPERVISOR_H
+
+#include <stdint.h> // Fixed-width integer types
+#include <stdbool.h> // Standard boolean library
+#include "daq_device.h" // Acquisition backends
+
+// Constants
+#define DAQ_RETRY_FIRST_MS 20    // Delay before the second reopen attempt (the first is immediate)
+#define DAQ_RETRY_MAX_MS 2000    // Longest delay between reopen attempts
+
+// Results of supervisorScan
+#define DAQ_SCAN_OK 0            // packedScan holds a scan
+#define DAQ_SCAN_RESUMED 1       // packedScan holds the first scan after a gap, gap is filled in
+#define DAQ_SCAN_NONE 2          // No scan was taken (device lost, or a reconnect attempt was made)
+
+// Time without scans, from the last scan before the loss to the first one after it
+typedef struct {
+    int64_t startUs;
+    int64_t endUs;
+} DaqGap;
+
+typedef struct {
+    uint64_t gaps;
+    uint64_t reconnectAttempts;
+    int64_t totalGapUs;
+    int64_t longestGapUs;
+    int64_t lastGapUs;
+    int lastError;               // Error that caused the last loss
+} DaqGapStats;
+
+// Keeps a device scanning: a failed scan closes it, and it is reopened with
+// exponential backoff until scans succeed again
+typedef struct {
+    DaqDevice* device;
+    bool connected;
+    bool inGap;
+    int64_t lastScanUs;          // First clock edge of the last good scan
+    uint32_t retryDelayMs;
+    DaqGapStats stats;
+} DaqSupervisor;
+
+// Opens device once, returns its error so a wrong setup fails at startup
+int supervisorOpen(DaqSupervisor* supervisor, DaqDevice* device);
+
+// Takes one scan and stamps it with the UTC time of its first clock edge,
+// or makes one reopen attempt if the device was lost
+int supervisorScan(DaqSupervisor* supervisor, float timebase, uint8_t packedScan[], int tubeCount,
+                   int64_t* scanTimeUs, DaqGap* gap);
+
+void supervisorClose(DaqSupervisor* supervisor);
+
+#endif
@@ -0,0 +1,264 @@
+#include "environment.h"
+#include <stdlib.h> // strtod, strtol
+#include <string.h> // memset, strcmp, strncpy
+#include <ctype.h> // isspace, tolower
+#include <process.h> // _beginthreadex
+#include "scan_clock.h" // Event times on the scan clock
+
+#define SIM_LIGHTS_ON_HOUR 7     // "sim": lights on 07:00 to 19:00 UTC, 25 C by day and 23 C by night
+#define SIM_LIGHTS_OFF_HOUR 19
+
+// Parses a decimal number into thousandths, returns 0 on success
+static int parseMilli(const char* text, int32_t* value) {
+    char* end;
+    double number = strtod(text, &end);
+
+    while (isspace((unsigned char)*end)) {
+        end++;
+    }
+    if (end == text || *end != '\0' || number < -2e6 || number > 2e6) {
+        return -1;
+    }
+    *value = (int32_t)(number * 1000.0 + (number < 0 ? -0.5 : 0.5));
+    return 0;
+}
+
+// Copies the first word of text in lower case, returns the text after it or NULL if too long
+static const char* takeWord(const char* text, char word[], size_t wordBytes) {
+    size_t length = 0;
+
+    while (isspace((unsigned char)*text)) {
+        text++;
+    }
+    while (text[length] != '\0' && !isspace((unsigned char)text[length])) {
+        if (length == wordBytes - 1) {
+            return NULL;
+        }
+        word[length] = (char)tolower((unsigned char)text[length]);
+        length++;
+    }
+    word[length] = '\0';
+    for (text += length; isspace((unsigned char)*text); text++) {
+    }
+    return text;
+}
+
+int environmentParse(const char* line, EnvironmentEvent* event) {
+    char word[16];
+    const char* value = takeWord(line, word, sizeof(word));
+
+    if (value == NULL) {
+        return -1;
+    }
+    memset(event, 0, sizeof(*event));
+    if (strcmp(word, "light") == 0 || strcmp(word, "lights") == 0) {
+        char state[4];
+        const char* rest = takeWord(value, state, sizeof(state));
+
+        event->kind = ENVIRONMENT_LIGHT;
+        if (rest == NULL || *rest != '\0') {
+            return -1;
+        }
+        event->value = strcmp(state, "on") == 0 || strcmp(state, "1") == 0;
+        return event->value || strcmp(state, "off") == 0 || strcmp(state, "0") == 0 ? 0 : -1;
+    }
+    if (strcmp(word, "temp") == 0 || strcmp(word, "temperature") == 0) {
+        event->kind = ENVIRONMENT_TEMPERATURE;
+        return parseMilli(value, &event->value);
+    }
+    if (strcmp(word, "humidity") == 0) {
+        event->kind = ENVIRONMENT_HUMIDITY;
+        return parseMilli(value, &event->value);
+    }
+    if (strcmp(word, "mark") == 0) {
+        char* end;
+        long number = strtol(value, &end, 10);
+
+        event->kind = ENVIRONMENT_MARK;
+        event->value = (int32_t)number;
+        return end != value && *end == '\0' ? 0 : -1;
+    }
+    return -1;
+}
+
+// Stamps event and hands it to the consumers, reader thread only
+static void publish(EnvironmentChannel* channel, EnvironmentEvent* event) {
+    uint64_t position = channel->published;
+
+    event->timeUs = scanClockToUtcUs(scanClockTicks());
+    channel->ring[position & (ENVIRONMENT_RING_EVENTS - 1)] = *event;
+    __atomic_store_n(&channel->published, position + 1, __ATOMIC_RELEASE);
+
+    channel->sequence++;
+    MemoryBarrier();
+    environmentApply(&channel->state, event);
+    MemoryBarrier();
+    channel->sequence++;
+}
+
+// One line of the source, comments and blank lines skipped
+static void readLine(EnvironmentChannel* channel, char* line) {
+    EnvironmentEvent event;
+    size_t length = strlen(line);
+
+    while (length > 0 && isspace((unsigned char)line[length - 1])) {
+        line[--length] = '\0';
+    }
+    line += strspn(line, " \t");
+    if (line[0] == '\0' || line[0] == '#' || line[0] == ';') {
+        return;
+    }
+    if (environmentParse(line, &event) != 0) {
+        channel->linesRejected++;
+        strncpy(channel->lastRejected, line, sizeof(channel->lastRejected) - 1);
+        return;
+    }
+    publish(channel, &event);
+}
+
+// Publishes the simulated lights and temperature whenever they change
+static void simulate(EnvironmentChannel* channel) {
+    int light = -1;
+
+    while (channel->running) {
+        int64_t hour = scanClockToUtcUs(scanClockTicks()) / 3600000000LL % 24;
+        int on = hour >= SIM_LIGHTS_ON_HOUR && hour < SIM_LIGHTS_OFF_HOUR;
+
+        if (on != light) {
+            EnvironmentEvent event;
+
+            memset(&event, 0, sizeof(event));
+            event.kind = ENVIRONMENT_LIGHT;
+            event.value = on;
+            publish(channel, &event);
+            event.kind = ENVIRONMENT_TEMPERATURE;
+            event.value = on ? 25000 : 23000;
+            publish(channel, &event);
+            light = on;
+        }
+        Sleep(ENVIRONMENT_POLL_MS);
+    }
+}
+
+// Reader thread function - turns the lines of the source into events
+static unsigned int __stdcall environmentThread(void* arg) {
+    EnvironmentChannel* channel = (EnvironmentChannel*)arg;
+    char line[ENVIRONMENT_LINE_BYTES];
+    size_t used = 0;
+
+    if (channel->file == NULL) {
+        simulate(channel);
+        return 0;
+    }
+    while (channel->running) {
+        // A followed file may end in the middle of a line that is still being written
+        if (fgets(line + used, (int)(sizeof(line) - used), channel->file) == NULL) {
+            if (channel->file == stdin) {
+                break;
+            }
+            clearerr(channel->file);
+            Sleep(ENVIRONMENT_POLL_MS);
+            continue;
+        }
+        used += strlen(line + used);
+        if (used > 0 && line[used - 1] != '\n' && used < sizeof(line) - 1) {
+            continue;
+        }
+        readLine(channel, line);
+        used = 0;
+    }
+    return 0;
+}
+
+int environmentOpen(EnvironmentChannel* channel, const char* source) {
+    memset(channel, 0, sizeof(*channel));
+    strncpy(channel->source, source, sizeof(channel->source) - 1);
+    if (strcmp(source, "stdin") == 0) {
+        channel->file = stdin;
+    } else if (strcmp(source, "sim") != 0) {
+        channel->file = fopen(source, "r");
+        if (channel->file == NULL || fseek(channel->file, 0, SEEK_END) != 0) {
+            if (channel->file != NULL) {
+                fclose(channel->file);
+            }
+            channel->file = NULL;
+            return -1;
+        }
+    }
+
+    channel->running = true;
+    channel->thread = (HANDLE)_beginthreadex(NULL, 0, environmentThread, channel, 0, NULL);
+    if (channel->thread == 0) {
+        channel->thread = NULL;
+        channel->running = false;
+        if (channel->file != NULL && channel->file != stdin) {
+            fclose(channel->file);
+        }
+        channel->file = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+void environmentClose(EnvironmentChannel* channel) {
+    if (channel->thread == NULL) {
+        return;
+    }
+    channel->running = false;
+    if (channel->file == stdin) {
+        CloseHandle(channel->thread);  // Blocked in fgets until the process ends
+    } else {
+        WaitForSingleObject(channel->thread, INFINITE);
+        CloseHandle(channel->thread);
+        if (channel->file != NULL) {
+            fclose(channel->file);
+        }
+    }
+    channel->thread = NULL;
+    channel->file = NULL;
+}
+
+bool environmentNext(const EnvironmentChannel* channel, EnvironmentCursor* cursor, int64_t timeUs,
+                     EnvironmentEvent* event) {
+    uint64_t published = __atomic_load_n(&channel->published, __ATOMIC_ACQUIRE);
+
+    while (cursor->position != published) {
+        // The slot published points at may be being overwritten, so a ring less one is safe
+        if (published - cursor->position >= ENVIRONMENT_RING_EVENTS) {
+            cursor->missed += published - cursor->position - (ENVIRONMENT_RING_EVENTS - 1);
+            cursor->position = published - (ENVIRONMENT_RING_EVENTS - 1);
+        }
+        *event = channel->ring[cursor->position & (ENVIRONMENT_RING_EVENTS - 1)];
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        published = __atomic_load_n(&channel->published, __ATOMIC_ACQUIRE);
+        if (published - cursor->position < ENVIRONMENT_RING_EVENTS) {
+            if (event->timeUs > timeUs) {
+                return false;  // Belongs after a later scan
+            }
+            cursor->position++;
+            return true;
+        }
+        // Overwritten while it was copied, the loop skips ahead
+    }
+    return false;
+}
+
+EnvironmentState environmentSnapshot(const EnvironmentChannel* channel) {
+    EnvironmentState state;
+    uint32_t before;
+
+    // Retry until the copy was not torn by the reader thread
+    for (;;) {
+        before = channel->sequence;
+        if (before & 1) {
+            YieldProcessor();
+            continue;
+        }
+        MemoryBarrier();
+        state = channel->state;
+        MemoryBarrier();
+        if (channel->sequence == before) {
+            return state;
+        }
+    }
+}
@@ -0,0 +1,94 @@
+#ifndef ENVIRONMENT_H
+#define ENVIRONMENT_H
+
+#include <stdio.h> // FILE
+#include <stdint.h> // Fixed-width integer types
+#include <stdbool.h> // Standard boolean library
+#include <windows.h> // Threads
+
+// Constants
+#define ENVIRONMENT_RING_EVENTS 1024     // Events kept for the monitors to merge, a power of two
+#define ENVIRONMENT_LINE_BYTES 256       // Longest line of an event source
+#define ENVIRONMENT_POLL_MS 200          // How often a followed file is checked for new lines
+#define ENVIRONMENT_LIGHT 0              // Kinds: lights, value 1 on or 0 off,
+#define ENVIRONMENT_TEMPERATURE 1        // temperature in thousandths of a degree Celsius,
+#define ENVIRONMENT_HUMIDITY 2           // relative humidity in thousandths of a percent,
+#define ENVIRONMENT_MARK 3               // or a condition number the experimenter chose
+#define ENVIRONMENT_KINDS 4
+
+// One change of the conditions, 16 bytes, stored as is in the archive
+typedef struct {
+    int64_t timeUs;          // UTC time on the scan clock, when the event was read
+    uint16_t kind;           // ENVIRONMENT_*
+    uint16_t reserved;
+    int32_t value;
+} EnvironmentEvent;
+
+// Conditions at one moment, built by applying events in order
+typedef struct {
+    int32_t values[ENVIRONMENT_KINDS];
+    uint32_t known;          // Bit (1 << kind) once an event of that kind was applied
+} EnvironmentState;
+
+// Read position of one consumer, e.g. a monitor's decode side
+typedef struct {
+    uint64_t position;       // Next event to take
+    uint64_t missed;         // Overwritten before they were taken
+} EnvironmentCursor;
+
+// External conditions as a stream of events next to the scans. A background thread
+// reads lines such as "light on", "temp 25.3", "humidity 61" or "mark 2" from stdin
+// or from a file it follows like tail -f, or simulates lights on 07:00-19:00 UTC
+// ("sim"), and stamps each event with the scan clock. Events go into a ring that
+// every consumer reads with its own cursor: one writer, no locks, nothing
+// allocated, and a consumer that falls more than a ring behind loses the oldest.
+typedef struct {
+    char source[260];        // "stdin", "sim" or a file path
+    EnvironmentEvent ring[ENVIRONMENT_RING_EVENTS];
+    volatile uint64_t published;  // Events written so far
+    EnvironmentState state;  // After the last published event, for the display
+    volatile uint32_t sequence;   // Odd while state is written
+    uint64_t linesRejected;  // Lines that are not an event
+    char lastRejected[ENVIRONMENT_LINE_BYTES];
+    FILE* file;              // stdin or the followed file, NULL for sim
+    HANDLE thread;
+    volatile bool running;
+} EnvironmentChannel;
+
+// Starts reading source; a file is followed from its current end. Returns 0, or -1
+// if the file cannot be opened or the thread cannot start.
+int environmentOpen(EnvironmentChannel* channel, const char* source);
+
+// Stops the thread. A thread blocked on stdin is left to end with the process.
+void environmentClose(EnvironmentChannel* channel);
+
+// Parses one source line into event (time not set); returns 0, or -1 if it is not an event
+int environmentParse(const char* line, EnvironmentEvent* event);
+
+// Takes the next event at or before timeUs, returns false if there is none yet
+bool environmentNext(const EnvironmentChannel* channel, EnvironmentCursor* cursor, int64_t timeUs,
+                     EnvironmentEvent* event);
+
+// Copies the conditions after the last event, safe from any thread
+EnvironmentState environmentSnapshot(const EnvironmentChannel* channel);
+
+static inline void environmentApply(EnvironmentState* state, const EnvironmentEvent* event) {
+    if (event->kind < ENVIRONMENT_KINDS) {
+        state->values[event->kind] = event->value;
+        state->known |= 1u << event->kind;
+    }
+}
+
+// True if the state has the lights on; unknown counts as off
+static inline bool environmentLightOn(const EnvironmentState* state) {
+    return (state->known & 1u << ENVIRONMENT_LIGHT) != 0 && state->values[ENVIRONMENT_LIGHT] != 0;
+}
+
+// "light", "temp", "humidity" or "mark"
+static inline const char* environmentKindName(uint32_t kind) {
+    static const char* const names[ENVIRONMENT_KINDS] = {"light", "temp", "humidity", "mark"};
+
+    return kind < ENVIRONMENT_KINDS ? names[kind] : "?";
+}
+
+#endif
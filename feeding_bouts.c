@@ -0,0 +1,104 @@
+#include "feeding_bouts.h"
+#include <string.h> // memset
+
+void feedingInit(FeedingDetector* detector, uint32_t tubeCount, uint32_t startMs, uint32_t endMs) {
+    memset(detector, 0, sizeof(*detector));
+    detector->tubeCount = tubeCount > SCAN_MAX_TUBES ? SCAN_MAX_TUBES : tubeCount;
+    detector->startDebounceUs = (int64_t)startMs * 1000;
+    detector->endDebounceUs = (int64_t)endMs * 1000;
+}
+
+uint64_t feedingSeen(const uint8_t packed[], const ScanState* state, int tubeCount, uint64_t previous) {
+    uint64_t seen = 0;
+    int i;
+
+    // Same condition decodeScan sets the eating flag on, but taken afresh every scan
+    for (i = 0; i < tubeCount; i++) {
+        uint8_t read = packed[i];
+        uint64_t feeding = read == PACKED_HOLD ? previous >> i & 1 :
+                           (uint64_t)(read == PACKED_DV_BIT && state->position[i] == 1);
+
+        seen |= feeding << i;
+    }
+    return seen;
+}
+
+static void endBout(FeedingDetector* detector, uint32_t tube, int64_t endUs) {
+    int64_t lengthUs = endUs - detector->boutStartUs[tube];
+
+    if (lengthUs < 0) {
+        lengthUs = 0;
+    }
+    detector->bouts[tube]++;
+    detector->boutUs[tube] += (uint64_t)lengthUs;
+    if (lengthUs > detector->longestUs[tube]) {
+        detector->longestUs[tube] = lengthUs;
+    }
+    detector->boutEndUs[tube] = endUs;
+    detector->feeding &= ~(1ull << tube);
+}
+
+FeedingDelta feedingScan(FeedingDetector* detector, int64_t timeUs, uint64_t seen) {
+    FeedingDelta delta = {0, 0, 0};
+    uint64_t mask = detector->tubeCount == 64 ? ~0ull : (1ull << detector->tubeCount) - 1;
+    uint64_t changed;
+    uint64_t bits;
+
+    seen &= mask;
+    changed = seen ^ detector->seen;
+    for (bits = changed; bits; bits &= bits - 1) {
+        detector->changedUs[__builtin_ctzll(bits)] = timeUs;
+    }
+    detector->seen = seen;
+    detector->pending |= changed;
+    detector->latestUs = timeUs;
+
+    // Only tubes still inside a debounce window
+    for (bits = detector->pending; bits; bits &= bits - 1) {
+        uint32_t tube = (uint32_t)__builtin_ctzll(bits);
+        uint64_t bit = 1ull << tube;
+        int64_t elapsedUs = timeUs - detector->changedUs[tube];
+
+        if (seen & bit) {
+            if (detector->feeding & bit) {
+                detector->pending &= ~bit;  // Back before the bout timed out
+            } else if (elapsedUs >= detector->startDebounceUs) {
+                detector->feeding |= bit;
+                detector->pending &= ~bit;
+                detector->boutStartUs[tube] = detector->changedUs[tube];
+                delta.started |= bit;
+            }
+        } else {
+            if (!(detector->feeding & bit)) {
+                detector->pending &= ~bit;  // Too short to start a bout
+            } else if (elapsedUs >= detector->endDebounceUs) {
+                endBout(detector, tube, detector->changedUs[tube]);
+                detector->pending &= ~bit;
+                delta.ended |= bit;
+            }
+        }
+    }
+    return delta;
+}
+
+FeedingDelta feedingGap(FeedingDetector* detector, int64_t startUs) {
+    FeedingDelta delta = {0, 0, 0};
+    uint64_t bits;
+
+    for (bits = detector->feeding; bits; bits &= bits - 1) {
+        uint32_t tube = (uint32_t)__builtin_ctzll(bits);
+        uint64_t bit = 1ull << tube;
+
+        // A bout already missing its fly ended when the fly was last missed
+        if (detector->seen & bit) {
+            endBout(detector, tube, startUs);
+            delta.cutByGap |= bit;
+        } else {
+            endBout(detector, tube, detector->changedUs[tube]);
+        }
+        delta.ended |= bit;
+    }
+    detector->seen = 0;
+    detector->pending = 0;
+    return delta;
+}
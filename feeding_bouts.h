@@ -0,0 +1,54 @@
+#ifndef FEEDING_BOUTS_H
+#define FEEDING_BOUTS_H
+
+#include <stdint.h> // Fixed-width integer types
+#include <stdbool.h> // Standard boolean library
+#include "scan_kernel.h" // ScanState, SCAN_MAX_TUBES
+
+// Constants
+#define FEEDING_START_MS 200         // Default: feeding must be seen this long before a bout starts
+#define FEEDING_END_MS 1000          // Default: and missed this long before it ends
+
+// Tubes whose bout started or ended in one scan, bit i is tube i
+typedef struct {
+    uint64_t started;
+    uint64_t ended;
+    uint64_t cutByGap;       // Of ended, bouts closed because acquisition stopped
+} FeedingDelta;
+
+// Debounced feeding bouts of one monitor. The input of every scan is the set of
+// tubes showing feeding (DV high, data lines 0, fly at position 1). A bout starts
+// once feeding has been seen for startDebounceUs and ends once it has been missing
+// for endDebounceUs; shorter breaks belong to the bout. Times are those of the first scan
+// that showed the change, so the debounce delays the report, not the bout.
+// Only tubes whose input changed within the debounce time are looked at.
+typedef struct {
+    int64_t startDebounceUs;
+    int64_t endDebounceUs;
+    uint32_t tubeCount;
+    uint64_t seen;                   // Tubes showing feeding in the latest scan
+    uint64_t pending;                // Tubes whose input changed less than the debounce ago
+    uint64_t feeding;                // Tubes in a bout
+    int64_t latestUs;                // Latest scan
+    int64_t changedUs[SCAN_MAX_TUBES];   // First scan of the current input
+    int64_t boutStartUs[SCAN_MAX_TUBES]; // Start of the bout in progress or of the last one
+    int64_t boutEndUs[SCAN_MAX_TUBES];   // End of the last finished bout
+    uint32_t bouts[SCAN_MAX_TUBES];      // Finished bouts
+    uint64_t boutUs[SCAN_MAX_TUBES];     // Their total length
+    int64_t longestUs[SCAN_MAX_TUBES];
+} FeedingDetector;
+
+void feedingInit(FeedingDetector* detector, uint32_t tubeCount, uint32_t startMs, uint32_t endMs);
+
+// Tubes showing feeding in one scan. state is the decoder state after the scan;
+// a tube held by oversampling (PACKED_HOLD) keeps its bit from previous.
+uint64_t feedingSeen(const uint8_t packed[], const ScanState* state, int tubeCount, uint64_t previous);
+
+// Advances every tube to timeUs given the tubes showing feeding in that scan
+FeedingDelta feedingScan(FeedingDetector* detector, int64_t timeUs, uint64_t seen);
+
+// Acquisition stopped after the scan at startUs: bouts in progress end there,
+// and tubes only count as feeding again once seen for the start debounce after it
+FeedingDelta feedingGap(FeedingDetector* detector, int64_t startUs);
+
+#endif
@@ -0,0 +1,68 @@
+#include "latency.h"
+#include <stdio.h> // printf, snprintf
+
+// Bucket bounds in the most readable unit
+static void formatNs(uint64_t ns, char* text, size_t size) {
+    if (ns < 10000) {
+        snprintf(text, size, "%llu ns", (unsigned long long)ns);
+    } else if (ns < 10000000) {
+        snprintf(text, size, "%.1f us", ns / 1e3);
+    } else {
+        snprintf(text, size, "%.1f ms", ns / 1e6);
+    }
+}
+
+uint64_t latencyPercentile(const LatencyHistogram* histogram, double percentile) {
+    uint64_t target = (uint64_t)(histogram->samples * percentile / 100.0);
+    uint64_t seen = 0;
+    int bucket;
+
+    if (histogram->samples == 0) {
+        return 0;
+    }
+    for (bucket = 0; bucket < LATENCY_BUCKETS; bucket++) {
+        seen += histogram->counts[bucket];
+        if (seen > target || seen == histogram->samples) {
+            break;
+        }
+    }
+    if (bucket >= LATENCY_BUCKETS - 1) {
+        return histogram->maxNs;
+    }
+    // The maximum is exact, a bucket bound above it would only overstate
+    return ((uint64_t)1 << bucket) - 1 < histogram->maxNs ? ((uint64_t)1 << bucket) - 1 : histogram->maxNs;
+}
+
+void latencyPrint(const LatencyHistogram* histogram, const char* title) {
+    uint64_t largest = 0;
+    char low[16], high[16], p50[16], p99[16], p999[16], max[16], mean[16];
+    int bucket;
+
+    printf("%s: %llu samples\n", title, (unsigned long long)histogram->samples);
+    if (histogram->samples == 0) {
+        return;
+    }
+    for (bucket = 0; bucket < LATENCY_BUCKETS; bucket++) {
+        if (histogram->counts[bucket] > largest) {
+            largest = histogram->counts[bucket];
+        }
+    }
+    for (bucket = 0; bucket < LATENCY_BUCKETS; bucket++) {
+        int width;
+
+        if (histogram->counts[bucket] == 0) {
+            continue;
+        }
+        formatNs(bucket == 0 ? 0 : (uint64_t)1 << (bucket - 1), low, sizeof(low));
+        formatNs(((uint64_t)1 << bucket) - 1, high, sizeof(high));
+        width = (int)(histogram->counts[bucket] * 40 / largest);
+        printf("  %10s - %-10s %12llu %.*s\n", low, high, (unsigned long long)histogram->counts[bucket],
+               width > 0 ? width : 1, "########################################");
+    }
+    formatNs(latencyPercentile(histogram, 50.0), p50, sizeof(p50));
+    formatNs(latencyPercentile(histogram, 99.0), p99, sizeof(p99));
+    formatNs(latencyPercentile(histogram, 99.9), p999, sizeof(p999));
+    formatNs(histogram->maxNs, max, sizeof(max));
+    formatNs(histogram->totalNs / histogram->samples, mean, sizeof(mean));
+    printf("  p50 %s, p99 %s, p99.9 %s, max %s, mean %s\n", p50, p99, p999, max, mean);
+}
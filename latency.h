@@ -0,0 +1,38 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <stdint.h> // Fixed-width integer types
+
+// Constants
+#define LATENCY_BUCKETS 40           // Bucket i holds samples of 2^(i-1) to 2^i - 1 ns, up to ~9 minutes
+
+// Power-of-two latency histogram. Recording is a few instructions and never
+// allocates; one thread records, others read it once recording has stopped.
+typedef struct {
+    uint64_t counts[LATENCY_BUCKETS];
+    uint64_t samples;
+    uint64_t totalNs;
+    uint64_t maxNs;
+} LatencyHistogram;
+
+static inline void latencyRecord(LatencyHistogram* histogram, uint64_t ns) {
+    int bucket = ns == 0 ? 0 : 64 - __builtin_clzll(ns);
+
+    if (bucket >= LATENCY_BUCKETS) {
+        bucket = LATENCY_BUCKETS - 1;
+    }
+    histogram->counts[bucket]++;
+    histogram->samples++;
+    histogram->totalNs += ns;
+    if (ns > histogram->maxNs) {
+        histogram->maxNs = ns;
+    }
+}
+
+// Upper bound of the bucket holding the given percentile (0-100), in ns; 0 without samples
+uint64_t latencyPercentile(const LatencyHistogram* histogram, double percentile);
+
+// Prints one line per non-empty bucket with a bar, then the percentiles
+void latencyPrint(const LatencyHistogram* histogram, const char* title);
+
+#endif
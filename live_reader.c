@@ -0,0 +1,116 @@
+#include "live_reader.h"
+#include <string.h> // memset, memcpy, memcmp
+
+int liveReaderOpen(LiveReader* reader, const char* name) {
+    memset(reader, 0, sizeof(*reader));
+
+    reader->mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, name);
+    if (reader->mapping == NULL) {
+        return -1;
+    }
+    reader->layout = MapViewOfFile(reader->mapping, FILE_MAP_READ, 0, 0, 0);
+    if (reader->layout == NULL) {
+        goto Error;
+    }
+    if (memcmp(reader->layout->magic, LIVE_SHARE_MAGIC, sizeof(LIVE_SHARE_MAGIC)) != 0 ||
+        reader->layout->version != LIVE_SHARE_VERSION ||
+        reader->layout->headerBytes != sizeof(LiveShareLayout) ||
+        reader->layout->ringScans != LIVE_RING_SCANS) {
+        goto Error;
+    }
+
+    // Start at the oldest scan still in the ring
+    reader->cursor = (uint64_t)reader->layout->scansPublished;
+    reader->cursor = reader->cursor > LIVE_RING_SCANS ? reader->cursor - LIVE_RING_SCANS : 0;
+
+    return 0;
+
+Error:
+    liveReaderClose(reader);
+    return -1;
+}
+
+void liveReaderClose(LiveReader* reader) {
+    if (reader->layout != NULL) {
+        UnmapViewOfFile(reader->layout);
+    }
+    if (reader->mapping != NULL) {
+        CloseHandle(reader->mapping);
+    }
+    reader->layout = NULL;
+    reader->mapping = NULL;
+}
+
+int liveReadSnapshot(const LiveReader* reader, uint32_t monitor, LiveMonitorSnapshot* snapshot) {
+    const LiveMonitorSnapshot* slot;
+    uint32_t before;
+    int attempt;
+
+    if (monitor >= LIVE_MAX_MONITORS) {
+        return -1;
+    }
+    slot = &reader->layout->monitors[monitor];
+
+    // Retry until the copy was not torn by the publisher. A publisher that died
+    // mid-write leaves the sequence odd for good, so give up after a while.
+    for (attempt = 0; ; attempt++) {
+        if (attempt == LIVE_READ_SPINS + LIVE_READ_WAIT_MS) {
+            return -1;
+        }
+        if (attempt >= LIVE_READ_SPINS) {
+            Sleep(1); // The publisher may have been preempted inside its write
+        }
+        before = slot->sequence;
+        if (before & 1) {
+            YieldProcessor();
+            continue;
+        }
+        MemoryBarrier();
+        memcpy(snapshot, (const void*)slot, sizeof(*snapshot));
+        MemoryBarrier();
+        if (slot->sequence == before) {
+            break;
+        }
+    }
+
+    return snapshot->tubeCount == 0 ? -1 : 0;
+}
+
+int liveReadScans(LiveReader* reader, LiveScanRecord records[], int maxRecords) {
+    const LiveShareLayout* layout = reader->layout;
+    uint64_t published = (uint64_t)layout->scansPublished;
+    int count = 0;
+
+    MemoryBarrier();
+    if (published < reader->cursor) {
+        reader->cursor = 0; // The program restarted and reset the segment
+    }
+    if (published - reader->cursor > LIVE_RING_SCANS) {
+        reader->scansMissed += published - reader->cursor - LIVE_RING_SCANS;
+        reader->cursor = published - LIVE_RING_SCANS;
+    }
+
+    while (reader->cursor < published && count < maxRecords) {
+        const LiveScanRecord* record = &layout->ring[reader->cursor & (LIVE_RING_SCANS - 1)];
+        uint64_t expected = 2 * reader->cursor + 2;
+
+        if (record->sequence != expected) {
+            // Overwritten while we were behind, the next scan may still be intact
+            reader->scansMissed++;
+            reader->cursor++;
+            continue;
+        }
+        MemoryBarrier();
+        memcpy(&records[count], (const void*)record, sizeof(*record));
+        MemoryBarrier();
+        if (record->sequence != expected) {
+            reader->scansMissed++;
+            reader->cursor++;
+            continue;
+        }
+        count++;
+        reader->cursor++;
+    }
+
+    return count;
+}
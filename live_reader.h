@@ -0,0 +1,35 @@
+#ifndef LIVE_READER_H
+#define LIVE_READER_H
+
+#include <stdint.h> // Fixed-width integer types
+#include <windows.h> // Named file mapping
+#include "live_share.h" // Shared segment layout
+
+// Constants
+#define LIVE_READ_SPINS 1000        // Busy retries of a snapshot being written
+#define LIVE_READ_WAIT_MS 100       // Then 1 ms retries before the slot is given up on
+
+// Read-only view of a running program's live segment. Readers never write
+// to the segment, so any number of them can poll it at any rate.
+typedef struct {
+    HANDLE mapping;
+    const LiveShareLayout* layout;
+    uint64_t cursor;        // Next ring index liveReadScans returns
+    uint64_t scansMissed;   // Ring records overwritten before this reader got to them
+} LiveReader;
+
+// Opens the named segment, returns 0 on success or -1 if the program is not
+// running or publishes a different layout version
+int liveReaderOpen(LiveReader* reader, const char* name);
+
+void liveReaderClose(LiveReader* reader);
+
+// Copies a consistent snapshot of monitor, returns 0 on success or -1 if the slot is
+// unused or stays mid-write for LIVE_READ_WAIT_MS (the publisher died while writing it)
+int liveReadSnapshot(const LiveReader* reader, uint32_t monitor, LiveMonitorSnapshot* snapshot);
+
+// Copies up to maxRecords scans published since the last call, returns the number copied.
+// A reader that falls more than a ring behind skips ahead and counts the loss in scansMissed.
+int liveReadScans(LiveReader* reader, LiveScanRecord records[], int maxRecords);
+
+#endif
@@ -0,0 +1,136 @@
+#include "live_share.h"
+#include <string.h> // memset, memcpy, memcmp
+
+// True if pid is a running process
+static bool processAlive(uint32_t pid) {
+    HANDLE process = OpenProcess(SYNCHRONIZE, FALSE, pid);
+    bool alive;
+
+    if (process == NULL) {
+        return GetLastError() == ERROR_ACCESS_DENIED; // Exists but belongs to someone else
+    }
+    alive = WaitForSingleObject(process, 0) == WAIT_TIMEOUT;
+    CloseHandle(process);
+    return alive;
+}
+
+int liveShareOpen(LiveShare* share, const char* name) {
+    LiveShareLayout* layout;
+    bool existed;
+
+    memset(share, 0, sizeof(*share));
+    InitializeCriticalSection(&share->ringLock);
+
+    // Pagefile-backed, so the segment lives as long as any process maps it
+    share->mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0,
+                                        (DWORD)sizeof(LiveShareLayout), name);
+    if (share->mapping == NULL) {
+        return -1;
+    }
+    existed = GetLastError() == ERROR_ALREADY_EXISTS;
+    layout = MapViewOfFile(share->mapping, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(LiveShareLayout));
+    if (layout == NULL) {
+        CloseHandle(share->mapping);
+        share->mapping = NULL;
+        return -1;
+    }
+
+    // Another program still publishing keeps its segment, only a dead publisher's is taken over
+    if (existed && memcmp(layout->magic, LIVE_SHARE_MAGIC, sizeof(layout->magic)) == 0 &&
+        layout->processId != GetCurrentProcessId() && processAlive(layout->processId)) {
+        UnmapViewOfFile(layout);
+        CloseHandle(share->mapping);
+        share->mapping = NULL;
+        return -1;
+    }
+
+    // A reader may already hold the mapping from an earlier run, hide it while resetting
+    memset(layout->magic, 0, sizeof(layout->magic));
+    MemoryBarrier();
+    memset((uint8_t*)layout + sizeof(layout->magic), 0, sizeof(*layout) - sizeof(layout->magic));
+    layout->version = LIVE_SHARE_VERSION;
+    layout->headerBytes = sizeof(LiveShareLayout);
+    layout->monitorCount = LIVE_MAX_MONITORS;
+    layout->ringScans = LIVE_RING_SCANS;
+    layout->processId = GetCurrentProcessId();
+    MemoryBarrier();
+    memcpy(layout->magic, LIVE_SHARE_MAGIC, sizeof(layout->magic));
+
+    share->layout = layout;
+    return 0;
+}
+
+void livePublishScan(LiveShare* share, uint32_t monitor, int64_t timeUs,
+                     const ScanState* state, uint32_t tubeCount) {
+    LiveShareLayout* layout = share->layout;
+    LiveMonitorSnapshot* snapshot;
+    LiveScanRecord* record;
+    uint64_t index;
+    uint32_t tube;
+
+    if (layout == NULL || monitor >= LIVE_MAX_MONITORS) {
+        return;
+    }
+    if (tubeCount > SCAN_MAX_TUBES) {
+        tubeCount = SCAN_MAX_TUBES;
+    }
+
+    // Snapshot slot
+    snapshot = &layout->monitors[monitor];
+    snapshot->sequence++;
+    MemoryBarrier();
+    snapshot->tubeCount = tubeCount;
+    snapshot->scanCount++;
+    snapshot->timeUs = timeUs;
+    for (tube = 0; tube < tubeCount; tube++) {
+        snapshot->states[tube] = (uint8_t)(state->position[tube] | state->eating[tube] << 4);
+    }
+    MemoryBarrier();
+    snapshot->sequence++;
+
+    // Ring record, readers detect being lapped through its sequence
+    EnterCriticalSection(&share->ringLock);
+    index = (uint64_t)layout->scansPublished;
+    record = &layout->ring[index & (LIVE_RING_SCANS - 1)];
+    record->sequence = 2 * index + 1;
+    MemoryBarrier();
+    record->timeUs = timeUs;
+    record->monitor = monitor;
+    record->tubeCount = tubeCount;
+    memcpy(record->states, snapshot->states, tubeCount);
+    MemoryBarrier();
+    record->sequence = 2 * index + 2;
+    layout->scansPublished = (int64_t)(index + 1);
+    LeaveCriticalSection(&share->ringLock);
+}
+
+void livePublishBin(LiveShare* share, uint32_t monitor, const ActivityBin* bin, uint32_t tubeCount) {
+    LiveMonitorSnapshot* snapshot;
+
+    if (share->layout == NULL || monitor >= LIVE_MAX_MONITORS) {
+        return;
+    }
+    if (tubeCount > SCAN_MAX_TUBES) {
+        tubeCount = SCAN_MAX_TUBES;
+    }
+
+    snapshot = &share->layout->monitors[monitor];
+    snapshot->sequence++;
+    MemoryBarrier();
+    snapshot->binEndUs = bin->endUs;
+    memcpy(snapshot->binMoves, bin->moves, tubeCount * sizeof(uint32_t));
+    MemoryBarrier();
+    snapshot->sequence++;
+}
+
+void liveShareClose(LiveShare* share) {
+    if (share->layout != NULL) {
+        UnmapViewOfFile(share->layout);
+    }
+    if (share->mapping != NULL) {
+        CloseHandle(share->mapping);
+    }
+    share->layout = NULL;
+    share->mapping = NULL;
+    DeleteCriticalSection(&share->ringLock);
+}
@@ -0,0 +1,74 @@
+#ifndef LIVE_SHARE_H
+#define LIVE_SHARE_H
+
+#include <stdint.h> // Fixed-width integer types
+#include <stdbool.h> // Standard boolean library
+#include <windows.h> // Named file mapping, memory barriers
+#include "scan_kernel.h" // ScanState, SCAN_MAX_TUBES
+#include "binning.h" // ActivityBin
+
+// Constants
+#define LIVE_SHARE_NAME "Local\\MultibeamActivityLive" // Default mapping name
+#define LIVE_SHARE_MAGIC "MADLIVE"   // 8 bytes including the terminator
+#define LIVE_SHARE_VERSION 2         // Bumped whenever the layout below changes
+#define LIVE_MAX_MONITORS 128        // Snapshot slots, one per monitor up to CONFIG_MAX_MONITORS
+#define LIVE_RING_SCANS 8192         // Recent scans kept, a power of two
+
+// Latest state of one monitor. sequence is odd while the publisher is
+// writing the slot; readers copy it and retry if sequence was odd or moved.
+typedef struct {
+    volatile uint32_t sequence;
+    uint32_t tubeCount;             // 0 = slot unused
+    uint64_t scanCount;             // Scans published for this monitor
+    int64_t timeUs;                 // Time of the latest scan
+    int64_t binEndUs;               // End of the last closed activity bin
+    uint8_t states[SCAN_MAX_TUBES]; // ARCHIVE_STATE layout: position | eating << 4
+    uint32_t binMoves[SCAN_MAX_TUBES]; // Moves per tube in the last closed bin
+} LiveMonitorSnapshot;
+
+// One scan in the ring. sequence is 2 * index + 1 while the record is
+// written and 2 * index + 2 once it holds scan number index.
+typedef struct {
+    volatile uint64_t sequence;
+    int64_t timeUs;
+    uint32_t monitor;
+    uint32_t tubeCount;
+    uint8_t states[SCAN_MAX_TUBES];
+} LiveScanRecord;
+
+// Whole shared segment; readers check magic, version and the sizes before use
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t headerBytes;           // sizeof(LiveShareLayout) of the publisher
+    uint32_t monitorCount;
+    uint32_t ringScans;
+    uint32_t processId;             // Publisher process
+    uint32_t reserved;
+    volatile int64_t scansPublished; // Next ring index to be written
+    LiveMonitorSnapshot monitors[LIVE_MAX_MONITORS];
+    LiveScanRecord ring[LIVE_RING_SCANS];
+} LiveShareLayout;
+
+// Publisher side. Decode workers publish different monitors at the same time; each
+// snapshot has a single writer, the ring is shared and taken under ringLock.
+typedef struct {
+    HANDLE mapping;
+    LiveShareLayout* layout;
+    CRITICAL_SECTION ringLock;
+} LiveShare;
+
+// Creates the named mapping and writes its header, returns 0 on success or -1 if
+// another running process publishes under name. liveShareClose must be called either way.
+int liveShareOpen(LiveShare* share, const char* name);
+
+// Publishes one decoded scan of monitor (0-based) to its snapshot and the ring
+void livePublishScan(LiveShare* share, uint32_t monitor, int64_t timeUs,
+                     const ScanState* state, uint32_t tubeCount);
+
+// Publishes the moves of a closed bin to the monitor's snapshot
+void livePublishBin(LiveShare* share, uint32_t monitor, const ActivityBin* bin, uint32_t tubeCount);
+
+void liveShareClose(LiveShare* share);
+
+#endif
@@ -0,0 +1,115 @@
+#include "locomotion.h"
+#include <string.h> // memset
+
+void locomotionInit(LocomotionTracker* tracker, uint32_t tubeCount, float spacingMm, uint32_t smoothMs) {
+    memset(tracker, 0, sizeof(*tracker));
+    tracker->tubeCount = tubeCount > SCAN_MAX_TUBES ? SCAN_MAX_TUBES : tubeCount;
+    tracker->spacingMm = spacingMm;
+    tracker->smoothUs = (int64_t)smoothMs * 1000;
+    tracker->episodeGapUs = (int64_t)LOCOMOTION_EPISODE_GAP_MS * 1000;
+}
+
+static void endEpisode(LocomotionTracker* tracker, uint32_t tube) {
+    TubeLocomotion* walker = &tracker->tubes[tube];
+    int64_t lengthUs = walker->lastStepUs - walker->episodeStartUs;
+
+    walker->episodes++;
+    walker->episodeUs += (uint64_t)lengthUs;
+    if (lengthUs > walker->longestEpisodeUs) {
+        walker->longestEpisodeUs = lengthUs;
+    }
+    tracker->moving &= ~(1ull << tube);
+}
+
+// The candidate held long enough: the fly went from position to candidate at candidateUs
+static void takeStep(LocomotionTracker* tracker, uint32_t tube) {
+    TubeLocomotion* walker = &tracker->tubes[tube];
+    uint64_t bit = 1ull << tube;
+    int64_t stepUs = walker->candidateUs;
+
+    if (walker->position != 0) {
+        uint32_t beams = walker->candidate > walker->position ? walker->candidate - walker->position :
+                                                                walker->position - walker->candidate;
+
+        walker->beams += beams;
+        walker->steps++;
+        if (tracker->moving & bit) {
+            // The first step of an episode comes from rest and has no speed
+            if (stepUs > walker->lastStepUs) {
+                float speed = beams * tracker->spacingMm * 1e6f / (float)(stepUs - walker->lastStepUs);
+
+                if (speed > walker->topSpeed) {
+                    walker->topSpeed = speed;
+                }
+            }
+        } else {
+            tracker->moving |= bit;
+            walker->episodeStartUs = stepUs;
+        }
+        walker->lastStepUs = stepUs;
+    }
+    walker->position = walker->candidate;
+    tracker->pending &= ~bit;
+}
+
+void locomotionScan(LocomotionTracker* tracker, int64_t timeUs, const ScanState* state, ScanDelta delta) {
+    uint64_t mask = tracker->tubeCount == 64 ? ~0ull : (1ull << tracker->tubeCount) - 1;
+    uint64_t bits;
+    uint32_t tube;
+
+    tracker->latestUs = timeUs;
+    if (!tracker->started) {
+        // Where the flies are now is where they start, not a step
+        for (tube = 0; tube < tracker->tubeCount; tube++) {
+            tracker->tubes[tube].position = state->position[tube] & PACKED_DATA_MASK;
+        }
+        tracker->started = true;
+        return;
+    }
+
+    // New readings start or cancel a candidate
+    for (bits = delta.moved & mask; bits; bits &= bits - 1) {
+        TubeLocomotion* walker;
+        uint8_t position;
+
+        tube = (uint32_t)__builtin_ctzll(bits);
+        walker = &tracker->tubes[tube];
+        position = state->position[tube] & PACKED_DATA_MASK;
+        if (position == 0 || position == walker->position) {
+            tracker->pending &= ~(1ull << tube);
+        } else if (walker->position == 0) {
+            walker->position = position;  // First beam this fly broke
+        } else {
+            walker->candidate = position;
+            walker->candidateUs = timeUs;
+            tracker->pending |= 1ull << tube;
+        }
+    }
+
+    for (bits = tracker->pending; bits; bits &= bits - 1) {
+        tube = (uint32_t)__builtin_ctzll(bits);
+        if (timeUs - tracker->tubes[tube].candidateUs >= tracker->smoothUs) {
+            takeStep(tracker, tube);
+        }
+    }
+
+    for (bits = tracker->moving; bits; bits &= bits - 1) {
+        tube = (uint32_t)__builtin_ctzll(bits);
+        if (timeUs - tracker->tubes[tube].lastStepUs >= tracker->episodeGapUs) {
+            endEpisode(tracker, tube);
+        }
+    }
+}
+
+void locomotionGap(LocomotionTracker* tracker) {
+    uint64_t bits;
+
+    for (bits = tracker->moving; bits; bits &= bits - 1) {
+        endEpisode(tracker, (uint32_t)__builtin_ctzll(bits));
+    }
+    tracker->pending = 0;
+}
+
+double locomotionPathMm(const LocomotionTracker* tracker, uint32_t tube) {
+    return (double)tracker->tubes[tube].beams * tracker->spacingMm;
+}
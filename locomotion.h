@@ -0,0 +1,57 @@
+#ifndef LOCOMOTION_H
+#define LOCOMOTION_H
+
+#include <stdint.h> // Fixed-width integer types
+#include <stdbool.h> // Standard boolean library
+#include "scan_kernel.h" // ScanState, ScanDelta, SCAN_MAX_TUBES
+
+// Constants
+#define LOCOMOTION_SPACING_MM 3.0f     // Default distance between two neighbouring beams
+#define LOCOMOTION_SMOOTH_MS 50        // Default: a new position must hold this long to count
+#define LOCOMOTION_EPISODE_GAP_MS 2000 // A movement episode ends after this long without a step
+
+// Walking of one fly. A step is a position change that held for the smoothing
+// time; a reading that goes back before then, or to 0 (no beam), is jitter and
+// never counted. Steps are timed at the first scan that showed the new position.
+typedef struct {
+    uint64_t beams;          // Path length in beams, the sum of |new - old position| over the steps
+    uint32_t steps;
+    uint32_t episodes;       // Finished movement episodes
+    uint64_t episodeUs;      // Their total length, first to last step
+    int64_t longestEpisodeUs;
+    float topSpeed;          // Fastest step in mm/s: its beams over the time since the step before
+    uint8_t position;        // Accepted position, 0 until the first reading
+    uint8_t candidate;       // Reading waiting for the smoothing time, while pending
+    int64_t candidateUs;     // First scan of the candidate
+    int64_t lastStepUs;
+    int64_t episodeStartUs;  // First step of the episode in progress
+} TubeLocomotion;
+
+// Online locomotion of one monitor. A scan only touches the tubes that moved,
+// wait for the smoothing time or are in an episode, so its cost does not grow
+// with the number of tubes that sit still.
+typedef struct {
+    float spacingMm;
+    int64_t smoothUs;
+    int64_t episodeGapUs;
+    uint32_t tubeCount;
+    bool started;
+    uint64_t pending;        // Tubes with a candidate position
+    uint64_t moving;         // Tubes in a movement episode
+    int64_t latestUs;
+    TubeLocomotion tubes[SCAN_MAX_TUBES];
+} LocomotionTracker;
+
+void locomotionInit(LocomotionTracker* tracker, uint32_t tubeCount, float spacingMm, uint32_t smoothMs);
+
+// Adds one decoded scan; delta must be the one decodeScan returned for it
+void locomotionScan(LocomotionTracker* tracker, int64_t timeUs, const ScanState* state, ScanDelta delta);
+
+// Acquisition stopped: episodes in progress end at their last step and
+// candidates are dropped. A position change across the gap still counts as a step.
+void locomotionGap(LocomotionTracker* tracker);
+
+// Path length of one tube in mm
+double locomotionPathMm(const LocomotionTracker* tracker, uint32_t tube);
+
+#endif
@@ -0,0 +1,2404 @@
+#include <stdio.h> // Standard input/output library
+#include <stdlib.h> // strtol, strtod
+#include <string.h> // strcmp
+#include <time.h> // gmtime
+#include "stream_server.h" // Server side, for streambench; pulls in winsock2.h which must precede windows.h
+#include <afunix.h> // AF_UNIX socket addresses of the streambench clients
+#include "archive_query.h" // Time-indexed archive queries
+#include "binning.h" // Activity bins
+#include "parquet_export.h" // Columnar export
+#include "live_reader.h" // Live state of a running program
+#include "tube_stats.h" // Occupancy, visit lengths and transitions
+#include "feeding_bouts.h" // Debounced feeding bouts
+#include "locomotion.h" // Path length, speed and movement episodes
+#include "circadian.h" // Periodograms of the activity bins
+#include "work_pool.h" // One archive per worker
+#include "tube_health.h" // Dead and empty tubes
+#include "pyramid.h" // Multi-resolution summaries
+#include "synchrony.h" // Tubes active together
+#include "activity_bitmap.h" // Moving tubes of every bin
+#include "live_share.h" // Publisher side, for livebench
+#include <math.h> // isnan
+#include <windows.h> // Sleep
+#include <process.h> // _beginthreadex
+
+// Function prototypes
+int runQuery(int argc, char* argv[]);
+int runCounts(int argc, char* argv[]);
+int runExport(int argc, char* argv[]);
+int runLive(int argc, char* argv[]);
+int runLiveBench(int argc, char* argv[]);
+int runStreamBench(int argc, char* argv[]);
+int runGaps(int argc, char* argv[]);
+int runRecover(int argc, char* argv[]);
+int runSyncBench(int argc, char* argv[]);
+int runPositions(int argc, char* argv[]);
+int runBouts(int argc, char* argv[]);
+int runWalk(int argc, char* argv[]);
+int runCircadian(int argc, char* argv[]);
+int runHealth(int argc, char* argv[]);
+int runPyramid(int argc, char* argv[]);
+int runZoom(int argc, char* argv[]);
+int runSynchrony(int argc, char* argv[]);
+int runBitmapBench(int argc, char* argv[]);
+int runEnvironment(int argc, char* argv[]);
+// Last change printChange reported
+typedef struct {
+    bool printed;
+    uint8_t position;
+    bool eating;
+} PrintedChange;
+
+void printUsage(void);
+int64_t parseTimeArg(const char* text);
+void formatTime(int64_t timeUs, char* buffer, size_t size);
+void printChange(int64_t timeUs, uint8_t position, bool eating, void* context);
+void replayEvents(ActivityBinner* binner, const EnvironmentEvent events[], int eventCount, int* next, int64_t timeUs);
+bool openNextSegment(ArchiveReader* reader, const char* path, uint32_t tubeCount, uint32_t* segment,
+                     uint32_t* skipped);
+void printSegments(uint32_t segments, uint32_t skipped);
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        printUsage();
+        return 1;
+    }
+
+    if (strcmp(argv[1], "query") == 0) {
+        return runQuery(argc - 2, argv + 2);
+    }
+    if (strcmp(argv[1], "counts") == 0) {
+        return runCounts(argc - 2, argv + 2);
+    }
+    if (strcmp(argv[1], "export") == 0) {
+        return runExport(argc - 2, argv + 2);
+    }
+    if (strcmp(argv[1], "gaps") == 0) {
+        return runGaps(argc - 2, argv + 2);
+    }
+    if (strcmp(argv[1], "live") == 0) {
+        return runLive(argc - 2, argv + 2);
+    }
+    if (strcmp(argv[1], "livebench") == 0) {
+        return runLiveBench(argc - 2, argv + 2);
+    }
+    if (strcmp(argv[1], "streambench") == 0) {
+        return runStreamBench(argc - 2, argv + 2);
+    }
+    if (strcmp(argv[1], "recover") == 0) {
+        return runRecover(argc - 2, argv + 2);
+    }
+    if (strcmp(argv[1], "syncbench") == 0) {
+        return runSyncBench(argc - 2, argv + 2);
+    }
+    if (strcmp(argv[1], "positions") == 0) {
+        return runPositions(argc - 2, argv + 2);
+    }
+    if (strcmp(argv[1], "bouts") == 0) {
+        return runBouts(argc - 2, argv + 2);
+    }
+    if (strcmp(argv[1], "walk") == 0) {
+        return runWalk(argc - 2, argv + 2);
+    }
+    if (strcmp(argv[1], "circadian") == 0) {
+        return runCircadian(argc - 2, argv + 2);
+    }
+    if (strcmp(argv[1], "health") == 0) {
+        return runHealth(argc - 2, argv + 2);
+    }
+    if (strcmp(argv[1], "pyramid") == 0) {
+        return runPyramid(argc - 2, argv + 2);
+    }
+    if (strcmp(argv[1], "zoom") == 0) {
+        return runZoom(argc - 2, argv + 2);
+    }
+    if (strcmp(argv[1], "synchrony") == 0) {
+        return runSynchrony(argc - 2, argv + 2);
+    }
+    if (strcmp(argv[1], "bitmapbench") == 0) {
+        return runBitmapBench(argc - 2, argv + 2);
+    }
+    if (strcmp(argv[1], "environment") == 0) {
+        return runEnvironment(argc - 2, argv + 2);
+    }
+
+    printUsage();
+    return 1;
+}
+
+void printUsage(void) {
+    printf("Multibeam Activity Detector - Archive Tool\n\n");
+    printf("Usage:\n");
+    printf("  madtool query <archive.mad> <tube> <start> <end>   Changes and counts for one tube\n");
+    printf("  madtool counts <archive.mad> <start> <end>         Counts for every tube\n");
+    printf("  madtool export <archive.mad> <out.parquet> [bin seconds]\n");
+    printf("                                                     Binned activity as Parquet (default 60 s bins)\n");
+    printf("  madtool gaps <archive.mad>                         Times acquisition was interrupted\n");
+    printf("  madtool positions <archive.mad> [tube]             Time at each position, visit lengths, transitions\n");
+    printf("  madtool bouts <archive.mad> [start ms] [end ms] [tube]\n");
+    printf("                                                     Feeding bouts per tube, or every bout of one tube\n");
+    printf("  madtool walk <archive.mad> [spacing mm] [smoothing ms]\n");
+    printf("                                                     Path length, top speed and movement episodes\n");
+    printf("  madtool circadian <archive.mad> [archive.mad ...]  Chi-square and Lomb-Scargle periods per tube\n");
+    printf("  madtool synchrony <archive.mad> [archive.mad ...]  Minutes most tubes moved together, correlation\n");
+    printf("                                                     between the tubes of each pair of monitors\n");
+    printf("  madtool environment <archive.mad>                  Light and temperature events, activity in\n");
+    printf("                                                     the light and in the dark, per condition mark\n");
+    printf("  madtool health <archive.mad> [dead hours] [empty hours]\n");
+    printf("                                                     Dead and empty tubes, and when they were flagged\n");
+    printf("  madtool zoom <archive.mad> <tube> <start> <end> [bins]\n");
+    printf("                                                     Activity from the pyramid, at most bins rows (default 48)\n");
+    printf("  madtool pyramid <archive.mad>                      Rebuild the pyramid from every segment\n");
+    printf("  madtool live [seconds]                             Follow a running program.exe (default 10 s)\n");
+    printf("  madtool livebench [readers] [seconds]              Live segment reads against a publisher running\n");
+    printf("                                                     flat out (default 4 readers, 10 s)\n");
+    printf("  madtool streambench <socket> [clients] [seconds] [scans per s]\n");
+    printf("                                                     Stream throughput and latency to many subscribers\n");
+    printf("                                                     and one that never reads (default 32, 10 s, 20000)\n");
+    printf("  madtool recover <archive.mad>                      Close a segment left open by a crash\n");
+    printf("  madtool syncbench <archive.mad> [seconds] [sync ms]\n");
+    printf("                                                     Append and sync latency while syncing hard\n");
+    printf("  madtool bitmapbench [tubes] [days]                 Activity bitmap queries on simulated flies\n");
+    printf("                                                     (default 5000 tubes, 30 days of minutes)\n\n");
+    printf("Times are Unix seconds (UTC), fractions allowed. Tubes are numbered from 1.\n");
+}
+
+// Unix seconds on the command line to archive microseconds
+int64_t parseTimeArg(const char* text) {
+    return (int64_t)(strtod(text, NULL) * 1000000.0);
+}
+
+void formatTime(int64_t timeUs, char* buffer, size_t size) {
+    time_t seconds = (time_t)(timeUs / 1000000);
+    struct tm* utc = gmtime(&seconds);
+
+    if (utc == NULL) {
+        snprintf(buffer, size, "%lld", (long long)timeUs);
+        return;
+    }
+    snprintf(buffer, size, "%04d-%02d-%02d %02d:%02d:%02d.%03d",
+             utc->tm_year + 1900, utc->tm_mon + 1, utc->tm_mday,
+             utc->tm_hour, utc->tm_min, utc->tm_sec, (int)(timeUs % 1000000 / 1000));
+}
+
+// Applies the environment events of a block up to timeUs, in order, from events[*next] on
+void replayEvents(ActivityBinner* binner, const EnvironmentEvent events[], int eventCount, int* next, int64_t timeUs) {
+    while (*next < eventCount && events[*next].timeUs <= timeUs) {
+        binnerAddEvent(binner, &events[(*next)++]);
+    }
+}
+
+// Opens the next segment of the recording at path, from *segment on, that can be read and
+// has tubeCount tubes; the others are counted in *skipped (the newest one of a recording
+// still running has no index yet). Returns false past the last segment, otherwise
+// *segment is left one past the segment opened.
+bool openNextSegment(ArchiveReader* reader, const char* path, uint32_t tubeCount, uint32_t* segment,
+                     uint32_t* skipped) {
+    for (;; (*segment)++) {
+        int status = archiveReaderOpenSegment(reader, path, *segment);
+
+        if (status > 0) {
+            return false;
+        }
+        if (status == 0 && reader->tubeCount == tubeCount) {
+            (*segment)++;
+            return true;
+        }
+        if (status == 0) {
+            archiveReaderClose(reader);
+        }
+        (*skipped)++;
+    }
+}
+
+// Says what a result covers once a recording has more than one segment
+void printSegments(uint32_t segments, uint32_t skipped) {
+    if (segments > 1 || skipped > 0) {
+        printf("%u segment(s) read", segments);
+        if (skipped > 0) {
+            printf(", %u skipped (unfinished, corrupt, wrong version or other tubes)", skipped);
+        }
+        printf("\n");
+    }
+}
+
+void printChange(int64_t timeUs, uint8_t position, bool eating, void* context) {
+    PrintedChange* last = context;
+    char timeText[32];
+
+    // Each segment reports its first scan in range, which may change nothing
+    if (last->printed && last->position == position && last->eating == eating) {
+        return;
+    }
+    last->printed = true;
+    last->position = position;
+    last->eating = eating;
+
+    formatTime(timeUs, timeText, sizeof(timeText));
+    if (eating) {
+        printf("%s | EATING  | position %d\n", timeText, position);
+    } else if (position > 0) {
+        printf("%s | ACTIVE  | position %d\n", timeText, position);
+    } else {
+        printf("%s | IDLE    | -\n", timeText);
+    }
+}
+
+int runQuery(int argc, char* argv[]) {
+    static ArchiveReader reader; // Large decode scratch, keep it off the stack
+    PrintedChange printed = {false, 0, false};
+    TubeActivity activity, total;
+    int64_t startUs, endUs;
+    uint32_t tubeCount, segment = 1, segments = 0, skipped = 0;
+    long tube;
+
+    if (argc < 4) {
+        printUsage();
+        return 1;
+    }
+    tube = strtol(argv[1], NULL, 10);
+    startUs = parseTimeArg(argv[2]);
+    endUs = parseTimeArg(argv[3]);
+
+    if (archiveReaderOpen(&reader, argv[0]) != 0) {
+        printf("Cannot open archive %s (missing, unfinished or wrong version, see madtool recover)\n", argv[0]);
+        return 1;
+    }
+    tubeCount = reader.tubeCount;
+    if (tube < 1 || tube > (long)tubeCount) {
+        printf("Tube must be between 1 and %u\n", tubeCount);
+        archiveReaderClose(&reader);
+        return 1;
+    }
+
+    printf("Time (UTC)              | Status  | Position\n");
+    printf("------------------------|---------|---------\n");
+    memset(&total, 0, sizeof(total));
+    do {
+        if (queryTubeChanges(&reader, (uint32_t)(tube - 1), startUs, endUs, printChange, &printed) != 0 ||
+            queryTubeActivity(&reader, (uint32_t)(tube - 1), startUs, endUs, &activity) != 0) {
+            printf("Archive is corrupt in segment %u\n", segment - 1);
+            archiveReaderClose(&reader);
+            return 1;
+        }
+        total.scans += activity.scans;
+        total.moves += activity.moves;
+        total.eatingScans += activity.eatingScans;
+        total.blocksDecoded += activity.blocksDecoded;
+        total.blocksSummarized += activity.blocksSummarized;
+        segments++;
+        archiveReaderClose(&reader);
+    } while (openNextSegment(&reader, argv[0], tubeCount, &segment, &skipped));
+
+    printf("\nTube %ld: %llu scans, %llu moves, %llu eating scans (%u blocks decoded, %u from index)\n",
+           tube, (unsigned long long)total.scans, (unsigned long long)total.moves,
+           (unsigned long long)total.eatingScans, total.blocksDecoded, total.blocksSummarized);
+    printSegments(segments, skipped);
+    return 0;
+}
+
+int runCounts(int argc, char* argv[]) {
+    static ArchiveReader reader; // Large decode scratch, keep it off the stack
+    static TubeActivity totals[SCAN_MAX_TUBES];
+    TubeActivity activity;
+    int64_t startUs, endUs;
+    uint32_t tube, tubeCount, segment = 1, segments = 0, skipped = 0;
+
+    if (argc < 3) {
+        printUsage();
+        return 1;
+    }
+    startUs = parseTimeArg(argv[1]);
+    endUs = parseTimeArg(argv[2]);
+
+    if (archiveReaderOpen(&reader, argv[0]) != 0) {
+        printf("Cannot open archive %s (missing, unfinished or wrong version, see madtool recover)\n", argv[0]);
+        return 1;
+    }
+    tubeCount = reader.tubeCount;
+
+    do {
+        for (tube = 0; tube < tubeCount; tube++) {
+            if (queryTubeActivity(&reader, tube, startUs, endUs, &activity) != 0) {
+                printf("Archive is corrupt in segment %u\n", segment - 1);
+                archiveReaderClose(&reader);
+                return 1;
+            }
+            totals[tube].scans += activity.scans;
+            totals[tube].moves += activity.moves;
+            totals[tube].eatingScans += activity.eatingScans;
+        }
+        segments++;
+        archiveReaderClose(&reader);
+    } while (openNextSegment(&reader, argv[0], tubeCount, &segment, &skipped));
+
+    printf("Tube |    Scans |    Moves |   Eating\n");
+    printf("-----|----------|----------|---------\n");
+    for (tube = 0; tube < tubeCount; tube++) {
+        printf("%4u | %8llu | %8llu | %8llu\n", tube + 1, (unsigned long long)totals[tube].scans,
+               (unsigned long long)totals[tube].moves, (unsigned long long)totals[tube].eatingScans);
+    }
+    printSegments(segments, skipped);
+    return 0;
+}
+
+// Export state shared with the bin callback
+typedef struct {
+    ParquetWriter parquet;
+    uint32_t monitorId;
+    uint64_t bins;
+    int error;
+} ExportContext;
+
+void exportBin(const ActivityBin* bin, uint32_t tubeCount, void* context) {
+    ExportContext* export = (ExportContext*)context;
+
+    if (parquetAppendBin(&export->parquet, export->monitorId, bin, tubeCount) != 0) {
+        export->error = -1;
+    }
+    export->bins++;
+}
+
+int runExport(int argc, char* argv[]) {
+    static ArchiveReader reader; // Large decode scratch, keep it off the stack
+    static int64_t times[ARCHIVE_BLOCK_SCANS];
+    static uint8_t states[ARCHIVE_BLOCK_SCANS * SCAN_MAX_TUBES];
+    static ExportContext export;
+    ActivityBinner binner;
+    ScanState scan;
+    double binSeconds = 60.0;
+    uint32_t block, tubeCount, segment = 1, segments = 0, skipped = 0;
+
+    if (argc < 2) {
+        printUsage();
+        return 1;
+    }
+    if (argc > 2) {
+        binSeconds = strtod(argv[2], NULL);
+        if (binSeconds <= 0.0) {
+            printf("Bin length must be positive\n");
+            return 1;
+        }
+    }
+
+    if (archiveReaderOpen(&reader, argv[0]) != 0) {
+        printf("Cannot open archive %s (missing, unfinished or wrong version, see madtool recover)\n", argv[0]);
+        return 1;
+    }
+    if (parquetOpen(&export.parquet, argv[1]) != 0) {
+        printf("Cannot create %s\n", argv[1]);
+        archiveReaderClose(&reader);
+        return 1;
+    }
+    export.monitorId = reader.header->monitorId;
+    tubeCount = reader.tubeCount;
+
+    memset(&scan, 0, sizeof(scan));
+    binnerInit(&binner, (int64_t)(binSeconds * 1000000.0), tubeCount, exportBin, &export);
+
+    // Replay every scan of every segment through the binner, deriving change masks from consecutive rows
+    do {
+        for (block = 0; block < reader.blockCount && export.error == 0; block++) {
+            EnvironmentEvent events[ARCHIVE_BLOCK_MAX_EVENTS];
+            int scanCount = archiveReaderDecodeBlock(&reader, block, times, states);
+            int eventCount = archiveReaderBlockEvents(&reader, block, events);
+            int next = 0;
+            int i;
+
+            if (scanCount < 0 || eventCount < 0) {
+                printf("Archive is corrupt at block %u of segment %u\n", block, segment - 1);
+                export.error = -1;
+                break;
+            }
+            for (i = 0; i < scanCount; i++) {
+                const uint8_t* row = states + (size_t)i * tubeCount;
+                ScanDelta delta = {0, 0};
+                uint32_t tube;
+
+                for (tube = 0; tube < tubeCount; tube++) {
+                    uint8_t position = row[tube] & PACKED_DATA_MASK;
+                    uint8_t eating = row[tube] >> 4;
+                    delta.moved |= (uint64_t)(position != scan.position[tube]) << tube;
+                    delta.eatingChanged |= (uint64_t)(eating != scan.eating[tube]) << tube;
+                    scan.position[tube] = position;
+                    scan.eating[tube] = eating;
+                }
+                replayEvents(&binner, events, eventCount, &next, times[i]);
+                binnerAddScan(&binner, times[i], &scan, delta);
+            }
+        }
+        segments++;
+        archiveReaderClose(&reader);
+    } while (export.error == 0 && openNextSegment(&reader, argv[0], tubeCount, &segment, &skipped));
+    binnerFlush(&binner);
+
+    if (parquetClose(&export.parquet) != 0) {
+        export.error = -1;
+    }
+
+    if (export.error != 0) {
+        printf("Export failed\n");
+        return 1;
+    }
+    printf("Exported %llu bins x %u tubes to %s\n", (unsigned long long)export.bins, tubeCount, argv[1]);
+    printSegments(segments, skipped);
+    return 0;
+}
+
+int runGaps(int argc, char* argv[]) {
+    static ArchiveReader reader; // Large decode scratch, keep it off the stack
+    int64_t totalUs = 0;
+    int64_t lastUs = 0;
+    bool started = false;
+    uint32_t gaps = 0;
+    uint32_t block, tubeCount, segment = 1, segments = 0, skipped = 0;
+
+    if (argc < 1) {
+        printUsage();
+        return 1;
+    }
+    if (archiveReaderOpen(&reader, argv[0]) != 0) {
+        printf("Cannot open archive %s (missing, unfinished or wrong version, see madtool recover)\n", argv[0]);
+        return 1;
+    }
+    tubeCount = reader.tubeCount;
+
+    printf("Gap start (UTC)         | Gap end (UTC)           | Seconds\n");
+    printf("------------------------|-------------------------|--------\n");
+    do {
+        // A gap may fall between two segments, a restart always does
+        for (block = 0; block < reader.blockCount; block++) {
+            char startText[32], endText[32];
+            int64_t endUs = reader.index[block].firstTimeUs;
+
+            if (started && (reader.index[block].flags & ARCHIVE_BLOCK_AFTER_GAP)) {
+                formatTime(lastUs, startText, sizeof(startText));
+                formatTime(endUs, endText, sizeof(endText));
+                printf("%s | %s | %7.2f\n", startText, endText, (endUs - lastUs) / 1e6);
+                totalUs += endUs - lastUs;
+                gaps++;
+            }
+            lastUs = reader.index[block].lastTimeUs;
+            started = true;
+        }
+        segments++;
+        archiveReaderClose(&reader);
+    } while (openNextSegment(&reader, argv[0], tubeCount, &segment, &skipped));
+    printf("\n%u gaps, %.2f s without scans\n", gaps, totalUs / 1e6);
+    printSegments(segments, skipped);
+    return 0;
+}
+
+int runLive(int argc, char* argv[]) {
+    static LiveScanRecord records[LIVE_RING_SCANS];
+    LiveReader reader;
+    LiveMonitorSnapshot snapshot;
+    double seconds = argc > 0 ? strtod(argv[0], NULL) : 10.0;
+    uint64_t scans = 0;
+    uint32_t tube;
+    int elapsedMs;
+
+    if (liveReaderOpen(&reader, LIVE_SHARE_NAME) != 0) {
+        printf("program.exe is not running (or is a different version)\n");
+        return 1;
+    }
+
+    // Drain the ring once per second and print the latest snapshot
+    for (elapsedMs = 0; elapsedMs < seconds * 1000.0; elapsedMs += 1000) {
+        int count;
+        char timeText[32];
+
+        Sleep(1000);
+        while ((count = liveReadScans(&reader, records, LIVE_RING_SCANS)) > 0) {
+            scans += (uint64_t)count;
+        }
+        if (liveReadSnapshot(&reader, 0, &snapshot) != 0) {
+            printf("No scans published yet, or program.exe stopped while publishing\n");
+            continue;
+        }
+
+        formatTime(snapshot.timeUs, timeText, sizeof(timeText));
+        printf("%s | %llu scans read, %llu missed |", timeText,
+               (unsigned long long)scans, (unsigned long long)reader.scansMissed);
+        for (tube = 0; tube < snapshot.tubeCount; tube++) {
+            uint8_t position = snapshot.states[tube] & PACKED_DATA_MASK;
+            printf(" %c", snapshot.states[tube] >> 4 ? 'E' : (position ? "0123456789ABCDEF"[position] : '-'));
+        }
+        printf("\n");
+    }
+
+    liveReaderClose(&reader);
+    return 0;
+}
+
+// Milliseconds since start
+static double elapsedMs(LARGE_INTEGER start, LARGE_INTEGER tickRate) {
+    LARGE_INTEGER now;
+
+    QueryPerformanceCounter(&now);
+    return (double)(now.QuadPart - start.QuadPart) * 1000.0 / tickRate.QuadPart;
+}
+
+#define LIVE_BENCH_NAME "Local\\MultibeamActivityLiveBench" // Never the name program.exe publishes under
+#define LIVE_BENCH_MONITORS 4
+#define LIVE_BENCH_TUBES 16
+#define LIVE_BENCH_BATCH 256        // Ring records a reader copies per call
+
+// Publisher of livebench: scan n of monitor n % LIVE_BENCH_MONITORS has time n and
+// every tube in the state derived from n, so a torn copy shows as tubes that disagree
+typedef struct {
+    LiveShare share;
+    volatile bool running;
+    uint64_t scans;
+    uint64_t bins;
+} LiveBenchPublisher;
+
+// One reader thread of livebench with its own view of the segment
+typedef struct {
+    LiveReader reader;
+    const volatile bool* running;
+    HANDLE thread;
+    uint64_t snapshots;
+    uint64_t unavailable;    // liveReadSnapshot gave up on a slot
+    uint64_t tornSnapshots;  // Returned as consistent, but its tubes or bin disagree
+    uint64_t records;
+    uint64_t tornRecords;
+    LatencyHistogram snapshotLatency;
+    LiveScanRecord batch[LIVE_BENCH_BATCH];
+} LiveBenchReader;
+
+// State byte every tube of scan n holds
+static uint8_t liveBenchState(uint64_t n) {
+    return (uint8_t)((n & PACKED_DATA_MASK) | ((n >> 4) & 1) << 4);
+}
+
+static unsigned int __stdcall liveBenchPublish(void* arg) {
+    static ScanState state;
+    static ActivityBin bin;
+    LiveBenchPublisher* publisher = arg;
+    uint64_t n;
+    uint32_t tube;
+
+    for (n = 0; publisher->running; n++) {
+        uint32_t monitor = (uint32_t)(n % LIVE_BENCH_MONITORS);
+
+        for (tube = 0; tube < LIVE_BENCH_TUBES; tube++) {
+            state.position[tube] = (uint8_t)(n & PACKED_DATA_MASK);
+            state.eating[tube] = (uint8_t)((n >> 4) & 1);
+        }
+        livePublishScan(&publisher->share, monitor, (int64_t)n, &state, LIVE_BENCH_TUBES);
+
+        // A bin closes every 64 scans of a monitor
+        if (n % (64 * LIVE_BENCH_MONITORS) < LIVE_BENCH_MONITORS) {
+            bin.endUs = (int64_t)n;
+            for (tube = 0; tube < LIVE_BENCH_TUBES; tube++) {
+                bin.moves[tube] = (uint32_t)n;
+            }
+            livePublishBin(&publisher->share, monitor, &bin, LIVE_BENCH_TUBES);
+            publisher->bins++;
+        }
+    }
+    publisher->scans = n;
+    return 0;
+}
+
+static unsigned int __stdcall liveBenchRead(void* arg) {
+    LiveBenchReader* bench = arg;
+    LiveMonitorSnapshot snapshot;
+    LARGE_INTEGER tickRate, before, after;
+    uint32_t monitor = 0, tube;
+    int count, i;
+
+    QueryPerformanceFrequency(&tickRate);
+    while (*bench->running) {
+        bool torn;
+
+        QueryPerformanceCounter(&before);
+        if (liveReadSnapshot(&bench->reader, monitor, &snapshot) != 0) {
+            bench->unavailable++;
+        } else {
+            QueryPerformanceCounter(&after);
+            latencyRecord(&bench->snapshotLatency,
+                          (uint64_t)((after.QuadPart - before.QuadPart) * 1000000000LL / tickRate.QuadPart));
+            torn = snapshot.tubeCount != LIVE_BENCH_TUBES ||
+                   (uint64_t)snapshot.timeUs % LIVE_BENCH_MONITORS != monitor;
+            for (tube = 0; tube < LIVE_BENCH_TUBES && !torn; tube++) {
+                torn = snapshot.states[tube] != liveBenchState((uint64_t)snapshot.timeUs) ||
+                       snapshot.binMoves[tube] != (uint32_t)snapshot.binEndUs;
+            }
+            bench->tornSnapshots += torn;
+            bench->snapshots++;
+        }
+        monitor = (monitor + 1) % LIVE_BENCH_MONITORS;
+
+        count = liveReadScans(&bench->reader, bench->batch, LIVE_BENCH_BATCH);
+        for (i = 0; i < count; i++) {
+            const LiveScanRecord* record = &bench->batch[i];
+
+            torn = record->tubeCount != LIVE_BENCH_TUBES ||
+                   record->monitor != (uint64_t)record->timeUs % LIVE_BENCH_MONITORS;
+            for (tube = 0; tube < LIVE_BENCH_TUBES && !torn; tube++) {
+                torn = record->states[tube] != liveBenchState((uint64_t)record->timeUs);
+            }
+            bench->tornRecords += torn;
+        }
+        bench->records += (uint64_t)count;
+    }
+    return 0;
+}
+
+// Publishes scans and bins as fast as one thread can while readers copy snapshots and
+// drain the ring, then reports read rates, snapshot latency and any torn copies
+int runLiveBench(int argc, char* argv[]) {
+    static LiveBenchPublisher publisher;
+    static LatencyHistogram latency;
+    LiveBenchReader* readers;
+    HANDLE publisherThread;
+    LARGE_INTEGER tickRate, start;
+    long readerCount = argc > 0 ? strtol(argv[0], NULL, 10) : 4;
+    double seconds = argc > 1 ? strtod(argv[1], NULL) : 10.0;
+    uint64_t snapshots = 0, unavailable = 0, tornSnapshots = 0, records = 0, tornRecords = 0, missed = 0;
+    double ms;
+    long i;
+    int bucket;
+
+    if (readerCount < 1 || readerCount > 64 || seconds <= 0.0) {
+        printf("Readers must be between 1 and 64 and seconds positive\n");
+        return 1;
+    }
+    if (liveShareOpen(&publisher.share, LIVE_BENCH_NAME) != 0) {
+        printf("Cannot create the shared memory segment (is another livebench running?)\n");
+        liveShareClose(&publisher.share);
+        return 1;
+    }
+    readers = calloc((size_t)readerCount, sizeof(LiveBenchReader));
+    if (readers == NULL) {
+        printf("Out of memory for %ld readers\n", readerCount);
+        liveShareClose(&publisher.share);
+        return 1;
+    }
+    for (i = 0; i < readerCount; i++) {
+        if (liveReaderOpen(&readers[i].reader, LIVE_BENCH_NAME) != 0) {
+            printf("Cannot open the shared memory segment as a reader\n");
+            while (i-- > 0) {
+                liveReaderClose(&readers[i].reader);
+            }
+            free(readers);
+            liveShareClose(&publisher.share);
+            return 1;
+        }
+        readers[i].running = &publisher.running;
+    }
+
+    QueryPerformanceFrequency(&tickRate);
+    publisher.running = true;
+    for (i = 0; i < readerCount; i++) {
+        readers[i].thread = (HANDLE)_beginthreadex(NULL, 0, liveBenchRead, &readers[i], 0, NULL);
+    }
+    QueryPerformanceCounter(&start);
+    publisherThread = (HANDLE)_beginthreadex(NULL, 0, liveBenchPublish, &publisher, 0, NULL);
+    Sleep((DWORD)(seconds * 1000.0));
+    publisher.running = false;
+    WaitForSingleObject(publisherThread, INFINITE);
+    CloseHandle(publisherThread);
+    ms = elapsedMs(start, tickRate);
+    for (i = 0; i < readerCount; i++) {
+        WaitForSingleObject(readers[i].thread, INFINITE);
+        CloseHandle(readers[i].thread);
+    }
+
+    printf("%ld readers, %d monitors of %d tubes; publisher: %llu scans (%.0f per s), %llu bins\n\n",
+           readerCount, LIVE_BENCH_MONITORS, LIVE_BENCH_TUBES, (unsigned long long)publisher.scans,
+           publisher.scans * 1000.0 / ms, (unsigned long long)publisher.bins);
+    printf("Reader | Snapshots/s | Unavailable | Torn | Ring records/s | Lapped | Torn\n");
+    printf("-------|-------------|-------------|------|----------------|--------|-----\n");
+    for (i = 0; i < readerCount; i++) {
+        LiveBenchReader* bench = &readers[i];
+
+        printf("%6ld | %11.0f | %11llu | %4llu | %14.0f | %6llu | %4llu\n", i + 1,
+               bench->snapshots * 1000.0 / ms, (unsigned long long)bench->unavailable,
+               (unsigned long long)bench->tornSnapshots, bench->records * 1000.0 / ms,
+               (unsigned long long)bench->reader.scansMissed, (unsigned long long)bench->tornRecords);
+        snapshots += bench->snapshots;
+        unavailable += bench->unavailable;
+        tornSnapshots += bench->tornSnapshots;
+        records += bench->records;
+        tornRecords += bench->tornRecords;
+        missed += bench->reader.scansMissed;
+        for (bucket = 0; bucket < LATENCY_BUCKETS; bucket++) {
+            latency.counts[bucket] += bench->snapshotLatency.counts[bucket];
+        }
+        latency.samples += bench->snapshotLatency.samples;
+        latency.totalNs += bench->snapshotLatency.totalNs;
+        if (bench->snapshotLatency.maxNs > latency.maxNs) {
+            latency.maxNs = bench->snapshotLatency.maxNs;
+        }
+    }
+    printf("   All | %11.0f | %11llu | %4llu | %14.0f | %6llu | %4llu\n\n", snapshots * 1000.0 / ms,
+           (unsigned long long)unavailable, (unsigned long long)tornSnapshots, records * 1000.0 / ms,
+           (unsigned long long)missed, (unsigned long long)tornRecords);
+    latencyPrint(&latency, "liveReadSnapshot (all readers)");
+
+    for (i = 0; i < readerCount; i++) {
+        liveReaderClose(&readers[i].reader);
+    }
+    free(readers);
+    liveShareClose(&publisher.share);
+    return tornSnapshots + tornRecords > 0 ? 1 : 0;
+}
+
+#define STREAM_BENCH_MONITORS 4
+#define STREAM_BENCH_TUBES 16
+
+// Clock and state shared by streambench and its clients
+typedef struct {
+    LARGE_INTEGER start;
+    LARGE_INTEGER tickRate;
+    volatile bool submitting;
+} StreamBenchShared;
+
+// One subscriber of streambench, reading frames on its own thread
+typedef struct {
+    SOCKET socket;
+    const StreamBenchShared* shared;
+    HANDLE thread;
+    uint8_t* payload;
+    uint64_t frames;
+    uint64_t records;
+    uint64_t bytes;
+    uint64_t sequenceGaps;   // Frames missing between two received ones, must stay 0
+    uint64_t outOfOrder;     // Scans older than the one before, must stay 0
+    bool dropped;            // Disconnected while scans were still being submitted
+    LatencyHistogram latency; // Submit to receipt of every scan record
+} StreamBenchClient;
+
+// Microseconds since the start of streambench
+static int64_t streamBenchNowUs(const StreamBenchShared* shared) {
+    LARGE_INTEGER now;
+
+    QueryPerformanceCounter(&now);
+    return (now.QuadPart - shared->start.QuadPart) * 1000000 / shared->tickRate.QuadPart;
+}
+
+// Receives exactly size bytes, returns false once the connection is gone
+static bool streamBenchReceive(SOCKET socket, uint8_t* buffer, uint32_t size) {
+    while (size > 0) {
+        int received = recv(socket, (char*)buffer, (int)size, 0);
+
+        if (received <= 0) {
+            return false;
+        }
+        buffer += received;
+        size -= (uint32_t)received;
+    }
+    return true;
+}
+
+static unsigned int __stdcall streamBenchRead(void* arg) {
+    StreamBenchClient* client = arg;
+    StreamFrameHeader frame;
+    uint32_t sequence = 0;
+    int64_t lastUs = -1;
+
+    while (streamBenchReceive(client->socket, (uint8_t*)&frame, sizeof(frame))) {
+        int64_t nowUs;
+        uint32_t offset = 0;
+
+        if (frame.magic != STREAM_FRAME_MAGIC || frame.payloadBytes > STREAM_PENDING_BYTES ||
+            !streamBenchReceive(client->socket, client->payload, frame.payloadBytes)) {
+            break;
+        }
+        nowUs = streamBenchNowUs(client->shared);
+        client->sequenceGaps += frame.sequence - sequence;
+        sequence = frame.sequence + 1;
+        client->frames++;
+        client->bytes += sizeof(frame) + frame.payloadBytes;
+        if (frame.type != STREAM_FRAME_SCANS) {
+            continue;
+        }
+        while (offset + sizeof(StreamScanRecord) <= frame.payloadBytes) {
+            const StreamScanRecord* record = (const StreamScanRecord*)(client->payload + offset);
+
+            latencyRecord(&client->latency, (uint64_t)(nowUs - record->timeUs) * 1000);
+            client->outOfOrder += record->timeUs < lastUs;
+            lastUs = record->timeUs;
+            client->records++;
+            offset += STREAM_RECORD_BYTES(StreamScanRecord, record->tubeCount);
+        }
+    }
+    client->dropped = client->shared->submitting;
+    return 0;
+}
+
+// Connects one subscriber to the server at address, returns INVALID_SOCKET on failure
+static SOCKET streamBenchConnect(const SOCKADDR_UN* address) {
+    SOCKET subscriber = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (subscriber != INVALID_SOCKET &&
+        connect(subscriber, (const struct sockaddr*)address, sizeof(*address)) != 0) {
+        closesocket(subscriber);
+        subscriber = INVALID_SOCKET;
+    }
+    return subscriber;
+}
+
+// Submits scans at a steady rate to a stream server with dozens of subscribers reading
+// as fast as they can and one that never reads, then reports throughput, the latency from
+// submit to receipt of every scan, and whether any subscriber that kept up lost a frame
+int runStreamBench(int argc, char* argv[]) {
+    static StreamServer server;
+    static StreamBenchShared shared;
+    static LatencyHistogram latency;
+    static ScanState state;
+    StreamBenchClient* clients;
+    SOCKADDR_UN address;
+    SOCKET stuck;
+    WSADATA wsaData;
+    long clientCount = argc > 1 ? strtol(argv[1], NULL, 10) : 32;
+    double seconds = argc > 2 ? strtod(argv[2], NULL) : 10.0;
+    double rate = argc > 3 ? strtod(argv[3], NULL) : 20000.0;
+    uint64_t submitted = 0, records = 0, bytes = 0, gaps = 0, outOfOrder = 0, fewest = UINT64_MAX;
+    uint32_t tube, dropped = 0;
+    double ms;
+    long i;
+    int bucket;
+
+    if (argc < 1) {
+        printUsage();
+        return 1;
+    }
+    if (clientCount < 1 || clientCount > STREAM_MAX_CLIENTS - 1 || seconds <= 0.0 || rate <= 0.0) {
+        printf("Clients must be between 1 and %d, seconds and scans per second positive\n", STREAM_MAX_CLIENTS - 1);
+        return 1;
+    }
+    if (strlen(argv[0]) >= sizeof(address.sun_path)) {
+        printf("Socket path too long\n");
+        return 1;
+    }
+    clients = calloc((size_t)clientCount, sizeof(StreamBenchClient));
+    if (clients == NULL || WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
+        printf("Out of memory for %ld clients, or Winsock unavailable\n", clientCount);
+        free(clients);
+        return 1;
+    }
+    if (streamServerOpen(&server, argv[0]) != 0) {
+        printf("Failed to listen on %s: %s\n", argv[0], server.failure);
+        free(clients);
+        WSACleanup();
+        return 1;
+    }
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, argv[0]);
+    QueryPerformanceFrequency(&shared.tickRate);
+    QueryPerformanceCounter(&shared.start);
+    shared.submitting = true;
+    for (i = 0; i < clientCount; i++) {
+        clients[i].shared = &shared;
+        clients[i].payload = malloc(STREAM_PENDING_BYTES);
+        clients[i].socket = streamBenchConnect(&address);
+        if (clients[i].payload == NULL || clients[i].socket == INVALID_SOCKET) {
+            printf("Cannot connect client %ld\n", i + 1);
+            if (clients[i].socket != INVALID_SOCKET) {
+                closesocket(clients[i].socket);
+            }
+            free(clients[i].payload);
+            clientCount = i;
+            break;
+        }
+        clients[i].thread = (HANDLE)_beginthreadex(NULL, 0, streamBenchRead, &clients[i], 0, NULL);
+    }
+    stuck = streamBenchConnect(&address);
+    Sleep(2 * STREAM_BATCH_MS); // Let the server accept everyone before the first scan
+
+    // Catch up with the rate after every Sleep, so scans come in bursts of at most a scheduler tick
+    QueryPerformanceCounter(&shared.start);
+    while ((ms = elapsedMs(shared.start, shared.tickRate)) < seconds * 1000.0) {
+        uint64_t due = (uint64_t)(ms * rate / 1000.0);
+
+        for (; submitted < due; submitted++) {
+            for (tube = 0; tube < STREAM_BENCH_TUBES; tube++) {
+                state.position[tube] = (uint8_t)((submitted + tube) & PACKED_DATA_MASK);
+            }
+            streamServerSubmitScan(&server, (uint32_t)(submitted % STREAM_BENCH_MONITORS),
+                                   streamBenchNowUs(&shared), &state, STREAM_BENCH_TUBES);
+        }
+        Sleep(1);
+    }
+    Sleep(5 * STREAM_BATCH_MS); // The last batch goes out
+    shared.submitting = false;
+    streamServerClose(&server); // Disconnects every client, ending their threads
+    for (i = 0; i < clientCount; i++) {
+        WaitForSingleObject(clients[i].thread, INFINITE);
+        CloseHandle(clients[i].thread);
+        closesocket(clients[i].socket);
+        free(clients[i].payload);
+    }
+    if (stuck != INVALID_SOCKET) {
+        closesocket(stuck);
+    }
+
+    for (i = 0; i < clientCount; i++) {
+        StreamBenchClient* client = &clients[i];
+
+        if (client->dropped) {
+            dropped++;
+            continue;
+        }
+        records += client->records;
+        bytes += client->bytes;
+        gaps += client->sequenceGaps;
+        outOfOrder += client->outOfOrder;
+        fewest = client->records < fewest ? client->records : fewest;
+        for (bucket = 0; bucket < LATENCY_BUCKETS; bucket++) {
+            latency.counts[bucket] += client->latency.counts[bucket];
+        }
+        latency.samples += client->latency.samples;
+        latency.totalNs += client->latency.totalNs;
+        if (client->latency.maxNs > latency.maxNs) {
+            latency.maxNs = client->latency.maxNs;
+        }
+    }
+    printf("%llu scans of %d tubes in %.1f s (%.0f per s), %llu dropped by the server, %llu frames sent\n",
+           (unsigned long long)submitted, STREAM_BENCH_TUBES, seconds, submitted / seconds,
+           (unsigned long long)server.recordsDropped, (unsigned long long)server.framesSent);
+    printf("%ld reading clients, %u of them disconnected; the client that never reads was %s\n", clientCount,
+           dropped, server.clientsDropped > dropped ? "disconnected" : "still connected at the end");
+    if (clientCount > (long)dropped) {
+        printf("Clients still connected: %.1f MB/s in all, fewest scans received %llu of %llu, "
+               "%llu frames missing, %llu scans out of order\n\n",
+               bytes / seconds / 1e6, (unsigned long long)fewest,
+               (unsigned long long)(submitted - server.recordsDropped), (unsigned long long)gaps,
+               (unsigned long long)outOfOrder);
+        latencyPrint(&latency, "Submit to receipt (clients still connected)");
+    }
+    free(clients);
+    WSACleanup();
+    return dropped > 0 || gaps > 0 || outOfOrder > 0 ? 1 : 0;
+}
+
+int runRecover(int argc, char* argv[]) {
+    ArchiveRecovery recovery;
+
+    if (argc < 1) {
+        printUsage();
+        return 1;
+    }
+    if (archiveRecover(argv[0], &recovery) != 0) {
+        printf("Cannot recover %s (missing, not an archive or wrong version)\n", argv[0]);
+        return 1;
+    }
+    if (!recovery.wasOpen) {
+        printf("%s was closed properly, nothing to do\n", argv[0]);
+        return 0;
+    }
+    printf("Recovered %s: kept %u blocks (%llu scans), cut %llu bytes after the last whole block\n", argv[0],
+           recovery.blocksKept, (unsigned long long)recovery.scansKept, (unsigned long long)recovery.bytesDropped);
+    return 0;
+}
+
+// Appends scans of 16 busy tubes as fast as possible with a short sync interval and small
+// segments, so the writer thread syncs constantly; archiveAppendScan must not notice
+int runSyncBench(int argc, char* argv[]) {
+    static ArchiveWriter writer; // Large block buffers, keep it off the stack
+    static ScanState state;
+    ArchiveOptions options = {ARCHIVE_SYNC_MS, 4};
+    LARGE_INTEGER start, now, tickRate;
+    double seconds = argc > 1 ? strtod(argv[1], NULL) : 10.0;
+    uint32_t random = 1;
+    uint64_t scans = 0;
+    int64_t elapsedUs = 0;
+
+    if (argc < 1) {
+        printUsage();
+        return 1;
+    }
+    options.syncMs = argc > 2 ? (uint32_t)strtoul(argv[2], NULL, 10) : 20;
+    if (archiveOpen(&writer, argv[0], 1, 16, &options) != 0) {
+        printf("Cannot create %s\n", argv[0]);
+        return 1;
+    }
+
+    QueryPerformanceFrequency(&tickRate);
+    QueryPerformanceCounter(&start);
+    while (elapsedUs < seconds * 1e6) {
+        uint32_t tube;
+
+        // One tube changes position every scan
+        random = random * 1103515245u + 12345u;
+        tube = (random >> 16) % 16;
+        state.position[tube] = (uint8_t)((random >> 8) % 16);
+        state.eating[tube] = state.position[tube] == 1;
+
+        QueryPerformanceCounter(&now);
+        elapsedUs = (now.QuadPart - start.QuadPart) * 1000000 / tickRate.QuadPart;
+        archiveAppendScan(&writer, elapsedUs, &state);
+        scans++;
+    }
+    archiveClose(&writer);
+
+    printf("%llu scans in %.1f s, %llu written, %llu dropped, %llu syncs every %u ms, %u segments\n\n",
+           (unsigned long long)scans, seconds, (unsigned long long)writer.stats.scansWritten,
+           (unsigned long long)writer.stats.scansDropped, (unsigned long long)writer.stats.syncs,
+           options.syncMs, writer.stats.segmentsClosed);
+    latencyPrint(&writer.appendLatency, "archiveAppendScan");
+    printf("\n");
+    latencyPrint(&writer.syncLatency, "Sync (writer thread)");
+    return 0;
+}
+
+// Lower bound of a dwell bucket as text
+static void formatDwellBucket(int bucket, char* buffer, size_t size) {
+    uint64_t ms = bucket == 0 ? 0 : 1ull << (bucket - 1);
+
+    if (ms < 1000) {
+        snprintf(buffer, size, "%llu ms", (unsigned long long)ms);
+    } else {
+        snprintf(buffer, size, "%.0f s", ms / 1000.0);
+    }
+}
+
+// Per-position detail of one tube: occupancy and visits, visit lengths, transitions
+static void printTubePositions(const TubePositionStats* tube, uint64_t totalUs) {
+    int position, to, bucket;
+
+    printf("Position |   Time (s) |      %% | Visits | Mean visit (s)\n");
+    printf("---------|------------|--------|--------|---------------\n");
+    for (position = 0; position < BIN_POSITIONS; position++) {
+        if (tube->occupancyUs[position] == 0 && tube->visits[position] == 0) {
+            continue;
+        }
+        printf("%8d | %10.1f | %5.1f%% | %6u | %14.2f\n", position, tube->occupancyUs[position] / 1e6,
+               totalUs > 0 ? 100.0 * tube->occupancyUs[position] / totalUs : 0.0, tube->visits[position],
+               tube->visits[position] > 0 ? tube->dwellUs[position] / 1e6 / tube->visits[position] : 0.0);
+    }
+
+    printf("\nFinished visits by length (rows: at least, columns: position)\n");
+    printf("%9s", "");
+    for (position = 0; position < BIN_POSITIONS; position++) {
+        printf(" %5d", position);
+    }
+    printf("\n");
+    for (bucket = 0; bucket < TUBE_STATS_DWELL_BUCKETS; bucket++) {
+        char label[16];
+        bool any = false;
+
+        for (position = 0; position < BIN_POSITIONS; position++) {
+            any |= tube->dwells[position][bucket] != 0;
+        }
+        if (!any) {
+            continue;
+        }
+        formatDwellBucket(bucket, label, sizeof(label));
+        printf("%9s", label);
+        for (position = 0; position < BIN_POSITIONS; position++) {
+            printf(" %5u", tube->dwells[position][bucket]);
+        }
+        printf("\n");
+    }
+
+    printf("\nTransitions (rows: from, columns: to)\n");
+    printf("%4s", "");
+    for (to = 0; to < BIN_POSITIONS; to++) {
+        printf(" %5d", to);
+    }
+    printf("\n");
+    for (position = 0; position < BIN_POSITIONS; position++) {
+        printf("%4d", position);
+        for (to = 0; to < BIN_POSITIONS; to++) {
+            printf(" %5u", tube->transitions[position][to]);
+        }
+        printf("\n");
+    }
+}
+
+int runPositions(int argc, char* argv[]) {
+    static ArchiveReader reader; // Large decode scratch, keep it off the stack
+    static int64_t times[ARCHIVE_BLOCK_SCANS];
+    static uint8_t states[ARCHIVE_BLOCK_SCANS * SCAN_MAX_TUBES];
+    static TubeStats stats, snapshot;
+    ScanState scan;
+    int64_t lastUs = 0;
+    bool started = false;
+    uint64_t totalUs;
+    long onlyTube = 0;
+    uint32_t block, tube, tubeCount, segment = 1, segments = 0, skipped = 0;
+
+    if (argc < 1) {
+        printUsage();
+        return 1;
+    }
+    if (archiveReaderOpen(&reader, argv[0]) != 0) {
+        printf("Cannot open archive %s (missing, unfinished or wrong version, see madtool recover)\n", argv[0]);
+        return 1;
+    }
+    if (argc > 1) {
+        onlyTube = strtol(argv[1], NULL, 10);
+        if (onlyTube < 1 || onlyTube > (long)reader.tubeCount) {
+            printf("Tube must be between 1 and %u\n", reader.tubeCount);
+            archiveReaderClose(&reader);
+            return 1;
+        }
+    }
+
+    // Same accumulator as program.exe, fed the way the decoder would have
+    tubeCount = reader.tubeCount;
+    memset(&scan, 0, sizeof(scan));
+    tubeStatsInit(&stats, tubeCount);
+    do {
+        for (block = 0; block < reader.blockCount; block++) {
+            int scanCount = archiveReaderDecodeBlock(&reader, block, times, states);
+            int i;
+
+            if (scanCount < 0) {
+                printf("Archive is corrupt at block %u of segment %u\n", block, segment - 1);
+                archiveReaderClose(&reader);
+                return 1;
+            }
+            if (started && (reader.index[block].flags & ARCHIVE_BLOCK_AFTER_GAP)) {
+                tubeStatsGap(&stats, lastUs, reader.index[block].firstTimeUs);
+            }
+            for (i = 0; i < scanCount; i++) {
+                const uint8_t* row = states + (size_t)i * tubeCount;
+                ScanDelta delta = {0, 0};
+
+                for (tube = 0; tube < tubeCount; tube++) {
+                    uint8_t position = row[tube] & PACKED_DATA_MASK;
+                    delta.moved |= (uint64_t)(position != scan.position[tube]) << tube;
+                    scan.position[tube] = position;
+                    scan.eating[tube] = row[tube] >> 4;
+                }
+                tubeStatsScan(&stats, times[i], &scan, delta);
+                lastUs = times[i];
+                started = true;
+            }
+        }
+        segments++;
+        archiveReaderClose(&reader);
+    } while (openNextSegment(&reader, argv[0], tubeCount, &segment, &skipped));
+    tubeStatsSnapshot(&stats, &snapshot);
+    totalUs = snapshot.started ? (uint64_t)(snapshot.latestUs - snapshot.firstUs - snapshot.gapUs) : 0;
+    printf("%llu scans over %.1f s, %.1f s of it in gaps\n", (unsigned long long)snapshot.scans,
+           snapshot.started ? (snapshot.latestUs - snapshot.firstUs) / 1e6 : 0.0, snapshot.gapUs / 1e6);
+    printSegments(segments, skipped);
+    printf("\n");
+
+    if (onlyTube > 0) {
+        printf("Tube %ld\n\n", onlyTube);
+        printTubePositions(&snapshot.tubes[onlyTube - 1], totalUs);
+        return 0;
+    }
+
+    printf("Tube | Visits | Mean visit (s) | %% of the time at position 0-15\n");
+    printf("-----|--------|----------------|--------------------------------\n");
+    for (tube = 0; tube < snapshot.tubeCount; tube++) {
+        const TubePositionStats* position = &snapshot.tubes[tube];
+        uint64_t visits = 0, dwellUs = 0;
+        int i;
+
+        for (i = 0; i < BIN_POSITIONS; i++) {
+            visits += position->visits[i];
+            dwellUs += position->dwellUs[i];
+        }
+        printf("%4u | %6llu | %14.2f |", tube + 1, (unsigned long long)visits, visits > 0 ? dwellUs / 1e6 / visits : 0.0);
+        for (i = 0; i < BIN_POSITIONS; i++) {
+            printf(" %3.0f", totalUs > 0 ? 100.0 * position->occupancyUs[i] / totalUs : 0.0);
+        }
+        printf("\n");
+    }
+    return 0;
+}
+
+// Prints one bout of the tube runBouts lists
+static void printBout(int64_t startUs, int64_t endUs, bool cut) {
+    char startText[32], endText[32];
+
+    formatTime(startUs, startText, sizeof(startText));
+    formatTime(endUs, endText, sizeof(endText));
+    printf("%s | %s | %9.1f%s\n", startText, endText, (endUs - startUs) / 1e6, cut ? " (gap)" : "");
+}
+
+int runBouts(int argc, char* argv[]) {
+    static ArchiveReader reader; // Large decode scratch, keep it off the stack
+    static int64_t times[ARCHIVE_BLOCK_SCANS];
+    static uint8_t states[ARCHIVE_BLOCK_SCANS * SCAN_MAX_TUBES];
+    static FeedingDetector detector;
+    long startMs = FEEDING_START_MS, endMs = FEEDING_END_MS;
+    long onlyTube = 0;
+    int64_t lastUs = 0;
+    uint64_t scans = 0;
+    uint32_t block, tube, tubeCount, segment = 1, segments = 0, skipped = 0;
+
+    if (argc < 1) {
+        printUsage();
+        return 1;
+    }
+    if (argc > 1) {
+        startMs = strtol(argv[1], NULL, 10);
+    }
+    if (argc > 2) {
+        endMs = strtol(argv[2], NULL, 10);
+    }
+    if (startMs < 0 || startMs > 60000 || endMs < 0 || endMs > 60000) {
+        printf("Debounce times must be 0 to 60000 ms\n");
+        return 1;
+    }
+    if (archiveReaderOpen(&reader, argv[0]) != 0) {
+        printf("Cannot open archive %s (missing, unfinished or wrong version, see madtool recover)\n", argv[0]);
+        return 1;
+    }
+    if (argc > 3) {
+        onlyTube = strtol(argv[3], NULL, 10);
+        if (onlyTube < 1 || onlyTube > (long)reader.tubeCount) {
+            printf("Tube must be between 1 and %u\n", reader.tubeCount);
+            archiveReaderClose(&reader);
+            return 1;
+        }
+        printf("Bout start (UTC)        | Bout end (UTC)          |   Seconds\n");
+        printf("------------------------|-------------------------|----------\n");
+    }
+
+    // The archive keeps the decoder's eating flag rather than every DV-high read,
+    // so the flag stands in for the reads program.exe debounces
+    tubeCount = reader.tubeCount;
+    feedingInit(&detector, tubeCount, (uint32_t)startMs, (uint32_t)endMs);
+    do {
+        for (block = 0; block < reader.blockCount; block++) {
+            int scanCount = archiveReaderDecodeBlock(&reader, block, times, states);
+            uint64_t bit = onlyTube > 0 ? 1ull << (onlyTube - 1) : 0;
+            FeedingDelta bouts;
+            int i;
+
+            if (scanCount < 0) {
+                printf("Archive is corrupt at block %u of segment %u\n", block, segment - 1);
+                archiveReaderClose(&reader);
+                return 1;
+            }
+            if (scans > 0 && (reader.index[block].flags & ARCHIVE_BLOCK_AFTER_GAP)) {
+                bouts = feedingGap(&detector, lastUs);
+                if (bouts.ended & bit) {
+                    printBout(detector.boutStartUs[onlyTube - 1], detector.boutEndUs[onlyTube - 1],
+                              (bouts.cutByGap & bit) != 0);
+                }
+            }
+            for (i = 0; i < scanCount; i++) {
+                const uint8_t* row = states + (size_t)i * tubeCount;
+                uint64_t seen = 0;
+
+                for (tube = 0; tube < tubeCount; tube++) {
+                    seen |= (uint64_t)(row[tube] >> 4) << tube;
+                }
+                bouts = feedingScan(&detector, times[i], seen);
+                if (bouts.ended & bit) {
+                    printBout(detector.boutStartUs[onlyTube - 1], detector.boutEndUs[onlyTube - 1], false);
+                }
+                lastUs = times[i];
+            }
+            scans += (uint64_t)scanCount;
+        }
+        segments++;
+        archiveReaderClose(&reader);
+    } while (openNextSegment(&reader, argv[0], tubeCount, &segment, &skipped));
+
+    if (onlyTube > 0) {
+        if (detector.feeding & (1ull << (onlyTube - 1))) {
+            printf("Still feeding since ");
+            printBout(detector.boutStartUs[onlyTube - 1], lastUs, false);
+        }
+        printf("\n%u bouts, %.1f s in total\n", detector.bouts[onlyTube - 1], detector.boutUs[onlyTube - 1] / 1e6);
+        printSegments(segments, skipped);
+        return 0;
+    }
+
+    printf("%llu scans, bouts start after %ld ms of feeding and end after %ld ms without\n",
+           (unsigned long long)scans, startMs, endMs);
+    printSegments(segments, skipped);
+    printf("\n");
+    printf("Tube |  Bouts | Total (s) | Mean (s) | Longest (s)\n");
+    printf("-----|--------|-----------|----------|------------\n");
+    for (tube = 0; tube < tubeCount; tube++) {
+        printf("%4u | %6u | %9.1f | %8.2f | %11.1f%s\n", tube + 1, detector.bouts[tube], detector.boutUs[tube] / 1e6,
+               detector.bouts[tube] > 0 ? detector.boutUs[tube] / 1e6 / detector.bouts[tube] : 0.0,
+               detector.longestUs[tube] / 1e6, detector.feeding >> tube & 1 ? "  feeding at the end" : "");
+    }
+    return 0;
+}
+
+int runWalk(int argc, char* argv[]) {
+    static ArchiveReader reader; // Large decode scratch, keep it off the stack
+    static int64_t times[ARCHIVE_BLOCK_SCANS];
+    static uint8_t states[ARCHIVE_BLOCK_SCANS * SCAN_MAX_TUBES];
+    static LocomotionTracker tracker;
+    float spacingMm = LOCOMOTION_SPACING_MM;
+    long smoothMs = LOCOMOTION_SMOOTH_MS;
+    ScanState scan;
+    uint64_t scans = 0;
+    uint32_t block, tube, tubeCount, segment = 1, segments = 0, skipped = 0;
+
+    if (argc < 1) {
+        printUsage();
+        return 1;
+    }
+    if (argc > 1) {
+        spacingMm = strtof(argv[1], NULL);
+    }
+    if (argc > 2) {
+        smoothMs = strtol(argv[2], NULL, 10);
+    }
+    if (spacingMm <= 0.0f || smoothMs < 0 || smoothMs > 60000) {
+        printf("Spacing must be positive and smoothing 0 to 60000 ms\n");
+        return 1;
+    }
+    if (archiveReaderOpen(&reader, argv[0]) != 0) {
+        printf("Cannot open archive %s (missing, unfinished or wrong version, see madtool recover)\n", argv[0]);
+        return 1;
+    }
+
+    // Same tracker as program.exe, fed the way the decoder would have
+    tubeCount = reader.tubeCount;
+    memset(&scan, 0, sizeof(scan));
+    locomotionInit(&tracker, tubeCount, spacingMm, (uint32_t)smoothMs);
+    do {
+        for (block = 0; block < reader.blockCount; block++) {
+            int scanCount = archiveReaderDecodeBlock(&reader, block, times, states);
+            int i;
+
+            if (scanCount < 0) {
+                printf("Archive is corrupt at block %u of segment %u\n", block, segment - 1);
+                archiveReaderClose(&reader);
+                return 1;
+            }
+            if (scans > 0 && (reader.index[block].flags & ARCHIVE_BLOCK_AFTER_GAP)) {
+                locomotionGap(&tracker);
+            }
+            for (i = 0; i < scanCount; i++) {
+                const uint8_t* row = states + (size_t)i * tubeCount;
+                ScanDelta delta = {0, 0};
+
+                for (tube = 0; tube < tubeCount; tube++) {
+                    uint8_t position = row[tube] & PACKED_DATA_MASK;
+                    delta.moved |= (uint64_t)(position != scan.position[tube]) << tube;
+                    scan.position[tube] = position;
+                }
+                locomotionScan(&tracker, times[i], &scan, delta);
+            }
+            scans += (uint64_t)scanCount;
+        }
+        segments++;
+        archiveReaderClose(&reader);
+    } while (openNextSegment(&reader, argv[0], tubeCount, &segment, &skipped));
+
+    printf("%llu scans, %.1f mm between beams, positions count after holding %ld ms\n",
+           (unsigned long long)scans, spacingMm, smoothMs);
+    printSegments(segments, skipped);
+    printf("\n");
+    printf("Tube |  Steps |  Path (mm) | Top (mm/s) | Episodes | Mean episode (s) | Longest (s)\n");
+    printf("-----|--------|------------|------------|----------|------------------|------------\n");
+    for (tube = 0; tube < tubeCount; tube++) {
+        const TubeLocomotion* walker = &tracker.tubes[tube];
+
+        printf("%4u | %6u | %10.0f | %10.1f | %8u | %16.2f | %11.1f%s\n", tube + 1, walker->steps,
+               locomotionPathMm(&tracker, tube), walker->topSpeed, walker->episodes,
+               walker->episodes > 0 ? walker->episodeUs / 1e6 / walker->episodes : 0.0,
+               walker->longestEpisodeUs / 1e6, tracker.moving >> tube & 1 ? "  moving at the end" : "");
+    }
+    return 0;
+}
+
+// One archive of runCircadian, replayed by whichever worker picks it up
+typedef struct {
+    const char* path;
+    ArchiveReader reader;
+    int64_t times[ARCHIVE_BLOCK_SCANS];
+    uint8_t states[ARCHIVE_BLOCK_SCANS * SCAN_MAX_TUBES];
+    CircadianEngine engine;
+    uint64_t scans;
+    uint32_t segments;
+    uint32_t segmentsSkipped;
+    int error;               // 0, or why the archive has no results
+} CircadianJob;
+
+static void addCircadianBin(const ActivityBin* bin, uint32_t tubeCount, void* context) {
+    circadianAddBin(context, bin);
+}
+
+static void replayCircadian(void* context, int worker) {
+    CircadianJob* job = context;
+    ActivityBinner binner;
+    ScanState scan;
+    uint32_t block, tubeCount, segment = 1;
+
+    if (archiveReaderOpen(&job->reader, job->path) != 0) {
+        job->error = 1;
+        return;
+    }
+    tubeCount = job->reader.tubeCount;
+    if (circadianOpen(&job->engine, tubeCount) != 0) {
+        archiveReaderClose(&job->reader);
+        job->error = 2;
+        return;
+    }
+
+    // The same one-minute bins program.exe feeds its engine, over every segment
+    memset(&scan, 0, sizeof(scan));
+    binnerInit(&binner, 60000000LL, tubeCount, addCircadianBin, &job->engine);
+    do {
+        for (block = 0; block < job->reader.blockCount; block++) {
+            EnvironmentEvent events[ARCHIVE_BLOCK_MAX_EVENTS];
+            int scanCount = archiveReaderDecodeBlock(&job->reader, block, job->times, job->states);
+            int eventCount = archiveReaderBlockEvents(&job->reader, block, events);
+            int next = 0;
+            int i;
+
+            if (scanCount < 0 || eventCount < 0) {
+                job->error = 3;
+                break;
+            }
+            for (i = 0; i < scanCount; i++) {
+                const uint8_t* row = job->states + (size_t)i * tubeCount;
+                ScanDelta delta = {0, 0};
+                uint32_t tube;
+
+                for (tube = 0; tube < tubeCount; tube++) {
+                    uint8_t position = row[tube] & PACKED_DATA_MASK;
+                    delta.moved |= (uint64_t)(position != scan.position[tube]) << tube;
+                    scan.position[tube] = position;
+                }
+                replayEvents(&binner, events, eventCount, &next, job->times[i]);
+                binnerAddScan(&binner, job->times[i], &scan, delta);
+            }
+            job->scans += (uint64_t)scanCount;
+        }
+        job->segments++;
+        archiveReaderClose(&job->reader);
+    } while (job->error == 0 &&
+             openNextSegment(&job->reader, job->path, tubeCount, &segment, &job->segmentsSkipped));
+    binnerFlush(&binner);
+    circadianFlush(&job->engine);
+    circadianPublish(&job->engine);
+}
+
+int runCircadian(int argc, char* argv[]) {
+    static const char* errors[] = {"", "cannot open (missing, unfinished or wrong version, see madtool recover)",
+                                   "out of memory", "corrupt"};
+    CircadianJob* jobs;
+    CircadianResult results[SCAN_MAX_TUBES];
+    SYSTEM_INFO system;
+    WorkPool pool;
+    LARGE_INTEGER tickRate, start, end;
+    int workerCount;
+    int failed = 0;
+    int i;
+
+    if (argc < 1) {
+        printUsage();
+        return 1;
+    }
+    jobs = calloc((size_t)argc, sizeof(CircadianJob));
+    if (jobs == NULL) {
+        printf("Out of memory for %d archives\n", argc);
+        return 1;
+    }
+    GetSystemInfo(&system);
+    workerCount = (int)system.dwNumberOfProcessors;
+    workerCount = workerCount < 1 ? 1 : workerCount > WORK_POOL_MAX_WORKERS ? WORK_POOL_MAX_WORKERS : workerCount;
+    workerCount = workerCount > argc ? argc : workerCount;
+
+    // Archives are independent, so a rack is spread over every CPU a monitor at a time
+    QueryPerformanceFrequency(&tickRate);
+    QueryPerformanceCounter(&start);
+    if (workPoolStart(&pool, workerCount, NULL, NULL) != 0) {
+        printf("Cannot start %d workers\n", workerCount);
+        free(jobs);
+        return 1;
+    }
+    for (i = 0; i < argc; i++) {
+        jobs[i].path = argv[i];
+        while (workPoolSubmit(&pool, i, replayCircadian, &jobs[i]) != 0) {
+            Sleep(1);  // Every queue is full
+        }
+    }
+    workPoolStop(&pool);
+    QueryPerformanceCounter(&end);
+
+    for (i = 0; i < argc; i++) {
+        CircadianJob* job = &jobs[i];
+        uint32_t bins;
+        uint32_t tube;
+
+        if (job->error != 0) {
+            printf("%s: %s\n\n", job->path, errors[job->error]);
+            circadianClose(&job->engine);
+            failed = 1;
+            continue;
+        }
+        bins = circadianSnapshot(&job->engine, results);
+        printf("%s: %llu scans, %.1f days in full 30-minute bins\n", job->path, (unsigned long long)job->scans,
+               bins / 48.0);
+        printSegments(job->segments, job->segmentsSkipped);
+        printf("\n");
+        printf("Tube | Chi-square (h) |     Qp | Qp 1%% | Lomb-Scargle (h) | Power | Power 1%% | Rhythmic | Dark\n");
+        printf("-----|----------------|--------|-------|------------------|-------|----------|----------|-----\n");
+        for (tube = 0; tube < job->engine.tubeCount; tube++) {
+            const CircadianResult* result = &results[tube];
+            char dark[8] = "-";
+
+            if (bins > 0 && !isnan(result->darkShare)) {
+                snprintf(dark, sizeof(dark), "%3.0f%%", 100.0 * result->darkShare);
+            }
+            if (result->chiPeriodH == 0.0f) {
+                printf("%4u | %14s | %6s | %5s | %16s | %5s | %8s | %-8s | %s\n", tube + 1, "-", "-", "-", "-", "-", "-",
+                       "-", dark);
+                continue;
+            }
+            printf("%4u | %14.1f | %6.1f | %5.1f | %16.1f | %5.1f | %8.1f | %-8s | %s\n", tube + 1, result->chiPeriodH,
+                   result->chiQp, result->chiThreshold, result->lsPeriodH, result->lsPower, result->lsThreshold,
+                   result->chiQp > result->chiThreshold && result->lsPower > result->lsThreshold ? "yes" : "no", dark);
+        }
+        printf("\n");
+        circadianClose(&job->engine);
+    }
+    printf("%d archive(s) on %d worker(s) in %.2f s\n", argc, workerCount,
+           (double)(end.QuadPart - start.QuadPart) / tickRate.QuadPart);
+    free(jobs);
+    return failed;
+}
+
+int runHealth(int argc, char* argv[]) {
+    static ArchiveReader reader; // Large decode scratch, keep it off the stack
+    static int64_t times[ARCHIVE_BLOCK_SCANS];
+    static uint8_t states[ARCHIVE_BLOCK_SCANS * SCAN_MAX_TUBES];
+    static HealthTracker tracker;
+    int64_t flaggedUs[SCAN_MAX_TUBES] = {0};
+    uint32_t alerts[SCAN_MAX_TUBES] = {0};
+    long deadHours = TUBE_HEALTH_DEAD_HOURS, emptyHours = TUBE_HEALTH_EMPTY_HOURS;
+    int64_t lastUs = 0;
+    ScanState scan;
+    uint32_t block, tube, tubeCount, segment = 1, segments = 0, skipped = 0;
+
+    if (argc < 1) {
+        printUsage();
+        return 1;
+    }
+    if (argc > 1) {
+        deadHours = strtol(argv[1], NULL, 10);
+    }
+    if (argc > 2) {
+        emptyHours = strtol(argv[2], NULL, 10);
+    }
+    if (deadHours < 1 || deadHours > 240 || emptyHours < 1 || emptyHours > 240) {
+        printf("Dead and empty times must be 1 to 240 hours\n");
+        return 1;
+    }
+    if (archiveReaderOpen(&reader, argv[0]) != 0) {
+        printf("Cannot open archive %s (missing, unfinished or wrong version, see madtool recover)\n", argv[0]);
+        return 1;
+    }
+
+    // Same classifier as program.exe, fed the way the decoder would have
+    tubeCount = reader.tubeCount;
+    memset(&scan, 0, sizeof(scan));
+    healthInit(&tracker, tubeCount, (uint32_t)deadHours, (uint32_t)emptyHours);
+    do {
+        for (block = 0; block < reader.blockCount; block++) {
+            int scanCount = archiveReaderDecodeBlock(&reader, block, times, states);
+            int i;
+
+            if (scanCount < 0) {
+                printf("Archive is corrupt at block %u of segment %u\n", block, segment - 1);
+                archiveReaderClose(&reader);
+                return 1;
+            }
+            for (i = 0; i < scanCount; i++) {
+                const uint8_t* row = states + (size_t)i * tubeCount;
+                ScanDelta delta = {0, 0};
+                HealthDelta changes;
+                uint64_t bits;
+
+                for (tube = 0; tube < tubeCount; tube++) {
+                    uint8_t position = row[tube] & PACKED_DATA_MASK;
+                    delta.moved |= (uint64_t)(position != scan.position[tube]) << tube;
+                    scan.position[tube] = position;
+                }
+                changes = healthScan(&tracker, times[i], &scan, delta);
+                for (bits = changes.dead | changes.empty; bits; bits &= bits - 1) {
+                    tube = (uint32_t)__builtin_ctzll(bits);
+                    flaggedUs[tube] = times[i];
+                    alerts[tube]++;
+                }
+                lastUs = times[i];
+            }
+        }
+        segments++;
+        archiveReaderClose(&reader);
+    } while (openNextSegment(&reader, argv[0], tubeCount, &segment, &skipped));
+
+    printf("Flies are flagged dead after %ld h at one beam, tubes empty after %ld h without a fly\n",
+           deadHours, emptyHours);
+    printSegments(segments, skipped);
+    printf("\n");
+    printf("Tube | State | Alerts | Flagged (UTC)           | Left its beam (UTC)     | Spread (beams)\n");
+    printf("-----|-------|--------|-------------------------|-------------------------|---------------\n");
+    for (tube = 0; tube < tubeCount; tube++) {
+        const TubeHealth* health = &tracker.tubes[tube];
+        static const char* names[] = {"alive", "dead", "empty"};
+        char flagged[32] = "-", moved[32] = "-";
+
+        if (alerts[tube] > 0) {
+            formatTime(flaggedUs[tube], flagged, sizeof(flagged));
+        }
+        if (health->anchor != 0) {
+            formatTime(health->anchorUs, moved, sizeof(moved));
+        }
+        printf("%4u | %-5s | %6u | %-23s | %-23s | %14.2f\n", tube + 1, names[health->state], alerts[tube],
+               flagged, moved, healthSpread(&tracker, tube, lastUs));
+    }
+    return 0;
+}
+
+int runPyramid(int argc, char* argv[]) {
+    static ArchiveReader reader; // Large decode scratch, keep it off the stack
+    static int64_t times[ARCHIVE_BLOCK_SCANS];
+    static uint8_t states[ARCHIVE_BLOCK_SCANS * SCAN_MAX_TUBES];
+    static PyramidWriter pyramid;
+    char path[MAX_PATH];
+    uint64_t scans = 0;
+    uint32_t segment, block;
+    int level;
+
+    if (argc < 1) {
+        printUsage();
+        return 1;
+    }
+    if (archiveReaderOpen(&reader, argv[0]) != 0) {
+        printf("Cannot open archive %s (missing, unfinished or wrong version, see madtool recover)\n", argv[0]);
+        return 1;
+    }
+
+    // Started over, a pyramid holds exactly what the segments hold
+    for (level = 0; level < PYRAMID_LEVELS; level++) {
+        pyramidLevelPath(argv[0], level, path, sizeof(path));
+        remove(path);
+    }
+    if (pyramidOpen(&pyramid, argv[0], reader.tubeCount) != 0) {
+        printf("Cannot create the pyramid files of %s\n", argv[0]);
+        archiveReaderClose(&reader);
+        return 1;
+    }
+    archiveReaderClose(&reader);
+
+    for (segment = 0; ; segment++) {
+        archiveSegmentPath(argv[0], segment, path, sizeof(path));
+        if (GetFileAttributesA(path) == INVALID_FILE_ATTRIBUTES) {
+            break;
+        }
+        if (archiveReaderOpen(&reader, path) != 0 || reader.tubeCount != pyramid.tubeCount) {
+            printf("Skipped %s (unfinished, wrong version or other tubes)\n", path);
+            continue;
+        }
+        pyramid.havePrevious = false; // As the recorder does at every segment
+        for (block = 0; block < reader.blockCount; block++) {
+            int scanCount = archiveReaderDecodeBlock(&reader, block, times, states);
+
+            if (scanCount < 0) {
+                printf("%s is corrupt at block %u, rest of it skipped\n", path, block);
+                break;
+            }
+            pyramidAddScans(&pyramid, times, states, scanCount,
+                            (reader.index[block].flags & ARCHIVE_BLOCK_AFTER_GAP) != 0);
+            scans += (uint64_t)scanCount;
+        }
+        archiveReaderClose(&reader);
+    }
+
+    if (pyramidClose(&pyramid) != 0) {
+        printf("Failed to write the pyramid of %s\n", argv[0]);
+        return 1;
+    }
+    printf("Rebuilt the pyramid of %s from %u segment(s): %llu scans, %llu bins\n", argv[0], segment,
+           (unsigned long long)scans, (unsigned long long)pyramid.binsWritten);
+    for (level = 0; level < PYRAMID_LEVELS; level++) {
+        pyramidLevelPath(argv[0], level, path, sizeof(path));
+        printf("  %s\n", path);
+    }
+    return 0;
+}
+
+int runZoom(int argc, char* argv[]) {
+    static const char digits[] = "0123456789abcdef";
+    PyramidReader reader;
+    int64_t startUs, endUs, index, last;
+    long tube, maxBins = 48;
+    int level;
+
+    if (argc < 4) {
+        printUsage();
+        return 1;
+    }
+    tube = strtol(argv[1], NULL, 10);
+    startUs = parseTimeArg(argv[2]);
+    endUs = parseTimeArg(argv[3]);
+    if (argc > 4) {
+        maxBins = strtol(argv[4], NULL, 10);
+    }
+    if (endUs < startUs || maxBins < 1) {
+        printf("End must not be before start, and bins must be at least 1\n");
+        return 1;
+    }
+    if (pyramidReaderOpen(&reader, argv[0]) != 0) {
+        printf("No pyramid for %s (recorded with pyramid = no? madtool pyramid builds one)\n", argv[0]);
+        return 1;
+    }
+    if (tube < 1 || tube > (long)reader.tubeCount) {
+        printf("Tube must be between 1 and %u\n", reader.tubeCount);
+        pyramidReaderClose(&reader);
+        return 1;
+    }
+
+    // The finest level that fits in the rows asked for, read straight from the mapping
+    level = pyramidChooseLevel(&reader, startUs, endUs, (uint32_t)maxBins);
+    index = startUs / pyramidBinUs(level);
+    last = endUs / pyramidBinUs(level);
+    printf("Tube %ld, %lld s bins. Occupancy is the share of scans at positions 0 to 15, in 15ths; * after a gap\n\n",
+           tube, (long long)(pyramidBinUs(level) / 1000000));
+    printf("Bin start (UTC)         |  Scans |  Moves | Feeding | Mean pos | Occupancy\n");
+    printf("------------------------|--------|--------|---------|----------|-----------------\n");
+    for (; index <= last; index++) {
+        const PyramidBinHeader* bin = pyramidBin(&reader, level, index);
+        const PyramidTubeBin* record;
+        char timeText[32], occupancy[PYRAMID_POSITIONS + 1];
+        uint32_t position, share, shares = 0, weighted = 0;
+
+        formatTime(index * pyramidBinUs(level), timeText, sizeof(timeText));
+        if (bin == NULL || bin->scans == 0) {
+            printf("%s |      0 |      - |       - |        - | -\n", timeText);
+            continue;
+        }
+        record = (const PyramidTubeBin*)(bin + 1) + (tube - 1);
+        for (position = 0; position < PYRAMID_POSITIONS; position++) {
+            share = pyramidOccupancy(record, position);
+            occupancy[position] = digits[share];
+            if (position > 0) {
+                shares += share;
+                weighted += share * position;
+            }
+        }
+        occupancy[PYRAMID_POSITIONS] = '\0';
+        printf("%s | %6u | %6u | %6.1f%% | ", timeText, bin->scans, record->moves,
+               100.0 * record->feedingScans / bin->scans);
+        if (shares > 0) {
+            printf("%8.1f", (double)weighted / shares);
+        } else {
+            printf("       -");
+        }
+        printf(" | %s%s\n", occupancy, (bin->flags & PYRAMID_BIN_AFTER_GAP) ? " *" : "");
+    }
+    pyramidReaderClose(&reader);
+    return 0;
+}
+
+// One monitor of runSynchrony: its minutes as bits, one tube per bit
+typedef struct {
+    int64_t startUs;
+    uint64_t active;
+    uint32_t scans;
+} SynchronyMinute;
+
+typedef struct {
+    const char* path;
+    ArchiveReader reader;
+    int64_t times[ARCHIVE_BLOCK_SCANS];
+    uint8_t states[ARCHIVE_BLOCK_SCANS * SCAN_MAX_TUBES];
+    uint32_t tubeCount;
+    SynchronyMinute* minutes;
+    uint32_t minuteCount;
+    uint32_t minuteSlots;
+    uint32_t segments;
+    uint32_t segmentsSkipped;
+    int error;               // 0, or why the archive has no results
+} SynchronyJob;
+
+static void addSynchronyBin(const ActivityBin* bin, uint32_t tubeCount, void* context) {
+    SynchronyJob* job = context;
+    SynchronyMinute* minute;
+    uint32_t tube;
+
+    if (job->minuteCount == job->minuteSlots) {
+        uint32_t slots = job->minuteSlots ? job->minuteSlots * 2 : 1440;
+        SynchronyMinute* grown = realloc(job->minutes, slots * sizeof(SynchronyMinute));
+
+        if (grown == NULL) {
+            job->error = 2;
+            return;
+        }
+        job->minutes = grown;
+        job->minuteSlots = slots;
+    }
+    minute = &job->minutes[job->minuteCount++];
+    minute->startUs = bin->startUs;
+    minute->scans = bin->scans;
+    minute->active = 0;
+    for (tube = 0; tube < tubeCount; tube++) {
+        minute->active |= (uint64_t)(bin->moves[tube] > 0) << tube;
+    }
+}
+
+static void replaySynchrony(void* context, int worker) {
+    SynchronyJob* job = context;
+    ActivityBinner binner;
+    ScanState scan;
+    uint32_t block, segment = 1;
+
+    if (archiveReaderOpen(&job->reader, job->path) != 0) {
+        job->error = 1;
+        return;
+    }
+    job->tubeCount = job->reader.tubeCount;
+
+    // The same one-minute bins program.exe feeds its engine, over every segment
+    memset(&scan, 0, sizeof(scan));
+    binnerInit(&binner, 60000000LL, job->tubeCount, addSynchronyBin, job);
+    do {
+        for (block = 0; block < job->reader.blockCount && job->error == 0; block++) {
+            int scanCount = archiveReaderDecodeBlock(&job->reader, block, job->times, job->states);
+            int i;
+
+            if (scanCount < 0) {
+                job->error = 3;
+                break;
+            }
+            for (i = 0; i < scanCount; i++) {
+                const uint8_t* row = job->states + (size_t)i * job->tubeCount;
+                ScanDelta delta = {0, 0};
+                uint32_t tube;
+
+                for (tube = 0; tube < job->tubeCount; tube++) {
+                    uint8_t position = row[tube] & PACKED_DATA_MASK;
+                    delta.moved |= (uint64_t)(position != scan.position[tube]) << tube;
+                    scan.position[tube] = position;
+                }
+                binnerAddScan(&binner, job->times[i], &scan, delta);
+            }
+        }
+        job->segments++;
+        archiveReaderClose(&job->reader);
+    } while (job->error == 0 &&
+             openNextSegment(&job->reader, job->path, job->tubeCount, &segment, &job->segmentsSkipped));
+    binnerFlush(&binner);
+}
+
+#define SYNCHRONY_TOP_MINUTES 10
+
+// Keeps top sorted by active share, most first
+static void rankMinute(SynchronyBin top[], uint32_t* topCount, const SynchronyBin* bin) {
+    uint32_t slot = *topCount;
+
+    if (bin->observedTubes == 0) {
+        return;
+    }
+    while (slot > 0 && (uint64_t)bin->activeTubes * top[slot - 1].observedTubes >
+                       (uint64_t)top[slot - 1].activeTubes * bin->observedTubes) {
+        if (slot < SYNCHRONY_TOP_MINUTES) {
+            top[slot] = top[slot - 1];
+        }
+        slot--;
+    }
+    if (slot < SYNCHRONY_TOP_MINUTES) {
+        top[slot] = *bin;
+        *topCount += *topCount < SYNCHRONY_TOP_MINUTES;
+    }
+}
+
+int runSynchrony(int argc, char* argv[]) {
+    static const char* errors[] = {"", "cannot open (missing, unfinished or wrong version, see madtool recover)",
+                                   "out of memory", "corrupt"};
+    static SynchronyEngine engine; // Window bookkeeping of up to 128 monitors
+    static SynchronyBin top[SYNCHRONY_TOP_MINUTES];
+    static uint32_t tubeCounts[SYNCHRONY_MAX_MONITORS];
+    SynchronyJob* jobs;
+    uint32_t* next;              // Next minute of each archive
+    double* sums = NULL;         // [monitor][monitor] correlations of every full window
+    uint32_t* windows = NULL;
+    SYSTEM_INFO system;
+    WorkPool pool;
+    int64_t index, firstIndex = INT64_MAX, lastIndex = INT64_MIN;
+    uint32_t topCount = 0, sinceCompute = 0;
+    int workerCount;
+    int failed = 0;
+    int i, j;
+
+    if (argc < 1 || argc > SYNCHRONY_MAX_MONITORS) {
+        printUsage();
+        return 1;
+    }
+    jobs = calloc((size_t)argc, sizeof(SynchronyJob));
+    next = calloc((size_t)argc, sizeof(uint32_t));
+    if (jobs == NULL || next == NULL) {
+        printf("Out of memory for %d archives\n", argc);
+        free(jobs);
+        free(next);
+        return 1;
+    }
+    GetSystemInfo(&system);
+    workerCount = (int)system.dwNumberOfProcessors;
+    workerCount = workerCount < 1 ? 1 : workerCount > WORK_POOL_MAX_WORKERS ? WORK_POOL_MAX_WORKERS : workerCount;
+    workerCount = workerCount > argc ? argc : workerCount;
+    if (workPoolStart(&pool, workerCount, NULL, NULL) != 0) {
+        printf("Cannot start %d workers\n", workerCount);
+        free(jobs);
+        free(next);
+        return 1;
+    }
+    for (i = 0; i < argc; i++) {
+        jobs[i].path = argv[i];
+        while (workPoolSubmit(&pool, i, replaySynchrony, &jobs[i]) != 0) {
+            Sleep(1);  // Every queue is full
+        }
+    }
+    workPoolStop(&pool);
+
+    for (i = 0; i < argc; i++) {
+        SynchronyJob* job = &jobs[i];
+
+        if (job->error != 0) {
+            printf("%s: %s\n", job->path, errors[job->error]);
+            failed = 1;
+            continue;
+        }
+        tubeCounts[i] = job->tubeCount;
+        if (job->segments > 1 || job->segmentsSkipped > 0) {
+            printf("%s: ", job->path);
+            printSegments(job->segments, job->segmentsSkipped);
+        }
+        if (job->minuteCount > 0) {
+            firstIndex = job->minutes[0].startUs / 60000000LL < firstIndex ?
+                         job->minutes[0].startUs / 60000000LL : firstIndex;
+            lastIndex = job->minutes[job->minuteCount - 1].startUs / 60000000LL > lastIndex ?
+                        job->minutes[job->minuteCount - 1].startUs / 60000000LL : lastIndex;
+        }
+    }
+    if (!failed && firstIndex > lastIndex) {
+        printf("No full minute in any archive\n");
+        failed = 1;
+    }
+    if (failed) {
+        goto Done;
+    }
+    sums = calloc((size_t)argc * argc, sizeof(double));
+    windows = calloc((size_t)argc * argc, sizeof(uint32_t));
+    if (sums == NULL || windows == NULL ||
+        synchronyOpen(&engine, (uint32_t)argc, tubeCounts, 60000000LL, SYNCHRONY_WINDOW_BINS) != 0) {
+        printf("Out of memory for the synchrony window\n");
+        failed = 1;
+        goto Done;
+    }
+
+    // Every monitor reports every minute, without data where its archive has none,
+    // so each minute finishes as soon as the last monitor added it
+    for (index = firstIndex; index <= lastIndex; index++) {
+        SynchronyBin latest, peak;
+
+        for (i = 0; i < argc; i++) {
+            SynchronyJob* job = &jobs[i];
+            const SynchronyMinute* minute = next[i] < job->minuteCount ? &job->minutes[next[i]] : NULL;
+
+            if (minute != NULL && minute->startUs / 60000000LL == index) {
+                synchronyAddBin(&engine, (uint32_t)i, minute->startUs, minute->active, minute->scans > 0);
+                next[i]++;
+            } else {
+                synchronyAddBin(&engine, (uint32_t)i, index * 60000000LL, 0, false);
+            }
+        }
+        synchronyLatest(&engine, &latest, &peak);
+        rankMinute(top, &topCount, &latest);
+
+        // Windows side by side, each minute counted once
+        if (++sinceCompute == SYNCHRONY_WINDOW_BINS) {
+            sinceCompute = 0;
+            synchronyCompute(&engine);
+            for (i = 0; i < argc * argc; i++) {
+                if (!isnan(engine.monitorMatrix[i])) {
+                    sums[i] += engine.monitorMatrix[i];
+                    windows[i]++;
+                }
+            }
+        }
+    }
+
+    printf("%lld minutes of %d monitor(s), %u tubes; correlations by %s over %d-minute windows\n\n",
+           (long long)(lastIndex - firstIndex + 1), argc, engine.tubeCount, synchronyKernelName(),
+           SYNCHRONY_WINDOW_BINS);
+    printf("Most synchronous minutes:\n");
+    printf("Minute (UTC)            | Active | Of tubes | Share\n");
+    printf("------------------------|--------|----------|------\n");
+    for (i = 0; i < (int)topCount; i++) {
+        char timeText[32];
+
+        formatTime(top[i].startUs, timeText, sizeof(timeText));
+        printf("%-23s | %6u | %8u | %4.0f%%\n", timeText, top[i].activeTubes, top[i].observedTubes,
+               100.0 * top[i].activeTubes / top[i].observedTubes);
+    }
+    printf("\nMean correlation of the minutes tubes moved, by monitor (diagonal: tubes of the same monitor):\n");
+    printf("       ");
+    for (j = 0; j < argc; j++) {
+        printf(" %6d", j + 1);
+    }
+    printf("\n");
+    for (i = 0; i < argc; i++) {
+        printf("%6d ", i + 1);
+        for (j = 0; j < argc; j++) {
+            if (windows[i * argc + j] > 0) {
+                printf(" %6.2f", sums[i * argc + j] / windows[i * argc + j]);
+            } else {
+                printf(" %6s", "-");
+            }
+        }
+        printf("  %s\n", argv[i]);
+    }
+
+Done:
+    synchronyClose(&engine);
+    for (i = 0; i < argc; i++) {
+        free(jobs[i].minutes);
+    }
+    free(jobs);
+    free(next);
+    free(sums);
+    free(windows);
+    return failed;
+}
+
+int runBitmapBench(int argc, char* argv[]) {
+    const int64_t minuteUs = 60000000LL;
+    const int64_t originUs = 1767225600LL * 1000000LL; // 2026-01-01 00:00 UTC
+    const int repeats = 100;
+    uint32_t tubeCount = argc > 0 ? (uint32_t)strtoul(argv[0], NULL, 10) : 5000;
+    uint32_t days = argc > 1 ? (uint32_t)strtoul(argv[1], NULL, 10) : 30;
+    uint32_t monitorCount = (tubeCount + 63) / 64;
+    int64_t minutes = (int64_t)days * 1440, endUs = originUs + minutes * minuteUs;
+    ActivityBitmap* bitmaps;
+    uint32_t* deathMinute;   // Per tube, minutes + 1 if it never dies
+    LARGE_INTEGER tickRate, start;
+    uint64_t expected = 0, total, found, bytes = 0, kinds[3] = {0, 0, 0};
+    uint32_t random = 1, monitor, tube;
+    int64_t minute;
+    double ms;
+    int i;
+
+    if (tubeCount == 0 || days == 0) {
+        printUsage();
+        return 1;
+    }
+    bitmaps = calloc(monitorCount, sizeof(ActivityBitmap));
+    deathMinute = calloc((size_t)monitorCount * 64, sizeof(uint32_t));
+    if (bitmaps == NULL || deathMinute == NULL) {
+        printf("Out of memory for %u tubes\n", tubeCount);
+        free(bitmaps);
+        free(deathMinute);
+        return 1;
+    }
+    QueryPerformanceFrequency(&tickRate);
+
+    // Flies move in bouts of a few minutes, in about 30% of the minutes by day and 2%
+    // by night; 5% of the tubes are empty and another 5% of the flies die at some point
+    for (tube = 0; tube < monitorCount * 64; tube++) {
+        random = random * 1103515245u + 12345u;
+        deathMinute[tube] = tube >= tubeCount || random % 100 < 5 ? 0 :
+                            random % 100 < 10 ? (uint32_t)(random >> 8) % (uint32_t)minutes : (uint32_t)minutes + 1;
+    }
+    QueryPerformanceCounter(&start);
+    for (monitor = 0; monitor < monitorCount; monitor++) {
+        uint64_t moved = 0;
+
+        activityBitmapInit(&bitmaps[monitor], minuteUs, tubeCount - monitor * 64 < 64 ? tubeCount - monitor * 64 : 64);
+        for (minute = 0; minute < minutes; minute++) {
+            bool day = minute % 1440 >= 420 && minute % 1440 < 1140;
+
+            for (tube = 0; tube < 64; tube++) {
+                bool moving = moved >> tube & 1;
+                uint32_t chance = moving ? (day ? 65 : 50) : (day ? 15 : 1); // Percent to keep or start moving
+
+                random = random * 1103515245u + 12345u;
+                moving = (random >> 16) % 100 < chance && minute < deathMinute[monitor * 64 + tube];
+                moved = (moved & ~(1ull << tube)) | (uint64_t)moving << tube;
+            }
+            expected += (uint64_t)__builtin_popcountll(moved);
+            if (activityBitmapAdd(&bitmaps[monitor], originUs + minute * minuteUs, moved) != 0) {
+                printf("Out of memory after %lld minutes of monitor %u\n", (long long)minute, monitor + 1);
+                return 1;
+            }
+        }
+    }
+    ms = elapsedMs(start, tickRate);
+    for (monitor = 0; monitor < monitorCount; monitor++) {
+        bytes += bitmaps[monitor].bytes + sizeof(ActivityBitmap);
+        for (i = 0; i < 3; i++) {
+            kinds[i] += bitmaps[monitor].kinds[i];
+        }
+    }
+    printf("%u tubes on %u monitors, %u days of minutes, simulated and added in %.0f ms\n", tubeCount, monitorCount,
+           days, ms);
+    printf("%.1f MB in bitmaps (%.1f MB uncompressed); containers: %llu arrays, %llu bitmaps, %llu runs\n\n",
+           bytes / 1e6, (double)tubeCount * minutes / 8 / 1e6, (unsigned long long)kinds[ACTIVITY_ARRAY],
+           (unsigned long long)kinds[ACTIVITY_BITMAP], (unsigned long long)kinds[ACTIVITY_RUNS]);
+
+    printf("Query (every monitor)                              | ms per query | Result\n");
+    printf("---------------------------------------------------|--------------|-------\n");
+    QueryPerformanceCounter(&start);
+    for (i = 0, found = 0; i < repeats; i++) {
+        int64_t atUs = originUs + (int64_t)(i * 7919 % minutes) * minuteUs;
+
+        for (monitor = 0; monitor < monitorCount; monitor++) {
+            found += (uint64_t)__builtin_popcountll(activityBitmapBin(&bitmaps[monitor], atUs));
+        }
+    }
+    printf("Tubes that moved in a given minute                 | %12.4f | %.0f tubes on average\n",
+           elapsedMs(start, tickRate) / repeats, (double)found / repeats);
+
+    QueryPerformanceCounter(&start);
+    for (i = 0, found = 0; i < repeats; i++) {
+        int64_t atUs = originUs + (int64_t)(i * 7919 % minutes) * minuteUs;
+
+        for (monitor = 0; monitor < monitorCount; monitor++) {
+            found += (uint64_t)__builtin_popcountll(activityBitmapBin(&bitmaps[monitor], atUs) &
+                                                    activityBitmapBin(&bitmaps[monitor], atUs + minuteUs));
+        }
+    }
+    printf("Tubes that moved in both of two minutes            | %12.4f | %.0f tubes on average\n",
+           elapsedMs(start, tickRate) / repeats, (double)found / repeats);
+
+    QueryPerformanceCounter(&start);
+    for (i = 0, found = 0; i < repeats; i++) {
+        int64_t atUs = originUs + (int64_t)(i * 7919 % (minutes - 10)) * minuteUs;
+
+        for (monitor = 0; monitor < monitorCount; monitor++) {
+            found += (uint64_t)__builtin_popcountll(activityBitmapAll(&bitmaps[monitor], atUs, atUs + 10 * minuteUs));
+        }
+    }
+    printf("Tubes that moved in every minute of 10             | %12.4f | %.1f tubes on average\n",
+           elapsedMs(start, tickRate) / repeats, (double)found / repeats);
+
+    QueryPerformanceCounter(&start);
+    for (i = 0, found = 0; i < repeats; i++) {
+        int64_t atUs = originUs + (int64_t)(i % days) * 1440 * minuteUs;
+
+        for (monitor = 0; monitor < monitorCount; monitor++) {
+            found += activityBitmapCount(&bitmaps[monitor], atUs, atUs + 1440 * minuteUs, ~0ull, NULL);
+        }
+    }
+    printf("Active tube-minutes in a day                       | %12.4f | %.0f on average\n",
+           elapsedMs(start, tickRate) / repeats, (double)found / repeats);
+
+    QueryPerformanceCounter(&start);
+    for (monitor = 0, total = 0; monitor < monitorCount; monitor++) {
+        total += activityBitmapCount(&bitmaps[monitor], originUs, endUs, ~0ull, NULL);
+    }
+    printf("Active tube-minutes in the whole record            | %12.4f | %llu (%s)\n", elapsedMs(start, tickRate),
+           (unsigned long long)total, total == expected ? "as simulated" : "WRONG");
+
+    QueryPerformanceCounter(&start);
+    for (monitor = 0, found = 0; monitor < monitorCount; monitor++) {
+        found += bitmaps[monitor].tubeCount -
+                 (uint64_t)__builtin_popcountll(activityBitmapAny(&bitmaps[monitor], endUs - 1440 * minuteUs, endUs));
+    }
+    printf("Tubes that did not move in the last day            | %12.4f | %llu tubes\n", elapsedMs(start, tickRate),
+           (unsigned long long)found);
+
+    QueryPerformanceCounter(&start);
+    for (monitor = 0, found = 0; monitor < monitorCount; monitor++) {
+        found += (uint64_t)__builtin_popcountll(activityBitmapStreak(&bitmaps[monitor], originUs, endUs, 5));
+    }
+    printf("Tubes active 5 minutes running, whole record       | %12.4f | %llu tubes\n", elapsedMs(start, tickRate),
+           (unsigned long long)found);
+
+    QueryPerformanceCounter(&start);
+    for (monitor = 0, found = 0; monitor < monitorCount; monitor++) {
+        found += (uint64_t)__builtin_popcountll(activityBitmapStreak(&bitmaps[monitor], originUs, endUs, 20));
+    }
+    printf("Tubes active 20 minutes running, whole record      | %12.4f | %llu tubes\n", elapsedMs(start, tickRate),
+           (unsigned long long)found);
+
+    for (monitor = 0; monitor < monitorCount; monitor++) {
+        activityBitmapFree(&bitmaps[monitor]);
+    }
+    free(bitmaps);
+    free(deathMinute);
+    return total == expected ? 0 : 1;
+}
+
+#define CONDITION_MARKS 16 // Distinct condition marks runEnvironment keeps apart
+
+// Activity of one archive split by the conditions each minute was spent in
+typedef struct {
+    uint32_t lightMinutes;   // Minutes with scans, lights on for all of them
+    uint32_t darkMinutes;    // Lights known and off for all of them
+    uint64_t lightMoves[SCAN_MAX_TUBES];
+    uint64_t darkMoves[SCAN_MAX_TUBES];
+    int32_t marks[CONDITION_MARKS];      // In order of first use
+    uint32_t markMinutes[CONDITION_MARKS];
+    uint64_t markMoves[CONDITION_MARKS]; // Of every tube
+    uint32_t markCount;
+    uint32_t marksDropped;   // Minutes under marks past CONDITION_MARKS
+} ConditionSplit;
+
+static void splitBin(const ActivityBin* bin, uint32_t tubeCount, void* context) {
+    ConditionSplit* split = context;
+    uint64_t moves = 0;
+    uint32_t tube, slot;
+
+    if (bin->scans == 0) {
+        return;
+    }
+    for (tube = 0; tube < tubeCount; tube++) {
+        moves += bin->moves[tube];
+    }
+    if (bin->lightScans == bin->scans) {
+        split->lightMinutes++;
+        for (tube = 0; tube < tubeCount; tube++) {
+            split->lightMoves[tube] += bin->moves[tube];
+        }
+    } else if (bin->lightScans == 0 && (bin->environment.known & 1u << ENVIRONMENT_LIGHT)) {
+        split->darkMinutes++;
+        for (tube = 0; tube < tubeCount; tube++) {
+            split->darkMoves[tube] += bin->moves[tube];
+        }
+    }
+    if ((bin->environment.known & 1u << ENVIRONMENT_MARK) == 0) {
+        return;
+    }
+    for (slot = 0; slot < split->markCount && split->marks[slot] != bin->environment.values[ENVIRONMENT_MARK]; slot++) {
+    }
+    if (slot == CONDITION_MARKS) {
+        split->marksDropped++;
+        return;
+    }
+    if (slot == split->markCount) {
+        split->marks[split->markCount++] = bin->environment.values[ENVIRONMENT_MARK];
+    }
+    split->markMinutes[slot]++;
+    split->markMoves[slot] += moves;
+}
+
+static void formatEvent(const EnvironmentEvent* event, char* buffer, size_t size) {
+    switch (event->kind) {
+    case ENVIRONMENT_LIGHT:
+        snprintf(buffer, size, "%s", event->value ? "on" : "off");
+        break;
+    case ENVIRONMENT_TEMPERATURE:
+        snprintf(buffer, size, "%.3f C", event->value / 1000.0);
+        break;
+    case ENVIRONMENT_HUMIDITY:
+        snprintf(buffer, size, "%.1f %% RH", event->value / 1000.0);
+        break;
+    default:
+        snprintf(buffer, size, "%d", event->value);
+        break;
+    }
+}
+
+int runEnvironment(int argc, char* argv[]) {
+    static ArchiveReader reader; // Large decode scratch, keep it off the stack
+    static int64_t times[ARCHIVE_BLOCK_SCANS];
+    static uint8_t states[ARCHIVE_BLOCK_SCANS * SCAN_MAX_TUBES];
+    static ConditionSplit split;
+    ActivityBinner binner;
+    ScanState scan;
+    uint64_t eventTotal = 0;
+    uint32_t block, tube, slot, tubeCount, segment = 1, segments = 0, skipped = 0;
+
+    if (argc < 1) {
+        printUsage();
+        return 1;
+    }
+    if (archiveReaderOpen(&reader, argv[0]) != 0) {
+        printf("Cannot open archive %s (missing, unfinished or wrong version, see madtool recover)\n", argv[0]);
+        return 1;
+    }
+
+    // The events sit in the blocks next to the scans, so one pass both lists them and splits the minutes
+    printf("Time (UTC)              | Event    | Value\n");
+    printf("------------------------|----------|------------\n");
+    tubeCount = reader.tubeCount;
+    memset(&scan, 0, sizeof(scan));
+    binnerInit(&binner, 60000000LL, tubeCount, splitBin, &split);
+    do {
+        for (block = 0; block < reader.blockCount; block++) {
+            EnvironmentEvent events[ARCHIVE_BLOCK_MAX_EVENTS];
+            int scanCount = archiveReaderDecodeBlock(&reader, block, times, states);
+            int eventCount = archiveReaderBlockEvents(&reader, block, events);
+            int next = 0;
+            int i;
+
+            if (scanCount < 0 || eventCount < 0) {
+                printf("Archive is corrupt at block %u of segment %u\n", block, segment - 1);
+                archiveReaderClose(&reader);
+                return 1;
+            }
+            for (i = 0; i < eventCount; i++) {
+                char timeText[32], valueText[32];
+
+                formatTime(events[i].timeUs, timeText, sizeof(timeText));
+                formatEvent(&events[i], valueText, sizeof(valueText));
+                printf("%s | %-8s | %s\n", timeText, environmentKindName(events[i].kind), valueText);
+            }
+            eventTotal += (uint64_t)eventCount;
+            for (i = 0; i < scanCount; i++) {
+                const uint8_t* row = states + (size_t)i * tubeCount;
+                ScanDelta delta = {0, 0};
+
+                for (tube = 0; tube < tubeCount; tube++) {
+                    uint8_t position = row[tube] & PACKED_DATA_MASK;
+                    delta.moved |= (uint64_t)(position != scan.position[tube]) << tube;
+                    scan.position[tube] = position;
+                }
+                replayEvents(&binner, events, eventCount, &next, times[i]);
+                binnerAddScan(&binner, times[i], &scan, delta);
+            }
+        }
+        segments++;
+        archiveReaderClose(&reader);
+    } while (openNextSegment(&reader, argv[0], tubeCount, &segment, &skipped));
+    binnerFlush(&binner);
+    printf("\n%llu events; %u minutes wholly in the light and %u wholly in the dark\n",
+           (unsigned long long)eventTotal, split.lightMinutes, split.darkMinutes);
+    printSegments(segments, skipped);
+    printf("\n");
+
+    printf("Tube | Light moves/h | Dark moves/h | Dark share\n");
+    printf("-----|---------------|--------------|-----------\n");
+    for (tube = 0; tube < tubeCount; tube++) {
+        double light = split.lightMinutes > 0 ? 60.0 * split.lightMoves[tube] / split.lightMinutes : 0.0;
+        double dark = split.darkMinutes > 0 ? 60.0 * split.darkMoves[tube] / split.darkMinutes : 0.0;
+
+        printf("%4u | ", tube + 1);
+        if (split.lightMinutes > 0) {
+            printf("%13.1f | ", light);
+        } else {
+            printf("%13s | ", "-");
+        }
+        if (split.darkMinutes > 0) {
+            printf("%12.1f | ", dark);
+        } else {
+            printf("%12s | ", "-");
+        }
+        if (split.lightMinutes > 0 && split.darkMinutes > 0 && light + dark > 0.0) {
+            printf("%9.0f%%\n", 100.0 * dark / (light + dark));
+        } else {
+            printf("%10s\n", "-");
+        }
+    }
+
+    if (split.markCount > 0) {
+        printf("\nMark |   Hours | Moves/h per tube\n");
+        printf("-----|---------|-----------------\n");
+        for (slot = 0; slot < split.markCount; slot++) {
+            printf("%4d | %7.1f | %16.1f\n", split.marks[slot], split.markMinutes[slot] / 60.0,
+                   60.0 * split.markMoves[slot] / split.markMinutes[slot] / tubeCount);
+        }
+        if (split.marksDropped > 0) {
+            printf("%u minutes under further marks left out\n", split.marksDropped);
+        }
+    }
+    return 0;
+}
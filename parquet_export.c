@@ -0,0 +1,512 @@
+#include "parquet_export.h"
+#include <stdlib.h> // malloc, realloc, free
+#include <string.h> // memset, strlen
+
+// Parquet enums used by this writer (parquet.thrift)
+#define PQ_TYPE_INT32 1
+#define PQ_TYPE_INT64 2
+#define PQ_REQUIRED 0
+#define PQ_CONVERTED_TIMESTAMP_MICROS 10
+#define PQ_ENCODING_PLAIN 0
+#define PQ_ENCODING_RLE 3
+#define PQ_ENCODING_RLE_DICTIONARY 8
+#define PQ_PAGE_DATA 0
+#define PQ_PAGE_DICTIONARY 2
+
+// Thrift compact protocol field types
+#define TC_I32 5
+#define TC_I64 6
+#define TC_BINARY 8
+#define TC_LIST 9
+#define TC_STRUCT 12
+
+#define HASH_SLOTS (PARQUET_DICTIONARY_LIMIT * 2)
+#define THRIFT_MAX_DEPTH 8
+
+// Column layout, the order matches the values written by parquetAppendBin
+static const char* columnNames[PARQUET_COLUMNS] = {
+    "monitor", "tube", "bin_start", "scans", "moves", "feeding_starts", "feeding_scans",
+    "occupancy_0", "occupancy_1", "occupancy_2", "occupancy_3", "occupancy_4", "occupancy_5",
+    "occupancy_6", "occupancy_7", "occupancy_8", "occupancy_9", "occupancy_10", "occupancy_11",
+    "occupancy_12", "occupancy_13", "occupancy_14", "occupancy_15", "light_scans", "mark"
+};
+#define COLUMN_BIN_START 2
+
+static int columnType(int column) {
+    return column == COLUMN_BIN_START ? PQ_TYPE_INT64 : PQ_TYPE_INT32;
+}
+
+// Growable buffer written with the Thrift compact protocol
+typedef struct {
+    uint8_t* data;
+    size_t size;
+    size_t capacity;
+    int16_t lastField[THRIFT_MAX_DEPTH];
+    int depth;
+    bool failed;
+} ThriftBuffer;
+
+static void tbByte(ThriftBuffer* tb, uint8_t value) {
+    if (tb->size == tb->capacity) {
+        size_t capacity = tb->capacity ? tb->capacity * 2 : 1024;
+        uint8_t* grown = realloc(tb->data, capacity);
+        if (grown == NULL) {
+            tb->failed = true;
+            return;
+        }
+        tb->data = grown;
+        tb->capacity = capacity;
+    }
+    tb->data[tb->size++] = value;
+}
+
+static void tbVarint(ThriftBuffer* tb, uint64_t value) {
+    while (value >= 0x80) {
+        tbByte(tb, (uint8_t)(value | 0x80));
+        value >>= 7;
+    }
+    tbByte(tb, (uint8_t)value);
+}
+
+static uint64_t zigzag(int64_t value) {
+    return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static void tbField(ThriftBuffer* tb, int16_t id, uint8_t type) {
+    int16_t delta = id - tb->lastField[tb->depth];
+    if (delta > 0 && delta <= 15) {
+        tbByte(tb, (uint8_t)((delta << 4) | type));
+    } else {
+        tbByte(tb, type);
+        tbVarint(tb, zigzag(id));
+    }
+    tb->lastField[tb->depth] = id;
+}
+
+static void tbI32(ThriftBuffer* tb, int16_t id, int32_t value) {
+    tbField(tb, id, TC_I32);
+    tbVarint(tb, zigzag(value));
+}
+
+static void tbI64(ThriftBuffer* tb, int16_t id, int64_t value) {
+    tbField(tb, id, TC_I64);
+    tbVarint(tb, zigzag(value));
+}
+
+static void tbRawString(ThriftBuffer* tb, const char* text) {
+    size_t length = strlen(text);
+    size_t i;
+    tbVarint(tb, length);
+    for (i = 0; i < length; i++) {
+        tbByte(tb, (uint8_t)text[i]);
+    }
+}
+
+static void tbString(ThriftBuffer* tb, int16_t id, const char* text) {
+    tbField(tb, id, TC_BINARY);
+    tbRawString(tb, text);
+}
+
+static void tbListHeader(ThriftBuffer* tb, uint8_t elementType, uint32_t count) {
+    if (count < 15) {
+        tbByte(tb, (uint8_t)((count << 4) | elementType));
+    } else {
+        tbByte(tb, (uint8_t)(0xF0 | elementType));
+        tbVarint(tb, count);
+    }
+}
+
+static void tbList(ThriftBuffer* tb, int16_t id, uint8_t elementType, uint32_t count) {
+    tbField(tb, id, TC_LIST);
+    tbListHeader(tb, elementType, count);
+}
+
+// Opens a struct, either as field id or (id 0) as a list element
+static void tbStructBegin(ThriftBuffer* tb, int16_t id) {
+    if (id != 0) {
+        tbField(tb, id, TC_STRUCT);
+    }
+    tb->lastField[++tb->depth] = 0;
+}
+
+static void tbStructEnd(ThriftBuffer* tb) {
+    tbByte(tb, 0);
+    tb->depth--;
+}
+
+// Writes a page header and its content, returns the header offset
+static uint64_t writePage(ParquetWriter* writer, int pageType, uint32_t valueCount, int encoding,
+                          const uint8_t* content, size_t contentBytes) {
+    ThriftBuffer tb;
+    uint64_t offset = writer->offset;
+
+    memset(&tb, 0, sizeof(tb));
+    tbI32(&tb, 1, pageType);
+    tbI32(&tb, 2, (int32_t)contentBytes);
+    tbI32(&tb, 3, (int32_t)contentBytes);
+    if (pageType == PQ_PAGE_DATA) {
+        tbStructBegin(&tb, 5);
+        tbI32(&tb, 1, (int32_t)valueCount);
+        tbI32(&tb, 2, encoding);
+        tbI32(&tb, 3, PQ_ENCODING_RLE);
+        tbI32(&tb, 4, PQ_ENCODING_RLE);
+        tbStructEnd(&tb);
+    } else {
+        tbStructBegin(&tb, 7);
+        tbI32(&tb, 1, (int32_t)valueCount);
+        tbI32(&tb, 2, encoding);
+        tbStructEnd(&tb);
+    }
+    tbByte(&tb, 0);
+
+    fwrite(tb.data, 1, tb.size, writer->file);
+    fwrite(content, 1, contentBytes, writer->file);
+    writer->offset += tb.size + contentBytes;
+    free(tb.data);
+
+    return offset;
+}
+
+static size_t putPlain(uint8_t* out, int64_t value, int type) {
+    int bytes = type == PQ_TYPE_INT64 ? 8 : 4;
+    int i;
+    for (i = 0; i < bytes; i++) {
+        out[i] = (uint8_t)((uint64_t)value >> (8 * i));
+    }
+    return (size_t)bytes;
+}
+
+static size_t putVarint(uint8_t* out, uint32_t value) {
+    size_t n = 0;
+    while (value >= 0x80) {
+        out[n++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    out[n++] = (uint8_t)value;
+    return n;
+}
+
+// RLE/bit-packed hybrid: runs of 8+ equal indices become RLE runs, the rest is
+// bit-packed in groups of 8 (only the final group may be padded)
+static size_t encodeHybrid(const uint32_t values[], uint32_t count, int bitWidth, uint8_t* out) {
+    int valueBytes = (bitWidth + 7) / 8;
+    size_t n = 0;
+    uint32_t i = 0;
+
+    while (i < count) {
+        uint32_t run = 1;
+        while (i + run < count && values[i + run] == values[i]) {
+            run++;
+        }
+
+        if (run >= 8) {
+            int b;
+            n += putVarint(out + n, run << 1);
+            for (b = 0; b < valueBytes; b++) {
+                out[n++] = (uint8_t)(values[i] >> (8 * b));
+            }
+            i += run;
+        } else {
+            uint32_t start = i;
+            uint32_t end;
+            uint32_t groups;
+            uint64_t bitBuffer = 0;
+            int bitCount = 0;
+            uint32_t j;
+
+            // Extend in groups of 8 until an RLE-worthy run starts at a group boundary
+            do {
+                i += 8;
+                run = 1;
+                while (i < count && i + run < count && values[i + run] == values[i] && run < 8) {
+                    run++;
+                }
+            } while (i < count && run < 8);
+
+            end = i < count ? i : count;
+            groups = (i - start) / 8;
+            n += putVarint(out + n, (groups << 1) | 1);
+            for (j = start; j < start + groups * 8; j++) {
+                bitBuffer |= (uint64_t)(j < end ? values[j] : 0) << bitCount;
+                bitCount += bitWidth;
+                while (bitCount >= 8) {
+                    out[n++] = (uint8_t)bitBuffer;
+                    bitBuffer >>= 8;
+                    bitCount -= 8;
+                }
+            }
+            i = end;
+        }
+    }
+
+    return n;
+}
+
+// Dictionary index of value, adding it if new, or -1 once the dictionary is full
+static int32_t dictionaryIndex(ParquetWriter* writer, uint32_t* dictionarySize, int64_t value) {
+    uint64_t hash = (uint64_t)value * 0x9E3779B97F4A7C15ull;
+    uint32_t slot = (uint32_t)(hash >> 40) & (HASH_SLOTS - 1);
+
+    while (writer->slots[slot] != 0) {
+        int32_t index = writer->slots[slot] - 1;
+        if (writer->dictionary[index] == value) {
+            return index;
+        }
+        slot = (slot + 1) & (HASH_SLOTS - 1);
+    }
+
+    if (*dictionarySize == PARQUET_DICTIONARY_LIMIT) {
+        return -1;
+    }
+    writer->dictionary[*dictionarySize] = value;
+    writer->slots[slot] = (int32_t)++*dictionarySize;
+    return (int32_t)(*dictionarySize - 1);
+}
+
+static void writeColumnChunk(ParquetWriter* writer, int column, ParquetChunkInfo* chunk) {
+    const int64_t* values = writer->columns[column];
+    uint32_t rows = writer->rowCount;
+    int type = columnType(column);
+    uint64_t start = writer->offset;
+    uint32_t dictionarySize = 0;
+    bool useDictionary = true;
+    size_t n = 0;
+    uint32_t i;
+
+    memset(writer->slots, 0, HASH_SLOTS * sizeof(int32_t));
+    for (i = 0; i < rows; i++) {
+        int32_t index = dictionaryIndex(writer, &dictionarySize, values[i]);
+        if (index < 0) {
+            useDictionary = false;
+            break;
+        }
+        writer->indices[i] = (uint32_t)index;
+    }
+
+    if (useDictionary) {
+        int bitWidth = 1;
+        while (bitWidth < 32 && (1u << bitWidth) < dictionarySize) {
+            bitWidth++;
+        }
+
+        for (i = 0; i < dictionarySize; i++) {
+            n += putPlain(writer->page + n, writer->dictionary[i], type);
+        }
+        chunk->dictionaryOffset = writePage(writer, PQ_PAGE_DICTIONARY, dictionarySize, PQ_ENCODING_PLAIN,
+                                            writer->page, n);
+
+        writer->page[0] = (uint8_t)bitWidth;
+        n = 1 + encodeHybrid(writer->indices, rows, bitWidth, writer->page + 1);
+        chunk->dataOffset = writePage(writer, PQ_PAGE_DATA, rows, PQ_ENCODING_RLE_DICTIONARY, writer->page, n);
+    } else {
+        for (i = 0; i < rows; i++) {
+            n += putPlain(writer->page + n, values[i], type);
+        }
+        chunk->dictionaryOffset = 0;
+        chunk->dataOffset = writePage(writer, PQ_PAGE_DATA, rows, PQ_ENCODING_PLAIN, writer->page, n);
+    }
+
+    chunk->bytes = writer->offset - start;
+}
+
+static int writeRowGroup(ParquetWriter* writer) {
+    ParquetRowGroupInfo* group;
+    int column;
+
+    if (writer->rowCount == 0) {
+        return 0;
+    }
+
+    if (writer->groupCount == writer->groupCapacity) {
+        uint32_t capacity = writer->groupCapacity ? writer->groupCapacity * 2 : 16;
+        ParquetRowGroupInfo* grown = realloc(writer->groups, capacity * sizeof(ParquetRowGroupInfo));
+        if (grown == NULL) {
+            return -1;
+        }
+        writer->groups = grown;
+        writer->groupCapacity = capacity;
+    }
+
+    group = &writer->groups[writer->groupCount++];
+    group->rows = writer->rowCount;
+    group->bytes = 0;
+    for (column = 0; column < PARQUET_COLUMNS; column++) {
+        writeColumnChunk(writer, column, &group->chunks[column]);
+        group->bytes += group->chunks[column].bytes;
+    }
+
+    writer->totalRows += writer->rowCount;
+    writer->rowCount = 0;
+    return ferror(writer->file) ? -1 : 0;
+}
+
+// FileMetaData: schema, row groups and column chunk locations
+static void encodeFooter(ParquetWriter* writer, ThriftBuffer* tb) {
+    uint32_t g;
+    int column;
+
+    tbI32(tb, 1, 1);
+    tbList(tb, 2, TC_STRUCT, PARQUET_COLUMNS + 1);
+    tbStructBegin(tb, 0);
+    tbString(tb, 4, "schema");
+    tbI32(tb, 5, PARQUET_COLUMNS);
+    tbStructEnd(tb);
+    for (column = 0; column < PARQUET_COLUMNS; column++) {
+        tbStructBegin(tb, 0);
+        tbI32(tb, 1, columnType(column));
+        tbI32(tb, 3, PQ_REQUIRED);
+        tbString(tb, 4, columnNames[column]);
+        if (column == COLUMN_BIN_START) {
+            tbI32(tb, 6, PQ_CONVERTED_TIMESTAMP_MICROS);
+        }
+        tbStructEnd(tb);
+    }
+
+    tbI64(tb, 3, writer->totalRows);
+
+    tbList(tb, 4, TC_STRUCT, writer->groupCount);
+    for (g = 0; g < writer->groupCount; g++) {
+        const ParquetRowGroupInfo* group = &writer->groups[g];
+
+        tbStructBegin(tb, 0);
+        tbList(tb, 1, TC_STRUCT, PARQUET_COLUMNS);
+        for (column = 0; column < PARQUET_COLUMNS; column++) {
+            const ParquetChunkInfo* chunk = &group->chunks[column];
+            bool dictionary = chunk->dictionaryOffset != 0;
+
+            tbStructBegin(tb, 0);
+            tbI64(tb, 2, (int64_t)(dictionary ? chunk->dictionaryOffset : chunk->dataOffset));
+            tbStructBegin(tb, 3);
+            tbI32(tb, 1, columnType(column));
+            tbList(tb, 2, TC_I32, dictionary ? 3 : 2);
+            tbVarint(tb, PQ_ENCODING_PLAIN << 1);
+            tbVarint(tb, PQ_ENCODING_RLE << 1);
+            if (dictionary) {
+                tbVarint(tb, PQ_ENCODING_RLE_DICTIONARY << 1);
+            }
+            tbList(tb, 3, TC_BINARY, 1);
+            tbRawString(tb, columnNames[column]);
+            tbI32(tb, 4, 0); // UNCOMPRESSED
+            tbI64(tb, 5, group->rows);
+            tbI64(tb, 6, (int64_t)chunk->bytes);
+            tbI64(tb, 7, (int64_t)chunk->bytes);
+            tbI64(tb, 9, (int64_t)chunk->dataOffset);
+            if (dictionary) {
+                tbI64(tb, 11, (int64_t)chunk->dictionaryOffset);
+            }
+            tbStructEnd(tb);
+            tbStructEnd(tb);
+        }
+        tbI64(tb, 2, (int64_t)group->bytes);
+        tbI64(tb, 3, group->rows);
+        tbStructEnd(tb);
+    }
+
+    tbString(tb, 6, "madtool (multibeam activity detector)");
+    tbByte(tb, 0);
+}
+
+int parquetOpen(ParquetWriter* writer, const char* path) {
+    int column;
+
+    memset(writer, 0, sizeof(*writer));
+
+    for (column = 0; column < PARQUET_COLUMNS; column++) {
+        writer->columns[column] = malloc(PARQUET_ROW_GROUP_ROWS * sizeof(int64_t));
+        if (writer->columns[column] == NULL) {
+            goto Error;
+        }
+    }
+    writer->dictionary = malloc(PARQUET_DICTIONARY_LIMIT * sizeof(int64_t));
+    writer->indices = malloc(PARQUET_ROW_GROUP_ROWS * sizeof(uint32_t));
+    writer->slots = malloc(HASH_SLOTS * sizeof(int32_t));
+    writer->pageCapacity = (size_t)PARQUET_ROW_GROUP_ROWS * 9 + 64;
+    writer->page = malloc(writer->pageCapacity);
+    if (writer->dictionary == NULL || writer->indices == NULL || writer->slots == NULL || writer->page == NULL) {
+        goto Error;
+    }
+
+    writer->file = fopen(path, "wb");
+    if (writer->file == NULL) {
+        goto Error;
+    }
+    fwrite("PAR1", 1, 4, writer->file);
+    writer->offset = 4;
+
+    return 0;
+
+Error:
+    parquetClose(writer);
+    return -1;
+}
+
+int parquetAppendBin(ParquetWriter* writer, uint32_t monitorId, const ActivityBin* bin, uint32_t tubeCount) {
+    uint32_t tube;
+    int position;
+
+    for (tube = 0; tube < tubeCount; tube++) {
+        uint32_t row = writer->rowCount++;
+
+        writer->columns[0][row] = monitorId;
+        writer->columns[1][row] = tube + 1;
+        writer->columns[2][row] = bin->startUs;
+        writer->columns[3][row] = bin->scans;
+        writer->columns[4][row] = bin->moves[tube];
+        writer->columns[5][row] = bin->feedingStarts[tube];
+        writer->columns[6][row] = bin->feedingScans[tube];
+        for (position = 0; position < BIN_POSITIONS; position++) {
+            writer->columns[7 + position][row] = bin->occupancy[tube][position];
+        }
+        writer->columns[7 + BIN_POSITIONS][row] = bin->lightScans;
+        writer->columns[8 + BIN_POSITIONS][row] = bin->environment.values[ENVIRONMENT_MARK]; // 0 until the first mark
+
+        if (writer->rowCount == PARQUET_ROW_GROUP_ROWS && writeRowGroup(writer) != 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+int parquetClose(ParquetWriter* writer) {
+    ThriftBuffer tb;
+    uint8_t footerLength[4];
+    int error = 0;
+    int column;
+
+    if (writer->file != NULL) {
+        memset(&tb, 0, sizeof(tb));
+        error = writeRowGroup(writer);
+        encodeFooter(writer, &tb);
+        putPlain(footerLength, (int64_t)tb.size, PQ_TYPE_INT32);
+
+        if (tb.failed ||
+            fwrite(tb.data, 1, tb.size, writer->file) != tb.size ||
+            fwrite(footerLength, 1, 4, writer->file) != 4 ||
+            fwrite("PAR1", 1, 4, writer->file) != 4) {
+            error = -1;
+        }
+        if (fclose(writer->file) != 0) {
+            error = -1;
+        }
+        free(tb.data);
+        writer->file = NULL;
+    }
+
+    for (column = 0; column < PARQUET_COLUMNS; column++) {
+        free(writer->columns[column]);
+        writer->columns[column] = NULL;
+    }
+    free(writer->dictionary);
+    free(writer->indices);
+    free(writer->slots);
+    free(writer->page);
+    free(writer->groups);
+    writer->dictionary = NULL;
+    writer->indices = NULL;
+    writer->slots = NULL;
+    writer->page = NULL;
+    writer->groups = NULL;
+
+    return error;
+}
@@ -0,0 +1,59 @@
+#ifndef PARQUET_EXPORT_H
+#define PARQUET_EXPORT_H
+
+#include <stdio.h> // FILE
+#include <stdint.h> // Fixed-width integer types
+#include <stdbool.h> // Standard boolean library
+#include "binning.h" // ActivityBin
+
+// Constants
+#define PARQUET_COLUMNS (9 + BIN_POSITIONS) // monitor, tube, bin_start, scans, moves, feeding_*, occupancy_*,
+                                            // light_scans, mark
+#define PARQUET_ROW_GROUP_ROWS 131072       // Rows buffered before a row group is written
+#define PARQUET_DICTIONARY_LIMIT 65536      // Distinct values per column chunk before falling back to PLAIN
+
+// Where one column chunk of a row group ended up in the file
+typedef struct {
+    uint64_t dictionaryOffset; // 0 when the chunk is PLAIN encoded
+    uint64_t dataOffset;
+    uint64_t bytes;            // Page headers and pages, no compression
+} ParquetChunkInfo;
+
+typedef struct {
+    int64_t rows;
+    uint64_t bytes;
+    ParquetChunkInfo chunks[PARQUET_COLUMNS];
+} ParquetRowGroupInfo;
+
+// Writes binned activity as an uncompressed Parquet file, one row per tube per bin.
+// Every column chunk is dictionary encoded with RLE/bit-packed indices when it has
+// few distinct values (counts that are mostly 0, tube and monitor ids, bin starts).
+typedef struct {
+    FILE* file;
+    uint64_t offset;
+
+    int64_t* columns[PARQUET_COLUMNS]; // Buffered rows of the current row group
+    uint32_t rowCount;
+    int64_t totalRows;
+
+    ParquetRowGroupInfo* groups;
+    uint32_t groupCount;
+    uint32_t groupCapacity;
+
+    int64_t* dictionary;       // Encoding scratch, reused for every column chunk
+    uint32_t* indices;
+    int32_t* slots;
+    uint8_t* page;
+    size_t pageCapacity;
+} ParquetWriter;
+
+// Creates the file, returns 0 on success
+int parquetOpen(ParquetWriter* writer, const char* path);
+
+// Adds tubeCount rows for one closed bin
+int parquetAppendBin(ParquetWriter* writer, uint32_t monitorId, const ActivityBin* bin, uint32_t tubeCount);
+
+// Writes the last row group and the footer, returns 0 on success
+int parquetClose(ParquetWriter* writer);
+
+#endif
@@ -1,28 +1,41 @@
-#include "include/NIDAQmx.h" // NI DAQ driver library
 #include <stdio.h> // Standard input/output library
-#include <stdbool.h> // Standard boolean library 
+#include <stdlib.h> // strtoul, strtof, atoi, calloc, free
+#include <string.h> // strcmp, strchr, memcpy, memcmp
+#include <stdbool.h> // Standard boolean library
+#include <time.h> // gmtime
+#include <math.h> // isnan
+#include "stream_server.h" // Local socket streaming, pulls in winsock2.h which must precede windows.h
 #include <windows.h> // Windows API library, used for Sleep function
-
-// Error checking macro
-#define DAQmxErrChk(functionCall) if( DAQmxFailed(error=(functionCall)) ) goto Error; else
+#include <process.h> // _beginthreadex
+#include "scan_kernel.h" // Whole-scan decode kernel
+#include "archive.h" // Compressed scan archive
+#include "binning.h" // Per-minute activity bins
+#include "dam_writer.h" // DAMSystem-compatible monitor files
+#include "live_share.h" // Shared-memory publication of live state
+#include "daq_supervisor.h" // Device backends and reconnection
+#include "scan_clock.h" // Monotonic, drift-corrected scan times
+#include "timebase_tuner.h" // Timebase auto-tuning
+#include "config.h" // Monitor configuration file
+#include "rcu.h" // Lock-free configuration swaps
+#include "scan_ring.h" // Raw scans from the I/O threads to the decode workers
+#include "work_pool.h" // Decode workers
+#include "tube_events.h" // Tube transitions from the decode workers to the display
+#include "tube_stats.h" // Online occupancy, visit lengths and transitions
+#include "feeding_bouts.h" // Debounced feeding bouts
+#include "locomotion.h" // Path length, speed and movement episodes
+#include "circadian.h" // Periodograms of the activity bins
+#include "tube_health.h" // Dead and empty tubes
+#include "synchrony.h" // Tubes active together
+#include "activity_bitmap.h" // Moving tubes of every minute since startup
+#include "environment.h" // Light and temperature events merged with the scans
 
 // Constants
-#define NUM_TUBES 16        // Number of tubes to monitor
-#define PORT0_LINE_COUNT 5  // P0.0 to P0.4 for data input
-#define PORT1_LINE_COUNT 2  // P1.0 (reset) and P1.1 (clock)
-
-// Global variables
-TaskHandle inputTask = 0;    // Handle for input task, keeps track of the task, and allows for communication with the task
-TaskHandle outputTask = 0;   // Handle for output task, keeps track of the task, and allows for communication with the task
-float timebase = 0.0002f;    // Default 0.2ms (for 1KHz clock)
-
-// Function prototypes
-int initializeDevice(void);
-int configureTimebase(void);
-void cleanup(void);
-int runAcquisition(void);
-void processData(unsigned char data[], int tubeNumber);
-void displayTable(void);
+#define BIN_LENGTH_US 60000000LL // Live activity bins of one minute
+#define RELOAD_POLL_MS 1000      // How often the configuration file is checked for changes
+#define DISPLAY_MS 100           // Shortest time between two screen refreshes
+#define DISPLAY_IDLE_MS 1000     // Screen refresh while no tube changes, for the status lines
+#define EVENT_BATCH 1024         // Tube events the display takes from the queue at once
+#define DRAIN_BATCH 64           // Scans one task decodes before requeueing its monitor behind the others
 
 // Table to store tube readings
 typedef struct {
@@ -30,167 +43,1325 @@ typedef struct {
     bool isEating; // Indicates if the fly is eating
 } TubeReading;
 
-TubeReading tubeReadings[NUM_TUBES]; // Array to store tube readings for all tubes
+// Settings of one monitor that a reload may change
+typedef struct {
+    float timebase;              // Seconds
+    int oversample;
+    bool rejectUnstable;
+    ArchiveWriter* archive;      // NULL = not archived
+    char archivePath[CONFIG_PATH_BYTES];
+} MonitorSettings;
+
+// Everything a reload may change, with its outputs already open. Never modified
+// once published through scanConfigRcu; a reload builds a new one, reusing the
+// outputs whose path did not change, and the old one is released after every
+// reader has moved on.
+typedef struct {
+    uint32_t version;            // 1 at startup, +1 per applied reload
+    DamWriter* damWriter;        // NULL = no DAM files
+    char damDirectory[CONFIG_PATH_BYTES];
+    StreamServer* streamServer;  // NULL = not streaming
+    char socketPath[CONFIG_PATH_BYTES];
+    MonitorSettings monitors[CONFIG_MAX_MONITORS];
+} ScanConfig;
+
+// One configured monitor with everything the scan loop touches, resolved once at
+// startup so nothing is looked up in the configuration while scanning. Its I/O
+// thread owns the device and fills ring; the decode side (scanConfig onwards) is
+// only touched by the one worker running drainMonitor for it at a time.
+typedef struct {
+    const MonitorConfig* config; // Devices, channels and tubes, fixed until restart
+    uint32_t index;              // Slot in the live share and stream frames (position in the file)
+    uint32_t number;             // DAM MonitorN.txt number
+    int tubeCount;
+    float timebase;              // Timebase resolved at startup, seconds
+    DaqDevice device;            // NI USB-6501, or the simulator
+    DaqSupervisor supervisor;    // Reopens the device after it is lost
+    bool deviceOpen;
+    HANDLE ioThread;
+    int ioReader;                // Reader slot of the I/O thread in scanConfigRcu
+    uint64_t scansRead;          // Queued by the I/O thread
+    uint64_t scansDropped;       // Read while the ring was full
+    ScanRing ring;
+    volatile LONG scheduled;     // 1 while a drainMonitor task is queued or running
+    uint64_t scansDecoded;
+    const ScanConfig* scanConfig;     // Read by the worker at the start of the current task
+    const MonitorSettings* settings;  // This monitor's entry in it
+    TubeReading tubeReadings[SCAN_MAX_TUBES];   // Last state reported in a tube event
+    TubeReading shownReadings[SCAN_MAX_TUBES];  // Built from the events by the main thread
+    ScanState scanState;         // Decoder state for all tubes, updated once per scan
+    ActivityBinner binner;       // Bins decoded scans into one-minute activity counts
+    ActivityBin lastBin;         // Most recently closed bin, shown by displayTable
+    TubeStats positionStats;     // Since startup, snapshot with tubeStatsSnapshot from other threads
+    FeedingDetector feeding;     // Feeding bouts since startup
+    LocomotionTracker locomotion; // Walking since startup
+    CircadianEngine circadian;   // Periodograms since startup, snapshot with circadianSnapshot
+    HealthTracker health;        // Dead and empty tubes
+    ActivityBitmap activity;     // Tubes that moved in each minute since startup
+    EnvironmentCursor environmentCursor; // Next environment event to merge before a scan
+    uint32_t activityFailures;   // Minutes the bitmap could not take
+} Monitor;
+
+// Global variables
+AppConfig config;            // From -c, or built from the command line; fixed after startup
+const char* configPath;      // -c, watched for changes while running
+Monitor* monitors;           // One per config.monitors entry
+int monitorCount;
+volatile bool running = true; // Cleared by Ctrl+C so the archive can be closed
+LiveShare liveShare;         // Live state for other processes on this machine
+RcuDomain scanConfigRcu;     // Current ScanConfig, swapped by the reload thread
+int workerReaders[WORK_POOL_MAX_WORKERS]; // Reader slots of the decode workers
+int displayReader;           // Reader slot of the main thread
+WorkPool decodePool;         // Decodes and writes out the scans of every monitor
+TubeEventQueue tubeEvents;   // Transitions decoded by the workers, read by the main thread
+int runSeconds;              // -r, stop after this long (0 = until Ctrl+C)
+char reloadMessages[2][CONFIG_ERROR_BYTES]; // Outcome of the last reload, written alternately
+volatile int reloadMessage;  // Index of the message displayTable shows
+SynchronyEngine synchrony;   // Every tube's activity bins, correlations computed by the main thread
+EnvironmentChannel environment; // Events of [acquisition] environment, none if it is not set
+
+// Function prototypes
+int parseCommandLine(int argc, char* argv[]);
+int openMonitor(Monitor* monitor, const MonitorConfig* monitorConfig, uint32_t index);
+int configureTimebase(Monitor* monitor, bool retune);
+void timebaseKey(const MonitorConfig* monitorConfig, int oversample, char key[48]);
+ScanConfig* buildScanConfig(const AppConfig* appConfig, const ScanConfig* previous, char error[CONFIG_ERROR_BYTES]);
+void releaseScanConfig(ScanConfig* scanConfig, const ScanConfig* keep);
+unsigned int __stdcall reloadThread(void* arg);
+unsigned int __stdcall ioThread(void* arg);
+void drainMonitor(void* context, int worker);
+void workerIdle(int worker, void* context);
+void cleanup(void);
+void markGap(Monitor* monitor, const DaqGap* gap);
+void mergeEnvironment(Monitor* monitor, int64_t timeUs);
+void pushBoutEvents(Monitor* monitor, FeedingDelta bouts);
+void pushHealthAlerts(Monitor* monitor, int64_t timeUs, HealthDelta health);
+void processScan(Monitor* monitor, const uint8_t packedScan[], int64_t scanTimeUs);
+void binClosed(const ActivityBin* bin, uint32_t tubeCount, void* context);
+bool applyTubeEvents(void);
+void displayTable(const ScanConfig* scanConfig);
+void reportThroughput(double seconds, int workerCount);
+BOOL WINAPI consoleHandler(DWORD signal);
 
-int main(void) {
+int main(int argc, char* argv[]) {
     int error = 0; // Error code
-    char inputBuffer[10]; // Buffer to store user input
-    
+    LARGE_INTEGER startTicks, endTicks, tickRate; // Startup time, then acquisition time
+    LARGE_INTEGER drawTicks = {0}; // Last screen refresh
+    bool changed = false;  // Tube events applied since drawTicks
+    HANDLE reloadThreadHandle = NULL; // Watches configPath
+    SYSTEM_INFO system;
+    int workerCount;
+    int i;
+
     printf("Multibeam Activity Detector Control Program\n");
     printf("=========================================\n\n");
-    
-    // Initialize the device
-    error = initializeDevice();
+
+    QueryPerformanceCounter(&startTicks);
+    QueryPerformanceFrequency(&tickRate);
+    error = parseCommandLine(argc, argv);
     if (error) {
-        printf("Failed to initialize device. Error: %d\n", error);
         return error;
     }
-    
-    // Configure timebase
-    printf("Select timebase (milliseconds):\n");
-    printf("1. 0.01\n2. 0.1\n3. 1.0\n4. 10.0\n");
-    printf("Choice: ");
-    fgets(inputBuffer, sizeof(inputBuffer), stdin);
-    switch(inputBuffer[0]) {
-        case '1': timebase = 0.00001f; break;
-        case '2': timebase = 0.0001f; break;
-        case '3': timebase = 0.001f; break;
-        case '4': timebase = 0.01f; break;
-        default:  printf("Using default timebase (0.2ms)\n");
-    }
-    
-    // Main acquisition loop
-    printf("\nStarting acquisition. Press Ctrl+C to stop.\n\n");
-    while(1) {
-        error = runAcquisition();
+
+    // Pick the decode kernel for this CPU
+    initScanKernel();
+    printf("Decode kernel: %s\n", scanKernelName());
+    if (scanClockStart() != 0) {
+        printf("Clock calibration thread failed to start, scan times will drift\n");
+    }
+    printf("Scan clock: %s\n\n", scanClockGetStats().source);
+
+    // Initialize every monitor and its timebase
+    monitors = calloc((size_t)config.monitorCount, sizeof(Monitor));
+    if (monitors == NULL) {
+        printf("Out of memory for %d monitors\n", config.monitorCount);
+        return -1;
+    }
+    for (i = 0; i < config.monitorCount; i++) {
+        monitorCount = i + 1;
+        error = openMonitor(&monitors[i], &config.monitors[i], (uint32_t)i);
         if (error) {
-            printf("Acquisition error: %d\n", error);
+            cleanup();
+            return error;
+        }
+    }
+    {
+        uint32_t tubeCounts[CONFIG_MAX_MONITORS];
+
+        for (i = 0; i < monitorCount; i++) {
+            tubeCounts[i] = (uint32_t)monitors[i].tubeCount;
+        }
+        if (synchronyOpen(&synchrony, (uint32_t)monitorCount, tubeCounts, BIN_LENGTH_US,
+                          config.synchronyWindowBins) != 0) {
+            printf("Out of memory for the synchrony window of %u minutes\n", config.synchronyWindowBins);
+            cleanup();
+            return -1;
+        }
+    }
+    if (config.environmentSource[0] != '\0' && environmentOpen(&environment, config.environmentSource) != 0) {
+        printf("Cannot read environment events from %s\n", config.environmentSource);
+        cleanup();
+        return -1;
+    }
+
+    // Open the outputs that were asked for
+    {
+        char outputError[CONFIG_ERROR_BYTES];
+        ScanConfig* initial = buildScanConfig(&config, NULL, outputError);
+
+        if (initial == NULL) {
+            printf("%s\n", outputError);
+            cleanup();
+            return -1;
+        }
+        rcuInit(&scanConfigRcu, initial);
+        for (i = 0; i < monitorCount; i++) {
+            monitors[i].scanConfig = initial;
+            monitors[i].settings = &initial->monitors[i];
+        }
+    }
+    if (liveShareOpen(&liveShare, LIVE_SHARE_NAME) != 0) {
+        printf("Live shared memory unavailable or used by another program.exe, continuing without it\n");
+    } else if (monitorCount > LIVE_MAX_MONITORS) {
+        printf("Live shared memory has room for %d monitors, monitors after that are not published\n",
+               LIVE_MAX_MONITORS);
+    }
+    if (tubeEventQueueOpen(&tubeEvents) != 0) {
+        printf("Out of memory for the tube event queue\n");
+        error = -1;
+        goto Shutdown;
+    }
+
+    // A monitor is only ever decoded by one worker at a time, more would sit idle
+    GetSystemInfo(&system);
+    workerCount = config.workerCount > 0 ? config.workerCount : (int)system.dwNumberOfProcessors;
+    if (workerCount > monitorCount) {
+        workerCount = monitorCount;
+    }
+    if (workerCount > WORK_POOL_MAX_WORKERS) {
+        workerCount = WORK_POOL_MAX_WORKERS;
+    }
+    for (i = 0; i < workerCount; i++) {
+        workerReaders[i] = rcuRegisterReader(&scanConfigRcu);
+    }
+    for (i = 0; i < monitorCount; i++) {
+        monitors[i].ioReader = rcuRegisterReader(&scanConfigRcu);
+    }
+    displayReader = rcuRegisterReader(&scanConfigRcu);
+    if (workPoolStart(&decodePool, workerCount, workerIdle, NULL) != 0) {
+        printf("Failed to start %d decode workers\n", workerCount);
+        error = -1;
+        goto Shutdown;
+    }
+    if (configPath != NULL) {
+        reloadThreadHandle = (HANDLE)_beginthreadex(NULL, 0, reloadThread, NULL, 0, NULL);
+    }
+    SetConsoleCtrlHandler(consoleHandler, TRUE);
+
+    QueryPerformanceCounter(&endTicks);
+    printf("%d monitor(s) ready in %.1f ms, %d decode worker(s)\n", monitorCount,
+           (endTicks.QuadPart - startTicks.QuadPart) * 1000.0 / tickRate.QuadPart, workerCount);
+
+    // One I/O thread per device, so a slow or lost device never holds up the others
+    printf("\nStarting acquisition. Press Ctrl+C to stop.\n\n");
+    QueryPerformanceCounter(&startTicks);
+    for (i = 0; i < monitorCount; i++) {
+        monitors[i].ioThread = (HANDLE)_beginthreadex(NULL, 0, ioThread, &monitors[i], 0, NULL);
+        if (monitors[i].ioThread == NULL) {
+            printf("Monitor %u: failed to start its I/O thread\n", monitors[i].number);
+            running = false;
+            error = -1;
             break;
         }
-        displayTable();
-        Sleep(100);  // Small delay between iterations
     }
-    
+
+    // The main thread only shows what the workers decoded. It sleeps until a tube
+    // changes, then redraws at most every DISPLAY_MS while events keep coming.
+    while (running) {
+        LONGLONG sinceDrawMs;
+
+        changed |= applyTubeEvents();
+        QueryPerformanceCounter(&endTicks);
+        sinceDrawMs = (endTicks.QuadPart - drawTicks.QuadPart) * 1000 / tickRate.QuadPart;
+        if ((changed && sinceDrawMs >= DISPLAY_MS) || sinceDrawMs >= DISPLAY_IDLE_MS) {
+            synchronyCompute(&synchrony);  // Only once a minute, when a bin finished
+            displayTable(rcuRead(&scanConfigRcu, displayReader));
+            rcuReaderOffline(&scanConfigRcu, displayReader); // Holds nothing while sleeping
+            drawTicks = endTicks;
+            sinceDrawMs = 0;
+            changed = false;
+        }
+        if (runSeconds > 0 && endTicks.QuadPart - startTicks.QuadPart >= runSeconds * tickRate.QuadPart) {
+            running = false;
+        } else if (changed) {
+            Sleep((DWORD)(DISPLAY_MS - sinceDrawMs));  // Further events wait in the queue
+        } else {
+            tubeEventWait(&tubeEvents, (DWORD)(DISPLAY_IDLE_MS - sinceDrawMs));
+        }
+    }
+
+    // Devices first, then the scans they queued, then the configuration they used
+    for (i = 0; i < monitorCount; i++) {
+        if (monitors[i].ioThread != NULL) {
+            WaitForSingleObject(monitors[i].ioThread, INFINITE);
+            CloseHandle(monitors[i].ioThread);
+        }
+    }
+    workPoolStop(&decodePool);
+    QueryPerformanceCounter(&endTicks);
+    reportThroughput((double)(endTicks.QuadPart - startTicks.QuadPart) / tickRate.QuadPart, workerCount);
+
+Shutdown:
+    if (reloadThreadHandle != NULL) {
+        WaitForSingleObject(reloadThreadHandle, INFINITE);
+        CloseHandle(reloadThreadHandle);
+    }
+    for (i = 0; i < monitorCount; i++) {
+        // Monitors the workers last saw with an older ScanConfig may point at a released one
+        monitors[i].scanConfig = scanConfigRcu.current;
+        monitors[i].settings = &monitors[i].scanConfig->monitors[i];
+        binnerFlush(&monitors[i].binner);
+    }
+    synchronyFlush(&synchrony);
+    releaseScanConfig(scanConfigRcu.current, NULL);
+
+    tubeEventQueueClose(&tubeEvents);
+    liveShareClose(&liveShare);
+    scanClockStop();
     cleanup();
     return error;
 }
 
-int initializeDevice(void) {
-    int error = 0; // Error code to track errors
-    
-    // Configure digital input (P0.0-P0.4)
-    DAQmxErrChk(DAQmxCreateTask("InputTask", &inputTask));
-    DAQmxErrChk(DAQmxCreateDIChan(inputTask, "Dev1/port0/line0:4", "",
-                                 DAQmx_Val_ChanForAllLines));
-    
-    // Configure digital output (P1.0-P1.1)
-    DAQmxErrChk(DAQmxCreateTask("OutputTask", &outputTask));
-    DAQmxErrChk(DAQmxCreateDOChan(outputTask, "Dev1/port1/line0:1", "",
-                                 DAQmx_Val_ChanForAllLines));
-    
+// program.exe -c monitors.ini [-t] [-r seconds]
+// program.exe [-a archive.mad] [-d dam_directory] [-u socket_path] [-s] [-f scans,ms] [-t]
+//             [-o reads] [-x] [-b ms] [-r seconds]
+// The second form runs a single monitor on Dev1 (or the simulator with -s).
+// -r stops after that many seconds, for benchmarks (see bench-scaling.ps1).
+int parseCommandLine(int argc, char* argv[]) {
+    char error[CONFIG_ERROR_BYTES];
+    const char* path = NULL; // -c
+    MonitorConfig* monitor = &config.monitors[0];
+    bool simulate = false; // -s
+    bool retune = false; // -t
+    int i;
+
+    configInit(&config);
+    configDefaultMonitor(monitor, 1);
+    config.monitorCount = 1;
+
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            path = argv[++i];
+        } else if (strcmp(argv[i], "-a") == 0 && i + 1 < argc) {
+            snprintf(monitor->archivePath, sizeof(monitor->archivePath), "%s", argv[++i]);
+        } else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
+            snprintf(config.damDirectory, sizeof(config.damDirectory), "%s", argv[++i]);
+        } else if (strcmp(argv[i], "-u") == 0 && i + 1 < argc) {
+            snprintf(config.socketPath, sizeof(config.socketPath), "%s", argv[++i]);
+        } else if (strcmp(argv[i], "-t") == 0) {
+            retune = true;
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            monitor->oversample = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-x") == 0) {
+            monitor->rejectUnstable = true;
+        } else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+            monitor->timebase = strtof(argv[++i], NULL) / 1000.0f;
+        } else if (strcmp(argv[i], "-s") == 0) {
+            simulate = true;
+        } else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            runSeconds = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+            const char* outage = strchr(argv[++i], ',');
+            monitor->faults.failEveryScans = (uint32_t)strtoul(argv[i], NULL, 10);
+            monitor->faults.outageMs = outage != NULL ? (uint32_t)strtoul(outage + 1, NULL, 10) : 0;
+            simulate = true;
+        } else {
+            // Bare path for compatibility
+            snprintf(monitor->archivePath, sizeof(monitor->archivePath), "%s", argv[i]);
+        }
+    }
+
+    configPath = path;
+    if (configPath != NULL) {
+        if (configLoad(&config, configPath, error) != 0) {
+            printf("Configuration error: %s\n", error);
+            return -1;
+        }
+        printf("Loaded %d monitor(s) from %s\n", config.monitorCount, configPath);
+    } else {
+        if (simulate) {
+            snprintf(monitor->device, sizeof(monitor->device), "%s", CONFIG_SIM_DEVICE);
+        }
+        if (configFinish(&config, error) != 0) {
+            printf("Invalid option: %s\n", error);
+            return -1;
+        }
+    }
+    config.retune |= retune;
     return 0;
+}
 
-Error:
-    cleanup();
-    return error;
+// Resolves one configured monitor into its runtime state and opens its device
+int openMonitor(Monitor* monitor, const MonitorConfig* monitorConfig, uint32_t index) {
+    bool simulate = strcmp(monitorConfig->device, CONFIG_SIM_DEVICE) == 0;
+    int error;
+
+    monitor->config = monitorConfig;
+    monitor->index = index;
+    monitor->number = monitorConfig->number;
+    monitor->tubeCount = monitorConfig->tubeCount;
+    binnerInit(&monitor->binner, BIN_LENGTH_US, (uint32_t)monitor->tubeCount, binClosed, monitor);
+    tubeStatsInit(&monitor->positionStats, (uint32_t)monitor->tubeCount);
+    feedingInit(&monitor->feeding, (uint32_t)monitor->tubeCount, config.feedingStartMs, config.feedingEndMs);
+    locomotionInit(&monitor->locomotion, (uint32_t)monitor->tubeCount, monitorConfig->spacingMm, config.smoothingMs);
+    healthInit(&monitor->health, (uint32_t)monitor->tubeCount, config.deadHours, config.emptyHours);
+    activityBitmapInit(&monitor->activity, BIN_LENGTH_US, (uint32_t)monitor->tubeCount);
+    if (circadianOpen(&monitor->circadian, (uint32_t)monitor->tubeCount) != 0) {
+        printf("Monitor %u: out of memory for the periodograms\n", monitor->number);
+        return -1;
+    }
+
+    if (simulate) {
+        daqSimInit(&monitor->device, &monitorConfig->faults);
+    } else {
+        daqNiInit(&monitor->device, monitorConfig->inputLines, monitorConfig->outputLines);
+    }
+    monitor->device.oversample = monitorConfig->oversample;
+    monitor->device.rejectUnstable = monitorConfig->rejectUnstable;
+    error = supervisorOpen(&monitor->supervisor, &monitor->device);
+    if (error) {
+        printf("Monitor %u: failed to initialize %s. Error: %d\n", monitor->number, monitorConfig->device, error);
+        return error;
+    }
+    monitor->deviceOpen = true;
+
+    return configureTimebase(monitor, config.retune);
 }
 
-int runAcquisition(void) {
-    int error = 0; // Error code to track errors
-    unsigned char inputData[PORT0_LINE_COUNT]; // Buffer to store input data
-    unsigned char outputData[PORT1_LINE_COUNT]; // Buffer to store output data
-    int tubeCounter; // Counter for the number of tubes
-    
-    // Step 1: Send reset pulse (P1.0 HIGH for 3Tb)
-    outputData[0] = 1;  // Reset high
-    outputData[1] = 0;  // Clock low
-    DAQmxErrChk(DAQmxWriteDigitalLines(outputTask, 1, 1, timebase*3.0,
-                                      DAQmx_Val_GroupByChannel, outputData, NULL, NULL));
-    
-    outputData[0] = 0;
-    DAQmxErrChk(DAQmxWriteDigitalLines(outputTask, 1, 1, timebase,
-                                      DAQmx_Val_GroupByChannel, outputData, NULL, NULL));
-    
-    // Main acquisition loop for all tubes
-    for(tubeCounter = 0; tubeCounter < NUM_TUBES; tubeCounter++) {
-        // Step 2: Send clock pulse (P1.1 HIGH)
-        outputData[1] = 1;
-        DAQmxErrChk(DAQmxWriteDigitalLines(outputTask, 1, 1, timebase*2.5,
-                                          DAQmx_Val_GroupByChannel, outputData, NULL, NULL));
-        
-        // Step 4-5: Wait 1Tb and read data during 2Tb interval
-        Sleep((DWORD)(timebase * 1000));
-        DAQmxErrChk(DAQmxReadDigitalLines(inputTask, 1, timebase*2.0,
-                                         DAQmx_Val_GroupByChannel, inputData,
-                                         PORT0_LINE_COUNT, NULL, NULL, NULL));
-        
-        // Process the read data
-        processData(inputData, tubeCounter);
-        
-        // Step 7: Wait 2Tb
-        Sleep((DWORD)(timebase * 2000));
-        
-        // Clock low
-        outputData[1] = 0;
-        DAQmxErrChk(DAQmxWriteDigitalLines(outputTask, 1, 1, timebase*2.5,
-                                          DAQmx_Val_GroupByChannel, outputData, NULL, NULL));
-    }
-    
+// Stops the main loop on Ctrl+C instead of killing the process
+BOOL WINAPI consoleHandler(DWORD signal) {
+    if (signal == CTRL_C_EVENT || signal == CTRL_BREAK_EVENT) {
+        running = false;
+        tubeEventWake(&tubeEvents);
+        return TRUE;
+    }
+    return FALSE;
+}
+
+// Uses the configured timebase, else the one saved for this device, else tunes it
+// on the monitor and saves the result. retune (-t) skips the saved value.
+int configureTimebase(Monitor* monitor, bool retune) {
+    TuneReport report;
+    char key[48];
+    int i;
+
+    if (monitor->config->timebase > 0.0f) {
+        monitor->timebase = monitor->config->timebase;
+        return 0;
+    }
+    timebaseKey(monitor->config, monitor->config->oversample, key);
+    if (!retune && loadTimebase(TUNE_FILE, key, &monitor->timebase) == 0) {
+        printf("Monitor %u: using saved timebase %.3f ms for %s (-t to tune again)\n",
+               monitor->number, monitor->timebase * 1000.0f, key);
+        return 0;
+    }
+
+    printf("Monitor %u: tuning timebase for %s...\n", monitor->number, key);
+    tuneTimebase(&monitor->device, monitor->tubeCount, &report);
+    for (i = 0; i < report.stepCount; i++) {
+        const TuneStep* step = &report.steps[i];
+        printf("  %7.3f ms: %4u reads, %3u disagreements, %3u glitches, %2u failed scans -> %s\n",
+               step->timebase * 1000.0f, step->reads, step->disagreements, step->glitches,
+               step->failedScans, step->reliable ? "ok" : "unreliable");
+    }
+    if (report.timebase == 0.0f) {
+        printf("No reliable timebase found, check the monitor connection\n");
+        return -1;
+    }
+
+    monitor->timebase = report.timebase;
+    printf("Monitor %u: using timebase %.3f ms\n", monitor->number, monitor->timebase * 1000.0f);
+    if (saveTimebase(TUNE_FILE, key, monitor->timebase) != 0) {
+        printf("Could not save %s, tuning will run again next time\n", TUNE_FILE);
+    }
     return 0;
+}
+
+// Name of a monitor's saved timebase in TUNE_FILE, tuned values depend on the oversampling
+void timebaseKey(const MonitorConfig* monitorConfig, int oversample, char key[48]) {
+    if (oversample > 1) {
+        snprintf(key, 48, "%s/x%d", monitorConfig->device, oversample);
+    } else {
+        snprintf(key, 48, "%s", monitorConfig->device);
+    }
+}
+
+// Opens what appConfig asks for, taking over the outputs of previous whose path is unchanged.
+// Returns NULL with error set if an output cannot be opened; nothing of previous is touched.
+ScanConfig* buildScanConfig(const AppConfig* appConfig, const ScanConfig* previous, char error[CONFIG_ERROR_BYTES]) {
+    ScanConfig* scanConfig = calloc(1, sizeof(ScanConfig));
+    ArchiveOptions archiveOptions = {appConfig->archiveSyncMs, appConfig->archiveSegmentMiB,
+                                     appConfig->archivePyramid};
+    int i;
+
+    if (scanConfig == NULL) {
+        snprintf(error, CONFIG_ERROR_BYTES, "out of memory");
+        return NULL;
+    }
+    scanConfig->version = previous != NULL ? previous->version + 1 : 1;
+
+    for (i = 0; i < monitorCount; i++) {
+        const MonitorConfig* monitorConfig = &appConfig->monitors[i];
+        MonitorSettings* settings = &scanConfig->monitors[i];
+        const MonitorSettings* old = previous != NULL ? &previous->monitors[i] : NULL;
+
+        settings->oversample = monitorConfig->oversample;
+        settings->rejectUnstable = monitorConfig->rejectUnstable;
+        settings->timebase = monitorConfig->timebase;
+        if (settings->timebase == 0.0f) {
+            // auto: never tunes while scanning, takes the saved value or keeps the current one
+            char key[48];
+
+            timebaseKey(monitorConfig, settings->oversample, key);
+            if (loadTimebase(TUNE_FILE, key, &settings->timebase) != 0) {
+                settings->timebase = old != NULL ? old->timebase : monitors[i].timebase;
+            }
+        }
+
+        memcpy(settings->archivePath, monitorConfig->archivePath, sizeof(settings->archivePath));
+        if (settings->archivePath[0] == '\0') {
+            continue;
+        }
+        if (old != NULL && old->archive != NULL && strcmp(old->archivePath, settings->archivePath) == 0) {
+            settings->archive = old->archive;
+            continue;
+        }
+        settings->archive = malloc(sizeof(ArchiveWriter));
+        if (settings->archive == NULL ||
+            archiveOpen(settings->archive, settings->archivePath, monitors[i].number,
+                        (uint32_t)monitors[i].tubeCount, &archiveOptions) != 0) {
+            free(settings->archive);
+            settings->archive = NULL;
+            snprintf(error, CONFIG_ERROR_BYTES, "Monitor %u: failed to open archive %s",
+                     monitors[i].number, settings->archivePath);
+            goto Error;
+        }
+        if (settings->archive->recovery.wasOpen) {
+            printf("Monitor %u: recovered %u segment(s) of %s left open: kept %u blocks (%llu scans), cut %llu bytes\n",
+                   monitors[i].number, settings->archive->segmentsRecovered, settings->archivePath,
+                   settings->archive->recovery.blocksKept, (unsigned long long)settings->archive->recovery.scansKept,
+                   (unsigned long long)settings->archive->recovery.bytesDropped);
+        }
+        printf("Monitor %u: archiving scans to %s\n", monitors[i].number, settings->archive->segmentPath);
+    }
+
+    memcpy(scanConfig->damDirectory, appConfig->damDirectory, sizeof(scanConfig->damDirectory));
+    if (previous != NULL && previous->damWriter != NULL &&
+        strcmp(previous->damDirectory, scanConfig->damDirectory) == 0) {
+        scanConfig->damWriter = previous->damWriter;
+    } else if (scanConfig->damDirectory[0] != '\0') {
+        scanConfig->damWriter = malloc(sizeof(DamWriter));
+        if (scanConfig->damWriter == NULL || damWriterOpen(scanConfig->damWriter, scanConfig->damDirectory) != 0) {
+            free(scanConfig->damWriter);
+            scanConfig->damWriter = NULL;
+            snprintf(error, CONFIG_ERROR_BYTES, "Failed to start DAM writer for %s", scanConfig->damDirectory);
+            goto Error;
+        }
+        printf("Writing DAM files to %s\n", scanConfig->damDirectory);
+    }
+
+    memcpy(scanConfig->socketPath, appConfig->socketPath, sizeof(scanConfig->socketPath));
+    if (previous != NULL && previous->streamServer != NULL &&
+        strcmp(previous->socketPath, scanConfig->socketPath) == 0) {
+        scanConfig->streamServer = previous->streamServer;
+    } else if (scanConfig->socketPath[0] != '\0') {
+        scanConfig->streamServer = malloc(sizeof(StreamServer));
+        if (scanConfig->streamServer == NULL || streamServerOpen(scanConfig->streamServer, scanConfig->socketPath) != 0) {
+            snprintf(error, CONFIG_ERROR_BYTES, "Failed to listen on %s: %s", scanConfig->socketPath,
+                     scanConfig->streamServer != NULL ? scanConfig->streamServer->failure : "out of memory");
+            free(scanConfig->streamServer);
+            scanConfig->streamServer = NULL;
+            goto Error;
+        }
+        printf("Streaming to subscribers on %s\n", scanConfig->socketPath);
+    }
+
+    return scanConfig;
 
 Error:
-    return error;
+    releaseScanConfig(scanConfig, previous);
+    return NULL;
 }
 
-void processData(unsigned char data[], int tubeNumber) {
-    if (data[4] == 0) {  // DV is LOW - normal position reading
-        tubeReadings[tubeNumber].value = 
-            data[0] + (data[1] << 1) + (data[2] << 2) + (data[3] << 3);
-        tubeReadings[tubeNumber].isEating = false;
+// Closes the outputs of scanConfig that keep does not share and frees it.
+// No reader may still hold scanConfig.
+void releaseScanConfig(ScanConfig* scanConfig, const ScanConfig* keep) {
+    int i;
+
+    if (scanConfig->streamServer != NULL && (keep == NULL || keep->streamServer != scanConfig->streamServer)) {
+        StreamServer* server = scanConfig->streamServer;
+
+        streamServerClose(server);
+        printf("Streamed %llu frames on %s (%llu records and %llu slow clients dropped)\n",
+               (unsigned long long)server->framesSent, scanConfig->socketPath,
+               (unsigned long long)server->recordsDropped, (unsigned long long)server->clientsDropped);
+        free(server);
     }
-    else {  // DV is HIGH - check for eating condition
-        if (data[0] == 0 && data[1] == 0 && data[2] == 0 && data[3] == 0 &&
-            tubeReadings[tubeNumber].value == 1) {
-            tubeReadings[tubeNumber].isEating = true;
+    if (scanConfig->damWriter != NULL && (keep == NULL || keep->damWriter != scanConfig->damWriter)) {
+        DamWriter* writer = scanConfig->damWriter;
+
+        damWriterClose(writer);
+        printf("Wrote %llu DAM rows to %s (%llu dropped)\n", (unsigned long long)writer->rowsWritten,
+               scanConfig->damDirectory, (unsigned long long)writer->rowsDropped);
+        free(writer);
+    }
+    for (i = 0; i < monitorCount; i++) {
+        ArchiveWriter* archive = scanConfig->monitors[i].archive;
+
+        if (archive == NULL || (keep != NULL && keep->monitors[i].archive == archive)) {
+            continue;
         }
+        archiveClose(archive);
+        printf("Monitor %u: archived %llu scans to %s (%llu dropped), %llu bytes, ratio %.1f:1, %u segment(s)\n",
+               monitors[i].number, (unsigned long long)archive->stats.scansWritten,
+               scanConfig->monitors[i].archivePath, (unsigned long long)archive->stats.scansDropped,
+               (unsigned long long)archive->stats.encodedBytes,
+               archive->stats.encodedBytes ? (double)archive->stats.rawBytes / archive->stats.encodedBytes : 0.0,
+               archive->stats.segmentsClosed);
+        printf("  %llu syncs, longest %.1f ms; appends p99.9 %.1f us, longest %.1f us\n",
+               (unsigned long long)archive->stats.syncs, archive->syncLatency.maxNs / 1e6,
+               latencyPercentile(&archive->appendLatency, 99.9) / 1e3, archive->appendLatency.maxNs / 1e3);
+        if (archive->stats.eventsWritten + archive->stats.eventsDropped > 0) {
+            printf("  %llu environment events stored (%llu dropped)\n", (unsigned long long)archive->stats.eventsWritten,
+                   (unsigned long long)archive->stats.eventsDropped);
+        }
+        if (archive->options.pyramid) {
+            printf("  %llu pyramid bins written%s\n", (unsigned long long)archive->pyramid.binsWritten,
+                   archive->pyramid.failed ? ", some failed (madtool pyramid rebuilds them)" : "");
+        }
+        free(archive);
     }
+    free(scanConfig);
 }
 
-void displayTable(void) {
+// Only settings in ScanConfig can change while scanning, the devices stay as they were opened
+static const char* restartNeeded(const AppConfig* next) {
     int i;
-    printf("\033[2J\033[H");  // Clear screen and move cursor to top
-    printf("Multibeam Activity Detector - Real-time Monitoring\n");
-    printf("===============================================\n\n");
-    printf("Tube | Position | Status | Activity\n");
-    printf("-----|----------|---------|----------\n");
-    
-    for(i = 0; i < NUM_TUBES; i++) {
+
+    if (next->monitorCount != config.monitorCount || next->cpu != config.cpu ||
+        next->scanIntervalMs != config.scanIntervalMs || next->workerCount != config.workerCount ||
+        next->feedingStartMs != config.feedingStartMs || next->feedingEndMs != config.feedingEndMs ||
+        next->smoothingMs != config.smoothingMs || next->deadHours != config.deadHours ||
+        next->emptyHours != config.emptyHours || next->synchronyWindowBins != config.synchronyWindowBins ||
+        strcmp(next->environmentSource, config.environmentSource) != 0) {
+        return "monitors or [acquisition] changed, restart to apply";
+    }
+    if (next->archiveSyncMs != config.archiveSyncMs || next->archiveSegmentMiB != config.archiveSegmentMiB ||
+        next->archivePyramid != config.archivePyramid) {
+        return "archive sync, segment or pyramid changed, restart to apply";
+    }
+    for (i = 0; i < config.monitorCount; i++) {
+        const MonitorConfig* now = &config.monitors[i];
+        const MonitorConfig* then = &next->monitors[i];
+
+        if (then->number != now->number || then->tubeCount != now->tubeCount ||
+            strcmp(then->device, now->device) != 0 || strcmp(then->inputLines, now->inputLines) != 0 ||
+            strcmp(then->outputLines, now->outputLines) != 0 || then->spacingMm != now->spacingMm ||
+            memcmp(&then->faults, &now->faults, sizeof(SimFaults)) != 0) {
+            return "devices, channels, tubes or spacing changed, restart to apply";
+        }
+    }
+    return NULL;
+}
+
+// Replaces the message displayTable shows without making it wait: the other buffer is
+// written, then made current. Reloads are RELOAD_POLL_MS apart, far longer than a printf.
+static void setReloadMessage(const char* message) {
+    int next = reloadMessage ^ 1;
+
+    snprintf(reloadMessages[next], sizeof(reloadMessages[next]), "%s", message);
+    __atomic_store_n(&reloadMessage, next, __ATOMIC_RELEASE);
+}
+
+// Applies configPath whenever it is saved. I/O threads and workers pick the new ScanConfig
+// up at their next scan or task; the old one is released here once all have moved past it.
+unsigned int __stdcall reloadThread(void* arg) {
+    static AppConfig next; // Too large for the stack
+    WIN32_FILE_ATTRIBUTE_DATA attributes;
+    FILETIME lastWrite = {0, 0};
+
+    if (GetFileAttributesExA(configPath, GetFileExInfoStandard, &attributes)) {
+        lastWrite = attributes.ftLastWriteTime;
+    }
+    while (running) {
+        char error[CONFIG_ERROR_BYTES];
+        const char* problem;
+        ScanConfig* current = scanConfigRcu.current; // Only this thread publishes
+        ScanConfig* fresh;
+
+        Sleep(RELOAD_POLL_MS);
+        if (!GetFileAttributesExA(configPath, GetFileExInfoStandard, &attributes) ||
+            CompareFileTime(&attributes.ftLastWriteTime, &lastWrite) == 0) {
+            continue;
+        }
+        lastWrite = attributes.ftLastWriteTime;
+
+        if (configLoad(&next, configPath, error) != 0) {
+            setReloadMessage(error);
+            continue;
+        }
+        problem = restartNeeded(&next);
+        if (problem != NULL) {
+            setReloadMessage(problem);
+            continue;
+        }
+        fresh = buildScanConfig(&next, current, error);
+        if (fresh == NULL) {
+            setReloadMessage(error);
+            continue;
+        }
+
+        rcuPublish(&scanConfigRcu, fresh);
+        rcuSynchronize(&scanConfigRcu);
+        releaseScanConfig(current, fresh);
+        setReloadMessage("last change applied");
+    }
+    return 0;
+}
+
+// Reads one monitor until the program stops and queues its scans for the workers.
+// Never waits for them on a real device: with the ring full the scan is dropped, and
+// the next one that fits carries a gap over the lost ones. The simulator has nothing
+// to overrun and waits instead, so with interval = 0 it measures decode throughput.
+unsigned int __stdcall ioThread(void* arg) {
+    Monitor* monitor = arg;
+    bool simulated = strcmp(monitor->config->device, CONFIG_SIM_DEVICE) == 0;
+    RawScan scan;
+    bool queued;
+    bool lost = false;       // Scans were dropped since lastQueuedUs
+    int64_t lastQueuedUs = 0;
+
+    if (config.cpu >= 0 && SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << config.cpu) == 0) {
+        printf("Monitor %u: could not pin the I/O thread to CPU %d\n", monitor->number, config.cpu);
+    }
+    while (running) {
+        // Scan boundary: picks up a reloaded timebase or oversampling without locking
+        const ScanConfig* scanConfig = rcuRead(&scanConfigRcu, monitor->ioReader);
+        const MonitorSettings* settings = &scanConfig->monitors[monitor->index];
+
+        monitor->device.oversample = settings->oversample;
+        monitor->device.rejectUnstable = settings->rejectUnstable;
+        scan.result = supervisorScan(&monitor->supervisor, settings->timebase, scan.packed,
+                                     monitor->tubeCount, &scan.timeUs, &scan.gap);
+        if (scan.result == DAQ_SCAN_NONE) {
+            continue;  // The supervisor paces the retries, displayTable shows the state
+        }
+
+        if (lost && lastQueuedUs != 0) {
+            if (scan.result != DAQ_SCAN_RESUMED) {
+                scan.gap.endUs = scan.timeUs;
+            }
+            scan.gap.startUs = lastQueuedUs;
+            scan.result = DAQ_SCAN_RESUMED;
+        }
+        queued = scanRingPush(&monitor->ring, &scan);
+        while (!queued && simulated && running) {
+            Sleep(0);
+            queued = scanRingPush(&monitor->ring, &scan);
+        }
+        if (!queued && simulated) {
+            break;  // Stopping
+        }
+        if (!queued) {
+            lost = true;
+            monitor->scansDropped++;
+        } else {
+            lost = false;
+            lastQueuedUs = scan.timeUs;
+            monitor->scansRead++;
+
+            // Pairs with the fence in drainMonitor: either the worker sees this scan
+            // before it stops, or this thread sees scheduled cleared and queues a new task
+            __atomic_thread_fence(__ATOMIC_SEQ_CST);
+            if (__atomic_load_n(&monitor->scheduled, __ATOMIC_RELAXED) == 0 &&
+                __atomic_exchange_n(&monitor->scheduled, 1, __ATOMIC_ACQ_REL) == 0) {
+                workPoolSubmit(&decodePool, (int)monitor->index, drainMonitor, monitor);
+            }
+        }
+        if (config.scanIntervalMs > 0) {
+            Sleep((DWORD)config.scanIntervalMs);
+        }
+    }
+    rcuReaderOffline(&scanConfigRcu, monitor->ioReader);
+    return 0;
+}
+
+// Decodes the queued scans of one monitor in order. At most one task per monitor is
+// queued or running (scheduled), which keeps its scans in order whichever worker runs it.
+void drainMonitor(void* context, int worker) {
+    Monitor* monitor = context;
+    const ScanConfig* scanConfig = rcuRead(&scanConfigRcu, workerReaders[worker]);
+    RawScan scan;
+    int drained = 0;
+
+    monitor->scanConfig = scanConfig;
+    monitor->settings = &scanConfig->monitors[monitor->index];
+    for (;;) {
+        while (drained < DRAIN_BATCH && scanRingPop(&monitor->ring, &scan)) {
+            if (scan.result == DAQ_SCAN_RESUMED) {
+                markGap(monitor, &scan.gap);
+            }
+            mergeEnvironment(monitor, scan.timeUs);
+            processScan(monitor, scan.packed, scan.timeUs);
+            monitor->scansDecoded++;
+            drained++;
+        }
+        if (drained == DRAIN_BATCH) {
+            // Still scheduled, the other monitors queued meanwhile go first
+            workPoolSubmit(&decodePool, worker, drainMonitor, monitor);
+            return;
+        }
+
+        __atomic_store_n(&monitor->scheduled, 0, __ATOMIC_RELEASE);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if (scanRingEmpty(&monitor->ring) || __atomic_exchange_n(&monitor->scheduled, 1, __ATOMIC_ACQ_REL) != 0) {
+            return;
+        }
+        // A scan arrived after the ring looked empty and the I/O thread left it to us
+    }
+}
+
+// A sleeping worker holds no ScanConfig and must not hold up a reload
+void workerIdle(int worker, void* context) {
+    rcuReaderOffline(&scanConfigRcu, workerReaders[worker]);
+}
+
+// Printed after the pool stopped; with interval = 0 and simulated monitors it measures decoding throughput
+void reportThroughput(double seconds, int workerCount) {
+    uint64_t read = 0, dropped = 0, decoded = 0, bouts = 0, boutUs = 0, episodes = 0;
+    SynchronyBin latest, peak;
+    double pathMm = 0.0;
+    int dead = 0, empty = 0;
+    int i;
+    int tube;
+
+    for (i = 0; i < monitorCount; i++) {
+        read += monitors[i].scansRead;
+        dropped += monitors[i].scansDropped;
+        decoded += monitors[i].scansDecoded;
+        for (tube = 0; tube < monitors[i].tubeCount; tube++) {
+            bouts += monitors[i].feeding.bouts[tube];
+            boutUs += monitors[i].feeding.boutUs[tube];
+            episodes += monitors[i].locomotion.tubes[tube].episodes;
+            pathMm += locomotionPathMm(&monitors[i].locomotion, (uint32_t)tube);
+        }
+        dead += __builtin_popcountll(monitors[i].health.dead);
+        empty += __builtin_popcountll(monitors[i].health.empty);
+    }
+    printf("Decoded %llu of %llu scans from %d monitor(s) in %.1f s: %.0f scans/s, %llu dropped\n",
+           (unsigned long long)decoded, (unsigned long long)read, monitorCount, seconds,
+           seconds > 0.0 ? decoded / seconds : 0.0, (unsigned long long)dropped);
+    printf("%d decode worker(s) ran %llu tasks, %llu stolen\n", workerCount,
+           (unsigned long long)decodePool.executed, (unsigned long long)decodePool.stolen);
+    printf("%llu tube events, %llu dropped by a full queue; the display was woken %llu times\n",
+           (unsigned long long)tubeEvents.pushPosition, (unsigned long long)tubeEvents.dropped,
+           (unsigned long long)tubeEvents.wakeups);
+    printf("%llu feeding bouts finished, %.1f s of feeding\n", (unsigned long long)bouts, boutUs / 1e6);
+    printf("%.3f m walked, %llu movement episodes finished\n", pathMm / 1000.0, (unsigned long long)episodes);
+    printf("%d tube(s) flagged dead, %d empty\n", dead, empty);
+    if (synchronyLatest(&synchrony, &latest, &peak) > 0) {
+        time_t peakTime = (time_t)(peak.startUs / 1000000);
+        struct tm* utc = gmtime(&peakTime);
+
+        printf("Most synchronous minute %02d:%02d UTC: %u of %u tubes active; correlations by %s, %u late bins\n",
+               utc != NULL ? utc->tm_hour : 0, utc != NULL ? utc->tm_min : 0, peak.activeTubes, peak.observedTubes,
+               synchronyKernelName(), synchrony.lateBins);
+    }
+    {
+        uint64_t bytes = 0, kinds[3] = {0, 0, 0};
+        uint32_t failures = 0;
+
+        for (i = 0; i < monitorCount; i++) {
+            const ActivityBitmap* activity = &monitors[i].activity;
+
+            bytes += activity->bytes;
+            kinds[ACTIVITY_ARRAY] += activity->kinds[ACTIVITY_ARRAY];
+            kinds[ACTIVITY_BITMAP] += activity->kinds[ACTIVITY_BITMAP];
+            kinds[ACTIVITY_RUNS] += activity->kinds[ACTIVITY_RUNS];
+            failures += monitors[i].activityFailures;
+        }
+        if (config.environmentSource[0] != '\0') {
+            uint64_t missed = 0;
+
+            for (i = 0; i < monitorCount; i++) {
+                missed += monitors[i].environmentCursor.missed;
+            }
+            printf("%llu environment events from %s, %llu lines not understood, %llu missed by a monitor\n",
+                   (unsigned long long)environment.published, config.environmentSource,
+                   (unsigned long long)environment.linesRejected, (unsigned long long)missed);
+        }
+        printf("Activity bitmaps: %llu bytes sealed in %llu arrays, %llu bitmaps and %llu runs containers, "
+               "%u minutes lost\n", (unsigned long long)bytes, (unsigned long long)kinds[ACTIVITY_ARRAY],
+               (unsigned long long)kinds[ACTIVITY_BITMAP], (unsigned long long)kinds[ACTIVITY_RUNS], failures);
+    }
+}
+
+// Hands the environment events up to timeUs to the outputs ahead of the scan at
+// timeUs, so bins and archive see conditions and scans in time order. Copies only.
+void mergeEnvironment(Monitor* monitor, int64_t timeUs) {
+    EnvironmentEvent event;
+
+    while (environmentNext(&environment, &monitor->environmentCursor, timeUs, &event)) {
+        binnerAddEvent(&monitor->binner, &event);
+        if (monitor->settings->archive != NULL) {
+            archiveAppendEvent(monitor->settings->archive, &event);
+        }
+    }
+}
+
+// Records an interruption in every output before the first scan after it
+void markGap(Monitor* monitor, const DaqGap* gap) {
+    tubeStatsGap(&monitor->positionStats, gap->startUs, gap->endUs);
+    pushBoutEvents(monitor, feedingGap(&monitor->feeding, gap->startUs));
+    locomotionGap(&monitor->locomotion);
+    if (monitor->settings->archive != NULL) {
+        archiveMarkGap(monitor->settings->archive);
+    }
+    if (monitor->scanConfig->streamServer != NULL) {
+        streamServerSubmitGap(monitor->scanConfig->streamServer, monitor->index, gap->startUs, gap->endUs);
+    }
+}
+
+void processScan(Monitor* monitor, const uint8_t packedScan[], int64_t scanTimeUs) {
+    ScanDelta delta = decodeScan(&monitor->scanState, packedScan, monitor->tubeCount);
+    uint64_t changed = delta.moved | delta.eatingChanged;
+    TubeEvent events[SCAN_MAX_TUBES];
+    uint32_t eventCount = 0;
+
+    // Only tubes the kernel reported as changed become events
+    while (changed) {
+        int tube = __builtin_ctzll(changed);
+        TubeReading* reading = &monitor->tubeReadings[tube];
+        TubeEvent* event = &events[eventCount++];
+        bool eating = monitor->scanState.eating[tube] != 0;
+
+        event->timeUs = scanTimeUs;
+        event->monitor = (uint16_t)monitor->index;
+        event->tube = (uint8_t)tube;
+        event->kind = (uint8_t)((delta.moved >> tube & 1) ? TUBE_EVENT_MOVED : 0);
+        if (eating != reading->isEating) {
+            event->kind |= eating ? TUBE_EVENT_EATING_START : TUBE_EVENT_EATING_STOP;
+        }
+        event->oldPosition = (uint8_t)reading->value;
+        event->newPosition = monitor->scanState.position[tube];
+        event->reserved = 0;
+        tubeEventPush(&tubeEvents, event);
+        reading->value = monitor->scanState.position[tube];
+        reading->isEating = eating;
+        changed &= changed - 1;
+    }
+    if (eventCount > 0) {
+        tubeEventNotify(&tubeEvents);
+        if (monitor->scanConfig->streamServer != NULL) {
+            streamServerSubmitEvents(monitor->scanConfig->streamServer, events, eventCount);
+        }
+    }
+    pushBoutEvents(monitor, feedingScan(&monitor->feeding, scanTimeUs,
+                                        feedingSeen(packedScan, &monitor->scanState, monitor->tubeCount,
+                                                    monitor->feeding.seen)));
+
+    binnerAddScan(&monitor->binner, scanTimeUs, &monitor->scanState, delta);
+    tubeStatsScan(&monitor->positionStats, scanTimeUs, &monitor->scanState, delta);
+    locomotionScan(&monitor->locomotion, scanTimeUs, &monitor->scanState, delta);
+    pushHealthAlerts(monitor, scanTimeUs, healthScan(&monitor->health, scanTimeUs, &monitor->scanState, delta));
+    livePublishScan(&liveShare, monitor->index, scanTimeUs, &monitor->scanState, (uint32_t)monitor->tubeCount);
+    if (monitor->scanConfig->streamServer != NULL) {
+        streamServerSubmitScan(monitor->scanConfig->streamServer, monitor->index, scanTimeUs,
+                               &monitor->scanState, (uint32_t)monitor->tubeCount);
+    }
+    if (monitor->settings->archive != NULL) {
+        archiveAppendScan(monitor->settings->archive, scanTimeUs, &monitor->scanState);
+    }
+}
+
+// One tube event per bout that started or ended, timed at the start or end of the bout
+void pushBoutEvents(Monitor* monitor, FeedingDelta bouts) {
+    TubeEvent events[SCAN_MAX_TUBES];
+    uint32_t eventCount = 0;
+    uint64_t bits;
+
+    // A tube either starts or ends a bout in one scan, never both
+    for (bits = bouts.ended | bouts.started; bits; bits &= bits - 1) {
+        int tube = __builtin_ctzll(bits);
+        uint64_t bit = 1ull << tube;
+        TubeEvent* event = &events[eventCount++];
+
+        memset(event, 0, sizeof(*event));
+        event->monitor = (uint16_t)monitor->index;
+        event->tube = (uint8_t)tube;
+        event->oldPosition = event->newPosition = monitor->scanState.position[tube];
+        if (bouts.ended & bit) {
+            event->timeUs = monitor->feeding.boutEndUs[tube];
+            event->kind = TUBE_EVENT_BOUT_END | (bouts.cutByGap & bit ? TUBE_EVENT_BOUT_CUT : 0);
+        } else {
+            event->timeUs = monitor->feeding.boutStartUs[tube];
+            event->kind = TUBE_EVENT_BOUT_START;
+        }
+        tubeEventPush(&tubeEvents, event);
+    }
+    if (eventCount == 0) {
+        return;
+    }
+    tubeEventNotify(&tubeEvents);
+    if (monitor->scanConfig->streamServer != NULL) {
+        streamServerSubmitEvents(monitor->scanConfig->streamServer, events, eventCount);
+    }
+}
+
+// One alert per tube that became dead or empty; a revived tube needs no event, the display
+// reads its state, and can raise the alert again after another full window
+void pushHealthAlerts(Monitor* monitor, int64_t timeUs, HealthDelta health) {
+    TubeEvent events[SCAN_MAX_TUBES];
+    uint32_t eventCount = 0;
+    uint64_t bits;
+
+    for (bits = health.dead | health.empty; bits; bits &= bits - 1) {
+        int tube = __builtin_ctzll(bits);
+        TubeEvent* event = &events[eventCount++];
+
+        memset(event, 0, sizeof(*event));
+        event->timeUs = timeUs;
+        event->monitor = (uint16_t)monitor->index;
+        event->tube = (uint8_t)tube;
+        event->kind = health.dead >> tube & 1 ? TUBE_EVENT_DEAD : TUBE_EVENT_EMPTY;
+        event->oldPosition = event->newPosition = monitor->scanState.position[tube]; // Alerts do not move the fly
+        tubeEventPush(&tubeEvents, event);
+    }
+    if (eventCount == 0) {
+        return;
+    }
+    tubeEventNotify(&tubeEvents);
+    if (monitor->scanConfig->streamServer != NULL) {
+        streamServerSubmitEvents(monitor->scanConfig->streamServer, events, eventCount);
+    }
+}
+
+void binClosed(const ActivityBin* bin, uint32_t tubeCount, void* context) {
+    Monitor* monitor = context;
+    uint64_t active = 0;
+    uint32_t tube;
+
+    monitor->lastBin = *bin;
+    if (circadianAddBin(&monitor->circadian, bin)) {
+        circadianPublish(&monitor->circadian);  // Every 30 minutes, well under a millisecond
+    }
+    for (tube = 0; tube < tubeCount; tube++) {
+        active |= (uint64_t)(bin->moves[tube] > 0) << tube;
+    }
+    synchronyAddBin(&synchrony, monitor->index, bin->startUs, active, bin->scans > 0);
+    if (activityBitmapAdd(&monitor->activity, bin->startUs, active) != 0) {
+        monitor->activityFailures++;
+    }
+    livePublishBin(&liveShare, monitor->index, bin, tubeCount);
+    if (monitor->scanConfig->streamServer != NULL) {
+        streamServerSubmitBin(monitor->scanConfig->streamServer, monitor->index, bin, tubeCount);
+    }
+    if (monitor->scanConfig->damWriter != NULL) {
+        damWriterSubmit(monitor->scanConfig->damWriter, monitor->number, bin, tubeCount);
+    }
+}
+
+// Brings shownReadings up to date with the queued tube events, returns true if any arrived.
+// If the queue overflowed the display copies the decoder state instead, as it did before events.
+bool applyTubeEvents(void) {
+    static LONGLONG droppedSeen;
+    TubeEvent events[EVENT_BATCH];
+    uint32_t count;
+    bool applied = false;
+    uint32_t i;
+
+    while ((count = tubeEventPop(&tubeEvents, events, EVENT_BATCH)) > 0) {
+        for (i = 0; i < count; i++) {
+            TubeReading* shown = &monitors[events[i].monitor].shownReadings[events[i].tube];
+
+            // The debounced bouts decide what is shown as eating, not the raw flag
+            shown->value = events[i].newPosition;
+            if (events[i].kind & TUBE_EVENT_BOUT_START) {
+                shown->isEating = true;
+            } else if (events[i].kind & TUBE_EVENT_BOUT_END) {
+                shown->isEating = false;
+            }
+        }
+        applied = true;
+    }
+    if (tubeEvents.dropped != droppedSeen) {
+        droppedSeen = tubeEvents.dropped;
+        for (i = 0; i < (uint32_t)monitorCount; i++) {
+            int tube;
+
+            for (tube = 0; tube < monitors[i].tubeCount; tube++) {
+                monitors[i].shownReadings[tube].value = monitors[i].tubeReadings[tube].value;
+                monitors[i].shownReadings[tube].isEating = (monitors[i].feeding.feeding >> tube & 1) != 0;
+            }
+        }
+        applied = true;
+    }
+    return applied;
+}
+
+// Tube table of a single monitor
+static void displayMonitor(const Monitor* monitor) {
+    const DaqDevice* device = &monitor->device;
+    const DaqSupervisor* supervisor = &monitor->supervisor;
+    static TubeStats stats;  // Too large for the stack
+    CircadianResult rhythms[SCAN_MAX_TUBES];
+    int64_t totalUs;
+    int i;
+
+    tubeStatsSnapshot(&monitor->positionStats, &stats);
+    circadianSnapshot(&monitor->circadian, rhythms);
+    totalUs = stats.latestUs - stats.firstUs - stats.gapUs;
+    printf("Tube | Position | Moves/min | Most at   | Mean visit | Bouts | Path mm | Top mm/s | Period  | Sync r | Status | Activity\n");
+    printf("-----|----------|-----------|-----------|------------|-------|---------|----------|---------|--------|---------|----------\n");
+
+    for(i = 0; i < monitor->tubeCount; i++) {
+        const TubeReading* reading = &monitor->shownReadings[i];
+        const TubePositionStats* tube = &stats.tubes[i];
+        const TubeHealth* health = &monitor->health.tubes[i];
+        uint32_t visits = 0;
+        uint64_t dwellUs = 0;
+        int most = 0;
+        int position;
+
+        for (position = 0; position < BIN_POSITIONS; position++) {
+            visits += tube->visits[position];
+            dwellUs += tube->dwellUs[position];
+            if (tube->occupancyUs[position] > tube->occupancyUs[most]) {
+                most = position;
+            }
+        }
         printf("%4d | ", i + 1);  // Tube number
-        
-        if (tubeReadings[i].isEating) {
-            printf("%8d | EATING  | Feeding at position 1\n", 1);
-        } else if (tubeReadings[i].value > 0) {
-            printf("%8d | ACTIVE  | Moving at position %d\n", 
-                   tubeReadings[i].value, 
-                   tubeReadings[i].value);
+
+        if (reading->isEating) {
+            printf("%8d | ", 1);
+        } else if (reading->value > 0) {
+            printf("%8d | ", reading->value);
+        } else {
+            printf("%8s | ", "-");
+        }
+        printf("%9u | ", monitor->lastBin.moves[i]);  // Moves in the last full minute
+        printf("%2d (%3.0f%%) | ", most, totalUs > 0 ? 100.0 * tube->occupancyUs[most] / totalUs : 0.0);
+        if (visits > 0) {
+            printf("%8.1f s | ", dwellUs / 1e6 / visits);
+        } else {
+            printf("%10s | ", "-");
+        }
+        printf("%5u | ", monitor->feeding.bouts[i]);
+        printf("%7.0f | %8.1f | ", locomotionPathMm(&monitor->locomotion, (uint32_t)i),
+               monitor->locomotion.tubes[i].topSpeed);
+        if (rhythms[i].chiPeriodH > 0.0f && rhythms[i].chiQp > rhythms[i].chiThreshold) {
+            printf("%5.1f h | ", rhythms[i].chiPeriodH);
+        } else {
+            printf("%7s | ", "-");
+        }
+        if (!isnan(synchrony.tubeMeans[synchrony.firstTube[monitor->index] + i])) {
+            printf("%6.2f | ", synchrony.tubeMeans[synchrony.firstTube[monitor->index] + i]);
+        } else {
+            printf("%6s | ", "-");
+        }
+
+        if (health->state == TUBE_DEAD) {
+            printf("DEAD?   | Not left position %d for %.1f h\n", health->anchor,
+                   (monitor->health.latestUs - health->anchorUs) / 3.6e9);
+        } else if (health->state == TUBE_EMPTY) {
+            printf("EMPTY   | No fly seen since the start\n");
+        } else if (reading->isEating) {
+            printf("EATING  | Feeding at position 1 for %.1f s\n",
+                   (monitor->feeding.latestUs - monitor->feeding.boutStartUs[i]) / 1e6);
+        } else if (reading->value > 0) {
+            printf("ACTIVE  | Moving at position %d\n", reading->value);
+        } else {
+            printf("IDLE    | No beam interrupted\n");
+        }
+    }
+    printf("\n");
+    if (!supervisor->connected) {
+        printf("DEVICE LOST (error %d) - reconnecting, attempt %llu\n\n", supervisor->stats.lastError,
+               (unsigned long long)supervisor->stats.reconnectAttempts);
+    }
+    printf("Gaps: %llu, total %.1f s, longest %.1f s, last %.1f s; %llu scans dropped by a full queue\n\n",
+           (unsigned long long)supervisor->stats.gaps, supervisor->stats.totalGapUs / 1e6,
+           supervisor->stats.longestGapUs / 1e6, supervisor->stats.lastGapUs / 1e6,
+           (unsigned long long)monitor->scansDropped);
+    if (device->oversample > 1) {
+        const ScanVoteStats* vote = &device->voteStats;
+        double reads = vote->tubeReads ? (double)vote->tubeReads : 1.0;
+
+        printf("Oversampling: %d reads per tube (%s), %.2f%% unstable, %.2f%% rejected\n\n",
+               device->oversample, device->rejectUnstable ? "reject" : "majority",
+               100.0 * vote->unstable / reads, 100.0 * vote->rejected / reads);
+    }
+}
+
+// One line per monitor, one character per tube: x dead, - empty, E eating, 1-F position, . idle
+static void displaySummary(const ScanConfig* scanConfig) {
+    SynchronyBin latest, peak;
+    int i;
+    int tube;
+
+    synchronyLatest(&synchrony, &latest, &peak);
+    printf("Monitor | Device           | Timebase | Gaps | Dropped | Active | Sync r | Tubes\n");
+    printf("--------|------------------|----------|------|---------|--------|--------|------\n");
+    for (i = 0; i < monitorCount; i++) {
+        const Monitor* monitor = &monitors[i];
+        char tubes[SCAN_MAX_TUBES + 1];
+
+        for (tube = 0; tube < monitor->tubeCount; tube++) {
+            const TubeReading* reading = &monitor->shownReadings[tube];
+            uint8_t health = monitor->health.tubes[tube].state;
+
+            tubes[tube] = health == TUBE_DEAD ? 'x' : health == TUBE_EMPTY ? '-' :
+                          reading->isEating ? 'E' :
+                          reading->value > 0 ? "0123456789ABCDEF"[reading->value & 15] : '.';
+        }
+        tubes[monitor->tubeCount] = '\0';
+        printf("%7u | %-16s | %5.3f ms | %4llu | %7llu | ", monitor->number, monitor->config->device,
+               scanConfig->monitors[i].timebase * 1000.0f, (unsigned long long)monitor->supervisor.stats.gaps,
+               (unsigned long long)monitor->scansDropped);
+        if (latest.observed[i]) {
+            printf("%3.0f%%   | ", 100.0 * latest.active[i] / monitor->tubeCount);
         } else {
-            printf("%8s | IDLE    | No activity detected\n", "-");
+            printf("%6s | ", "-");
         }
+        if (!isnan(synchrony.monitorMatrix[i * monitorCount + i])) {
+            printf("%6.2f | ", synchrony.monitorMatrix[i * monitorCount + i]);
+        } else {
+            printf("%6s | ", "-");
+        }
+        printf("%s%s\n", tubes, monitor->supervisor.connected ? "" : "  DEVICE LOST");
     }
     printf("\n");
+}
+
+// Share of the tubes active in the last minute and the most synchronous minute so far
+static void displaySynchrony(void) {
+    SynchronyBin latest, peak;
+    time_t peakTime;
+    struct tm* utc;
+
+    if (synchronyLatest(&synchrony, &latest, &peak) == 0) {
+        printf("Synchrony: waiting for the first full minute\n\n");
+        return;
+    }
+    peakTime = (time_t)(peak.startUs / 1000000);
+    utc = gmtime(&peakTime);
+    printf("Synchrony: %u of %u tubes active in the last minute (%.0f%%), most at %02d:%02d UTC (%.0f%%)\n\n",
+           latest.activeTubes, latest.observedTubes,
+           latest.observedTubes > 0 ? 100.0 * latest.activeTubes / latest.observedTubes : 0.0,
+           utc != NULL ? utc->tm_hour : 0, utc != NULL ? utc->tm_min : 0,
+           peak.observedTubes > 0 ? 100.0 * peak.activeTubes / peak.observedTubes : 0.0);
+}
+
+// Tubes of every monitor that kept moving for the last half hour, and that did not move for an hour
+static void displayActivity(void) {
+    uint32_t steady = 0;
+    uint32_t still = 0;
+    int i;
+
+    for (i = 0; i < monitorCount; i++) {
+        Monitor* monitor = &monitors[i];
+        int64_t endUs = monitor->lastBin.endUs;
+        uint64_t tubes = monitor->tubeCount < 64 ? (1ull << monitor->tubeCount) - 1 : ~0ull;
+
+        if (endUs == 0) {
+            continue;  // No minute closed yet
+        }
+        steady += (uint32_t)__builtin_popcountll(activityBitmapAll(&monitor->activity, endUs - 30 * BIN_LENGTH_US, endUs));
+        still += (uint32_t)__builtin_popcountll(tubes & ~activityBitmapAny(&monitor->activity, endUs - 60 * BIN_LENGTH_US, endUs));
+    }
+    printf("Activity: %u tube(s) moved in each of the last 30 minutes, %u did not move in the last hour\n\n",
+           steady, still);
+}
+
+// Conditions after the last environment event, if there is a source
+static void displayEnvironment(void) {
+    EnvironmentState state;
+
+    if (config.environmentSource[0] == '\0') {
+        return;
+    }
+    state = environmentSnapshot(&environment);
+    printf("Environment (%s): lights %s", config.environmentSource,
+           state.known & 1u << ENVIRONMENT_LIGHT ? (state.values[ENVIRONMENT_LIGHT] ? "on" : "off") : "unknown");
+    if (state.known & 1u << ENVIRONMENT_TEMPERATURE) {
+        printf(", %.1f C", state.values[ENVIRONMENT_TEMPERATURE] / 1000.0);
+    }
+    if (state.known & 1u << ENVIRONMENT_HUMIDITY) {
+        printf(", %.0f%% RH", state.values[ENVIRONMENT_HUMIDITY] / 1000.0);
+    }
+    if (state.known & 1u << ENVIRONMENT_MARK) {
+        printf(", mark %d", state.values[ENVIRONMENT_MARK]);
+    }
+    if (environment.linesRejected > 0) {
+        printf("; %llu line(s) not understood, last \"%s\"", (unsigned long long)environment.linesRejected,
+               environment.lastRejected);
+    }
+    printf("\n\n");
+}
+
+// Only shownReadings come from tube events; the counters are read while the workers update them
+void displayTable(const ScanConfig* scanConfig) {
+    ScanClockStats clock = scanClockGetStats();
+    printf("\033[2J\033[H");  // Clear screen and move cursor to top
+    printf("Multibeam Activity Detector - Real-time Monitoring\n");
+    printf("===============================================\n\n");
+
+    if (monitorCount == 1) {
+        displayMonitor(&monitors[0]);
+    } else {
+        displaySummary(scanConfig);
+    }
+    displaySynchrony();
+    displayActivity();
+    displayEnvironment();
+    printf("Clock: %s at %.6f MHz, offset to system clock %lld us (max %lld us, %llu steps)\n\n",
+           clock.source, clock.ticksPerSecond / 1e6, (long long)clock.lastOffsetUs,
+           (long long)clock.maxOffsetUs, (unsigned long long)clock.steps);
+    if (configPath != NULL) {
+        printf("Configuration %s version %u%s%s\n\n", configPath, scanConfig->version,
+               reloadMessages[reloadMessage][0] != '\0' ? ": " : "", reloadMessages[reloadMessage]);
+    }
     printf("Legend:\n");
-    printf("- EATING: Fly is feeding at position 1\n");
+    printf("- EATING: Fly is in a feeding bout at position 1\n");
     printf("- ACTIVE: Fly is moving, position indicates beam location\n");
-    printf("- IDLE: No fly detected at this tube\n\n");
+    printf("- IDLE: No beam interrupted right now, the fly may be between beams or asleep\n");
+    printf("- DEAD?: The fly has not left one beam for %u h, EMPTY: no fly seen for %u h\n",
+           config.deadHours, config.emptyHours);
+    printf("- Moves/min: Position changes in the last full minute\n");
+    printf("- Most at: Position the fly spent the most time at since startup, and its share\n");
+    printf("- Mean visit: Average time between two position changes since startup\n");
+    printf("- Bouts: Feeding bouts finished since startup\n");
+    printf("- Path mm, Top mm/s: Distance walked since startup and the fastest step\n");
+    printf("- Period: Chi-square period of the activity if significant, from 32 hours in\n");
+    printf("- Sync r: Mean correlation of the minutes a tube moved with those of the other tubes of its\n");
+    printf("  monitor over the last %u minutes (per monitor in the summary, next to Active: the share of\n"
+           "  its tubes that moved in the last minute)\n\n", config.synchronyWindowBins);
 }
 
 void cleanup(void) {
-    if (inputTask != 0) {
-        DAQmxStopTask(inputTask);
-        DAQmxClearTask(inputTask);
-    }
-    if (outputTask != 0) {
-        DAQmxStopTask(outputTask);
-        DAQmxClearTask(outputTask);
+    int i;
+
+    for (i = 0; i < monitorCount; i++) {
+        if (monitors[i].deviceOpen) {
+            supervisorClose(&monitors[i].supervisor);
+            monitors[i].deviceOpen = false;
+        }
+        circadianClose(&monitors[i].circadian);
+        activityBitmapFree(&monitors[i].activity);
     }
-}
\ No newline at end of file
+    synchronyClose(&synchrony);
+    environmentClose(&environment);
+    free(monitors);
+    monitors = NULL;
+    monitorCount = 0;
+}
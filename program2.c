@@ -5,17 +5,24 @@
 #include <process.h>
 #include <stdint.h>
 #include <string.h>
+#include "config.h" // Monitor configuration file
+#include "timebase_tuner.h" // loadTimebase, TUNE_FILE
 
 // Constants
-#define NUM_TUBES 16
+#define NUM_TUBES 16          // Most tubes this program reads
 #define PORT0_LINE_COUNT 5
 #define PORT1_LINE_COUNT 2
+#define RETRY_FIRST_MS 20     // Delay after the first failed reconnect
+#define RETRY_MAX_MS 2000     // Longest delay between reconnect attempts
 
 // Shared state structure
 typedef struct {
     TaskHandle inputTask;
     TaskHandle outputTask;
     float timebase;
+    int tubeCount;                   // From the configuration, at most NUM_TUBES
+    char inputLines[64];             // DAQmx channel strings from the configuration
+    char outputLines[64];
     volatile bool running;
     CRITICAL_SECTION mutex;
     CONDITION_VARIABLE resetCond;    // Signals when reset pulse occurs
@@ -23,6 +30,11 @@ typedef struct {
     bool resetActive;                // Indicates reset pulse is active
     bool clockHigh;                 // Indicates clock state
     int currentTube;               // Current tube being read
+    SRWLOCK deviceLock;              // Shared by DAQmx calls, exclusive while tasks are re-created
+    volatile bool deviceLost;        // Set by either thread when a DAQmx call fails
+    int lastError;                   // Error that caused the last loss
+    unsigned long long gaps;         // Times the device was lost and reconnected
+    unsigned long long reconnectAttempts;
 } SharedState;
 
 // Tube reading structure
@@ -45,12 +57,12 @@ int initializeDevice(void) {
     
     // Configure digital input (P0.0-P0.4)
     DAQmxErrChk(DAQmxCreateTask("InputTask", &state.inputTask));
-    DAQmxErrChk(DAQmxCreateDIChan(state.inputTask, "Dev2/port0/line0:4", "",
+    DAQmxErrChk(DAQmxCreateDIChan(state.inputTask, state.inputLines, "",
                                  DAQmx_Val_ChanForAllLines));
     
     // Configure digital output (P1.0-P1.1)
     DAQmxErrChk(DAQmxCreateTask("OutputTask", &state.outputTask));
-    DAQmxErrChk(DAQmxCreateDOChan(state.outputTask, "Dev2/port1/line0:1", "",
+    DAQmxErrChk(DAQmxCreateDOChan(state.outputTask, state.outputLines, "",
                                  DAQmx_Val_ChanForAllLines));
     
     return 0;
@@ -59,15 +71,84 @@ Error:
     return error;
 }
 
+// Stops and clears both tasks
+void clearTasks(void) {
+    if (state.inputTask != 0) {
+        DAQmxStopTask(state.inputTask);
+        DAQmxClearTask(state.inputTask);
+        state.inputTask = 0;
+    }
+    if (state.outputTask != 0) {
+        DAQmxStopTask(state.outputTask);
+        DAQmxClearTask(state.outputTask);
+        state.outputTask = 0;
+    }
+}
+
+// Re-creates the tasks after a loss, backing off until the device is back or we stop
+void reconnectDevice(void) {
+    DWORD delayMs = 0;
+
+    while (state.running) {
+        int error;
+
+        AcquireSRWLockExclusive(&state.deviceLock);
+        clearTasks();
+        state.reconnectAttempts++;
+        error = initializeDevice();
+        ReleaseSRWLockExclusive(&state.deviceLock);
+
+        if (error == 0) {
+            state.deviceLost = false;
+            state.gaps++;
+            return;
+        }
+        delayMs = delayMs == 0 ? RETRY_FIRST_MS : delayMs * 2 > RETRY_MAX_MS ? RETRY_MAX_MS : delayMs * 2;
+        Sleep(delayMs);
+    }
+}
+
+// Writes the P1 lines, marking the device lost on failure
+int writeLines(uInt8 outputData[], float timeout) {
+    int error;
+
+    AcquireSRWLockShared(&state.deviceLock);
+    error = DAQmxWriteDigitalLines(state.outputTask, 1, 1, timeout,
+                                   DAQmx_Val_GroupByChannel, outputData, NULL, NULL);
+    ReleaseSRWLockShared(&state.deviceLock);
+    if (DAQmxFailed(error)) {
+        state.lastError = error;
+        state.deviceLost = true;
+    }
+    return error;
+}
+
+// Reads the P0 lines, marking the device lost on failure
+int readLines(uInt8 inputData[], float timeout) {
+    int error;
+
+    AcquireSRWLockShared(&state.deviceLock);
+    error = DAQmxReadDigitalLines(state.inputTask, 1, timeout,
+                                  DAQmx_Val_GroupByChannel, inputData,
+                                  PORT0_LINE_COUNT, NULL, NULL, NULL);
+    ReleaseSRWLockShared(&state.deviceLock);
+    if (DAQmxFailed(error)) {
+        state.lastError = error;
+        state.deviceLost = true;
+    }
+    return error;
+}
+
 // Initialize shared state
 void initializeState(void) {
     int i;
-    state.timebase = 0.0002f;  // Default 0.2ms
     state.running = true;
     state.resetActive = false;
     state.clockHigh = false;
     state.currentTube = 0;
+    state.deviceLost = false;
 
+    InitializeSRWLock(&state.deviceLock);
     InitializeCriticalSection(&state.mutex);
     InitializeConditionVariable(&state.resetCond);
     InitializeConditionVariable(&state.clockCond);
@@ -109,6 +190,12 @@ unsigned int __stdcall outputThread(void* arg) {
     int i;
     
     while (state.running) {
+        // Re-create the tasks before starting a new cycle if either thread lost the device
+        if (state.deviceLost) {
+            reconnectDevice();
+            continue;
+        }
+        
         // Send reset pulse (P1.0 HIGH for 3Tb)
         EnterCriticalSection(&state.mutex);
         outputData[0] = 1;  // Reset high
@@ -118,20 +205,18 @@ unsigned int __stdcall outputThread(void* arg) {
         WakeAllConditionVariable(&state.resetCond);
         LeaveCriticalSection(&state.mutex);
         
-        DAQmxWriteDigitalLines(state.outputTask, 1, 1, state.timebase*3.0,
-                              DAQmx_Val_GroupByChannel, outputData, NULL, NULL);
+        writeLines(outputData, state.timebase*3.0);
         
         // Reset low
         outputData[0] = 0;
-        DAQmxWriteDigitalLines(state.outputTask, 1, 1, state.timebase,
-                              DAQmx_Val_GroupByChannel, outputData, NULL, NULL);
+        writeLines(outputData, state.timebase);
         
         EnterCriticalSection(&state.mutex);
         state.resetActive = false;
         LeaveCriticalSection(&state.mutex);
         
         // Clock cycles for all tubes
-        for (i = 0; i < NUM_TUBES; i++) {
+        for (i = 0; i < state.tubeCount; i++) {
             // Clock high
             EnterCriticalSection(&state.mutex);
             outputData[1] = 1;
@@ -139,8 +224,7 @@ unsigned int __stdcall outputThread(void* arg) {
             WakeAllConditionVariable(&state.clockCond);
             LeaveCriticalSection(&state.mutex);
             
-            DAQmxWriteDigitalLines(state.outputTask, 1, 1, state.timebase*2.5,
-                                  DAQmx_Val_GroupByChannel, outputData, NULL, NULL);
+            writeLines(outputData, state.timebase*2.5);
             
             // Clock low
             EnterCriticalSection(&state.mutex);
@@ -149,8 +233,7 @@ unsigned int __stdcall outputThread(void* arg) {
             WakeAllConditionVariable(&state.clockCond);
             LeaveCriticalSection(&state.mutex);
             
-            DAQmxWriteDigitalLines(state.outputTask, 1, 1, state.timebase*2.5,
-                                  DAQmx_Val_GroupByChannel, outputData, NULL, NULL);
+            writeLines(outputData, state.timebase*2.5);
         }
     }
     
@@ -171,7 +254,7 @@ unsigned int __stdcall inputThread(void* arg) {
         LeaveCriticalSection(&state.mutex);
         
         // Process all tubes
-        for (i = 0; i < NUM_TUBES; i++) {
+        for (i = 0; i < state.tubeCount; i++) {
             // Wait for clock to go high
             EnterCriticalSection(&state.mutex);
             while (!state.clockHigh) {
@@ -181,12 +264,10 @@ unsigned int __stdcall inputThread(void* arg) {
             
             // Wait 1Tb then read data
             Sleep((DWORD)(state.timebase * 1000));
-            DAQmxReadDigitalLines(state.inputTask, 1, state.timebase*2.0,
-                                DAQmx_Val_GroupByChannel, inputData,
-                                PORT0_LINE_COUNT, NULL, NULL, NULL);
-            
-            // Process the data
-            processData(inputData, i);
+            // Process the data, a failed read leaves the tube's last reading in place
+            if (!DAQmxFailed(readLines(inputData, state.timebase*2.0))) {
+                processData(inputData, i);
+            }
             
             // Wait for clock to go low
             EnterCriticalSection(&state.mutex);
@@ -211,7 +292,7 @@ unsigned int __stdcall displayThread(void* arg) {
         printf("Tube | Position | Status | Activity\n");
         printf("-----|----------|---------|----------\n");
         
-        for (i = 0; i < NUM_TUBES; i++) {
+        for (i = 0; i < state.tubeCount; i++) {
             EnterCriticalSection(&tubeReadings[i].mutex);
             
             printf("%4d | ", i + 1);
@@ -229,16 +310,70 @@ unsigned int __stdcall displayThread(void* arg) {
             LeaveCriticalSection(&tubeReadings[i].mutex);
         }
         
+        if (state.deviceLost) {
+            printf("\nDEVICE LOST (error %d) - reconnecting, attempt %llu\n",
+                   state.lastError, state.reconnectAttempts);
+        }
+        printf("\nReconnects: %llu\n", state.gaps);
+        
         Sleep(100);  // Update display every 100ms
     }
     
     return 0;
 }
 
-int main(void) {
+// Takes the first monitor of the configuration file: program2.exe [-c monitors.ini].
+// Without -c and without monitors.ini it reads 16 tubes on Dev2 as it always did.
+int loadConfiguration(int argc, char* argv[]) {
+    static AppConfig config; // Too large for the stack
+    char error[CONFIG_ERROR_BYTES];
+    bool explicitPath = argc > 2 && strcmp(argv[1], "-c") == 0;
+    const char* path = explicitPath ? argv[2] : CONFIG_FILE;
+    MonitorConfig* monitor = &config.monitors[0];
+
+    if (!explicitPath && GetFileAttributesA(path) == INVALID_FILE_ATTRIBUTES) {
+        configInit(&config);
+        configDefaultMonitor(monitor, 1);
+        snprintf(monitor->device, sizeof(monitor->device), "Dev2");
+        config.monitorCount = 1;
+        if (configFinish(&config, error) != 0) {
+            printf("Configuration error: %s\n", error);
+            return -1;
+        }
+    } else if (configLoad(&config, path, error) != 0) {
+        printf("Configuration error: %s\n", error);
+        return -1;
+    }
+    if (monitor->tubeCount > NUM_TUBES || strcmp(monitor->device, CONFIG_SIM_DEVICE) == 0) {
+        printf("Monitor %u: program2 reads up to %d tubes from an NI device\n", monitor->number, NUM_TUBES);
+        return -1;
+    }
+    if (config.monitorCount > 1) {
+        printf("Using monitor %u, program2 runs a single monitor\n", monitor->number);
+    }
+
+    state.tubeCount = monitor->tubeCount;
+    snprintf(state.inputLines, sizeof(state.inputLines), "%s", monitor->inputLines);
+    snprintf(state.outputLines, sizeof(state.outputLines), "%s", monitor->outputLines);
+
+    // auto takes the timebase program.exe tuned for this device
+    state.timebase = monitor->timebase;
+    if (state.timebase == 0.0f && loadTimebase(TUNE_FILE, monitor->device, &state.timebase) != 0) {
+        state.timebase = 0.0002f;
+        printf("No tuned timebase for %s, using default timebase (0.2ms)\n", monitor->device);
+    }
+    printf("Timebase %.3f ms, %d tubes on %s\n", state.timebase * 1000.0f, state.tubeCount, monitor->device);
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
     int error;
     HANDLE threads[3];
-    char choice;
+    
+    error = loadConfiguration(argc, argv);
+    if (error) {
+        return error;
+    }
     
     error = initializeDevice();
     if (error) {
@@ -248,20 +383,6 @@ int main(void) {
     
     initializeState();
     
-    // Configure timebase
-    printf("Select timebase (milliseconds):\n");
-    printf("1. 0.01\n2. 0.1\n3. 1.0\n4. 10.0\n");
-    printf("Choice: ");
-    scanf_s(" %c", &choice, 1);
-    
-    switch(choice) {
-        case '1': state.timebase = 0.00001f; break;
-        case '2': state.timebase = 0.0001f; break;
-        case '3': state.timebase = 0.001f; break;
-        case '4': state.timebase = 0.01f; break;
-        default:  printf("Using default timebase (0.2ms)\n");
-    }
-    
     // Create threads
     threads[0] = (HANDLE)_beginthreadex(NULL, 0, outputThread, NULL, 0, NULL);
     threads[1] = (HANDLE)_beginthreadex(NULL, 0, inputThread, NULL, 0, NULL);
@@ -269,7 +390,6 @@ int main(void) {
     
     printf("\nPress Enter to stop acquisition...\n");
     getchar();
-    getchar();
     
     // Stop acquisition and wait for threads
     state.running = false;
@@ -290,14 +410,7 @@ int main(void) {
     }
     
     // Cleanup DAQ tasks
-    if (state.inputTask != 0) {
-        DAQmxStopTask(state.inputTask);
-        DAQmxClearTask(state.inputTask);
-    }
-    if (state.outputTask != 0) {
-        DAQmxStopTask(state.outputTask);
-        DAQmxClearTask(state.outputTask);
-    }
+    clearTasks();
     
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,418 @@
+#include "pyramid.h"
+#include <string.h> // memset, memcpy, memcmp, strrchr
+#include <io.h> // _get_osfhandle
+
+static const int64_t levelBinUs[PYRAMID_LEVELS] = {1000000LL, 10000000LL, 60000000LL, 600000000LL, 3600000000LL};
+static const char* levelNames[PYRAMID_LEVELS] = {"1s", "10s", "1m", "10m", "1h"};
+
+int64_t pyramidBinUs(int level) {
+    return levelBinUs[level];
+}
+
+// Bin of timeUs, rounding down before the epoch too
+static int64_t binIndex(int64_t timeUs, int64_t binUs) {
+    return timeUs >= 0 ? timeUs / binUs : -((-timeUs + binUs - 1) / binUs);
+}
+
+void pyramidLevelPath(const char* path, int level, char* out, size_t outBytes) {
+    const char* extension = strrchr(path, '.');
+    const char* separator = strrchr(path, '\\');
+
+    if (separator == NULL || (strrchr(path, '/') != NULL && strrchr(path, '/') > separator)) {
+        separator = strrchr(path, '/');
+    }
+    if (extension != NULL && (separator == NULL || extension > separator)) {
+        snprintf(out, outBytes, "%.*s.%s.pyr", (int)(extension - path), path, levelNames[level]);
+    } else {
+        snprintf(out, outBytes, "%s.%s.pyr", path, levelNames[level]);
+    }
+}
+
+// Opens the file of one level, keeping its records if the header matches
+static int openLevel(PyramidWriter* writer, const char* path, int level) {
+    PyramidLevel* state = &writer->levels[level];
+    PyramidFileHeader header;
+    char levelPath[MAX_PATH];
+    int64_t fileBytes;
+
+    state->binUs = levelBinUs[level];
+    state->originIndex = -1;
+    state->index = INT64_MIN;
+    pyramidLevelPath(path, level, levelPath, sizeof(levelPath));
+
+    state->file = fopen(levelPath, "r+b");
+    if (state->file != NULL) {
+        if (fread(&header, sizeof(header), 1, state->file) == 1 &&
+            memcmp(header.magic, PYRAMID_MAGIC, sizeof(PYRAMID_MAGIC)) == 0 && header.version == PYRAMID_VERSION &&
+            header.tubeCount == writer->tubeCount && header.binUs == state->binUs &&
+            header.recordBytes == writer->recordBytes && _fseeki64(state->file, 0, SEEK_END) == 0 &&
+            (fileBytes = _ftelli64(state->file)) >= (int64_t)sizeof(header)) {
+            state->originIndex = header.originIndex;
+            state->records = (uint64_t)(fileBytes - (int64_t)sizeof(header)) / writer->recordBytes;
+            return 0;
+        }
+        // Derived data only, a pyramid that does not fit is started over
+        fclose(state->file);
+    }
+    state->file = fopen(levelPath, "w+b");
+    return state->file != NULL ? 0 : -1;
+}
+
+int pyramidOpen(PyramidWriter* writer, const char* path, uint32_t tubeCount) {
+    int level;
+
+    memset(writer, 0, sizeof(*writer));
+    writer->tubeCount = tubeCount;
+    writer->recordBytes = sizeof(PyramidBinHeader) + tubeCount * sizeof(PyramidTubeBin);
+    if (tubeCount == 0 || tubeCount > SCAN_MAX_TUBES) {
+        return -1;
+    }
+    for (level = 0; level < PYRAMID_LEVELS; level++) {
+        if (openLevel(writer, path, level) != 0) {
+            while (level-- > 0) {
+                fclose(writer->levels[level].file);
+            }
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void addCounts(PyramidCounts* to, const PyramidCounts* from, uint32_t tubeCount) {
+    uint32_t tube, position;
+
+    to->scans += from->scans;
+    to->flags |= from->flags;
+    for (tube = 0; tube < tubeCount; tube++) {
+        to->moves[tube] += from->moves[tube];
+        to->feedingScans[tube] += from->feedingScans[tube];
+        for (position = 0; position < PYRAMID_POSITIONS; position++) {
+            to->occupancy[tube][position] += from->occupancy[tube][position];
+        }
+    }
+}
+
+// Writes counts as the record of bin index of level; bins before the first record of the file are lost
+static void writeRecord(PyramidWriter* writer, int level, int64_t index, const PyramidCounts* counts) {
+    PyramidLevel* state = &writer->levels[level];
+    PyramidBinHeader* bin = (PyramidBinHeader*)writer->record;
+    PyramidTubeBin* tubes = (PyramidTubeBin*)(bin + 1);
+    uint32_t tube, position;
+
+    if (state->file == NULL || counts->scans == 0) {
+        return;
+    }
+    if (state->originIndex < 0) {
+        PyramidFileHeader header;
+
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, PYRAMID_MAGIC, sizeof(PYRAMID_MAGIC));
+        header.version = PYRAMID_VERSION;
+        header.tubeCount = writer->tubeCount;
+        header.binUs = state->binUs;
+        header.originIndex = index;
+        header.recordBytes = writer->recordBytes;
+        if (_fseeki64(state->file, 0, SEEK_SET) != 0 || fwrite(&header, sizeof(header), 1, state->file) != 1) {
+            writer->failed = true;
+            return;
+        }
+        state->originIndex = index;
+    }
+    if (index < state->originIndex) {
+        return;
+    }
+
+    bin->scans = counts->scans;
+    bin->flags = counts->flags;
+    for (tube = 0; tube < writer->tubeCount; tube++) {
+        tubes[tube].moves = counts->moves[tube];
+        tubes[tube].feedingScans = counts->feedingScans[tube];
+        memset(tubes[tube].occupancy, 0, sizeof(tubes[tube].occupancy));
+        for (position = 0; position < PYRAMID_POSITIONS; position++) {
+            uint32_t share = (uint32_t)(((uint64_t)counts->occupancy[tube][position] * 15 + counts->scans / 2) /
+                                        counts->scans);
+            tubes[tube].occupancy[position >> 1] |= (uint8_t)(share << ((position & 1) * 4));
+        }
+    }
+
+    // Seeking past the end leaves a hole of zeros, which reads as bins without scans
+    if (_fseeki64(state->file, (int64_t)sizeof(PyramidFileHeader) +
+                  (index - state->originIndex) * (int64_t)writer->recordBytes, SEEK_SET) != 0 ||
+        fwrite(writer->record, writer->recordBytes, 1, state->file) != 1) {
+        writer->failed = true;
+        return;
+    }
+    if ((uint64_t)(index - state->originIndex) >= state->records) {
+        state->records = (uint64_t)(index - state->originIndex) + 1;
+    }
+    writer->binsWritten++;
+}
+
+// Reads back the record of bin index of level as counts, all zero if the file has none
+static void readRecord(PyramidWriter* writer, int level, int64_t index, PyramidCounts* counts) {
+    PyramidLevel* state = &writer->levels[level];
+    const PyramidBinHeader* bin = (const PyramidBinHeader*)writer->record;
+    const PyramidTubeBin* tubes = (const PyramidTubeBin*)(bin + 1);
+    uint32_t tube, position;
+
+    memset(counts, 0, sizeof(*counts));
+    if (state->originIndex < 0 || index < state->originIndex ||
+        (uint64_t)(index - state->originIndex) >= state->records ||
+        _fseeki64(state->file, (int64_t)sizeof(PyramidFileHeader) +
+                  (index - state->originIndex) * (int64_t)writer->recordBytes, SEEK_SET) != 0 ||
+        fread(writer->record, writer->recordBytes, 1, state->file) != 1) {
+        return;
+    }
+    counts->scans = bin->scans;
+    counts->flags = bin->flags;
+    for (tube = 0; tube < writer->tubeCount; tube++) {
+        counts->moves[tube] = tubes[tube].moves;
+        counts->feedingScans[tube] = tubes[tube].feedingScans;
+        for (position = 0; position < PYRAMID_POSITIONS; position++) {
+            counts->occupancy[tube][position] = (pyramidOccupancy(&tubes[tube], position) * bin->scans + 7) / 15;
+        }
+    }
+}
+
+static void setBin(PyramidLevel* state, int64_t index) {
+    state->index = index;
+    state->startUs = index * state->binUs;
+    state->endUs = state->startUs + state->binUs;
+}
+
+// First scan since open: the bins it falls in may have records from before a restart.
+// Those include the level below, so each level keeps only what the level below lacks.
+// Occupancy only comes back in 15ths, so a bin across a restart may be off by a rounding.
+static void resumeBins(PyramidWriter* writer, int64_t timeUs) {
+    PyramidCounts below, saved;
+    uint32_t tube, position;
+    int level;
+
+    memset(&below, 0, sizeof(below));
+    for (level = 0; level < PYRAMID_LEVELS; level++) {
+        PyramidLevel* state = &writer->levels[level];
+        PyramidCounts* counts = &state->counts;
+
+        setBin(state, binIndex(timeUs, state->binUs));
+        readRecord(writer, level, state->index, counts);
+        saved = *counts;
+        counts->scans -= counts->scans > below.scans ? below.scans : counts->scans;
+        for (tube = 0; tube < writer->tubeCount; tube++) {
+            counts->moves[tube] -= counts->moves[tube] > below.moves[tube] ? below.moves[tube] : counts->moves[tube];
+            counts->feedingScans[tube] -= counts->feedingScans[tube] > below.feedingScans[tube]
+                                              ? below.feedingScans[tube] : counts->feedingScans[tube];
+            for (position = 0; position < PYRAMID_POSITIONS; position++) {
+                uint32_t* count = &counts->occupancy[tube][position];
+                *count -= *count > below.occupancy[tube][position] ? below.occupancy[tube][position] : *count;
+            }
+        }
+        below = saved;
+    }
+}
+
+// Closes every bin timeUs is past, from the 1 s level up
+static void advanceBins(PyramidWriter* writer, int64_t timeUs) {
+    int level;
+
+    for (level = 0; level < PYRAMID_LEVELS; level++) {
+        PyramidLevel* state = &writer->levels[level];
+        int64_t index = binIndex(timeUs, state->binUs);
+
+        if (index == state->index) {
+            break;
+        }
+        writeRecord(writer, level, state->index, &state->counts);
+        if (level + 1 < PYRAMID_LEVELS) {
+            addCounts(&writer->levels[level + 1].counts, &state->counts, writer->tubeCount);
+        }
+        memset(&state->counts, 0, sizeof(state->counts));
+        setBin(state, index);
+    }
+}
+
+void pyramidAddScans(PyramidWriter* writer, const int64_t times[], const uint8_t states[], int scanCount,
+                     bool afterGap) {
+    PyramidLevel* first = &writer->levels[0];
+    uint32_t tubeCount = writer->tubeCount;
+    const uint8_t* previous = writer->previous;
+    uint32_t tube;
+    int i;
+
+    for (i = 0; i < scanCount; i++) {
+        const uint8_t* row = states + (size_t)i * tubeCount;
+        PyramidCounts* counts = &first->counts;
+
+        if (!writer->started) {
+            resumeBins(writer, times[i]);
+            writer->started = true;
+        } else if (times[i] < first->startUs || times[i] >= first->endUs) {
+            advanceBins(writer, times[i]);
+        }
+        if (!writer->havePrevious) {
+            previous = row; // Nothing to compare the first scan with
+            writer->havePrevious = true;
+        }
+        if (i == 0 && afterGap) {
+            counts->flags |= PYRAMID_BIN_AFTER_GAP;
+            previous = row; // A change across a gap is not a move anyone saw
+        }
+
+        counts->scans++;
+        for (tube = 0; tube < tubeCount; tube++) {
+            counts->moves[tube] += (row[tube] & PACKED_DATA_MASK) != (previous[tube] & PACKED_DATA_MASK);
+            counts->feedingScans[tube] += row[tube] >> 4;
+            counts->occupancy[tube][row[tube] & PACKED_DATA_MASK]++;
+        }
+        previous = row;
+    }
+    if (scanCount > 0) {
+        memcpy(writer->previous, previous, tubeCount);
+    }
+}
+
+int pyramidSync(PyramidWriter* writer) {
+    PyramidCounts total;
+    int error = writer->failed ? -1 : 0;
+    int level;
+
+    // A bin in progress is written with the levels below it, the way it will end up
+    memset(&total, 0, sizeof(total));
+    for (level = 0; level < PYRAMID_LEVELS && writer->started; level++) {
+        addCounts(&total, &writer->levels[level].counts, writer->tubeCount);
+        writeRecord(writer, level, writer->levels[level].index, &total);
+    }
+    for (level = 0; level < PYRAMID_LEVELS; level++) {
+        FILE* file = writer->levels[level].file;
+
+        if (file != NULL && (fflush(file) != 0 || !FlushFileBuffers((HANDLE)_get_osfhandle(_fileno(file))))) {
+            error = -1;
+        }
+    }
+    return writer->failed ? -1 : error;
+}
+
+int pyramidClose(PyramidWriter* writer) {
+    int error = pyramidSync(writer);
+    int level;
+
+    for (level = 0; level < PYRAMID_LEVELS; level++) {
+        if (writer->levels[level].file != NULL && fclose(writer->levels[level].file) != 0) {
+            error = -1;
+        }
+        writer->levels[level].file = NULL;
+    }
+    return error;
+}
+
+static void closeView(PyramidLevelView* view) {
+    if (view->base != NULL) {
+        UnmapViewOfFile(view->base);
+    }
+    if (view->mapping != NULL) {
+        CloseHandle(view->mapping);
+    }
+    if (view->file != NULL) {
+        CloseHandle(view->file);
+    }
+    memset(view, 0, sizeof(*view));
+}
+
+// Maps one level file, returns 0 if it exists and has a valid header
+static int openView(PyramidLevelView* view, const char* path, int level) {
+    LARGE_INTEGER fileSize;
+    char levelPath[MAX_PATH];
+
+    memset(view, 0, sizeof(*view));
+    pyramidLevelPath(path, level, levelPath, sizeof(levelPath));
+
+    // The recorder may still be writing it
+    view->file = CreateFileA(levelPath, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING,
+                             FILE_ATTRIBUTE_NORMAL, NULL);
+    if (view->file == INVALID_HANDLE_VALUE) {
+        view->file = NULL;
+        return -1;
+    }
+    if (!GetFileSizeEx(view->file, &fileSize) || (uint64_t)fileSize.QuadPart < sizeof(PyramidFileHeader)) {
+        goto Error;
+    }
+    view->mapping = CreateFileMappingA(view->file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (view->mapping == NULL) {
+        goto Error;
+    }
+    view->base = MapViewOfFile(view->mapping, FILE_MAP_READ, 0, 0, 0);
+    if (view->base == NULL) {
+        goto Error;
+    }
+
+    view->header = (const PyramidFileHeader*)view->base;
+    if (memcmp(view->header->magic, PYRAMID_MAGIC, sizeof(PYRAMID_MAGIC)) != 0 ||
+        view->header->version != PYRAMID_VERSION || view->header->binUs != levelBinUs[level] ||
+        view->header->tubeCount == 0 || view->header->tubeCount > SCAN_MAX_TUBES ||
+        view->header->recordBytes != sizeof(PyramidBinHeader) + view->header->tubeCount * sizeof(PyramidTubeBin)) {
+        goto Error;
+    }
+    view->records = ((uint64_t)fileSize.QuadPart - sizeof(PyramidFileHeader)) / view->header->recordBytes;
+    return 0;
+
+Error:
+    closeView(view);
+    return -1;
+}
+
+int pyramidReaderOpen(PyramidReader* reader, const char* path) {
+    int level;
+
+    memset(reader, 0, sizeof(*reader));
+    for (level = 0; level < PYRAMID_LEVELS; level++) {
+        PyramidLevelView* view = &reader->levels[level];
+
+        if (openView(view, path, level) != 0) {
+            continue;
+        }
+        if (reader->tubeCount != 0 && view->header->tubeCount != reader->tubeCount) {
+            closeView(view); // Left over from a configuration with other tubes
+            continue;
+        }
+        reader->tubeCount = view->header->tubeCount;
+    }
+    return reader->tubeCount != 0 ? 0 : -1;
+}
+
+void pyramidReaderClose(PyramidReader* reader) {
+    int level;
+
+    for (level = 0; level < PYRAMID_LEVELS; level++) {
+        closeView(&reader->levels[level]);
+    }
+}
+
+int pyramidChooseLevel(const PyramidReader* reader, int64_t startUs, int64_t endUs, uint32_t maxBins) {
+    int coarsest = -1;
+    int level;
+
+    for (level = 0; level < PYRAMID_LEVELS; level++) {
+        if (reader->levels[level].base == NULL) {
+            continue;
+        }
+        if (binIndex(endUs, levelBinUs[level]) - binIndex(startUs, levelBinUs[level]) < (int64_t)maxBins) {
+            return level;
+        }
+        coarsest = level;
+    }
+    return coarsest;
+}
+
+const PyramidBinHeader* pyramidBin(const PyramidReader* reader, int level, int64_t index) {
+    const PyramidLevelView* view = &reader->levels[level];
+    int64_t record;
+
+    if (view->base == NULL) {
+        return NULL;
+    }
+    record = index - view->header->originIndex;
+    if (record < 0 || (uint64_t)record >= view->records) {
+        return NULL;
+    }
+    return (const PyramidBinHeader*)(view->base + sizeof(PyramidFileHeader) +
+                                     (uint64_t)record * view->header->recordBytes);
+}
@@ -0,0 +1,133 @@
+#ifndef PYRAMID_H
+#define PYRAMID_H
+
+#include <stdio.h> // FILE
+#include <stdint.h> // Fixed-width integer types
+#include <stdbool.h> // Standard boolean library
+#include <windows.h> // File mapping
+#include "scan_kernel.h" // SCAN_MAX_TUBES
+
+// Constants
+#define PYRAMID_MAGIC "MADPYR"      // First 8 bytes of every pyramid file (with terminator)
+#define PYRAMID_VERSION 1           // Bumped whenever the on-disk layout changes
+#define PYRAMID_LEVELS 5            // 1 s, 10 s, 1 min, 10 min and 1 h bins
+#define PYRAMID_POSITIONS 16        // Positions 0 (no beam) to 15
+#define PYRAMID_BIN_AFTER_GAP 1u    // Acquisition was interrupted before a scan of this bin
+
+// File layout, one file per level next to the archive (monitor1.mad gives
+// monitor1.1s.pyr ... monitor1.1h.pyr): PyramidFileHeader, then one record per bin
+// from originIndex on. A record is a PyramidBinHeader and tubeCount PyramidTubeBins;
+// bin i of the level starts at i * binUs from the Unix epoch and its record sits at
+// a fixed offset, so any range of any level is one contiguous read. Bins without
+// scans are left as holes of zeros.
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t tubeCount;
+    int64_t binUs;
+    int64_t originIndex;  // Bin of the first record
+    uint32_t recordBytes;
+    uint32_t reserved;
+} PyramidFileHeader;
+
+typedef struct {
+    uint32_t scans;       // 0 = no data
+    uint32_t flags;       // PYRAMID_BIN_* bits
+} PyramidBinHeader;
+
+// One tube within one bin
+typedef struct {
+    uint32_t moves;       // Position changes
+    uint32_t feedingScans; // Scans with the eating flag set
+    uint8_t occupancy[8]; // Share of the scans at each position in 15ths, two positions a byte, low nibble first
+} PyramidTubeBin;
+
+// Exact sums of one bin while it is open
+typedef struct {
+    uint32_t scans;
+    uint32_t flags;
+    uint32_t moves[SCAN_MAX_TUBES];
+    uint32_t feedingScans[SCAN_MAX_TUBES];
+    uint32_t occupancy[SCAN_MAX_TUBES][PYRAMID_POSITIONS]; // Scans at each position
+} PyramidCounts;
+
+typedef struct {
+    FILE* file;
+    int64_t binUs;
+    int64_t originIndex;  // -1 until the header is written
+    uint64_t records;     // Records in the file, holes included
+    int64_t index;        // Bin being summed
+    int64_t startUs;      // Its time range, [startUs, endUs)
+    int64_t endUs;
+    PyramidCounts counts; // Scans of the bin, and the finished bins of the level below
+} PyramidLevel;
+
+// Writer of the pyramid of one archive. Every scan goes into the 1 s bin; a bin
+// that ends is written and added to the bin above, so each level costs one
+// record per bin whatever the scan rate. pyramidSync writes the bins in progress
+// as well, each including the levels below, so a restart picks them up again.
+typedef struct {
+    uint32_t tubeCount;
+    uint32_t recordBytes;
+    bool started;
+    bool failed;          // A write failed, the files are incomplete (madtool pyramid rebuilds them)
+    uint8_t previous[SCAN_MAX_TUBES]; // Last row added
+    bool havePrevious;    // Cleared at each archive segment, whose first scan is not a move either
+    uint64_t binsWritten;
+    PyramidLevel levels[PYRAMID_LEVELS];
+    uint8_t record[sizeof(PyramidBinHeader) + SCAN_MAX_TUBES * sizeof(PyramidTubeBin)];
+} PyramidWriter;
+
+// Read-only view of the pyramid files of an archive, each level memory mapped as
+// it was when opened; a missing level has no records
+typedef struct {
+    HANDLE file;
+    HANDLE mapping;
+    const uint8_t* base;
+    const PyramidFileHeader* header;
+    uint64_t records;
+} PyramidLevelView;
+
+typedef struct {
+    uint32_t tubeCount;
+    PyramidLevelView levels[PYRAMID_LEVELS];
+} PyramidReader;
+
+// Bin length of level in microseconds
+int64_t pyramidBinUs(int level);
+
+// Name of the file of level for the archive at path
+void pyramidLevelPath(const char* path, int level, char* out, size_t outBytes);
+
+// Opens or creates the files of every level. Files of another tube count or
+// version are started over. Returns 0 on success.
+int pyramidOpen(PyramidWriter* writer, const char* path, uint32_t tubeCount);
+
+// Adds scanCount scans, rows of tubeCount bytes in archive state format, in time order.
+// afterGap marks the first of them as the first scan after an interruption.
+void pyramidAddScans(PyramidWriter* writer, const int64_t times[], const uint8_t states[], int scanCount,
+                     bool afterGap);
+
+// Writes the bins in progress and flushes every file to disk, returns 0 on success
+int pyramidSync(PyramidWriter* writer);
+
+// Syncs and closes the files, returns 0 on success
+int pyramidClose(PyramidWriter* writer);
+
+// Maps every level of the archive at path that exists, returns 0 if at least one does
+int pyramidReaderOpen(PyramidReader* reader, const char* path);
+
+void pyramidReaderClose(PyramidReader* reader);
+
+// Finest level with at most maxBins bins between startUs and endUs, or the coarsest
+int pyramidChooseLevel(const PyramidReader* reader, int64_t startUs, int64_t endUs, uint32_t maxBins);
+
+// Record of bin index of level, NULL if the file does not reach it; its tubes follow the header
+const PyramidBinHeader* pyramidBin(const PyramidReader* reader, int level, int64_t index);
+
+// Share of the scans of a bin that tube spent at position, in 15ths
+static inline uint32_t pyramidOccupancy(const PyramidTubeBin* tube, uint32_t position) {
+    return (tube->occupancy[position >> 1] >> ((position & 1) * 4)) & 15;
+}
+
+#endif
@@ -0,0 +1,43 @@
+#include "rcu.h"
+#include <string.h> // memset
+#include <windows.h> // Sleep
+
+void rcuInit(RcuDomain* domain, void* initial) {
+    memset(domain, 0, sizeof(*domain));
+    domain->current = initial;
+    domain->generation = 1;
+}
+
+int rcuRegisterReader(RcuDomain* domain) {
+    int reader = domain->readerCount;
+
+    if (reader == RCU_MAX_READERS) {
+        return -1;
+    }
+    // Offline until its first rcuRead, it holds nothing yet
+    domain->readerSeen[reader] = RCU_OFFLINE;
+    domain->readerCount++;
+    return reader;
+}
+
+void* rcuPublish(RcuDomain* domain, void* next) {
+    void* previous = domain->current;
+
+    // current before generation: a reader that sees the new generation sees next
+    __atomic_store_n(&domain->current, next, __ATOMIC_RELEASE);
+    __atomic_store_n(&domain->generation, domain->generation + 1, __ATOMIC_RELEASE);
+    return previous;
+}
+
+void rcuSynchronize(RcuDomain* domain) {
+    uint64_t target = __atomic_load_n(&domain->generation, __ATOMIC_ACQUIRE);
+    int reader;
+
+    // Orders the publish before the loads of readerSeen, see rcuRead
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    for (reader = 0; reader < domain->readerCount; reader++) {
+        while (__atomic_load_n(&domain->readerSeen[reader], __ATOMIC_ACQUIRE) < target) {
+            Sleep(RCU_POLL_MS);
+        }
+    }
+}
@@ -0,0 +1,52 @@
+#ifndef RCU_H
+#define RCU_H
+
+#include <stdint.h> // Fixed-width integer types
+
+// Constants
+#define RCU_MAX_READERS 256         // Threads that may read an RcuDomain
+#define RCU_OFFLINE UINT64_MAX      // Reader slot value while the thread holds no pointer
+#define RCU_POLL_MS 1               // Sleep between grace-period checks in rcuSynchronize
+
+// One published pointer with quiescent-state based reclamation. Readers never
+// lock or wait: each calls rcuRead at a point where it holds no pointer from an
+// earlier call (for an I/O thread, between scans) and may use the result until
+// its next rcuRead. The single writer swaps in a new object with rcuPublish and
+// frees the old one after rcuSynchronize, once every reader has moved past it.
+typedef struct {
+    void* current;
+    uint64_t generation;                    // Bumped by every rcuPublish
+    uint64_t readerSeen[RCU_MAX_READERS];   // Generation each reader last read, or RCU_OFFLINE
+    int readerCount;
+} RcuDomain;
+
+// Publishes initial with no readers registered
+void rcuInit(RcuDomain* domain, void* initial);
+
+// Claims a reader slot, call before the reader thread starts. Returns the slot or -1 if full.
+int rcuRegisterReader(RcuDomain* domain);
+
+// Quiescent point plus read: the reader drops whatever it read before and gets the current object
+static inline void* rcuRead(RcuDomain* domain, int reader) {
+    uint64_t generation = __atomic_load_n(&domain->generation, __ATOMIC_ACQUIRE);
+
+    // Announce before loading, pairs with the fence in rcuSynchronize: either the
+    // writer sees this generation and waits, or this load sees the new pointer
+    __atomic_store_n(&domain->readerSeen[reader], generation, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    return __atomic_load_n(&domain->current, __ATOMIC_ACQUIRE);
+}
+
+// The reader holds nothing until its next rcuRead, so it never delays reclamation (thread exit, long waits)
+static inline void rcuReaderOffline(RcuDomain* domain, int reader) {
+    __atomic_store_n(&domain->readerSeen[reader], RCU_OFFLINE, __ATOMIC_RELEASE);
+}
+
+// Makes next the current object and returns the previous one, which stays valid
+// for readers until rcuSynchronize returns. Single writer only.
+void* rcuPublish(RcuDomain* domain, void* next);
+
+// Waits until every reader has called rcuRead (or gone offline) since the last rcuPublish
+void rcuSynchronize(RcuDomain* domain);
+
+#endif
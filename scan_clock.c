@@ -0,0 +1,218 @@
+#include "scan_clock.h"
+#include <string.h> // memset
+#include <process.h> // _beginthreadex
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h> // __get_cpuid
+#endif
+
+// utc = baseUtcUs + (ticks - baseTicks) * usPerTick
+typedef struct {
+    uint64_t baseTicks;
+    int64_t baseUtcUs;
+    double usPerTick;
+} ClockMapping;
+
+bool scanClockUseTsc = false;
+
+// Mapping readers see, odd sequence while the calibration thread rewrites it
+static volatile uint32_t mappingSequence;
+static ClockMapping mapping;
+
+// Start of the long baseline used to estimate the tick rate
+static uint64_t firstTicks;
+static int64_t firstUtcUs;
+
+static ScanClockStats stats;
+static CRITICAL_SECTION clockMutex;
+static bool mutexReady;        // clockMutex lives from scanClockStart to scanClockStop
+static CONDITION_VARIABLE stopCond;
+static HANDLE calibrationThread;
+static bool running;
+
+static int64_t systemUtcUs(void) {
+    FILETIME fileTime;
+    ULARGE_INTEGER ticks;
+
+    GetSystemTimePreciseAsFileTime(&fileTime);
+    ticks.LowPart = fileTime.dwLowDateTime;
+    ticks.HighPart = fileTime.dwHighDateTime;
+    return (int64_t)(ticks.QuadPart / 10) - 11644473600000000LL; // FILETIME is 100ns since 1601
+}
+
+// Reads ticks and the system clock together, keeping the tightest of a few tries
+static void samplePair(uint64_t* ticks, int64_t* utcUs) {
+    uint64_t best = UINT64_MAX;
+    int i;
+
+    for (i = 0; i < 5; i++) {
+        uint64_t before = scanClockTicks();
+        int64_t utc = systemUtcUs();
+        uint64_t after = scanClockTicks();
+
+        if (after - before < best) {
+            best = after - before;
+            *ticks = before + (after - before) / 2;
+            *utcUs = utc;
+        }
+    }
+}
+
+static bool invariantTsc(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    unsigned int eax, ebx, ecx, edx;
+
+    if (__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx)) {
+        return (edx & (1u << 8)) != 0;
+    }
+#endif
+    return false;
+}
+
+static void publishMapping(uint64_t baseTicks, int64_t baseUtcUs, double usPerTick) {
+    __atomic_store_n(&mappingSequence, mappingSequence + 1, __ATOMIC_RELEASE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    mapping.baseTicks = baseTicks;
+    mapping.baseUtcUs = baseUtcUs;
+    mapping.usPerTick = usPerTick;
+    __atomic_store_n(&mappingSequence, mappingSequence + 1, __ATOMIC_RELEASE);
+}
+
+int64_t scanClockToUtcUs(uint64_t ticks) {
+    ClockMapping current;
+    uint32_t sequence;
+
+    // Plain loads on x86, the loop only repeats during a calibration
+    do {
+        sequence = __atomic_load_n(&mappingSequence, __ATOMIC_ACQUIRE);
+        current = mapping;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while ((sequence & 1) || sequence != __atomic_load_n(&mappingSequence, __ATOMIC_RELAXED));
+
+    return current.baseUtcUs + (int64_t)((double)(int64_t)(ticks - current.baseTicks) * current.usPerTick);
+}
+
+// Compares the mapping with the system clock and slews it so the offset is gone by the next calibration
+static void calibrate(void) {
+    uint64_t ticks;
+    int64_t utcUs;
+    int64_t mappedUs;
+    int64_t offsetUs;
+
+    samplePair(&ticks, &utcUs);
+    mappedUs = scanClockToUtcUs(ticks);
+    offsetUs = utcUs - mappedUs;
+
+    EnterCriticalSection(&clockMutex);
+    if (offsetUs > SCAN_CLOCK_STEP_US || offsetUs < -SCAN_CLOCK_STEP_US) {
+        // The system clock was set, start over from it
+        publishMapping(ticks, utcUs, mapping.usPerTick);
+        firstTicks = ticks;
+        firstUtcUs = utcUs;
+        stats.steps++;
+    } else {
+        double usPerTick = (double)(utcUs - firstUtcUs) / (double)(ticks - firstTicks);
+        double intervalTicks = SCAN_CLOCK_CALIBRATE_MS * 1000.0 / usPerTick;
+
+        publishMapping(ticks, mappedUs, usPerTick + offsetUs / intervalTicks);
+        stats.ticksPerSecond = 1e6 / usPerTick;
+        if (offsetUs > stats.maxOffsetUs || -offsetUs > stats.maxOffsetUs) {
+            stats.maxOffsetUs = offsetUs < 0 ? -offsetUs : offsetUs;
+        }
+    }
+    stats.lastOffsetUs = offsetUs;
+    stats.calibrations++;
+    LeaveCriticalSection(&clockMutex);
+}
+
+// Calibration thread function - compares with the system clock until stopped
+static unsigned int __stdcall calibrationThreadFn(void* arg) {
+    EnterCriticalSection(&clockMutex);
+    while (running) {
+        SleepConditionVariableCS(&stopCond, &clockMutex, SCAN_CLOCK_CALIBRATE_MS);
+        if (!running) {
+            break;
+        }
+        LeaveCriticalSection(&clockMutex);
+        calibrate();
+        EnterCriticalSection(&clockMutex);
+    }
+    LeaveCriticalSection(&clockMutex);
+
+    return 0;
+}
+
+int scanClockStart(void) {
+    LARGE_INTEGER frequency;
+    double ticksPerSecond;
+
+    QueryPerformanceFrequency(&frequency);
+    scanClockUseTsc = invariantTsc();
+
+    if (scanClockUseTsc) {
+        // TSC rate against the performance counter over a short interval, refined by calibration
+        LARGE_INTEGER qpcStart, qpcEnd;
+        uint64_t tscStart, tscEnd;
+
+        QueryPerformanceCounter(&qpcStart);
+        tscStart = scanClockTicks();
+        Sleep(50);
+        QueryPerformanceCounter(&qpcEnd);
+        tscEnd = scanClockTicks();
+        ticksPerSecond = (double)(tscEnd - tscStart) * (double)frequency.QuadPart /
+                         (double)(qpcEnd.QuadPart - qpcStart.QuadPart);
+    } else {
+        ticksPerSecond = (double)frequency.QuadPart;
+    }
+
+    memset(&stats, 0, sizeof(stats));
+    stats.source = scanClockUseTsc ? "tsc" : "qpc";
+    stats.ticksPerSecond = ticksPerSecond;
+    samplePair(&firstTicks, &firstUtcUs);
+    publishMapping(firstTicks, firstUtcUs, 1e6 / ticksPerSecond);
+
+    InitializeCriticalSection(&clockMutex);
+    InitializeConditionVariable(&stopCond);
+    running = true;
+    calibrationThread = (HANDLE)_beginthreadex(NULL, 0, calibrationThreadFn, NULL, 0, NULL);
+    mutexReady = true;
+    if (calibrationThread == 0) {
+        // The stats stay readable, scanClockStop deletes the section
+        calibrationThread = NULL;
+        running = false;
+        return -1;
+    }
+
+    return 0;
+}
+
+void scanClockStop(void) {
+    if (!mutexReady) {
+        return;
+    }
+
+    if (calibrationThread != NULL) {
+        EnterCriticalSection(&clockMutex);
+        running = false;
+        WakeConditionVariable(&stopCond);
+        LeaveCriticalSection(&clockMutex);
+        WaitForSingleObject(calibrationThread, INFINITE);
+        CloseHandle(calibrationThread);
+        calibrationThread = NULL;
+    }
+    mutexReady = false;
+    DeleteCriticalSection(&clockMutex);
+}
+
+ScanClockStats scanClockGetStats(void) {
+    ScanClockStats copy;
+
+    // Before scanClockStart or after scanClockStop nothing else writes the stats
+    if (!mutexReady) {
+        return stats;
+    }
+    EnterCriticalSection(&clockMutex);
+    copy = stats;
+    LeaveCriticalSection(&clockMutex);
+    return copy;
+}
@@ -0,0 +1,54 @@
+#ifndef SCAN_CLOCK_H
+#define SCAN_CLOCK_H
+
+#include <stdint.h> // Fixed-width integer types
+#include <stdbool.h> // Standard boolean library
+#include <windows.h> // QueryPerformanceCounter
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h> // __rdtsc
+#endif
+
+// Constants
+#define SCAN_CLOCK_CALIBRATE_MS 10000 // Interval between comparisons with the system clock
+#define SCAN_CLOCK_STEP_US 500000     // Larger offsets are stepped instead of slewed
+
+typedef struct {
+    const char* source;       // "tsc" or "qpc"
+    double ticksPerSecond;    // Current estimate of the tick rate against UTC
+    int64_t lastOffsetUs;     // System clock minus our mapping at the last calibration
+    int64_t maxOffsetUs;      // Largest |lastOffsetUs| seen after the first calibration
+    uint64_t calibrations;
+    uint64_t steps;           // Calibrations where the offset was too large to slew
+} ScanClockStats;
+
+// Raw monotonic ticks. The invariant TSC costs a few nanoseconds to read;
+// QueryPerformanceCounter is used where the TSC is not invariant.
+extern bool scanClockUseTsc;
+
+static inline uint64_t scanClockTicks(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    if (scanClockUseTsc) {
+        return __rdtsc();
+    }
+#endif
+    {
+        LARGE_INTEGER counter;
+        QueryPerformanceCounter(&counter);
+        return (uint64_t)counter.QuadPart;
+    }
+}
+
+// Measures the tick rate and starts the calibration thread, returns 0 on success.
+// On failure the clock runs uncalibrated and the stats stay readable until scanClockStop.
+int scanClockStart(void);
+
+void scanClockStop(void);
+
+// UTC microseconds since the Unix epoch for a tick value. The mapping is
+// slewed rather than stepped at calibration, so it never runs backwards.
+int64_t scanClockToUtcUs(uint64_t ticks);
+
+ScanClockStats scanClockGetStats(void);
+
+#endif
@@ -0,0 +1,272 @@
+#include "scan_kernel.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SCAN_KERNEL_X86
+#include <immintrin.h> // SSE2/AVX2 intrinsics
+#endif
+
+// Decode function selected at runtime by initScanKernel
+typedef ScanDelta (*DecodeFn)(ScanState* state, const uint8_t packed[], int tubeCount);
+
+// Vote function selected with it, returns the number of unstable tubes
+typedef int (*VoteFn)(const uint8_t samples[], int sampleCount, int tubeCount, bool rejectUnstable,
+                      uint8_t packed[]);
+
+static ScanDelta decodeScalar(ScanState* state, const uint8_t packed[], int tubeCount);
+static int voteScalar(const uint8_t samples[], int sampleCount, int tubeCount, bool rejectUnstable,
+                      uint8_t packed[]);
+static DecodeFn decodeImpl = decodeScalar;
+static VoteFn voteImpl = voteScalar;
+static const char* decodeName = "scalar";
+
+uint8_t packPortLines(const unsigned char lines[]) {
+    return (uint8_t)((lines[0] & 1) | ((lines[1] & 1) << 1) | ((lines[2] & 1) << 2) |
+                     ((lines[3] & 1) << 3) | ((lines[4] & 1) << 4));
+}
+
+// Same rules processData() applied per tube:
+// DV low  -> position = data lines, eating cleared
+// DV high -> eating set if data lines are 0 and the fly was at position 1, else unchanged
+static ScanDelta decodeRange(ScanState* state, const uint8_t packed[], int first, int last) {
+    ScanDelta delta = {0, 0};
+    int i;
+
+    for (i = first; i < last; i++) {
+        uint8_t oldPosition = state->position[i];
+        uint8_t oldEating = state->eating[i];
+        uint8_t data = packed[i] & PACKED_DATA_MASK;
+
+        if ((packed[i] & PACKED_DV_BIT) == 0) {
+            state->position[i] = data;
+            state->eating[i] = 0;
+        } else if (data == 0 && oldPosition == 1) {
+            state->eating[i] = 1;
+        }
+
+        delta.moved |= (uint64_t)(state->position[i] != oldPosition) << i;
+        delta.eatingChanged |= (uint64_t)(state->eating[i] != oldEating) << i;
+    }
+
+    return delta;
+}
+
+static ScanDelta decodeScalar(ScanState* state, const uint8_t packed[], int tubeCount) {
+    return decodeRange(state, packed, 0, tubeCount);
+}
+
+// Bit-sliced vote: every bit of a sample byte gets its own 3-bit counter (c0, c1, c2) of how
+// many samples had it set, so a few AND/XOR ops vote all five lines at once and the same code
+// works on a vector of tubes. A line is set when its count reaches (sampleCount + 1) / 2.
+static int voteRange(const uint8_t samples[], int sampleCount, int tubeCount, bool rejectUnstable,
+                     uint8_t packed[], int first) {
+    int unstableTubes = 0;
+    int i;
+    int s;
+
+    for (i = first; i < tubeCount; i++) {
+        unsigned c0 = 0, c1 = 0, c2 = 0;
+        unsigned all = PACKED_HOLD, any = 0;
+        unsigned majority;
+        unsigned unstable;
+
+        for (s = 0; s < sampleCount; s++) {
+            unsigned x = samples[s * tubeCount + i];
+            unsigned carry0 = c0 & x;
+
+            c0 ^= x;
+            c2 |= c1 & carry0;
+            c1 ^= carry0;
+            all &= x;
+            any |= x;
+        }
+        majority = sampleCount == 1 ? c0 : sampleCount == 3 ? c1 | c2 :
+                   sampleCount == 5 ? c2 | (c1 & c0) : c2;
+        unstable = (any & ~all) & PACKED_HOLD;
+
+        packed[i] = (uint8_t)(rejectUnstable && unstable ? PACKED_HOLD : majority & PACKED_HOLD);
+        unstableTubes += unstable != 0;
+    }
+
+    return unstableTubes;
+}
+
+static int voteScalar(const uint8_t samples[], int sampleCount, int tubeCount, bool rejectUnstable,
+                      uint8_t packed[]) {
+    return voteRange(samples, sampleCount, tubeCount, rejectUnstable, packed, 0);
+}
+
+#ifdef SCAN_KERNEL_X86
+
+// 16 tubes per iteration, the tail goes through voteRange
+static int voteSse2(const uint8_t samples[], int sampleCount, int tubeCount, bool rejectUnstable,
+                    uint8_t packed[]) {
+    const __m128i lineMask = _mm_set1_epi8(PACKED_HOLD);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i reject = rejectUnstable ? _mm_set1_epi8(-1) : zero;
+    int unstableTubes = 0;
+    int i;
+    int s;
+
+    for (i = 0; i + 16 <= tubeCount; i += 16) {
+        __m128i c0 = zero, c1 = zero, c2 = zero;
+        __m128i all = lineMask, any = zero;
+        __m128i majority;
+        __m128i stable;
+        __m128i hold;
+
+        for (s = 0; s < sampleCount; s++) {
+            __m128i x = _mm_loadu_si128((const __m128i*)(samples + s * tubeCount + i));
+            __m128i carry0 = _mm_and_si128(c0, x);
+
+            c0 = _mm_xor_si128(c0, x);
+            c2 = _mm_or_si128(c2, _mm_and_si128(c1, carry0));
+            c1 = _mm_xor_si128(c1, carry0);
+            all = _mm_and_si128(all, x);
+            any = _mm_or_si128(any, x);
+        }
+        majority = sampleCount == 1 ? c0 : sampleCount == 3 ? _mm_or_si128(c1, c2) :
+                   sampleCount == 5 ? _mm_or_si128(c2, _mm_and_si128(c1, c0)) : c2;
+
+        // 0xFF where every sample of the tube agreed on all five lines
+        stable = _mm_cmpeq_epi8(_mm_and_si128(_mm_andnot_si128(all, any), lineMask), zero);
+        hold = _mm_andnot_si128(stable, reject);
+
+        _mm_storeu_si128((__m128i*)(packed + i),
+                         _mm_and_si128(_mm_or_si128(hold, majority), lineMask));
+        unstableTubes += __builtin_popcount(~_mm_movemask_epi8(stable) & 0xFFFF);
+    }
+
+    return unstableTubes + voteRange(samples, sampleCount, tubeCount, rejectUnstable, packed, i);
+}
+
+// 16 tubes per iteration from first on, branch-free version of decodeRange
+static ScanDelta decodeSse2Range(ScanState* state, const uint8_t packed[], int first, int last) {
+    const __m128i dvBit = _mm_set1_epi8(PACKED_DV_BIT);
+    const __m128i dataMask = _mm_set1_epi8(PACKED_DATA_MASK);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi8(1);
+    ScanDelta delta = {0, 0};
+    int i;
+
+    for (i = first; i + 16 <= last; i += 16) {
+        __m128i in = _mm_loadu_si128((const __m128i*)(packed + i));
+        __m128i pos = _mm_loadu_si128((const __m128i*)(state->position + i));
+        __m128i eat = _mm_loadu_si128((const __m128i*)(state->eating + i));
+
+        __m128i dvHigh = _mm_cmpeq_epi8(_mm_and_si128(in, dvBit), dvBit);
+        __m128i data = _mm_and_si128(in, dataMask);
+        __m128i startEat = _mm_and_si128(_mm_cmpeq_epi8(data, zero), _mm_cmpeq_epi8(pos, one));
+        __m128i keepEat = _mm_cmpeq_epi8(eat, one);
+
+        __m128i newPos = _mm_or_si128(_mm_and_si128(dvHigh, pos), _mm_andnot_si128(dvHigh, data));
+        __m128i newEat = _mm_and_si128(_mm_and_si128(dvHigh, _mm_or_si128(startEat, keepEat)), one);
+
+        _mm_storeu_si128((__m128i*)(state->position + i), newPos);
+        _mm_storeu_si128((__m128i*)(state->eating + i), newEat);
+
+        delta.moved |= (uint64_t)(~_mm_movemask_epi8(_mm_cmpeq_epi8(newPos, pos)) & 0xFFFF) << i;
+        delta.eatingChanged |= (uint64_t)(~_mm_movemask_epi8(_mm_cmpeq_epi8(newEat, eat)) & 0xFFFF) << i;
+    }
+
+    if (i < last) {
+        ScanDelta tail = decodeRange(state, packed, i, last);
+        delta.moved |= tail.moved;
+        delta.eatingChanged |= tail.eatingChanged;
+    }
+
+    return delta;
+}
+
+static ScanDelta decodeSse2(ScanState* state, const uint8_t packed[], int tubeCount) {
+    return decodeSse2Range(state, packed, 0, tubeCount);
+}
+
+// 32 tubes per iteration, compiled for AVX2 only in this function
+__attribute__((target("avx2")))
+static ScanDelta decodeAvx2(ScanState* state, const uint8_t packed[], int tubeCount) {
+    const __m256i dvBit = _mm256_set1_epi8(PACKED_DV_BIT);
+    const __m256i dataMask = _mm256_set1_epi8(PACKED_DATA_MASK);
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i one = _mm256_set1_epi8(1);
+    ScanDelta delta = {0, 0};
+    int i;
+
+    for (i = 0; i + 32 <= tubeCount; i += 32) {
+        __m256i in = _mm256_loadu_si256((const __m256i*)(packed + i));
+        __m256i pos = _mm256_loadu_si256((const __m256i*)(state->position + i));
+        __m256i eat = _mm256_loadu_si256((const __m256i*)(state->eating + i));
+
+        __m256i dvHigh = _mm256_cmpeq_epi8(_mm256_and_si256(in, dvBit), dvBit);
+        __m256i data = _mm256_and_si256(in, dataMask);
+        __m256i startEat = _mm256_and_si256(_mm256_cmpeq_epi8(data, zero), _mm256_cmpeq_epi8(pos, one));
+        __m256i keepEat = _mm256_cmpeq_epi8(eat, one);
+
+        __m256i newPos = _mm256_blendv_epi8(data, pos, dvHigh);
+        __m256i newEat = _mm256_and_si256(_mm256_and_si256(dvHigh, _mm256_or_si256(startEat, keepEat)), one);
+
+        _mm256_storeu_si256((__m256i*)(state->position + i), newPos);
+        _mm256_storeu_si256((__m256i*)(state->eating + i), newEat);
+
+        delta.moved |= (uint64_t)(uint32_t)~_mm256_movemask_epi8(_mm256_cmpeq_epi8(newPos, pos)) << i;
+        delta.eatingChanged |= (uint64_t)(uint32_t)~_mm256_movemask_epi8(_mm256_cmpeq_epi8(newEat, eat)) << i;
+    }
+
+    if (i < tubeCount) {
+        ScanDelta tail = decodeSse2Range(state, packed, i, tubeCount);
+        delta.moved |= tail.moved;
+        delta.eatingChanged |= tail.eatingChanged;
+    }
+
+    return delta;
+}
+
+#endif
+
+void initScanKernel(void) {
+#ifdef SCAN_KERNEL_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2")) {
+        // Votes are only a few dozen bytes per scan, 16 lanes are plenty
+        voteImpl = voteSse2;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        decodeImpl = decodeAvx2;
+        decodeName = "avx2";
+        return;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        decodeImpl = decodeSse2;
+        decodeName = "sse2";
+        return;
+    }
+#endif
+    decodeImpl = decodeScalar;
+    decodeName = "scalar";
+}
+
+const char* scanKernelName(void) {
+    return decodeName;
+}
+
+ScanDelta decodeScan(ScanState* state, const uint8_t packed[], int tubeCount) {
+    if (tubeCount > SCAN_MAX_TUBES) {
+        tubeCount = SCAN_MAX_TUBES;
+    }
+    return decodeImpl(state, packed, tubeCount);
+}
+
+void voteSamples(const uint8_t samples[], int sampleCount, int tubeCount, bool rejectUnstable,
+                 uint8_t packed[], ScanVoteStats* stats) {
+    int unstableTubes;
+
+    if (tubeCount > SCAN_MAX_TUBES) {
+        tubeCount = SCAN_MAX_TUBES;
+    }
+    unstableTubes = voteImpl(samples, sampleCount, tubeCount, rejectUnstable, packed);
+
+    stats->tubeReads += (uint64_t)tubeCount;
+    stats->unstable += (uint64_t)unstableTubes;
+    if (rejectUnstable) {
+        stats->rejected += (uint64_t)unstableTubes;
+    }
+}
@@ -0,0 +1,51 @@
+#ifndef SCAN_KERNEL_H
+#define SCAN_KERNEL_H
+
+#include <stdint.h> // Fixed-width integer types
+#include <stdbool.h> // Standard boolean library
+
+// Constants
+#define SCAN_MAX_TUBES 64      // Most tubes decoded per call, one bit per tube in a ScanDelta mask
+#define PACKED_DATA_MASK 0x0F  // Bits 0-3 of a packed byte hold P0.0-P0.3 (position)
+#define PACKED_DV_BIT 0x10     // Bit 4 of a packed byte holds P0.4 (data valid)
+#define PACKED_HOLD (PACKED_DV_BIT | PACKED_DATA_MASK) // Never sent by the monitor, decodes as "no change"
+#define SCAN_MAX_SAMPLES 7     // Most reads voted per tube, odd so there is always a majority
+
+// Decoder state for one monitor, one byte per tube so a scan fits in a few vector registers
+typedef struct {
+    uint8_t position[SCAN_MAX_TUBES]; // Last position read while DV was low
+    uint8_t eating[SCAN_MAX_TUBES];   // 1 while the fly is feeding at position 1, else 0
+} ScanState;
+
+// Tubes whose state changed in a scan, bit i is tube i
+typedef struct {
+    uint64_t moved;         // Position changed
+    uint64_t eatingChanged; // Eating flag set or cleared
+} ScanDelta;
+
+// Oversampling outcome, accumulated over every voteSamples call
+typedef struct {
+    uint64_t tubeReads;     // Voted tube reads (one per tube per scan)
+    uint64_t unstable;      // Reads whose samples did not all agree
+    uint64_t rejected;      // Unstable reads replaced by PACKED_HOLD
+} ScanVoteStats;
+
+// Picks the widest decode kernel the CPU supports, call once before decodeScan
+void initScanKernel(void);
+
+// Name of the kernel picked by initScanKernel ("avx2", "sse2" or "scalar")
+const char* scanKernelName(void);
+
+// Packs the five P0 line bytes of one DAQmxReadDigitalLines call into a single byte
+uint8_t packPortLines(const unsigned char lines[]);
+
+// Applies one scan of packed bytes (one per tube) to state and reports what changed
+ScanDelta decodeScan(ScanState* state, const uint8_t packed[], int tubeCount);
+
+// Majority-votes each of the five lines over sampleCount (odd, 1..SCAN_MAX_SAMPLES) reads.
+// samples holds sampleCount rows of tubeCount packed bytes, row s being the s-th read of every
+// tube. With rejectUnstable a tube whose samples disagree gets PACKED_HOLD so it keeps its state.
+void voteSamples(const uint8_t samples[], int sampleCount, int tubeCount, bool rejectUnstable,
+                 uint8_t packed[], ScanVoteStats* stats);
+
+#endif
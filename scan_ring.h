@@ -0,0 +1,58 @@
+#ifndef SCAN_RING_H
+#define SCAN_RING_H
+
+#include <stdint.h> // Fixed-width integer types
+#include <stdbool.h> // Standard boolean library
+#include "scan_kernel.h" // SCAN_MAX_TUBES
+#include "daq_supervisor.h" // DaqGap
+
+// Constants
+#define SCAN_RING_SCANS 256          // Scans buffered per monitor, a power of two
+
+// One scan as the I/O thread read it, decoded later by a worker
+typedef struct {
+    int64_t timeUs;                  // UTC time of the scan's first clock edge
+    DaqGap gap;                      // Set when result is DAQ_SCAN_RESUMED
+    int result;                      // DAQ_SCAN_OK or DAQ_SCAN_RESUMED
+    uint8_t packed[SCAN_MAX_TUBES];
+} RawScan;
+
+// Single-producer single-consumer ring. The producer only writes tail, the consumer
+// only writes head; they sit on separate cache lines.
+typedef struct {
+    volatile uint64_t head;          // Next scan to pop
+    uint8_t headPad[56];
+    volatile uint64_t tail;          // Next free slot
+    uint8_t tailPad[56];
+    RawScan scans[SCAN_RING_SCANS];
+} ScanRing;
+
+// Producer side, returns false without waiting if the ring is full
+static inline bool scanRingPush(ScanRing* ring, const RawScan* scan) {
+    uint64_t tail = ring->tail;
+
+    if (tail - __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == SCAN_RING_SCANS) {
+        return false;
+    }
+    ring->scans[tail & (SCAN_RING_SCANS - 1)] = *scan;
+    __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+// Consumer side, returns false if the ring is empty
+static inline bool scanRingPop(ScanRing* ring, RawScan* scan) {
+    uint64_t head = ring->head;
+
+    if (head == __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE)) {
+        return false;
+    }
+    *scan = ring->scans[head & (SCAN_RING_SCANS - 1)];
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+static inline bool scanRingEmpty(ScanRing* ring) {
+    return __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+}
+
+#endif
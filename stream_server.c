@@ -0,0 +1,388 @@
+#include "stream_server.h"
+#include <afunix.h> // AF_UNIX socket addresses
+#include <stdlib.h> // malloc, free
+#include <string.h> // memset, memcpy, strlen
+#include <process.h> // _beginthreadex
+
+// Unsent bytes of a client that fit before the ring wraps
+static uint32_t contiguousUsed(const StreamClient* client) {
+    uint32_t toEnd = STREAM_CLIENT_QUEUE_BYTES - client->head;
+    return client->used < toEnd ? client->used : toEnd;
+}
+
+static void queueBytes(StreamClient* client, const void* data, uint32_t size) {
+    uint32_t tail = (client->head + client->used) % STREAM_CLIENT_QUEUE_BYTES;
+    uint32_t first = STREAM_CLIENT_QUEUE_BYTES - tail;
+
+    if (first > size) {
+        first = size;
+    }
+    memcpy(client->queue + tail, data, first);
+    memcpy(client->queue, (const uint8_t*)data + first, size - first);
+    client->used += size;
+}
+
+static void dropClient(StreamServer* server, uint32_t slot) {
+    closesocket(server->clients[slot].socket);
+    free(server->clients[slot].queue);
+    server->clients[slot] = server->clients[--server->clientCount];
+}
+
+static void acceptClient(StreamServer* server) {
+    SOCKET socket = accept(server->listener, NULL, NULL);
+    StreamClient* client;
+    u_long nonBlocking = 1;
+
+    if (socket == INVALID_SOCKET) {
+        return;
+    }
+    if (server->clientCount == STREAM_MAX_CLIENTS) {
+        closesocket(socket);
+        return;
+    }
+    client = &server->clients[server->clientCount];
+    memset(client, 0, sizeof(*client));
+    client->queue = malloc(STREAM_CLIENT_QUEUE_BYTES);
+    if (client->queue == NULL || ioctlsocket(socket, FIONBIO, &nonBlocking) != 0) {
+        free(client->queue);
+        closesocket(socket);
+        return;
+    }
+    client->socket = socket;
+    client->subscriptions = (1u << STREAM_FRAME_SCANS) | (1u << STREAM_FRAME_BINS) | (1u << STREAM_FRAME_GAPS);
+    server->clientCount++;
+}
+
+// Reads subscription masks, returns -1 when the client has gone
+static int readClient(StreamClient* client) {
+    int received;
+
+    // A stream socket may split a mask across reads, it applies once all 4 bytes are in
+    while ((received = recv(client->socket, (char*)client->mask + client->maskBytes,
+                            (int)(sizeof(client->mask) - client->maskBytes), 0)) > 0) {
+        client->maskBytes += (uint32_t)received;
+        if (client->maskBytes == sizeof(client->mask)) {
+            memcpy(&client->subscriptions, client->mask, sizeof(client->mask));
+            client->maskBytes = 0;
+        }
+    }
+    if (received == 0) {
+        return -1;
+    }
+    if (received == SOCKET_ERROR && WSAGetLastError() != WSAEWOULDBLOCK) {
+        return -1;
+    }
+    return 0;
+}
+
+// Sends as much of the queue as the socket takes, returns -1 on a broken connection
+static int sendClient(StreamClient* client) {
+    while (client->used > 0) {
+        int sent = send(client->socket, (const char*)client->queue + client->head,
+                        (int)contiguousUsed(client), 0);
+        if (sent == SOCKET_ERROR) {
+            return WSAGetLastError() == WSAEWOULDBLOCK ? 0 : -1;
+        }
+        client->head = (client->head + (uint32_t)sent) % STREAM_CLIENT_QUEUE_BYTES;
+        client->used -= (uint32_t)sent;
+    }
+    client->head = 0; // Keep frames contiguous while the client keeps up
+    return 0;
+}
+
+// Frames whatever producers queued since the last pass and hands it to every subscriber
+static void distributeBatch(StreamServer* server) {
+    uint32_t bytes[STREAM_FRAME_TYPES];
+    uint32_t count[STREAM_FRAME_TYPES];
+    uint32_t type;
+    uint32_t slot;
+
+    EnterCriticalSection(&server->mutex);
+    for (type = 0; type < STREAM_FRAME_TYPES; type++) {
+        uint8_t* swap = server->pending[type];
+        server->pending[type] = server->batch[type];
+        server->batch[type] = swap;
+        bytes[type] = server->pendingBytes[type];
+        count[type] = server->pendingCount[type];
+        server->pendingBytes[type] = 0;
+        server->pendingCount[type] = 0;
+    }
+    LeaveCriticalSection(&server->mutex);
+
+    for (type = 0; type < STREAM_FRAME_TYPES; type++) {
+        StreamFrameHeader frame;
+
+        if (count[type] == 0) {
+            continue;
+        }
+        frame.magic = STREAM_FRAME_MAGIC;
+        frame.type = (uint16_t)(type + 1);
+        frame.count = (uint16_t)count[type];
+        frame.payloadBytes = bytes[type];
+
+        slot = 0;
+        while (slot < server->clientCount) {
+            StreamClient* client = &server->clients[slot];
+
+            if (!(client->subscriptions & (1u << frame.type))) {
+                slot++;
+                continue;
+            }
+            if (STREAM_CLIENT_QUEUE_BYTES - client->used < sizeof(frame) + bytes[type]) {
+                server->clientsDropped++;
+                dropClient(server, slot);
+                continue;
+            }
+            frame.sequence = client->sequence++;
+            queueBytes(client, &frame, sizeof(frame));
+            queueBytes(client, server->batch[type], bytes[type]);
+            server->framesSent++;
+            slot++;
+        }
+    }
+}
+
+// Server thread function - accepts clients and streams batches until stopped
+static unsigned int __stdcall streamServerThread(void* arg) {
+    StreamServer* server = (StreamServer*)arg;
+    WSAPOLLFD fds[STREAM_MAX_CLIENTS + 1];
+    uint32_t slot;
+
+    while (server->running) {
+        uint32_t polled = server->clientCount;
+
+        fds[0].fd = server->listener;
+        fds[0].events = POLLRDNORM;
+        fds[0].revents = 0;
+        for (slot = 0; slot < polled; slot++) {
+            fds[slot + 1].fd = server->clients[slot].socket;
+            fds[slot + 1].events = POLLRDNORM | (server->clients[slot].used ? POLLWRNORM : 0);
+            fds[slot + 1].revents = 0;
+        }
+        if (WSAPoll(fds, polled + 1, STREAM_BATCH_MS) == SOCKET_ERROR) {
+            Sleep(STREAM_BATCH_MS);
+            continue;
+        }
+
+        // Walk backwards so dropping a client (last one moves into its slot) skips nothing
+        for (slot = polled; slot-- > 0;) {
+            short events = fds[slot + 1].revents;
+            if ((events & (POLLERR | POLLHUP | POLLNVAL)) ||
+                ((events & POLLRDNORM) && readClient(&server->clients[slot]) != 0)) {
+                dropClient(server, slot);
+            }
+        }
+        if (fds[0].revents & POLLRDNORM) {
+            acceptClient(server);
+        }
+
+        distributeBatch(server);
+        for (slot = server->clientCount; slot-- > 0;) {
+            if (sendClient(&server->clients[slot]) != 0) {
+                dropClient(server, slot);
+            }
+        }
+    }
+
+    return 0;
+}
+
+// Removes a socket file nobody listens on any more, returns NULL or why path cannot be bound
+static const char* clearStaleSocket(const char* path, const SOCKADDR_UN* address) {
+    DWORD attributes = GetFileAttributesA(path);
+    SOCKET probe;
+    bool listening;
+
+    if (attributes == INVALID_FILE_ATTRIBUTES) {
+        return NULL;
+    }
+    // AF_UNIX socket files are reparse points, anything else may be somebody's data
+    if (!(attributes & FILE_ATTRIBUTE_REPARSE_POINT) || (attributes & FILE_ATTRIBUTE_DIRECTORY)) {
+        return "path exists and is not a socket";
+    }
+    probe = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (probe == INVALID_SOCKET) {
+        return "cannot create a socket";
+    }
+    listening = connect(probe, (const struct sockaddr*)address, sizeof(*address)) == 0;
+    closesocket(probe);
+    if (listening) {
+        return "another program is listening on it";
+    }
+    return DeleteFileA(path) ? NULL : "cannot remove the stale socket file";
+}
+
+int streamServerOpen(StreamServer* server, const char* path) {
+    WSADATA wsaData;
+    SOCKADDR_UN address;
+    u_long nonBlocking = 1;
+    int type;
+
+    memset(server, 0, sizeof(*server));
+    server->listener = INVALID_SOCKET;
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        server->failure = "path too long";
+        return -1;
+    }
+    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
+        server->failure = "Winsock unavailable";
+        return -1;
+    }
+
+    for (type = 0; type < STREAM_FRAME_TYPES; type++) {
+        server->pending[type] = malloc(STREAM_PENDING_BYTES);
+        server->batch[type] = malloc(STREAM_PENDING_BYTES);
+        if (server->pending[type] == NULL || server->batch[type] == NULL) {
+            server->failure = "out of memory";
+            goto Error;
+        }
+    }
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+    server->failure = clearStaleSocket(path, &address); // A socket file left by a previous run makes bind fail
+    if (server->failure != NULL) {
+        goto Error;
+    }
+
+    server->failure = "cannot listen";
+    server->listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (server->listener == INVALID_SOCKET ||
+        bind(server->listener, (struct sockaddr*)&address, sizeof(address)) != 0 ||
+        listen(server->listener, SOMAXCONN) != 0 ||
+        ioctlsocket(server->listener, FIONBIO, &nonBlocking) != 0) {
+        goto Error;
+    }
+
+    InitializeCriticalSection(&server->mutex);
+    server->running = true;
+    server->thread = (HANDLE)_beginthreadex(NULL, 0, streamServerThread, server, 0, NULL);
+    if (server->thread == 0) {
+        server->failure = "cannot start the server thread";
+        DeleteCriticalSection(&server->mutex);
+        goto Error;
+    }
+
+    server->failure = NULL;
+    return 0;
+
+Error:
+    if (server->listener != INVALID_SOCKET) {
+        closesocket(server->listener);
+    }
+    for (type = 0; type < STREAM_FRAME_TYPES; type++) {
+        free(server->pending[type]);
+        free(server->batch[type]);
+    }
+    server->thread = NULL;
+    WSACleanup();
+    return -1;
+}
+
+// Reserves space for one record of type, returns NULL (and counts a drop) if the batch is full
+static uint8_t* reserveRecord(StreamServer* server, uint32_t type, uint32_t size) {
+    uint32_t index = type - 1;
+    uint8_t* record;
+
+    if (server->pendingBytes[index] + size > STREAM_PENDING_BYTES || server->pendingCount[index] == 0xFFFF) {
+        server->recordsDropped++;
+        return NULL;
+    }
+    record = server->pending[index] + server->pendingBytes[index];
+    memset(record, 0, size);
+    server->pendingBytes[index] += size;
+    server->pendingCount[index]++;
+    return record;
+}
+
+void streamServerSubmitScan(StreamServer* server, uint32_t monitor, int64_t timeUs,
+                            const ScanState* state, uint32_t tubeCount) {
+    uint32_t size = STREAM_RECORD_BYTES(StreamScanRecord, tubeCount);
+    StreamScanRecord* record;
+    uint8_t* states;
+    uint32_t tube;
+
+    EnterCriticalSection(&server->mutex);
+    record = (StreamScanRecord*)reserveRecord(server, STREAM_FRAME_SCANS, size);
+    if (record != NULL) {
+        record->timeUs = timeUs;
+        record->monitor = (uint16_t)monitor;
+        record->tubeCount = (uint16_t)tubeCount;
+        states = (uint8_t*)(record + 1);
+        for (tube = 0; tube < tubeCount; tube++) {
+            states[tube] = (uint8_t)(state->position[tube] | state->eating[tube] << 4);
+        }
+    }
+    LeaveCriticalSection(&server->mutex);
+}
+
+void streamServerSubmitBin(StreamServer* server, uint32_t monitor, const ActivityBin* bin, uint32_t tubeCount) {
+    uint32_t size = STREAM_RECORD_BYTES(StreamBinRecord, tubeCount * sizeof(uint32_t));
+    StreamBinRecord* record;
+
+    EnterCriticalSection(&server->mutex);
+    record = (StreamBinRecord*)reserveRecord(server, STREAM_FRAME_BINS, size);
+    if (record != NULL) {
+        record->startUs = bin->startUs;
+        record->endUs = bin->endUs;
+        record->monitor = (uint16_t)monitor;
+        record->tubeCount = (uint16_t)tubeCount;
+        record->scans = bin->scans;
+        memcpy(record + 1, bin->moves, tubeCount * sizeof(uint32_t));
+    }
+    LeaveCriticalSection(&server->mutex);
+}
+
+void streamServerSubmitGap(StreamServer* server, uint32_t monitor, int64_t startUs, int64_t endUs) {
+    StreamGapRecord* record;
+
+    EnterCriticalSection(&server->mutex);
+    record = (StreamGapRecord*)reserveRecord(server, STREAM_FRAME_GAPS, sizeof(StreamGapRecord));
+    if (record != NULL) {
+        record->startUs = startUs;
+        record->endUs = endUs;
+        record->monitor = (uint16_t)monitor;
+    }
+    LeaveCriticalSection(&server->mutex);
+}
+
+void streamServerSubmitEvents(StreamServer* server, const TubeEvent events[], uint32_t count) {
+    uint32_t i;
+
+    EnterCriticalSection(&server->mutex);
+    for (i = 0; i < count; i++) {
+        uint8_t* record = reserveRecord(server, STREAM_FRAME_EVENTS, sizeof(TubeEvent));
+
+        if (record == NULL) {
+            server->recordsDropped += count - i - 1;
+            break;
+        }
+        memcpy(record, &events[i], sizeof(TubeEvent));
+    }
+    LeaveCriticalSection(&server->mutex);
+}
+
+void streamServerClose(StreamServer* server) {
+    int type;
+
+    if (server->thread == NULL) {
+        return;
+    }
+
+    server->running = false;
+    WaitForSingleObject(server->thread, INFINITE);
+    CloseHandle(server->thread);
+    server->thread = NULL;
+    DeleteCriticalSection(&server->mutex);
+
+    while (server->clientCount > 0) {
+        dropClient(server, server->clientCount - 1);
+    }
+    closesocket(server->listener);
+    for (type = 0; type < STREAM_FRAME_TYPES; type++) {
+        free(server->pending[type]);
+        free(server->batch[type]);
+    }
+    WSACleanup();
+}
@@ -0,0 +1,119 @@
+#ifndef STREAM_SERVER_H
+#define STREAM_SERVER_H
+
+#include <stdint.h> // Fixed-width integer types
+#include <stdbool.h> // Standard boolean library
+#include <winsock2.h> // Sockets, WSAPoll
+#include <windows.h> // Threads and critical sections
+#include "scan_kernel.h" // ScanState
+#include "binning.h" // ActivityBin
+#include "tube_events.h" // TubeEvent
+
+// Constants
+#define STREAM_FRAME_MAGIC 0x5344414D    // "MADS" little-endian
+#define STREAM_FRAME_SCANS 1             // Payload is StreamScanRecord entries
+#define STREAM_FRAME_BINS 2              // Payload is StreamBinRecord entries
+#define STREAM_FRAME_GAPS 3              // Payload is StreamGapRecord entries
+#define STREAM_FRAME_EVENTS 4           // Payload is TubeEvent entries (tube_events.h), only sent on request
+#define STREAM_FRAME_TYPES 4
+#define STREAM_MAX_CLIENTS 64
+#define STREAM_CLIENT_QUEUE_BYTES (1 << 20) // Unsent bytes a client may fall behind by before it is dropped
+#define STREAM_PENDING_BYTES (256 * 1024) // Records batched between two server passes
+#define STREAM_BATCH_MS 20               // Longest a record waits before it is framed
+
+// Every frame starts with this header, payloadBytes of records follow
+typedef struct {
+    uint32_t magic;
+    uint16_t type;
+    uint16_t count;          // Records in the payload
+    uint32_t payloadBytes;
+    uint32_t sequence;       // Per client, gaps never occur; a dropped client is disconnected
+} StreamFrameHeader;
+
+// One decoded scan, followed by tubeCount state bytes padded to 8 bytes
+typedef struct {
+    int64_t timeUs;
+    uint16_t monitor;
+    uint16_t tubeCount;
+    uint32_t reserved;
+} StreamScanRecord;
+
+// One closed activity bin, followed by tubeCount uint32 move counts padded to 8 bytes
+typedef struct {
+    int64_t startUs;
+    int64_t endUs;
+    uint16_t monitor;
+    uint16_t tubeCount;
+    uint32_t scans;
+} StreamBinRecord;
+
+// Acquisition was interrupted between startUs and endUs (device lost and reconnected)
+typedef struct {
+    int64_t startUs;
+    int64_t endUs;
+    uint16_t monitor;
+    uint16_t reserved;
+    uint32_t reserved2;
+} StreamGapRecord;
+
+#define STREAM_RECORD_BYTES(base, payload) (((uint32_t)sizeof(base) + (payload) + 7) & ~7u)
+
+// Connected subscriber with its own bounded send queue
+typedef struct {
+    SOCKET socket;
+    uint32_t subscriptions;  // Bit (1 << frame type), clients may send a new uint32 mask at any time
+    uint8_t mask[4];         // Bytes of a mask recv has delivered only part of
+    uint32_t maskBytes;
+    uint32_t sequence;
+    uint8_t* queue;          // Ring of framed bytes not yet accepted by the socket
+    uint32_t head;
+    uint32_t used;
+} StreamClient;
+
+// Streams scans and bins to local subscribers over an AF_UNIX socket.
+// Producers copy records into a pending buffer under a short lock; one
+// server thread frames each batch, queues it per client and sends with
+// non-blocking sockets. A client whose queue would overflow is dropped,
+// so a stuck consumer never holds up acquisition.
+typedef struct {
+    SOCKET listener;
+    StreamClient clients[STREAM_MAX_CLIENTS];
+    uint32_t clientCount;
+
+    uint8_t* pending[STREAM_FRAME_TYPES]; // Records filled by producers, indexed by frame type - 1
+    uint8_t* batch[STREAM_FRAME_TYPES];   // Records being framed by the server thread
+    uint32_t pendingBytes[STREAM_FRAME_TYPES];
+    uint32_t pendingCount[STREAM_FRAME_TYPES];
+
+    uint64_t recordsDropped; // Records lost because the pending buffer was full
+    uint64_t clientsDropped; // Clients disconnected for falling behind
+    uint64_t framesSent;
+
+    CRITICAL_SECTION mutex;
+    HANDLE thread;
+    volatile bool running;
+    const char* failure;     // Why streamServerOpen returned -1
+} StreamServer;
+
+// Binds path and starts the server thread. A socket file left by a run that has
+// exited is removed first; any other file, or a socket another program still
+// listens on, is left alone and the call fails with server->failure set.
+int streamServerOpen(StreamServer* server, const char* path);
+
+// Queues one decoded scan for all clients subscribed to STREAM_FRAME_SCANS
+void streamServerSubmitScan(StreamServer* server, uint32_t monitor, int64_t timeUs,
+                            const ScanState* state, uint32_t tubeCount);
+
+// Queues one closed bin for all clients subscribed to STREAM_FRAME_BINS
+void streamServerSubmitBin(StreamServer* server, uint32_t monitor, const ActivityBin* bin, uint32_t tubeCount);
+
+// Queues one acquisition gap for all clients subscribed to STREAM_FRAME_GAPS
+void streamServerSubmitGap(StreamServer* server, uint32_t monitor, int64_t startUs, int64_t endUs);
+
+// Queues the transitions of one scan for all clients subscribed to STREAM_FRAME_EVENTS
+void streamServerSubmitEvents(StreamServer* server, const TubeEvent events[], uint32_t count);
+
+// Stops the server thread and disconnects every client
+void streamServerClose(StreamServer* server);
+
+#endif
@@ -0,0 +1,431 @@
+#include "synchrony.h"
+#include <stdlib.h> // calloc, free
+#include <string.h> // memset, memcpy
+#include <math.h> // sqrt, isnan, NAN
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h> // AVX2 intrinsics
+#define SYNCHRONY_X86
+#endif
+
+// Bins tube i and each of tubes first ... first + count - 1 were both active
+typedef void (*PairKernel)(const uint64_t* active, uint32_t stride, uint32_t words, uint32_t i, uint32_t first,
+                           uint32_t count, uint32_t out[]);
+
+static void pairsScalar(const uint64_t* active, uint32_t stride, uint32_t words, uint32_t i, uint32_t first,
+                        uint32_t count, uint32_t out[]) {
+    uint32_t k, w;
+
+    for (k = 0; k < count; k++) {
+        uint32_t together = 0;
+
+        for (w = 0; w < words; w++) {
+            const uint64_t* row = active + (size_t)w * stride;
+            together += (uint32_t)__builtin_popcountll(row[i] & row[first + k]);
+        }
+        out[k] = together;
+    }
+}
+
+#ifdef SYNCHRONY_X86
+
+// Same code, compiled to use the POPCNT instruction instead of a library call
+__attribute__((target("popcnt")))
+static void pairsPopcnt(const uint64_t* active, uint32_t stride, uint32_t words, uint32_t i, uint32_t first,
+                        uint32_t count, uint32_t out[]) {
+    uint32_t k, w;
+
+    for (k = 0; k < count; k++) {
+        uint32_t together = 0;
+
+        for (w = 0; w < words; w++) {
+            const uint64_t* row = active + (size_t)w * stride;
+            together += (uint32_t)__builtin_popcountll(row[i] & row[first + k]);
+        }
+        out[k] = together;
+    }
+}
+
+// Bits set in each 64-bit lane: a nibble lookup per byte, then the bytes of a lane summed
+__attribute__((target("avx2")))
+static inline __m256i popcountLanes(__m256i value) {
+    const __m256i nibbleBits = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                                0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i lowNibble = _mm256_set1_epi8(0x0F);
+    __m256i low = _mm256_and_si256(value, lowNibble);
+    __m256i high = _mm256_and_si256(_mm256_srli_epi16(value, 4), lowNibble);
+    __m256i bytes = _mm256_add_epi8(_mm256_shuffle_epi8(nibbleBits, low), _mm256_shuffle_epi8(nibbleBits, high));
+
+    return _mm256_sad_epu8(bytes, _mm256_setzero_si256());
+}
+
+// Eight pairs per iteration, compiled for AVX2 only in this function
+__attribute__((target("avx2")))
+static void pairsAvx2(const uint64_t* active, uint32_t stride, uint32_t words, uint32_t i, uint32_t first,
+                      uint32_t count, uint32_t out[]) {
+    uint32_t k = 0, w;
+
+    for (; k + 8 <= count; k += 8) {
+        __m256i low = _mm256_setzero_si256(), high = low;
+
+        for (w = 0; w < words; w++) {
+            const uint64_t* row = active + (size_t)w * stride;
+            __m256i a = _mm256_set1_epi64x((long long)row[i]);
+
+            low = _mm256_add_epi64(low, popcountLanes(_mm256_and_si256(a,
+                      _mm256_loadu_si256((const __m256i*)(row + first + k)))));
+            high = _mm256_add_epi64(high, popcountLanes(_mm256_and_si256(a,
+                       _mm256_loadu_si256((const __m256i*)(row + first + k + 4)))));
+        }
+        // Counts fit in 32 bits: keep the low half of each lane, in order
+        low = _mm256_permutevar8x32_epi32(low, _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7));
+        high = _mm256_permutevar8x32_epi32(high, _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7));
+        _mm256_storeu_si256((__m256i*)(out + k), _mm256_permute2x128_si256(low, high, 0x20));
+    }
+    if (k < count) {
+        pairsPopcnt(active, stride, words, i, first + k, count - k, out + k);
+    }
+}
+
+#endif
+
+static PairKernel pairKernel = pairsScalar;
+static const char* pairKernelName = "scalar";
+
+// Picks the pair kernel for this CPU, once
+static void initPairKernel(void) {
+#ifdef SYNCHRONY_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        pairKernel = pairsAvx2;
+        pairKernelName = "avx2";
+    } else if (__builtin_cpu_supports("popcnt")) {
+        pairKernel = pairsPopcnt;
+        pairKernelName = "popcnt";
+    }
+#endif
+}
+
+const char* synchronyKernelName(void) {
+    return pairKernelName;
+}
+
+int synchronyOpen(SynchronyEngine* engine, uint32_t monitorCount, const uint32_t tubeCounts[], int64_t binUs,
+                  uint32_t windowBins) {
+    uint32_t monitor, tube;
+    size_t tubeWords, monitorWords, i;
+
+    memset(engine, 0, sizeof(*engine));
+    if (monitorCount == 0 || monitorCount > SYNCHRONY_MAX_MONITORS || binUs <= 0 ||
+        windowBins == 0 || windowBins > SYNCHRONY_MAX_WINDOW_BINS) {
+        return -1;
+    }
+    initPairKernel();
+    engine->monitorCount = monitorCount;
+    for (monitor = 0; monitor < monitorCount; monitor++) {
+        engine->firstTube[monitor] = engine->tubeCount;
+        engine->tubeCount += tubeCounts[monitor] > SCAN_MAX_TUBES ? SCAN_MAX_TUBES : tubeCounts[monitor];
+    }
+    engine->firstTube[monitorCount] = engine->tubeCount;
+    engine->binUs = binUs;
+    engine->windowBins = windowBins;
+    engine->words = (windowBins + 63) / 64;
+    engine->nextIndex = -1;
+    for (i = 0; i < SYNCHRONY_PENDING_BINS; i++) {
+        engine->pending[i].index = -1;
+    }
+
+    tubeWords = (size_t)engine->words * engine->tubeCount + 1;
+    monitorWords = (size_t)engine->words * monitorCount;
+    engine->active = calloc(tubeWords, sizeof(uint64_t));
+    engine->observed = calloc(monitorWords, sizeof(uint64_t));
+    engine->activeCopy = calloc(tubeWords, sizeof(uint64_t));
+    engine->observedCopy = calloc(monitorWords, sizeof(uint64_t));
+    engine->together = calloc(engine->tubeCount + 1, sizeof(uint32_t));
+    engine->activeSeen = calloc((size_t)engine->tubeCount * monitorCount + 1, sizeof(uint32_t));
+    engine->activeScale = calloc((size_t)engine->tubeCount * monitorCount + 1, sizeof(float));
+    engine->bothSeen = calloc((size_t)monitorCount * monitorCount, sizeof(uint32_t));
+    engine->tubeMonitor = calloc(engine->tubeCount + 1, sizeof(uint16_t));
+    engine->tubeMatrix = calloc((size_t)engine->tubeCount * SCAN_MAX_TUBES + 1, sizeof(float));
+    engine->tubeMeans = calloc(engine->tubeCount + 1, sizeof(float));
+    engine->monitorMatrix = calloc((size_t)monitorCount * monitorCount, sizeof(float));
+    engine->tubeSums = calloc(engine->tubeCount + 1, sizeof(double));
+    engine->tubePairs = calloc(engine->tubeCount + 1, sizeof(uint32_t));
+    engine->monitorSums = calloc((size_t)monitorCount * monitorCount, sizeof(double));
+    engine->monitorPairs = calloc((size_t)monitorCount * monitorCount, sizeof(uint32_t));
+    if (engine->active == NULL || engine->observed == NULL || engine->activeCopy == NULL ||
+        engine->observedCopy == NULL || engine->together == NULL || engine->activeSeen == NULL ||
+        engine->activeScale == NULL || engine->bothSeen == NULL || engine->tubeMonitor == NULL || engine->tubeMatrix == NULL ||
+        engine->tubeMeans == NULL || engine->monitorMatrix == NULL || engine->tubeSums == NULL ||
+        engine->tubePairs == NULL || engine->monitorSums == NULL || engine->monitorPairs == NULL) {
+        synchronyClose(engine);
+        return -1;
+    }
+    for (monitor = 0; monitor < monitorCount; monitor++) {
+        for (tube = engine->firstTube[monitor]; tube < engine->firstTube[monitor + 1]; tube++) {
+            engine->tubeMonitor[tube] = (uint16_t)monitor;
+        }
+    }
+    for (i = 0; i < (size_t)engine->tubeCount * SCAN_MAX_TUBES; i++) {
+        engine->tubeMatrix[i] = NAN;
+    }
+    for (i = 0; i < engine->tubeCount; i++) {
+        engine->tubeMeans[i] = NAN;
+    }
+    for (i = 0; i < (size_t)monitorCount * monitorCount; i++) {
+        engine->monitorMatrix[i] = NAN;
+    }
+    InitializeCriticalSection(&engine->mutex);
+    engine->started = true;
+    return 0;
+}
+
+void synchronyClose(SynchronyEngine* engine) {
+    if (engine->started) {
+        DeleteCriticalSection(&engine->mutex);
+    }
+    free(engine->active);
+    free(engine->observed);
+    free(engine->activeCopy);
+    free(engine->observedCopy);
+    free(engine->together);
+    free(engine->activeSeen);
+    free(engine->activeScale);
+    free(engine->bothSeen);
+    free(engine->tubeMonitor);
+    free(engine->tubeMatrix);
+    free(engine->tubeMeans);
+    free(engine->monitorMatrix);
+    free(engine->tubeSums);
+    free(engine->tubePairs);
+    free(engine->monitorSums);
+    free(engine->monitorPairs);
+    memset(engine, 0, sizeof(*engine));
+}
+
+// Writes the pending bin of nextIndex into the window, with whatever monitors reported it; caller holds mutex
+static void finishBin(SynchronyEngine* engine) {
+    SynchronyPending* pending = &engine->pending[engine->nextIndex % SYNCHRONY_PENDING_BINS];
+    uint32_t column = (uint32_t)(engine->nextIndex % engine->windowBins);
+    uint64_t* activeRow = engine->active + (size_t)(column / 64) * engine->tubeCount;
+    uint64_t* observedRow = engine->observed + (size_t)(column / 64) * engine->monitorCount;
+    uint64_t bit = 1ull << (column % 64);
+    SynchronyBin* bin = &engine->latest;
+    uint32_t monitor, tube;
+
+    if (pending->index != engine->nextIndex) {
+        memset(pending, 0, sizeof(*pending)); // Nobody reported it
+    }
+    memset(bin, 0, sizeof(*bin));
+    bin->startUs = engine->nextIndex * engine->binUs;
+    for (monitor = 0; monitor < engine->monitorCount; monitor++) {
+        uint32_t first = engine->firstTube[monitor];
+        uint32_t count = engine->firstTube[monitor + 1] - first;
+        uint64_t active = pending->observed[monitor] ? pending->active[monitor] : 0;
+
+        for (tube = 0; tube < count; tube++) {
+            activeRow[first + tube] = (activeRow[first + tube] & ~bit) | (bit & (0 - (active >> tube & 1)));
+        }
+        observedRow[monitor] = (observedRow[monitor] & ~bit) | (pending->observed[monitor] ? bit : 0);
+        if (pending->observed[monitor]) {
+            bin->active[monitor] = (uint8_t)__builtin_popcountll(active);
+            bin->observed[monitor] = 1;
+            bin->activeTubes += bin->active[monitor];
+            bin->observedTubes += count;
+        }
+    }
+
+    if (bin->observedTubes > 0 && (engine->peak.observedTubes == 0 ||
+        (uint64_t)bin->activeTubes * engine->peak.observedTubes >
+        (uint64_t)engine->peak.activeTubes * bin->observedTubes)) {
+        engine->peak = *bin;
+    }
+    pending->index = -1;
+    engine->bins++;
+    engine->nextIndex++;
+}
+
+void synchronyAddBin(SynchronyEngine* engine, uint32_t monitor, int64_t startUs, uint64_t active, bool observed) {
+    int64_t index = startUs / engine->binUs;
+    SynchronyPending* pending;
+
+    if (monitor >= engine->monitorCount) {
+        return;
+    }
+    EnterCriticalSection(&engine->mutex);
+    if (engine->nextIndex < 0) {
+        engine->nextIndex = index;
+    }
+    if (index < engine->nextIndex) {
+        engine->lateBins++; // Its bin already went without this monitor
+        LeaveCriticalSection(&engine->mutex);
+        return;
+    }
+
+    // A monitor that stopped reporting holds the others up for a few bins only
+    while (index >= engine->nextIndex + SYNCHRONY_PENDING_BINS) {
+        finishBin(engine);
+    }
+    pending = &engine->pending[index % SYNCHRONY_PENDING_BINS];
+    if (pending->index != index) {
+        memset(pending, 0, sizeof(*pending));
+        pending->index = index;
+    }
+    if (!pending->hasReported[monitor]) {
+        pending->hasReported[monitor] = 1;
+        pending->reported++;
+    }
+    pending->active[monitor] = active;
+    pending->observed[monitor] = observed;
+
+    while (engine->pending[engine->nextIndex % SYNCHRONY_PENDING_BINS].index == engine->nextIndex &&
+           engine->pending[engine->nextIndex % SYNCHRONY_PENDING_BINS].reported == engine->monitorCount) {
+        finishBin(engine);
+    }
+    LeaveCriticalSection(&engine->mutex);
+}
+
+void synchronyFlush(SynchronyEngine* engine) {
+    bool waiting = true;
+    int i;
+
+    EnterCriticalSection(&engine->mutex);
+    while (waiting && engine->nextIndex >= 0) {
+        waiting = false;
+        for (i = 0; i < SYNCHRONY_PENDING_BINS; i++) {
+            waiting |= engine->pending[i].index >= engine->nextIndex;
+        }
+        if (waiting) {
+            finishBin(engine);
+        }
+    }
+    LeaveCriticalSection(&engine->mutex);
+}
+
+uint64_t synchronyLatest(SynchronyEngine* engine, SynchronyBin* latest, SynchronyBin* peak) {
+    uint64_t bins;
+
+    EnterCriticalSection(&engine->mutex);
+    *latest = engine->latest;
+    *peak = engine->peak;
+    bins = engine->bins;
+    LeaveCriticalSection(&engine->mutex);
+    return bins;
+}
+
+// Bins each tube was active while each monitor had data, and bins two monitors both had data.
+// The phi correlation of tube i of monitor p with tube j of monitor q over the n bins both
+// monitors had data, a and b of them active and ab both, is
+//   (n ab - a b) / sqrt(a (n - a) b (n - b))
+// so each tube gets 1 / sqrt(a (n - a)) against every monitor, NAN if undefined (the tube
+// was active in every bin or in none, or fewer than SYNCHRONY_MIN_BINS), and a pair costs
+// its one population count and a few multiplications.
+static void countSeen(SynchronyEngine* engine) {
+    uint32_t monitorCount = engine->monitorCount;
+    uint32_t tube, monitor, other, w;
+
+    memset(engine->activeSeen, 0, sizeof(uint32_t) * engine->tubeCount * monitorCount);
+    memset(engine->bothSeen, 0, sizeof(uint32_t) * monitorCount * monitorCount);
+    for (w = 0; w < engine->words; w++) {
+        const uint64_t* activeRow = engine->activeCopy + (size_t)w * engine->tubeCount;
+        const uint64_t* observedRow = engine->observedCopy + (size_t)w * monitorCount;
+
+        for (monitor = 0; monitor < monitorCount; monitor++) {
+            uint32_t* seen = engine->activeSeen + (size_t)monitor * engine->tubeCount;
+
+            for (tube = 0; tube < engine->tubeCount; tube++) {
+                seen[tube] += (uint32_t)__builtin_popcountll(activeRow[tube] & observedRow[monitor]);
+            }
+        }
+        for (monitor = 0; monitor < monitorCount; monitor++) {
+            for (other = 0; other < monitorCount; other++) {
+                engine->bothSeen[monitor * monitorCount + other] +=
+                    (uint32_t)__builtin_popcountll(observedRow[monitor] & observedRow[other]);
+            }
+        }
+    }
+
+    for (monitor = 0; monitor < monitorCount; monitor++) {
+        for (tube = 0; tube < engine->tubeCount; tube++) {
+            uint32_t home = engine->tubeMonitor[tube];
+            size_t cell = (size_t)monitor * engine->tubeCount + tube;
+            double n = engine->bothSeen[home * monitorCount + monitor];
+            double a = engine->activeSeen[cell];
+            double spread = a * (n - a);
+
+            engine->activeScale[cell] = n >= SYNCHRONY_MIN_BINS && spread > 0.0 ? (float)(1.0 / sqrt(spread)) : NAN;
+        }
+    }
+}
+
+bool synchronyCompute(SynchronyEngine* engine) {
+    uint32_t tubeCount = engine->tubeCount;
+    uint32_t monitorCount = engine->monitorCount;
+    uint32_t i, k, monitor;
+
+    EnterCriticalSection(&engine->mutex);
+    if (engine->bins == engine->computedBins) {
+        LeaveCriticalSection(&engine->mutex);
+        return false;
+    }
+    memcpy(engine->activeCopy, engine->active, sizeof(uint64_t) * engine->words * tubeCount);
+    memcpy(engine->observedCopy, engine->observed, sizeof(uint64_t) * engine->words * monitorCount);
+    engine->computedBins = engine->bins;
+    LeaveCriticalSection(&engine->mutex);
+
+    // A tube is only ever active while its monitor has data, so the bins both tubes
+    // were active is the one count of its own a pair needs
+    countSeen(engine);
+    memset(engine->tubeSums, 0, sizeof(double) * tubeCount);
+    memset(engine->tubePairs, 0, sizeof(uint32_t) * tubeCount);
+    memset(engine->monitorSums, 0, sizeof(double) * monitorCount * monitorCount);
+    memset(engine->monitorPairs, 0, sizeof(uint32_t) * monitorCount * monitorCount);
+
+    // Every pair once; tubes are numbered monitor by monitor, so the other tube's monitor is never before home
+    for (i = 0; i < tubeCount; i++) {
+        uint32_t home = engine->tubeMonitor[i];
+        uint32_t homeFirst = engine->firstTube[home];
+        const uint32_t* seenOfHome = engine->activeSeen + (size_t)home * tubeCount;
+        const float* scaleOfHome = engine->activeScale + (size_t)home * tubeCount;
+
+        engine->tubeMatrix[(size_t)i * SCAN_MAX_TUBES + (i - homeFirst)] = NAN;
+        pairKernel(engine->activeCopy, tubeCount, engine->words, i, i + 1, tubeCount - i - 1, engine->together);
+        for (k = 0; i + 1 + k < tubeCount; k++) {
+            uint32_t j = i + 1 + k;
+            uint32_t other = engine->tubeMonitor[j];
+            size_t cellI = (size_t)other * tubeCount + i;
+            float n = (float)engine->bothSeen[home * monitorCount + other];
+            float r = (n * engine->together[k] - (float)engine->activeSeen[cellI] * seenOfHome[j]) *
+                      engine->activeScale[cellI] * scaleOfHome[j];
+
+            if (other == home) {
+                engine->tubeMatrix[(size_t)i * SCAN_MAX_TUBES + (j - homeFirst)] = r;
+                engine->tubeMatrix[(size_t)j * SCAN_MAX_TUBES + (i - homeFirst)] = r;
+                if (!isnan(r)) {
+                    engine->tubeSums[i] += r;
+                    engine->tubeSums[j] += r;
+                    engine->tubePairs[i]++;
+                    engine->tubePairs[j]++;
+                }
+            }
+            if (!isnan(r)) {
+                engine->monitorSums[home * monitorCount + other] += r;
+                engine->monitorPairs[home * monitorCount + other]++;
+            }
+        }
+    }
+
+    for (i = 0; i < tubeCount; i++) {
+        engine->tubeMeans[i] = engine->tubePairs[i] > 0 ? (float)(engine->tubeSums[i] / engine->tubePairs[i]) : NAN;
+    }
+    for (i = 0; i < monitorCount; i++) {
+        for (monitor = i; monitor < monitorCount; monitor++) {
+            uint32_t pairs = engine->monitorPairs[i * monitorCount + monitor];
+            float mean = pairs > 0 ? (float)(engine->monitorSums[i * monitorCount + monitor] / pairs) : NAN;
+
+            engine->monitorMatrix[i * monitorCount + monitor] = mean;
+            engine->monitorMatrix[monitor * monitorCount + i] = mean;
+        }
+    }
+    return true;
+}
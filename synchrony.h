@@ -0,0 +1,105 @@
+#ifndef SYNCHRONY_H
+#define SYNCHRONY_H
+
+#include <stdint.h> // Fixed-width integer types
+#include <stdbool.h> // Standard boolean library
+#include <windows.h> // CRITICAL_SECTION
+#include "scan_kernel.h" // SCAN_MAX_TUBES
+
+// Constants
+#define SYNCHRONY_WINDOW_BINS 60     // Default: correlations over the last 60 bins (an hour of minutes)
+#define SYNCHRONY_MAX_WINDOW_BINS 1024
+#define SYNCHRONY_MAX_MONITORS 128   // As CONFIG_MAX_MONITORS
+#define SYNCHRONY_PENDING_BINS 4     // Bins that wait for a late monitor before going without it
+#define SYNCHRONY_MIN_BINS 8         // Bins two tubes must both have data for to get a correlation
+
+// Activity of every monitor in one bin, once all of them reported it or it could wait no longer
+typedef struct {
+    int64_t startUs;
+    uint32_t activeTubes;    // Tubes that moved, of the monitors with scans in the bin
+    uint32_t observedTubes;  // Tubes of the monitors with scans in the bin
+    uint8_t active[SYNCHRONY_MAX_MONITORS];   // Per monitor
+    uint8_t observed[SYNCHRONY_MAX_MONITORS]; // 1 if the monitor had scans in the bin
+} SynchronyBin;
+
+// Bins waiting for the other monitors
+typedef struct {
+    int64_t index;           // -1 = free
+    uint32_t reported;       // Monitors that reported it
+    uint64_t active[SYNCHRONY_MAX_MONITORS];
+    uint8_t observed[SYNCHRONY_MAX_MONITORS];
+    uint8_t hasReported[SYNCHRONY_MAX_MONITORS];
+} SynchronyPending;
+
+// Simultaneous activity of every tube of every monitor. A tube is active in a bin
+// if it moved at all. Each finished bin sets one bit per tube in the window bitmaps,
+// which are tube-minor rows of bits, one row per 64 bins of the window, so the bit
+// of a new bin overwrites the one a window ago. The phi correlation of two tubes
+// over the window then takes the population count of the AND of their rows, eight
+// pairs at a time with AVX2 where the CPU has it, and counts per tube and monitor
+// that are shared by all pairs.
+//
+// synchronyAddBin may be called by the decode worker of any monitor; the window
+// is behind mutex. synchronyCompute copies the window out and computes the
+// correlations on the caller's thread, which owns the results.
+typedef struct {
+    bool started;                // mutex initialised
+    uint32_t monitorCount;
+    uint32_t tubeCount;          // Of all monitors
+    uint32_t firstTube[SYNCHRONY_MAX_MONITORS + 1]; // Index of the first tube of each monitor
+    int64_t binUs;
+    uint32_t windowBins;
+    uint32_t words;              // 64-bin rows of the window
+
+    CRITICAL_SECTION mutex;
+    int64_t nextIndex;           // Oldest bin not finished yet, -1 before the first
+    SynchronyPending pending[SYNCHRONY_PENDING_BINS];
+    uint64_t* active;            // [word][tube] tube moved in the bin
+    uint64_t* observed;          // [word][monitor] monitor had scans in the bin
+    uint64_t bins;               // Bins finished
+    SynchronyBin latest;         // Last finished bin
+    SynchronyBin peak;           // Finished bin with the largest share of active tubes
+    uint32_t lateBins;           // Reports that came after their bin had gone without them
+
+    // Owned by the thread that calls synchronyCompute
+    uint64_t* activeCopy;
+    uint64_t* observedCopy;
+    uint32_t* together;          // Scratch, one row of pairs
+    uint32_t* activeSeen;        // [monitor][tube] bins the tube was active and the monitor had data
+    float* activeScale;          // [monitor][tube] 1 / sqrt(a (n - a)) of activeSeen, NAN if undefined
+    uint32_t* bothSeen;          // [monitor][monitor] bins both had data
+    uint16_t* tubeMonitor;       // Monitor of each tube
+    uint64_t computedBins;       // Bins behind the results
+    float* tubeMatrix;           // [tube][SCAN_MAX_TUBES] correlation with each tube of its monitor, NAN if undefined
+    float* tubeMeans;            // [tube] mean correlation with the other tubes of its monitor, NAN if undefined
+    float* monitorMatrix;        // [monitor][monitor] mean correlation of their tubes, NAN if undefined
+    double* tubeSums;            // Scratch for the means
+    uint32_t* tubePairs;
+    double* monitorSums;
+    uint32_t* monitorPairs;
+} SynchronyEngine;
+
+// tubeCounts has monitorCount entries; bins are binUs long and aligned to it.
+// Returns 0, or -1 if the window cannot be allocated.
+int synchronyOpen(SynchronyEngine* engine, uint32_t monitorCount, const uint32_t tubeCounts[], int64_t binUs,
+                  uint32_t windowBins);
+void synchronyClose(SynchronyEngine* engine);
+
+// One bin of one monitor, in time order per monitor; active has bit i set if tube i
+// moved, observed is false for a bin without scans
+void synchronyAddBin(SynchronyEngine* engine, uint32_t monitor, int64_t startUs, uint64_t active, bool observed);
+
+// Finishes the bins still waiting for a monitor, at the end of a record
+void synchronyFlush(SynchronyEngine* engine);
+
+// Last finished bin and the peak so far; returns the bins finished
+uint64_t synchronyLatest(SynchronyEngine* engine, SynchronyBin* latest, SynchronyBin* peak);
+
+// Recomputes every correlation from the window if bins finished since the last
+// call; returns true if it did. Call from one thread only.
+bool synchronyCompute(SynchronyEngine* engine);
+
+// Name of the pair kernel picked for this CPU ("avx2", "popcnt" or "scalar")
+const char* synchronyKernelName(void);
+
+#endif
@@ -0,0 +1,136 @@
+#include "timebase_tuner.h"
+#include <stdio.h> // fopen, fgets, fprintf
+#include <stdlib.h> // strtof
+#include <string.h> // memset, strcmp, strlen, strchr
+#include <windows.h> // MoveFileExA, DeleteFileA
+#include "scan_kernel.h" // SCAN_MAX_TUBES, PACKED_DV_BIT
+
+// Seconds. A 16-tube scan takes about 130 Tb, so starting at 2 ms keeps the slowest step to a few seconds
+static const float candidates[TUNE_CANDIDATES] = {
+    0.002f, 0.001f, 0.0005f, 0.0002f, 0.0001f, 0.00005f, 0.00002f, 0.00001f
+};
+
+// Longest line in the saved file
+#define TUNE_LINE_BYTES 128
+
+static void measureStep(DaqDevice* device, int tubeCount, TuneStep* step) {
+    uint8_t first[SCAN_MAX_TUBES];
+    uint8_t second[SCAN_MAX_TUBES];
+    uint64_t edgeTicks;
+    int pair;
+    int tube;
+
+    for (pair = 0; pair < TUNE_SCAN_PAIRS; pair++) {
+        // Flies move far slower than two scans take, so both must read the same
+        if (device->readScan(device, step->timebase, first, tubeCount, &edgeTicks) != 0 ||
+            device->readScan(device, step->timebase, second, tubeCount, &edgeTicks) != 0) {
+            step->failedScans++;
+            continue;
+        }
+        for (tube = 0; tube < tubeCount; tube++) {
+            step->reads += 2;
+            step->disagreements += first[tube] != second[tube];
+            step->glitches += (first[tube] & PACKED_DV_BIT) && (first[tube] & PACKED_DATA_MASK);
+            step->glitches += (second[tube] & PACKED_DV_BIT) && (second[tube] & PACKED_DATA_MASK);
+        }
+    }
+
+    step->reliable = step->failedScans == 0 &&
+                     (uint64_t)(step->disagreements + step->glitches) * 1000 <=
+                     (uint64_t)step->reads * TUNE_MAX_ERRORS_PER_MILLE;
+}
+
+float tuneTimebase(DaqDevice* device, int tubeCount, TuneReport* report) {
+    int i;
+
+    memset(report, 0, sizeof(*report));
+    if (tubeCount > SCAN_MAX_TUBES) {
+        tubeCount = SCAN_MAX_TUBES;
+    }
+
+    for (i = 0; i < TUNE_CANDIDATES; i++) {
+        TuneStep* step = &report->steps[report->stepCount++];
+
+        step->timebase = candidates[i];
+        measureStep(device, tubeCount, step);
+        if (!step->reliable) {
+            break;
+        }
+        report->timebase = step->timebase;
+    }
+
+    return report->timebase;
+}
+
+int loadTimebase(const char* path, const char* deviceName, float* timebase) {
+    FILE* file = fopen(path, "r");
+    char line[TUNE_LINE_BYTES];
+    size_t nameLength = strlen(deviceName);
+    int error = -1;
+
+    if (file == NULL) {
+        return -1;
+    }
+    while (fgets(line, sizeof(line), file) != NULL) {
+        if (strncmp(line, deviceName, nameLength) == 0 && line[nameLength] == ' ') {
+            float value = strtof(line + nameLength + 1, NULL);
+            if (value > 0.0f) {
+                *timebase = value;
+                error = 0;
+            }
+        }
+    }
+    fclose(file);
+
+    return error;
+}
+
+int saveTimebase(const char* path, const char* deviceName, float timebase) {
+    char tempPath[MAX_PATH];
+    char line[TUNE_LINE_BYTES];
+    size_t nameLength = strlen(deviceName);
+    bool lineStart = true; // fgets splits lines longer than the buffer
+    bool skipping = false; // Inside this device's old entry
+    FILE* source;
+    FILE* file;
+    int error = 0;
+
+    if (snprintf(tempPath, sizeof(tempPath), "%s.tmp", path) >= (int)sizeof(tempPath)) {
+        return -1;
+    }
+    file = fopen(tempPath, "w");
+    if (file == NULL) {
+        return -1;
+    }
+
+    // Other devices' entries are copied line by line, so any number of monitors survives
+    source = fopen(path, "r");
+    if (source != NULL) {
+        while (fgets(line, sizeof(line), source) != NULL) {
+            if (lineStart) {
+                skipping = strncmp(line, deviceName, nameLength) == 0 && line[nameLength] == ' ';
+            }
+            lineStart = strchr(line, '\n') != NULL;
+            if (!skipping && fputs(line, file) == EOF) {
+                error = -1;
+            }
+        }
+        if (ferror(source)) {
+            error = -1;
+        }
+        fclose(source);
+    }
+    if (fprintf(file, "%s %g\n", deviceName, timebase) < 0) {
+        error = -1;
+    }
+    if (fclose(file) != 0) {
+        error = -1;
+    }
+
+    // The old file stays intact until the new one is complete
+    if (error != 0 || !MoveFileExA(tempPath, path, MOVEFILE_REPLACE_EXISTING)) {
+        DeleteFileA(tempPath);
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,39 @@
+#ifndef TIMEBASE_TUNER_H
+#define TIMEBASE_TUNER_H
+
+#include <stdint.h> // Fixed-width integer types
+#include "daq_device.h" // Acquisition backends
+
+// Constants
+#define TUNE_CANDIDATES 8           // Timebases tried, slowest first
+#define TUNE_SCAN_PAIRS 10          // Back-to-back scan pairs taken at each timebase
+#define TUNE_MAX_ERRORS_PER_MILLE 2 // Errors per 1000 tube reads still counted as reliable
+#define TUNE_FILE "timebase.cfg"    // Saved results, one "<device> <seconds>" line per monitor
+
+// Outcome at one candidate timebase
+typedef struct {
+    float timebase;
+    uint32_t reads;         // Tube reads compared
+    uint32_t disagreements; // Tube read differently by two back-to-back scans
+    uint32_t glitches;      // DV high with data lines set, which the monitor never sends
+    uint32_t failedScans;   // readScan returned an error
+    bool reliable;
+} TuneStep;
+
+typedef struct {
+    TuneStep steps[TUNE_CANDIDATES];
+    int stepCount;
+    float timebase;         // Fastest reliable timebase, 0 if even the slowest failed
+} TuneReport;
+
+// Shortens the timebase from the slowest candidate until decoding stops
+// being consistent, device must be open. Returns report->timebase.
+float tuneTimebase(DaqDevice* device, int tubeCount, TuneReport* report);
+
+// Reads the saved timebase of deviceName from path, returns 0 if there is one
+int loadTimebase(const char* path, const char* deviceName, float* timebase);
+
+// Saves timebase for deviceName in path, keeping other devices' lines
+int saveTimebase(const char* path, const char* deviceName, float timebase);
+
+#endif
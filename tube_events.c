@@ -0,0 +1,117 @@
+#include "tube_events.h"
+#include <stdlib.h> // malloc, free
+#include <string.h> // memset
+
+#define QUEUE_MASK (TUBE_EVENT_QUEUE_EVENTS - 1)
+
+int tubeEventQueueOpen(TubeEventQueue* queue) {
+    uint64_t i;
+
+    memset(queue, 0, sizeof(*queue));
+    queue->slots = malloc(TUBE_EVENT_QUEUE_EVENTS * sizeof(TubeEventSlot));
+    if (queue->slots == NULL) {
+        return -1;
+    }
+    InitializeCriticalSection(&queue->sleepLock);
+    InitializeConditionVariable(&queue->wake);
+    for (i = 0; i < TUBE_EVENT_QUEUE_EVENTS; i++) {
+        queue->slots[i].sequence = i;
+    }
+    return 0;
+}
+
+void tubeEventQueueClose(TubeEventQueue* queue) {
+    if (queue->slots == NULL) {
+        return;
+    }
+    DeleteCriticalSection(&queue->sleepLock);
+    free(queue->slots);
+    queue->slots = NULL;
+}
+
+bool tubeEventPush(TubeEventQueue* queue, const TubeEvent* event) {
+    uint64_t position = __atomic_load_n(&queue->pushPosition, __ATOMIC_RELAXED);
+    TubeEventSlot* slot;
+
+    for (;;) {
+        int64_t lag;
+
+        slot = &queue->slots[position & QUEUE_MASK];
+        lag = (int64_t)(__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) - position);
+        if (lag == 0) {
+            // Free slot; on failure position is reloaded with the winner's
+            if (__atomic_compare_exchange_n(&queue->pushPosition, &position, position + 1, true,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (lag < 0) {
+            // Still holds an event from one lap ago
+            InterlockedIncrement64(&queue->dropped);
+            return false;
+        } else {
+            position = __atomic_load_n(&queue->pushPosition, __ATOMIC_RELAXED);
+        }
+    }
+    slot->event = *event;
+    __atomic_store_n(&slot->sequence, position + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+static bool queueEmpty(TubeEventQueue* queue) {
+    const TubeEventSlot* slot = &queue->slots[queue->popPosition & QUEUE_MASK];
+
+    return __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) != queue->popPosition + 1;
+}
+
+void tubeEventNotify(TubeEventQueue* queue) {
+    // Pairs with the fence in tubeEventWait: either the consumer sees the events
+    // before it sleeps, or this sees waiting set and wakes it
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&queue->waiting, __ATOMIC_RELAXED) != 0 &&
+        __atomic_exchange_n(&queue->waiting, 0, __ATOMIC_ACQ_REL) != 0) {
+        // The consumer holds sleepLock until it sleeps, so this cannot come too early
+        EnterCriticalSection(&queue->sleepLock);
+        WakeConditionVariable(&queue->wake);
+        LeaveCriticalSection(&queue->sleepLock);
+    }
+}
+
+uint32_t tubeEventPop(TubeEventQueue* queue, TubeEvent events[], uint32_t maxCount) {
+    uint32_t count = 0;
+
+    // A slot claimed but not yet filled stops the pop; its producer notifies once it is filled
+    while (count < maxCount && !queueEmpty(queue)) {
+        TubeEventSlot* slot = &queue->slots[queue->popPosition & QUEUE_MASK];
+
+        events[count++] = slot->event;
+        __atomic_store_n(&slot->sequence, queue->popPosition + TUBE_EVENT_QUEUE_EVENTS, __ATOMIC_RELEASE);
+        queue->popPosition++;
+    }
+    return count;
+}
+
+void tubeEventWait(TubeEventQueue* queue, DWORD timeoutMs) {
+    if (!queueEmpty(queue)) {
+        return;
+    }
+    EnterCriticalSection(&queue->sleepLock);
+    __atomic_store_n(&queue->waiting, 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (queueEmpty(queue) && !queue->wakeRequested &&
+        SleepConditionVariableCS(&queue->wake, &queue->sleepLock, timeoutMs)) {
+        queue->wakeups++;
+    }
+    __atomic_store_n(&queue->waiting, 0, __ATOMIC_RELAXED);
+    queue->wakeRequested = false;
+    LeaveCriticalSection(&queue->sleepLock);
+}
+
+void tubeEventWake(TubeEventQueue* queue) {
+    if (queue->slots == NULL) {
+        return;  // Not open
+    }
+    EnterCriticalSection(&queue->sleepLock);
+    queue->wakeRequested = true;
+    WakeConditionVariable(&queue->wake);
+    LeaveCriticalSection(&queue->sleepLock);
+}
@@ -0,0 +1,74 @@
+#ifndef TUBE_EVENTS_H
+#define TUBE_EVENTS_H
+
+#include <stdint.h> // Fixed-width integer types
+#include <stdbool.h> // Standard boolean library
+#include <windows.h> // Critical sections and condition variables
+
+// Constants
+#define TUBE_EVENT_QUEUE_EVENTS 65536    // Events buffered between decoders and the consumer, a power of two
+#define TUBE_EVENT_MOVED 0x01            // Position changed from oldPosition to newPosition
+#define TUBE_EVENT_EATING_START 0x02     // Fly started feeding
+#define TUBE_EVENT_EATING_STOP 0x04      // Fly stopped feeding
+#define TUBE_EVENT_BOUT_START 0x08       // Debounced feeding bout started at timeUs (feeding_bouts.h)
+#define TUBE_EVENT_BOUT_END 0x10         // Feeding bout ended at timeUs
+#define TUBE_EVENT_BOUT_CUT 0x20         // With BOUT_END: acquisition stopped, the fly may still be feeding
+#define TUBE_EVENT_DEAD 0x40             // Alert: the fly has not left one beam for hours (tube_health.h)
+#define TUBE_EVENT_EMPTY 0x80            // Alert: no fly seen in the tube since the start
+
+// One state transition of one tube, 16 bytes. A scan that changes both the
+// position and the eating flag of a tube gives one event with both bits set.
+// Bout events and alerts come on their own, bouts timed at their start or end.
+typedef struct {
+    int64_t timeUs;          // UTC time of the scan that showed the change
+    uint16_t monitor;        // Index of the monitor in the configuration
+    uint8_t tube;            // 0-based
+    uint8_t kind;            // TUBE_EVENT_* bits
+    uint8_t oldPosition;
+    uint8_t newPosition;
+    uint16_t reserved;
+} TubeEvent;
+
+typedef struct {
+    volatile uint64_t sequence;  // Equals the push position once the slot is free, +1 once it is filled
+    TubeEvent event;
+} TubeEventSlot;
+
+// Bounded lock-free queue from any number of decode workers to one consumer.
+// Producers claim a slot with one compare-and-swap and never wait; when the
+// queue is full the event is dropped and counted. The consumer sleeps on a
+// condition variable while the queue is empty, and producers only take the lock
+// to wake it when it is actually asleep, so a quiet rack costs neither side anything.
+typedef struct {
+    TubeEventSlot* slots;
+    volatile uint64_t pushPosition;  // Also the number of events pushed so far
+    uint8_t pushPad[56];
+    uint64_t popPosition;        // Consumer only
+    uint8_t popPad[56];
+    volatile LONG waiting;       // 1 while the consumer is in tubeEventWait
+    CRITICAL_SECTION sleepLock;
+    CONDITION_VARIABLE wake;
+    bool wakeRequested;          // Set by tubeEventWake under sleepLock
+    volatile LONGLONG dropped;   // Lost to a full queue, the consumer should resynchronise
+    uint64_t wakeups;            // Times the consumer was woken before its timeout
+} TubeEventQueue;
+
+int tubeEventQueueOpen(TubeEventQueue* queue);
+void tubeEventQueueClose(TubeEventQueue* queue);
+
+// Producer side, returns false without waiting if the queue is full
+bool tubeEventPush(TubeEventQueue* queue, const TubeEvent* event);
+
+// Producer side, call after pushing the events of one scan: wakes the consumer if it sleeps
+void tubeEventNotify(TubeEventQueue* queue);
+
+// Consumer side, copies up to maxCount events out in order and returns how many
+uint32_t tubeEventPop(TubeEventQueue* queue, TubeEvent events[], uint32_t maxCount);
+
+// Consumer side, returns once the queue is not empty, tubeEventWake is called or timeoutMs passed
+void tubeEventWait(TubeEventQueue* queue, DWORD timeoutMs);
+
+// Wakes the consumer from tubeEventWait, from any thread (for example to stop it)
+void tubeEventWake(TubeEventQueue* queue);
+
+#endif
@@ -0,0 +1,115 @@
+#include "tube_health.h"
+#include <string.h> // memset
+#include <math.h> // exp, sqrt
+
+void healthInit(HealthTracker* tracker, uint32_t tubeCount, uint32_t deadHours, uint32_t emptyHours) {
+    memset(tracker, 0, sizeof(*tracker));
+    tracker->tubeCount = tubeCount > SCAN_MAX_TUBES ? SCAN_MAX_TUBES : tubeCount;
+    tracker->deadUs = (int64_t)deadHours * 3600000000LL;
+    tracker->emptyUs = (int64_t)emptyHours * 3600000000LL;
+}
+
+// Weighted mean and mean square of a position that has been constant since spreadUs
+static void integrateSpread(const TubeHealth* tube, int64_t timeUs, double* mean, double* meanSquare) {
+    double weight = exp(-(double)(timeUs - tube->spreadUs) / (TUBE_HEALTH_SPREAD_MS * 1000.0));
+    double position = tube->position;
+
+    *mean = position + (tube->mean - position) * weight;
+    *meanSquare = position * position + (tube->meanSquare - position * position) * weight;
+}
+
+double healthSpread(const HealthTracker* tracker, uint32_t tube, int64_t timeUs) {
+    const TubeHealth* health = &tracker->tubes[tube];
+    double mean, meanSquare, variance;
+
+    if (health->anchor == 0) {
+        return 0.0;
+    }
+    integrateSpread(health, timeUs, &mean, &meanSquare);
+    variance = meanSquare - mean * mean;
+    return variance > 0.0 ? sqrt(variance) : 0.0;
+}
+
+// The fly is now at position, other than 0
+static void seePosition(TubeHealth* tube, uint8_t position, int64_t timeUs) {
+    if (tube->anchor == 0) {
+        tube->mean = position;
+        tube->meanSquare = (double)position * position;
+    } else {
+        integrateSpread(tube, timeUs, &tube->mean, &tube->meanSquare);
+    }
+    tube->spreadUs = timeUs;
+    tube->position = position;
+    if (tube->anchor == 0 || position > tube->anchor + 1 || position + 1 < tube->anchor) {
+        tube->anchor = position;
+        tube->anchorUs = timeUs;
+    }
+}
+
+HealthDelta healthScan(HealthTracker* tracker, int64_t timeUs, const ScanState* state, ScanDelta delta) {
+    HealthDelta changes = {0, 0, 0};
+    uint64_t mask = tracker->tubeCount == 64 ? ~0ull : (1ull << tracker->tubeCount) - 1;
+    uint64_t bits;
+    uint32_t tube;
+
+    tracker->latestUs = timeUs;
+    if (!tracker->started) {
+        for (tube = 0; tube < tracker->tubeCount; tube++) {
+            uint8_t position = state->position[tube] & PACKED_DATA_MASK;
+
+            if (position != 0) {
+                seePosition(&tracker->tubes[tube], position, timeUs);
+            }
+        }
+        tracker->startUs = timeUs;
+        tracker->nextCheckUs = timeUs + TUBE_HEALTH_CHECK_US;
+        tracker->started = true;
+        return changes;
+    }
+
+    // Only tubes that moved; a fly going somewhere clears an alert at once
+    for (bits = delta.moved & mask; bits; bits &= bits - 1) {
+        TubeHealth* health;
+        uint8_t position;
+
+        tube = (uint32_t)__builtin_ctzll(bits);
+        health = &tracker->tubes[tube];
+        position = state->position[tube] & PACKED_DATA_MASK;
+        if (position == 0) {
+            continue;
+        }
+        seePosition(health, position, timeUs);
+        if (health->state != TUBE_ALIVE && health->anchorUs == timeUs) {
+            health->state = TUBE_ALIVE;
+            tracker->dead &= ~(1ull << tube);
+            tracker->empty &= ~(1ull << tube);
+            changes.revived |= 1ull << tube;
+        }
+    }
+
+    if (timeUs < tracker->nextCheckUs) {
+        return changes;
+    }
+    tracker->nextCheckUs = timeUs + TUBE_HEALTH_CHECK_US;
+    for (tube = 0; tube < tracker->tubeCount; tube++) {
+        TubeHealth* health = &tracker->tubes[tube];
+        uint64_t bit = 1ull << tube;
+
+        if (health->state != TUBE_ALIVE) {
+            continue;
+        }
+        if (health->anchor == 0) {
+            if (timeUs - tracker->startUs >= tracker->emptyUs) {
+                health->state = TUBE_EMPTY;
+                tracker->empty |= bit;
+                changes.empty |= bit;
+            }
+        } else if (timeUs - health->anchorUs >= tracker->deadUs &&
+                   healthSpread(tracker, tube, timeUs) < TUBE_HEALTH_STILL_SPREAD) {
+            health->state = TUBE_DEAD;
+            tracker->dead |= bit;
+            changes.dead |= bit;
+        }
+    }
+    return changes;
+}
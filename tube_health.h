@@ -0,0 +1,67 @@
+#ifndef TUBE_HEALTH_H
+#define TUBE_HEALTH_H
+
+#include <stdint.h> // Fixed-width integer types
+#include <stdbool.h> // Standard boolean library
+#include "scan_kernel.h" // ScanState, ScanDelta, SCAN_MAX_TUBES
+
+// Constants
+#define TUBE_HEALTH_DEAD_HOURS 12      // Default: a fly that stays at one beam this long is flagged dead
+#define TUBE_HEALTH_EMPTY_HOURS 1      // Default: a tube with no fly seen this long after the start is flagged empty
+#define TUBE_HEALTH_SPREAD_MS 3600000  // Time constant of the position spread
+#define TUBE_HEALTH_STILL_SPREAD 0.75f // Spread in beams below which a fly counts as still (two beams half and half is 0.5)
+#define TUBE_HEALTH_CHECK_US 1000000   // Tubes are classified once a second of scan time
+
+// What a tube looks like over hours
+typedef enum {
+    TUBE_ALIVE,              // A fly that moved within the dead time, or not enough data yet
+    TUBE_DEAD,               // A fly that has not left one beam for the dead time
+    TUBE_EMPTY               // No beam interrupted since the start
+} TubeHealthState;
+
+// One tube. Readings of 0 carry no information (the fly is between beams or
+// asleep out of view), and so does flicker to a neighbouring beam, which a dead
+// fly lying across two beams produces; only a reading more than one beam away
+// from anchor counts as the fly going somewhere.
+typedef struct {
+    int64_t anchorUs;        // Since when the fly has stayed within one beam of anchor
+    int64_t spreadUs;        // Time the spread sums are integrated up to
+    double mean;             // Exponentially weighted mean of the position and of its square,
+    double meanSquare;       // over TUBE_HEALTH_SPREAD_MS
+    uint8_t anchor;          // 0 until a fly is seen
+    uint8_t position;        // Latest position other than 0
+    uint8_t state;           // TubeHealthState
+} TubeHealth;
+
+// Tubes whose classification changed, bit i is tube i
+typedef struct {
+    uint64_t dead;           // Became TUBE_DEAD
+    uint64_t empty;          // Became TUBE_EMPTY
+    uint64_t revived;        // Left TUBE_DEAD or TUBE_EMPTY
+} HealthDelta;
+
+// Dead and empty tubes of one monitor. A scan only touches the tubes that moved;
+// all tubes are classified once per TUBE_HEALTH_CHECK_US, so the cost per scan
+// stays constant and so does the memory per tube.
+typedef struct {
+    int64_t deadUs;
+    int64_t emptyUs;
+    uint32_t tubeCount;
+    bool started;
+    int64_t startUs;         // First scan
+    int64_t nextCheckUs;
+    int64_t latestUs;        // Latest scan
+    uint64_t dead;           // Tubes in TUBE_DEAD
+    uint64_t empty;          // Tubes in TUBE_EMPTY
+    TubeHealth tubes[SCAN_MAX_TUBES];
+} HealthTracker;
+
+void healthInit(HealthTracker* tracker, uint32_t tubeCount, uint32_t deadHours, uint32_t emptyHours);
+
+// Adds one decoded scan; delta must be the one decodeScan returned for it
+HealthDelta healthScan(HealthTracker* tracker, int64_t timeUs, const ScanState* state, ScanDelta delta);
+
+// Standard deviation of the position of one tube over the last hours, in beams
+double healthSpread(const HealthTracker* tracker, uint32_t tube, int64_t timeUs);
+
+#endif
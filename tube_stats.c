@@ -0,0 +1,120 @@
+#include "tube_stats.h"
+#include <string.h> // memset, memcpy
+#include <windows.h> // MemoryBarrier, YieldProcessor
+
+void tubeStatsInit(TubeStats* stats, uint32_t tubeCount) {
+    memset(stats, 0, sizeof(*stats));
+    stats->tubeCount = tubeCount > SCAN_MAX_TUBES ? SCAN_MAX_TUBES : tubeCount;
+}
+
+int tubeStatsDwellBucket(int64_t durationUs) {
+    uint64_t ms = durationUs > 0 ? (uint64_t)durationUs / 1000 : 0;
+    int bucket = ms == 0 ? 0 : 64 - __builtin_clzll(ms);
+
+    return bucket < TUBE_STATS_DWELL_BUCKETS ? bucket : TUBE_STATS_DWELL_BUCKETS - 1;
+}
+
+// Credits the current visit up to timeUs and, if its start is known, records its length
+static void endVisit(TubePositionStats* tube, int64_t timeUs) {
+    int64_t lengthUs = timeUs > tube->enteredUs ? timeUs - tube->enteredUs : 0;
+
+    tube->occupancyUs[tube->position] += (uint64_t)lengthUs;
+    if (!tube->censored) {
+        tube->dwellUs[tube->position] += (uint64_t)lengthUs;
+        tube->visits[tube->position]++;
+        tube->dwells[tube->position][tubeStatsDwellBucket(lengthUs)]++;
+    }
+}
+
+void tubeStatsScan(TubeStats* stats, int64_t timeUs, const ScanState* state, ScanDelta delta) {
+    uint64_t bits;
+    uint32_t tube;
+
+    stats->sequence++;
+    MemoryBarrier();
+    if (!stats->started) {
+        // Nobody knows how long the flies have been where they are now
+        for (tube = 0; tube < stats->tubeCount; tube++) {
+            stats->tubes[tube].position = state->position[tube] & PACKED_DATA_MASK;
+            stats->tubes[tube].enteredUs = timeUs;
+            stats->tubes[tube].censored = true;
+        }
+        stats->firstUs = timeUs;
+        stats->started = true;
+    } else {
+        // Only tubes that moved need their counters touched
+        for (bits = delta.moved; bits; bits &= bits - 1) {
+            TubePositionStats* moved;
+            uint8_t position;
+
+            tube = (uint32_t)__builtin_ctzll(bits);
+            if (tube >= stats->tubeCount) {
+                break;
+            }
+            moved = &stats->tubes[tube];
+            position = state->position[tube] & PACKED_DATA_MASK;
+            endVisit(moved, timeUs);
+            moved->transitions[moved->position][position]++;
+            moved->position = position;
+            moved->enteredUs = timeUs;
+            moved->censored = false;
+        }
+    }
+    stats->latestUs = timeUs;
+    stats->scans++;
+    MemoryBarrier();
+    stats->sequence++;
+}
+
+void tubeStatsGap(TubeStats* stats, int64_t startUs, int64_t endUs) {
+    uint32_t tube;
+
+    if (!stats->started) {
+        return;
+    }
+    stats->sequence++;
+    MemoryBarrier();
+    for (tube = 0; tube < stats->tubeCount; tube++) {
+        TubePositionStats* interrupted = &stats->tubes[tube];
+
+        if (startUs > interrupted->enteredUs) {
+            interrupted->occupancyUs[interrupted->position] += (uint64_t)(startUs - interrupted->enteredUs);
+        }
+        interrupted->enteredUs = endUs;
+        interrupted->censored = true;
+    }
+    if (endUs > startUs) {
+        stats->gapUs += endUs - startUs;
+    }
+    MemoryBarrier();
+    stats->sequence++;
+}
+
+void tubeStatsSnapshot(const TubeStats* stats, TubeStats* snapshot) {
+    uint32_t before;
+    uint32_t tube;
+
+    // Retry until the copy was not torn by the writer
+    for (;;) {
+        before = stats->sequence;
+        if (before & 1) {
+            YieldProcessor();
+            continue;
+        }
+        MemoryBarrier();
+        memcpy(snapshot, (const void*)stats, sizeof(*snapshot));
+        MemoryBarrier();
+        if (stats->sequence == before) {
+            break;
+        }
+    }
+
+    for (tube = 0; tube < snapshot->tubeCount; tube++) {
+        TubePositionStats* current = &snapshot->tubes[tube];
+
+        if (snapshot->latestUs > current->enteredUs) {
+            current->occupancyUs[current->position] += (uint64_t)(snapshot->latestUs - current->enteredUs);
+            current->enteredUs = snapshot->latestUs;
+        }
+    }
+}
@@ -0,0 +1,58 @@
+#ifndef TUBE_STATS_H
+#define TUBE_STATS_H
+
+#include <stdint.h> // Fixed-width integer types
+#include <stdbool.h> // Standard boolean library
+#include "scan_kernel.h" // ScanState, ScanDelta, SCAN_MAX_TUBES
+#include "binning.h" // BIN_POSITIONS
+
+// Constants
+#define TUBE_STATS_DWELL_BUCKETS 24  // Visit lengths by powers of two: bucket 0 is under 1 ms, bucket b
+                                     // [2^(b-1), 2^b) ms, the last one everything from about 70 minutes up
+
+// Where one fly has been since the start. A visit is the time between two
+// position changes; visits that began before the first scan or ran into a gap
+// have no known length and only count towards occupancy.
+typedef struct {
+    uint64_t occupancyUs[BIN_POSITIONS];       // Time at each position until enteredUs, a snapshot adds the rest
+    uint64_t dwellUs[BIN_POSITIONS];           // Total length of the finished visits at each position
+    uint32_t visits[BIN_POSITIONS];            // Finished visits, the sum of the row of dwells
+    uint32_t dwells[BIN_POSITIONS][TUBE_STATS_DWELL_BUCKETS]; // Finished visits by length
+    uint32_t transitions[BIN_POSITIONS][BIN_POSITIONS];       // [from][to] position changes
+    int64_t enteredUs;                         // Start of the current visit, or of the time credited so far
+    uint8_t position;                          // Position of the current visit
+    bool censored;                             // Current visit started before the first scan or a gap
+} TubePositionStats;
+
+// Online position statistics of one monitor. tubeStatsScan only touches the tubes
+// that changed, so a scan costs the same however long the experiment has run.
+// The decoding thread is the only writer; sequence is odd while it writes, so any
+// other thread can take a consistent copy with tubeStatsSnapshot at any time.
+typedef struct {
+    volatile uint32_t sequence;
+    uint32_t tubeCount;
+    bool started;
+    int64_t firstUs;                 // First scan
+    int64_t latestUs;                // Latest scan
+    int64_t gapUs;                   // Time without scans between firstUs and latestUs
+    uint64_t scans;
+    TubePositionStats tubes[SCAN_MAX_TUBES];
+} TubeStats;
+
+void tubeStatsInit(TubeStats* stats, uint32_t tubeCount);
+
+// Adds one decoded scan; delta must be the one decodeScan returned for it
+void tubeStatsScan(TubeStats* stats, int64_t timeUs, const ScanState* state, ScanDelta delta);
+
+// Acquisition stopped after the scan at startUs and resumed at endUs: the visits
+// in progress are credited up to startUs and count as censored
+void tubeStatsGap(TubeStats* stats, int64_t startUs, int64_t endUs);
+
+// Copies stats to snapshot with the visits in progress credited up to the latest scan.
+// Safe from any thread while the writer keeps going.
+void tubeStatsSnapshot(const TubeStats* stats, TubeStats* snapshot);
+
+// Dwell bucket of a visit of durationUs
+int tubeStatsDwellBucket(int64_t durationUs);
+
+#endif
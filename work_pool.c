@@ -0,0 +1,193 @@
+#include "work_pool.h"
+#include <stdlib.h> // calloc, free
+#include <string.h> // memset
+#include <process.h> // _beginthreadex
+
+// Argument of one worker thread
+typedef struct {
+    WorkPool* pool;
+    int worker;
+} WorkerStart;
+
+static bool pushTask(WorkQueue* queue, const WorkItem* item) {
+    bool pushed = false;
+
+    EnterCriticalSection(&queue->lock);
+    if (queue->tail - queue->head < WORK_QUEUE_CAPACITY) {
+        queue->items[queue->tail % WORK_QUEUE_CAPACITY] = *item;
+        queue->tail++;
+        pushed = true;
+    }
+    LeaveCriticalSection(&queue->lock);
+    return pushed;
+}
+
+static bool popTask(WorkQueue* queue, WorkItem* item) {
+    bool popped = false;
+
+    // Empty queues are skipped without taking their lock, a task missed here is counted in queued
+    if (__atomic_load_n(&queue->tail, __ATOMIC_RELAXED) == __atomic_load_n(&queue->head, __ATOMIC_RELAXED)) {
+        return false;
+    }
+    EnterCriticalSection(&queue->lock);
+    if (queue->tail != queue->head) {
+        *item = queue->items[queue->head % WORK_QUEUE_CAPACITY];
+        queue->head++;
+        popped = true;
+    }
+    LeaveCriticalSection(&queue->lock);
+    return popped;
+}
+
+// Own queue first, then the others starting with the next worker
+static bool takeTask(WorkPool* pool, int worker, WorkItem* item) {
+    int i;
+
+    if (popTask(&pool->queues[worker], item)) {
+        return true;
+    }
+    for (i = 1; i < pool->workerCount; i++) {
+        if (popTask(&pool->queues[(worker + i) % pool->workerCount], item)) {
+            pool->queues[worker].stolen++;
+            return true;
+        }
+    }
+    return false;
+}
+
+static unsigned int __stdcall workerThread(void* arg) {
+    WorkerStart* start = arg;
+    WorkPool* pool = start->pool;
+    int worker = start->worker;
+    WorkItem item;
+
+    free(start);
+    for (;;) {
+        bool stop;
+
+        if (takeTask(pool, worker, &item)) {
+            InterlockedDecrement(&pool->queued);
+            item.fn(item.context, worker);
+            pool->queues[worker].executed++;
+            continue;
+        }
+
+        if (pool->idle != NULL) {
+            pool->idle(worker, pool->idleContext);
+        }
+        // queued counts tasks already pushed, so a task this worker just missed
+        // while scanning the queues keeps it awake
+        EnterCriticalSection(&pool->sleepLock);
+        while (pool->queued == 0 && pool->running) {
+            pool->sleeping++;
+            SleepConditionVariableCS(&pool->wake, &pool->sleepLock, INFINITE);
+            pool->sleeping--;
+        }
+        stop = pool->queued == 0 && !pool->running;
+        LeaveCriticalSection(&pool->sleepLock);
+        if (stop) {
+            break;
+        }
+    }
+    return 0;
+}
+
+int workPoolStart(WorkPool* pool, int workerCount, WorkIdleFn idle, void* idleContext) {
+    int i;
+
+    memset(pool, 0, sizeof(*pool));
+    if (workerCount < 1 || workerCount > WORK_POOL_MAX_WORKERS) {
+        return -1;
+    }
+    pool->queues = calloc((size_t)workerCount, sizeof(WorkQueue));
+    pool->threads = calloc((size_t)workerCount, sizeof(HANDLE));
+    if (pool->queues == NULL || pool->threads == NULL) {
+        free(pool->queues);
+        free(pool->threads);
+        return -1;
+    }
+    pool->workerCount = workerCount;
+    pool->idle = idle;
+    pool->idleContext = idleContext;
+    pool->running = true;
+    InitializeCriticalSection(&pool->sleepLock);
+    InitializeConditionVariable(&pool->wake);
+    for (i = 0; i < workerCount; i++) {
+        InitializeCriticalSection(&pool->queues[i].lock);
+    }
+
+    for (i = 0; i < workerCount; i++) {
+        WorkerStart* start = malloc(sizeof(WorkerStart));
+
+        if (start == NULL) {
+            break;
+        }
+        start->pool = pool;
+        start->worker = i;
+        pool->threads[i] = (HANDLE)_beginthreadex(NULL, 0, workerThread, start, 0, NULL);
+        if (pool->threads[i] == NULL) {
+            free(start);
+            break;
+        }
+    }
+    if (i < workerCount) {
+        // Stop the workers that did start; the others never touch their queues
+        int started = i;
+
+        for (i = started; i < workerCount; i++) {
+            DeleteCriticalSection(&pool->queues[i].lock);
+        }
+        pool->workerCount = started;
+        workPoolStop(pool);
+        return -1;
+    }
+    return 0;
+}
+
+int workPoolSubmit(WorkPool* pool, int hint, WorkFn fn, void* context) {
+    WorkItem item = {fn, context};
+    int i;
+
+    for (i = 0; i < pool->workerCount; i++) {
+        if (pushTask(&pool->queues[(hint + i) % pool->workerCount], &item)) {
+            break;
+        }
+    }
+    if (i == pool->workerCount) {
+        return -1;
+    }
+
+    // Locked even when nobody seems asleep: a worker that just saw queued == 0
+    // is about to sleep under this lock and must not miss the wake-up
+    InterlockedIncrement(&pool->queued);
+    EnterCriticalSection(&pool->sleepLock);
+    if (pool->sleeping > 0) {
+        WakeConditionVariable(&pool->wake);
+    }
+    LeaveCriticalSection(&pool->sleepLock);
+    return 0;
+}
+
+void workPoolStop(WorkPool* pool) {
+    int i;
+
+    EnterCriticalSection(&pool->sleepLock);
+    pool->running = false;
+    WakeAllConditionVariable(&pool->wake);
+    LeaveCriticalSection(&pool->sleepLock);
+
+    for (i = 0; i < pool->workerCount; i++) {
+        WaitForSingleObject(pool->threads[i], INFINITE);
+        CloseHandle(pool->threads[i]);
+    }
+    for (i = 0; i < pool->workerCount; i++) {
+        pool->executed += pool->queues[i].executed;
+        pool->stolen += pool->queues[i].stolen;
+        DeleteCriticalSection(&pool->queues[i].lock);
+    }
+    DeleteCriticalSection(&pool->sleepLock);
+    free(pool->queues);
+    free(pool->threads);
+    pool->queues = NULL;
+    pool->threads = NULL;
+}
@@ -0,0 +1,62 @@
+#ifndef WORK_POOL_H
+#define WORK_POOL_H
+
+#include <stdint.h> // Fixed-width integer types
+#include <stdbool.h> // Standard boolean library
+#include <windows.h> // Threads, critical sections and condition variables
+
+// Constants
+#define WORK_POOL_MAX_WORKERS 64     // Worker threads per pool
+#define WORK_QUEUE_CAPACITY 256      // Tasks one worker can hold, at least CONFIG_MAX_MONITORS
+
+// One task, run by whichever worker gets to it first; worker is the index of that worker
+typedef void (*WorkFn)(void* context, int worker);
+
+// Called by a worker before it sleeps for lack of work
+typedef void (*WorkIdleFn)(int worker, void* idleContext);
+
+typedef struct {
+    WorkFn fn;
+    void* context;
+} WorkItem;
+
+// Tasks submitted to one worker, oldest first. Idle workers steal the oldest task of
+// a busy one, so a task that requeues itself goes behind everything already waiting.
+typedef struct {
+    CRITICAL_SECTION lock;
+    WorkItem items[WORK_QUEUE_CAPACITY];
+    uint32_t head;               // Next task to run
+    uint32_t tail;               // Next free slot
+    uint64_t executed;           // Tasks this worker ran
+    uint64_t stolen;             // Of those, taken from another worker's queue
+} WorkQueue;
+
+// Work-stealing pool. Submitting never waits for a task to run; a submitter only
+// takes one queue lock and the sleep lock, both held for a few instructions.
+typedef struct {
+    WorkQueue* queues;
+    HANDLE* threads;
+    int workerCount;
+    WorkIdleFn idle;
+    void* idleContext;
+
+    CRITICAL_SECTION sleepLock;
+    CONDITION_VARIABLE wake;
+    volatile LONG queued;        // Tasks in all queues
+    int sleeping;                // Workers waiting on wake
+    volatile bool running;
+    uint64_t executed;           // Totals over all workers, set by workPoolStop
+    uint64_t stolen;
+} WorkPool;
+
+// Starts workerCount workers (1 to WORK_POOL_MAX_WORKERS). idle may be NULL.
+int workPoolStart(WorkPool* pool, int workerCount, WorkIdleFn idle, void* idleContext);
+
+// Queues fn(context) on worker hint % workerCount; other workers steal it if that one is busy.
+// Returns -1 if every queue is full.
+int workPoolSubmit(WorkPool* pool, int hint, WorkFn fn, void* context);
+
+// Runs every queued task, then stops and frees the workers and adds up their counts
+void workPoolStop(WorkPool* pool);
+
+#endif